@@ -0,0 +1,1409 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
+#include "aot.h"
+#include "bytecode.h"
+#include "builtin.h"
+#include "code.h"
+#include "map.h"
+#include "memo.h"
+#include "util.h"
+
+/// 生成するプログラムの実行時ライブラリ
+static const char *AOT_RUNTIME =
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <string.h>\n"
+	"#include <limits.h>\n"
+	"#include <time.h>\n"
+	"#include <pthread.h>\n"
+	"\n"
+	"typedef struct pt_memo_entry\n"
+	"{\n"
+	"\tint func;\n"
+	"\tunsigned int version;\n"
+	"\tint args[PT_MEMO_MAX_ARGS];\n"
+	"\tint value;\n"
+	"} PtMemoEntry;\n"
+	"\n"
+	"static int pt_depth = 0;\n"
+	"static int pt_bind[PT_NNAMES + 1];\n"
+	"static unsigned int pt_version = 1;\n"
+	"static PtMemoEntry *pt_memo;\n"
+	"\n"
+	"static inline int pt_shl(int x, int n)\n"
+	"{\n"
+	"\treturn (int)((unsigned int)x << (n & 31));\n"
+	"}\n"
+	"\n"
+	"static inline int pt_shr(int x, int n)\n"
+	"{\n"
+	"\treturn x >> (n & 31);\n"
+	"}\n"
+	"\n"
+	"static inline void pt_error(void)\n"
+	"{\n"
+	"\tprintf(\"\\x1b[1m\\x1b[31merror : \\x1b[39m\\x1b[0m\");\n"
+	"}\n"
+	"\n"
+	"static inline int pt_undefined(const char *name)\n"
+	"{\n"
+	"\tpt_error();\n"
+	"\tprintf(\"\\\"%s\\\" is not defined\\n\", name);\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_no_function(const char *name)\n"
+	"{\n"
+	"\tpt_error();\n"
+	"\tprintf(\"function \\\"%s\\\" is not defined\\n\", name);\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_bad_arity(const char *name, int expected, int given)\n"
+	"{\n"
+	"\tpt_error();\n"
+	"\tprintf(\"function \\\"%s\\\" takes %d argument(s), but %d given\\n\", name, expected, given);\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline void pt_enter(void)\n"
+	"{\n"
+	"\tif (pt_depth >= PT_MAX_DEPTH)\n"
+	"\t{\n"
+	"\t\tpt_error();\n"
+	"\t\tprintf(\"maximum call depth (%d) exceeded\\n\", PT_MAX_DEPTH);\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\tpt_depth++;\n"
+	"}\n"
+	"\n"
+	"static inline unsigned int pt_memo_hash(int func, int argc, const int *args)\n"
+	"{\n"
+	"\tunsigned int hash = (unsigned int)(func + 1) * 2654435761u;\n"
+	"\tfor (int i = 0; i < argc; i++)\n"
+	"\t{\n"
+	"\t\thash = (hash ^ (unsigned int)args[i]) * 16777619u;\n"
+	"\t}\n"
+	"\treturn hash ^ (hash >> 16);\n"
+	"}\n"
+	"\n"
+	"static inline int pt_memo_match(PtMemoEntry *e, int func, int argc, const int *args)\n"
+	"{\n"
+	"\treturn e->func == func + 1 && e->version == pt_version && 0 == memcmp(e->args, args, argc * sizeof(int));\n"
+	"}\n"
+	"\n"
+	"static inline int pt_memo_lookup(int func, int argc, const int *args, int *value)\n"
+	"{\n"
+	"\tunsigned int pos = pt_memo_hash(func, argc, args);\n"
+	"\tfor (int i = 0; i < PT_MEMO_PROBE; i++)\n"
+	"\t{\n"
+	"\t\tPtMemoEntry *e = &pt_memo[(pos + i) & (PT_MEMO_SIZE - 1)];\n"
+	"\t\tif (pt_memo_match(e, func, argc, args))\n"
+	"\t\t{\n"
+	"\t\t\t*value = e->value;\n"
+	"\t\t\treturn 1;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\treturn 0;\n"
+	"}\n"
+	"\n"
+	"static inline void pt_memo_store(int func, int argc, const int *args, int value)\n"
+	"{\n"
+	"\tunsigned int pos = pt_memo_hash(func, argc, args);\n"
+	"\tPtMemoEntry *entry = &pt_memo[pos & (PT_MEMO_SIZE - 1)];\n"
+	"\tfor (int i = 0; i < PT_MEMO_PROBE; i++)\n"
+	"\t{\n"
+	"\t\tPtMemoEntry *e = &pt_memo[(pos + i) & (PT_MEMO_SIZE - 1)];\n"
+	"\t\tif (0 == e->func || e->version != pt_version || pt_memo_match(e, func, argc, args))\n"
+	"\t\t{\n"
+	"\t\t\tentry = e;\n"
+	"\t\t\tbreak;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\tentry->func = func + 1;\n"
+	"\tentry->version = pt_version;\n"
+	"\tmemcpy(entry->args, args, argc * sizeof(int));\n"
+	"\tentry->value = value;\n"
+	"}\n"
+	"\n";
+
+/// 生成するプログラムの配列の実行時ライブラリ（配列か組み込み関数を使うプログラムにだけ出力する）
+static const char *AOT_ARRAY_RUNTIME =
+	"typedef struct pt_array\n"
+	"{\n"
+	"\tint *data;\n"
+	"\tint length;\n"
+	"\tint columns;\n"
+	"} PtArray;\n"
+	"\n"
+	"static PtArray *pt_arrays;\n"
+	"static int pt_narrays = 0;\n"
+	"static int pt_array_capacity = 0;\n"
+	"\n"
+	"static inline void pt_array_error(const char *format, int x, int y)\n"
+	"{\n"
+	"\tpt_error();\n"
+	"\tprintf(format, x, y);\n"
+	"\texit(1);\n"
+	"}\n"
+	"\n"
+	"static inline PtArray *pt_get_array(int handle)\n"
+	"{\n"
+	"\tif (handle <= 0 || handle > pt_narrays)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"%d is not an array\\n\", handle, 0);\n"
+	"\t}\n"
+	"\treturn &pt_arrays[handle - 1];\n"
+	"}\n"
+	"\n"
+	"static inline int *pt_element(int handle, int index)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_array(handle);\n"
+	"\tif ((unsigned int)index >= (unsigned int)a->length)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"index %d is out of range of array (length %d)\\n\", index, a->length);\n"
+	"\t}\n"
+	"\treturn &a->data[index];\n"
+	"}\n"
+	"\n"
+	"static inline int pt_index(int handle, int index)\n"
+	"{\n"
+	"\treturn *pt_element(handle, index);\n"
+	"}\n"
+	"\n"
+	"static inline int pt_store(int handle, int index, int value)\n"
+	"{\n"
+	"\treturn *pt_element(handle, index) = value;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_array(int length)\n"
+	"{\n"
+	"\tif (length < 0)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"length of array must not be negative (%d)\\n\", length, 0);\n"
+	"\t}\n"
+	"\tif (pt_narrays == pt_array_capacity)\n"
+	"\t{\n"
+	"\t\tpt_array_capacity = pt_array_capacity ? pt_array_capacity * 2 : 16;\n"
+	"\t\tpt_arrays = (PtArray *)realloc(pt_arrays, pt_array_capacity * sizeof(PtArray));\n"
+	"\t}\n"
+	"\tpt_arrays[pt_narrays].data = (int *)calloc(length + 1, sizeof(int));\n"
+	"\tpt_arrays[pt_narrays].length = length;\n"
+	"\tpt_arrays[pt_narrays].columns = 0;\n"
+	"\tif (NULL == pt_arrays[pt_narrays].data)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"can't allocate array of length %d\\n\", length, 0);\n"
+	"\t}\n"
+	"\treturn ++pt_narrays;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_len(int handle)\n"
+	"{\n"
+	"\treturn pt_get_array(handle)->length;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_fill(int handle, int value)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_array(handle);\n"
+	"\tfor (int i = 0; i < a->length; i++)\n"
+	"\t{\n"
+	"\t\ta->data[i] = value;\n"
+	"\t}\n"
+	"\treturn handle;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_copy(int dst, int src)\n"
+	"{\n"
+	"\tPtArray *d = pt_get_array(dst);\n"
+	"\tPtArray *s = pt_get_array(src);\n"
+	"\tif (d->length < s->length)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"can't copy array of length %d into array of length %d\\n\", s->length, d->length);\n"
+	"\t}\n"
+	"\tmemmove(d->data, s->data, s->length * sizeof(int));\n"
+	"\treturn dst;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_sum(int handle)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_array(handle);\n"
+	"\tunsigned int sum = 0;\n"
+	"\tfor (int i = 0; i < a->length; i++)\n"
+	"\t{\n"
+	"\t\tsum += (unsigned int)a->data[i];\n"
+	"\t}\n"
+	"\treturn (int)sum;\n"
+	"}\n"
+	"\n"
+	"static inline PtArray *pt_non_empty(int handle, const char *name)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_array(handle);\n"
+	"\tif (0 == a->length)\n"
+	"\t{\n"
+	"\t\tpt_error();\n"
+	"\t\tprintf(\"\\\"%s\\\" of empty array\\n\", name);\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\treturn a;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_min(int handle)\n"
+	"{\n"
+	"\tPtArray *a = pt_non_empty(handle, \"min\");\n"
+	"\tint value = a->data[0];\n"
+	"\tfor (int i = 1; i < a->length; i++)\n"
+	"\t{\n"
+	"\t\tvalue = a->data[i] < value ? a->data[i] : value;\n"
+	"\t}\n"
+	"\treturn value;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_max(int handle)\n"
+	"{\n"
+	"\tPtArray *a = pt_non_empty(handle, \"max\");\n"
+	"\tint value = a->data[0];\n"
+	"\tfor (int i = 1; i < a->length; i++)\n"
+	"\t{\n"
+	"\t\tvalue = a->data[i] > value ? a->data[i] : value;\n"
+	"\t}\n"
+	"\treturn value;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_dot(int x, int y)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_array(x);\n"
+	"\tPtArray *b = pt_get_array(y);\n"
+	"\tunsigned int sum = 0;\n"
+	"\tif (a->length != b->length)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"lengths of arrays differ (%d and %d)\\n\", a->length, b->length);\n"
+	"\t}\n"
+	"\tfor (int i = 0; i < a->length; i++)\n"
+	"\t{\n"
+	"\t\tsum += (unsigned int)a->data[i] * (unsigned int)b->data[i];\n"
+	"\t}\n"
+	"\treturn (int)sum;\n"
+	"}\n"
+	"\n"
+	"static int pt_compare(const void *x, const void *y)\n"
+	"{\n"
+	"\tint a = *(const int *)x;\n"
+	"\tint b = *(const int *)y;\n"
+	"\treturn (a > b) - (a < b);\n"
+	"}\n"
+	"\n"
+	"static inline int pt_sort(int handle)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_array(handle);\n"
+	"\tqsort(a->data, a->length, sizeof(int), pt_compare);\n"
+	"\treturn handle;\n"
+	"}\n"
+	"\n"
+	"static inline PtArray *pt_get_matrix(int handle)\n"
+	"{\n"
+	"\tPtArray *m = pt_get_array(handle);\n"
+	"\tif (0 == m->columns)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"%d is not a matrix\\n\", handle, 0);\n"
+	"\t}\n"
+	"\treturn m;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_mat(int rows, int columns)\n"
+	"{\n"
+	"\tif (rows <= 0 || columns <= 0)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"size of matrix must be positive (%d x %d)\\n\", rows, columns);\n"
+	"\t}\n"
+	"\tif ((long)rows * columns > INT_MAX)\n"
+	"\t{\n"
+	"\t\tpt_array_error(\"can't allocate matrix of %d x %d\\n\", rows, columns);\n"
+	"\t}\n"
+	"\tint handle = pt_array(rows * columns);\n"
+	"\tpt_arrays[handle - 1].columns = columns;\n"
+	"\treturn handle;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_rows(int handle)\n"
+	"{\n"
+	"\tPtArray *m = pt_get_matrix(handle);\n"
+	"\treturn m->length / m->columns;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_cols(int handle)\n"
+	"{\n"
+	"\treturn pt_get_matrix(handle)->columns;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_offset(int handle, int row, int column)\n"
+	"{\n"
+	"\tPtArray *m = pt_get_matrix(handle);\n"
+	"\tint rows = m->length / m->columns;\n"
+	"\tif ((unsigned int)row >= (unsigned int)rows || (unsigned int)column >= (unsigned int)m->columns)\n"
+	"\t{\n"
+	"\t\tpt_error();\n"
+	"\t\tprintf(\"index (%d, %d) is out of range of matrix (%d x %d)\\n\", row, column, rows, m->columns);\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\treturn row * m->columns + column;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_matmul(int x, int y)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_matrix(x);\n"
+	"\tPtArray *b = pt_get_matrix(y);\n"
+	"\tint rows = a->length / a->columns;\n"
+	"\tint inner = a->columns;\n"
+	"\tint columns = b->columns;\n"
+	"\tif (inner != b->length / b->columns)\n"
+	"\t{\n"
+	"\t\tpt_error();\n"
+	"\t\tprintf(\"can't multiply matrix of %d x %d by matrix of %d x %d\\n\", rows, inner, b->length / b->columns, columns);\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\tint handle = pt_mat(rows, columns);\n"
+	"\tconst int *pa = pt_arrays[x - 1].data;\n"
+	"\tconst int *pb = pt_arrays[y - 1].data;\n"
+	"\tint *pc = pt_arrays[handle - 1].data;\n"
+	"\tfor (int i = 0; i < rows; i++)\n"
+	"\t{\n"
+	"\t\tfor (int k = 0; k < inner; k++)\n"
+	"\t\t{\n"
+	"\t\t\tunsigned int factor = (unsigned int)pa[i * inner + k];\n"
+	"\t\t\tfor (int j = 0; j < columns; j++)\n"
+	"\t\t\t{\n"
+	"\t\t\t\tpc[i * columns + j] = (int)((unsigned int)pc[i * columns + j] + factor * (unsigned int)pb[k * columns + j]);\n"
+	"\t\t\t}\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\treturn handle;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_transpose(int x)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_matrix(x);\n"
+	"\tint rows = a->length / a->columns;\n"
+	"\tint columns = a->columns;\n"
+	"\tint handle = pt_mat(columns, rows);\n"
+	"\tconst int *src = pt_arrays[x - 1].data;\n"
+	"\tint *dst = pt_arrays[handle - 1].data;\n"
+	"\tfor (int i = 0; i < rows; i++)\n"
+	"\t{\n"
+	"\t\tfor (int j = 0; j < columns; j++)\n"
+	"\t\t{\n"
+	"\t\t\tdst[j * rows + i] = src[i * columns + j];\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\treturn handle;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_matadd(int x, int y)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_matrix(x);\n"
+	"\tPtArray *b = pt_get_matrix(y);\n"
+	"\tif (a->columns != b->columns || a->length != b->length)\n"
+	"\t{\n"
+	"\t\tpt_error();\n"
+	"\t\tprintf(\"can't add matrix of %d x %d to matrix of %d x %d\\n\", b->length / b->columns, b->columns, a->length / a->columns, a->columns);\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\tfor (int i = 0; i < a->length; i++)\n"
+	"\t{\n"
+	"\t\ta->data[i] = (int)((unsigned int)a->data[i] + (unsigned int)b->data[i]);\n"
+	"\t}\n"
+	"\treturn x;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_matscale(int x, int factor)\n"
+	"{\n"
+	"\tPtArray *a = pt_get_matrix(x);\n"
+	"\tfor (int i = 0; i < a->length; i++)\n"
+	"\t{\n"
+	"\t\ta->data[i] = (int)((unsigned int)a->data[i] * (unsigned int)factor);\n"
+	"\t}\n"
+	"\treturn x;\n"
+	"}\n"
+	"\n";
+
+/// 生成するプログラムの連想配列の実行時ライブラリ（拡張は一度に移す）
+static const char *AOT_MAP_RUNTIME =
+	"typedef struct pt_map_entry\n"
+	"{\n"
+	"\tint key;\n"
+	"\tint value;\n"
+	"} PtMapEntry;\n"
+	"\n"
+	"typedef struct pt_map\n"
+	"{\n"
+	"\tPtMapEntry *entries;\n"
+	"\tunsigned int mask;\n"
+	"\tint shift;\n"
+	"\tint used;\n"
+	"\tint count;\n"
+	"\tint has_empty_key;\n"
+	"\tint empty_key_value;\n"
+	"} PtMap;\n"
+	"\n"
+	"static PtMap *pt_maps;\n"
+	"static int pt_nmaps = 0;\n"
+	"static int pt_map_capacity = 0;\n"
+	"\n"
+	"static inline unsigned int pt_hash(int key, int shift)\n"
+	"{\n"
+	"\treturn ((unsigned int)key * 2654435769u) >> shift;\n"
+	"}\n"
+	"\n"
+	"static inline PtMapEntry *pt_alloc_entries(unsigned int capacity)\n"
+	"{\n"
+	"\tPtMapEntry *entries = (PtMapEntry *)malloc(capacity * sizeof(PtMapEntry));\n"
+	"\tif (NULL == entries)\n"
+	"\t{\n"
+	"\t\tpt_error();\n"
+	"\t\tprintf(\"can't allocate map of %u slots\\n\", capacity);\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\tfor (unsigned int i = 0; i < capacity; i++)\n"
+	"\t{\n"
+	"\t\tentries[i].key = INT_MIN;\n"
+	"\t}\n"
+	"\treturn entries;\n"
+	"}\n"
+	"\n"
+	"static inline PtMap *pt_get_map(int handle)\n"
+	"{\n"
+	"\tif (handle <= PT_MAP_HANDLE_BASE || handle > PT_MAP_HANDLE_BASE + pt_nmaps)\n"
+	"\t{\n"
+	"\t\tpt_error();\n"
+	"\t\tprintf(\"%d is not a map\\n\", handle);\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\treturn &pt_maps[handle - PT_MAP_HANDLE_BASE - 1];\n"
+	"}\n"
+	"\n"
+	"static inline int *pt_find_key(PtMap *map, int key)\n"
+	"{\n"
+	"\tif (INT_MIN == key)\n"
+	"\t{\n"
+	"\t\treturn map->has_empty_key ? &map->empty_key_value : NULL;\n"
+	"\t}\n"
+	"\tfor (unsigned int i = pt_hash(key, map->shift);; i = (i + 1) & map->mask)\n"
+	"\t{\n"
+	"\t\tif (map->entries[i].key == key)\n"
+	"\t\t{\n"
+	"\t\t\treturn &map->entries[i].value;\n"
+	"\t\t}\n"
+	"\t\tif (INT_MIN == map->entries[i].key)\n"
+	"\t\t{\n"
+	"\t\t\treturn NULL;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"static inline void pt_insert_entry(PtMap *map, int key, int value)\n"
+	"{\n"
+	"\tunsigned int i = pt_hash(key, map->shift);\n"
+	"\twhile (INT_MIN != map->entries[i].key)\n"
+	"\t{\n"
+	"\t\ti = (i + 1) & map->mask;\n"
+	"\t}\n"
+	"\tmap->entries[i].key = key;\n"
+	"\tmap->entries[i].value = value;\n"
+	"\tmap->used++;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_map(void)\n"
+	"{\n"
+	"\tif (pt_nmaps == pt_map_capacity)\n"
+	"\t{\n"
+	"\t\tpt_map_capacity = pt_map_capacity ? pt_map_capacity * 2 : 16;\n"
+	"\t\tpt_maps = (PtMap *)realloc(pt_maps, pt_map_capacity * sizeof(PtMap));\n"
+	"\t}\n"
+	"\tPtMap *map = &pt_maps[pt_nmaps];\n"
+	"\tmap->entries = pt_alloc_entries(16);\n"
+	"\tmap->mask = 15;\n"
+	"\tmap->shift = 28;\n"
+	"\tmap->used = 0;\n"
+	"\tmap->count = 0;\n"
+	"\tmap->has_empty_key = 0;\n"
+	"\treturn PT_MAP_HANDLE_BASE + ++pt_nmaps;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_put(int handle, int key, int value)\n"
+	"{\n"
+	"\tPtMap *map = pt_get_map(handle);\n"
+	"\tint *found = pt_find_key(map, key);\n"
+	"\tif (found)\n"
+	"\t{\n"
+	"\t\treturn *found = value;\n"
+	"\t}\n"
+	"\tmap->count++;\n"
+	"\tif (INT_MIN == key)\n"
+	"\t{\n"
+	"\t\tmap->has_empty_key = 1;\n"
+	"\t\treturn map->empty_key_value = value;\n"
+	"\t}\n"
+	"\tif ((map->used + 1) * 4 > (int)(map->mask + 1) * 3)\n"
+	"\t{\n"
+	"\t\tPtMapEntry *old = map->entries;\n"
+	"\t\tunsigned int old_capacity = map->mask + 1;\n"
+	"\t\tif (old_capacity * 2 > (1u << 30))\n"
+	"\t\t{\n"
+	"\t\t\tpt_error();\n"
+	"\t\t\tprintf(\"map can't hold more than %d keys\\n\", map->count - 1);\n"
+	"\t\t\texit(1);\n"
+	"\t\t}\n"
+	"\t\tmap->entries = pt_alloc_entries(old_capacity * 2);\n"
+	"\t\tmap->mask = old_capacity * 2 - 1;\n"
+	"\t\tmap->shift--;\n"
+	"\t\tmap->used = 0;\n"
+	"\t\tfor (unsigned int i = 0; i < old_capacity; i++)\n"
+	"\t\t{\n"
+	"\t\t\tif (INT_MIN != old[i].key)\n"
+	"\t\t\t{\n"
+	"\t\t\t\tpt_insert_entry(map, old[i].key, old[i].value);\n"
+	"\t\t\t}\n"
+	"\t\t}\n"
+	"\t\tfree(old);\n"
+	"\t}\n"
+	"\tpt_insert_entry(map, key, value);\n"
+	"\treturn value;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_get(int handle, int key, int value)\n"
+	"{\n"
+	"\tint *found = pt_find_key(pt_get_map(handle), key);\n"
+	"\treturn found ? *found : value;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_has(int handle, int key)\n"
+	"{\n"
+	"\treturn NULL != pt_find_key(pt_get_map(handle), key);\n"
+	"}\n"
+	"\n"
+	"static inline int pt_del(int handle, int key)\n"
+	"{\n"
+	"\tPtMap *map = pt_get_map(handle);\n"
+	"\tint *found = pt_find_key(map, key);\n"
+	"\tif (NULL == found)\n"
+	"\t{\n"
+	"\t\treturn 0;\n"
+	"\t}\n"
+	"\tmap->count--;\n"
+	"\tif (INT_MIN == key)\n"
+	"\t{\n"
+	"\t\tmap->has_empty_key = 0;\n"
+	"\t\treturn 1;\n"
+	"\t}\n"
+	"\tunsigned int hole = (PtMapEntry *)found - map->entries;\n"
+	"\tfor (unsigned int i = (hole + 1) & map->mask; INT_MIN != map->entries[i].key; i = (i + 1) & map->mask)\n"
+	"\t{\n"
+	"\t\tunsigned int home = pt_hash(map->entries[i].key, map->shift);\n"
+	"\t\tif (((i - home) & map->mask) >= ((i - hole) & map->mask))\n"
+	"\t\t{\n"
+	"\t\t\tmap->entries[hole] = map->entries[i];\n"
+	"\t\t\thole = i;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\tmap->entries[hole].key = INT_MIN;\n"
+	"\tmap->used--;\n"
+	"\treturn 1;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_size(int handle)\n"
+	"{\n"
+	"\treturn pt_get_map(handle)->count;\n"
+	"}\n"
+	"\n";
+
+/// 生成するプログラムの数学の実行時ライブラリ（組み込み関数と同じく溢れたビットは捨てる）
+static const char *AOT_MATH_RUNTIME =
+	"static inline int pt_abs(int x)\n"
+	"{\n"
+	"\treturn (int)(x < 0 ? 0u - (unsigned int)x : (unsigned int)x);\n"
+	"}\n"
+	"\n"
+	"static inline int pt_min2(int x, int y)\n"
+	"{\n"
+	"\treturn x < y ? x : y;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_max2(int x, int y)\n"
+	"{\n"
+	"\treturn x > y ? x : y;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_pow(int x, int n)\n"
+	"{\n"
+	"\tif (n < 0)\n"
+	"\t{\n"
+	"\t\treturn 1 == x ? 1 : -1 == x ? 1 - ((n & 1) << 1) : 0;\n"
+	"\t}\n"
+	"\tunsigned int base = (unsigned int)x;\n"
+	"\tunsigned int value = 1;\n"
+	"\tfor (; n > 0; n >>= 1)\n"
+	"\t{\n"
+	"\t\tif (n & 1)\n"
+	"\t\t{\n"
+	"\t\t\tvalue *= base;\n"
+	"\t\t}\n"
+	"\t\tbase *= base;\n"
+	"\t}\n"
+	"\treturn (int)value;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_sqrt(int x)\n"
+	"{\n"
+	"\tunsigned int rest = x < 0 ? 0 : (unsigned int)x;\n"
+	"\tunsigned int root = 0;\n"
+	"\tfor (unsigned int bit = 1u << 30; bit > 0; bit >>= 2)\n"
+	"\t{\n"
+	"\t\tif (rest >= root + bit)\n"
+	"\t\t{\n"
+	"\t\t\trest -= root + bit;\n"
+	"\t\t\troot = (root >> 1) + bit;\n"
+	"\t\t}\n"
+	"\t\telse\n"
+	"\t\t{\n"
+	"\t\t\troot >>= 1;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\treturn (int)root;\n"
+	"}\n"
+	"\n"
+	"static inline int pt_clock(void)\n"
+	"{\n"
+	"\treturn (int)((long long)clock() * 1000 / CLOCKS_PER_SEC);\n"
+	"}\n"
+	"\n";
+
+/// 生成するプログラムの起動処理
+static const char *AOT_STARTUP =
+	"static void *pt_run(void *arg)\n"
+	"{\n"
+	"\t(void)arg;\n"
+	"\tpt_main();\n"
+	"\treturn NULL;\n"
+	"}\n"
+	"\n"
+	"int main(void)\n"
+	"{\n"
+	"\tpthread_attr_t attr;\n"
+	"\tpthread_t thread;\n"
+	"\n"
+	"\t(void)pt_bind;\n"
+	"\tpt_memo = (PtMemoEntry *)calloc(PT_MEMO_SIZE, sizeof(PtMemoEntry));\n"
+	"\tpthread_attr_init(&attr);\n"
+	"\tpthread_attr_setstacksize(&attr, PT_STACK_SIZE);\n"
+	"\tif (0 == pthread_create(&thread, &attr, pt_run, NULL))\n"
+	"\t{\n"
+	"\t\tpthread_join(thread, NULL);\n"
+	"\t}\n"
+	"\telse\n"
+	"\t{\n"
+	"\t\tpt_main();\n"
+	"\t}\n"
+	"\treturn 0;\n"
+	"}\n";
+
+/// 生成したコードを出力する標準出力の複製（-1なら標準出力を付け替えていない）
+static int output_fd = -1;
+
+/// 二項演算の命令とC言語の式の書式（BC_ADD〜BC_NEの順、左辺と右辺の式を埋め込む）
+/// 加減乗算はインタプリタと同じく溢れたビットを捨てるよう符号なしで計算する（符号付きの溢れは未定義動作）
+static const char *AOT_OPERATORS[] = {
+	"(int)((unsigned int)%s + (unsigned int)%s)",
+	"(int)((unsigned int)%s - (unsigned int)%s)",
+	"(int)((unsigned int)%s * (unsigned int)%s)",
+	"%s / %s", "%s %% %s",
+	"%s & %s", "%s | %s", "%s ^ %s", "pt_shl(%s, %s)", "pt_shr(%s, %s)",
+	"%s < %s", "%s > %s", "%s <= %s", "%s >= %s", "%s == %s", "%s != %s"};
+
+/**
+ * @brief 二項演算の式を出力する
+ * @param op 二項演算の命令
+ * @param left 左辺の式
+ * @param right 右辺の式
+ */
+static void printOperation(int op, const char *left, const char *right)
+{
+	printf(AOT_OPERATORS[op - BC_ADD], left, right);
+};
+
+/**
+ * @brief 関数がほかの関数と同じ名前で定義されているかどうかを判定する
+ * @param m プログラム
+ * @param f 関数
+ * @return 判定結果
+ */
+static BOOL isRedefined(BcModule *m, BcFunction *f)
+{
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		if (m->funcs[i] != f && m->funcs[i]->name_id == f->name_id)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+};
+
+/**
+ * @brief 関数本体に副作用のある命令がないかどうかを判定する（呼び出し先は含まない）
+ * @param m プログラム
+ * @param f 関数
+ * @return 判定結果
+ */
+static BOOL isPureBody(BcModule *m, BcFunction *f)
+{
+	// 未定義の変数を参照するとエラーを出力するため副作用とみなす
+	if (f->argc > MEMO_MAX_ARGS || isRedefined(m, f) || mayReadUndefined(f))
+	{
+		return FALSE;
+	}
+
+	for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		switch (f->code[pos])
+		{
+		case BC_PRINT:
+		case BC_EXIT:
+		case BC_DEFINE:
+		case BC_INDEX:
+		case BC_STORE_INDEX:
+		case BC_ASSIGN_INDEX:
+			// 配列は呼び出しをまたいで書き換わるため、配列を扱う関数はメモ化しない
+			return FALSE;
+		case BC_BUILTIN:
+			// 純粋でない組み込み関数は配列を扱うか外部の状態を読むため副作用とみなす
+			if (FALSE == getBuiltin(f->code[pos + 1])->pure)
+			{
+				return FALSE;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return TRUE;
+};
+
+/**
+ * @brief 関数名番号に束縛される唯一の関数を取得する
+ * @param m プログラム
+ * @param name_id 関数名番号
+ * @retval -1 定義がないか複数ある
+ * @retval Other 関数番号
+ */
+static int findUniqueFunction(BcModule *m, int name_id)
+{
+	int found = -1;
+
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		if (m->funcs[i]->name_id == name_id)
+		{
+			if (found >= 0)
+			{
+				return -1;
+			}
+			found = i;
+		}
+	}
+	return found;
+};
+
+/**
+ * @brief 全関数の純粋性を静的に解析する
+ * @param m プログラム
+ * @param pure 解析結果の格納先（添字が関数番号）
+ * @details 実行時の解析と同じく、副作用のある関数と、そのような関数を呼び出す関数を順に除いていく
+ */
+static void analyzePurity(BcModule *m, BOOL *pure)
+{
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		pure[i] = isPureBody(m, m->funcs[i]);
+	}
+
+	BOOL changed = TRUE;
+	while (changed)
+	{
+		changed = FALSE;
+		for (int i = 0; i < m->nfuncs; i++)
+		{
+			BcFunction *f = m->funcs[i];
+			for (int pos = 0; pure[i] && pos < f->count; pos += getBcLength(f->code[pos]))
+			{
+				if (BC_CALL == f->code[pos] || BC_TAIL_CALL == f->code[pos])
+				{
+					int callee = findUniqueFunction(m, f->code[pos + 1]);
+					if (callee < 0 || FALSE == pure[callee] || m->funcs[callee]->argc != f->code[pos + 2])
+					{
+						pure[i] = FALSE;
+						changed = TRUE;
+					}
+				}
+			}
+		}
+	}
+};
+
+/**
+ * @brief 関数のC言語の引数リストを出力する
+ * @param f 関数
+ * @param prefix 引数名の接頭辞
+ */
+static void emitParams(BcFunction *f, const char *prefix)
+{
+	if (0 == f->argc)
+	{
+		printf("void");
+	}
+	for (int i = 0; i < f->argc; i++)
+	{
+		printf("%sint %s%d", i ? ", " : "", prefix, i);
+	}
+};
+
+/**
+ * @brief スタック上の引数を並べて出力する
+ * @param first 先頭の引数のスタック位置
+ * @param argc 引数の数
+ */
+static void emitArgs(int first, int argc)
+{
+	for (int i = 0; i < argc; i++)
+	{
+		printf("%ss%d", i ? ", " : "", first + i);
+	}
+};
+
+/**
+ * @brief 関数呼び出しを出力する
+ * @param m プログラム
+ * @param f 呼び出し元の関数（トップレベルならm->main）
+ * @param memo 関数ごとのメモ化の有無
+ * @param name_id 関数名番号
+ * @param argc 引数の数
+ * @param first 先頭の引数のスタック位置（戻り値もここに置く）
+ * @param tail 末尾呼び出しかどうか
+ * @details 実行時に束縛されている関数で分岐する。末尾呼び出しでは呼び出しの深さを増やさない
+ */
+static void emitCall(BcModule *m, BcFunction *f, BOOL *memo, int name_id, int argc, int first, BOOL tail)
+{
+	printf("\tswitch (pt_bind[%d])\n\t{\n", name_id);
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		BcFunction *callee = m->funcs[i];
+		if (callee->name_id != name_id)
+		{
+			continue;
+		}
+
+		printf("\tcase %d:\n", i + 1);
+		if (callee->argc != argc)
+		{
+			printf("\t\ts%d = pt_bad_arity(\"%s\", %d, %d);\n", first, callee->name, callee->argc, argc);
+		}
+		else if (FALSE == tail)
+		{
+			printf("\t\ts%d = c%d(", first, i);
+			emitArgs(first, argc);
+			printf(");\n");
+		}
+		else if (callee == f && FALSE == memo[i])
+		{
+			// 自分自身の末尾呼び出しは引数を置き換えて先頭に戻る
+			for (int j = 0; j < argc; j++)
+			{
+				printf("\t\tv%d = s%d;\n", j, first + j);
+			}
+			for (int j = argc; j < f->nslots; j++)
+			{
+				printf("\t\td%d = 0;\n", j);
+			}
+			printf("\t\tgoto entry;\n");
+			continue;
+		}
+		else
+		{
+			if (memo[i])
+			{
+				printf("\t\t{\n\t\t\tint args[] = {");
+				emitArgs(first, argc);
+				printf("%s};\n", argc ? "" : "0");
+				printf("\t\t\tif (pt_memo_lookup(%d, %d, args, &s%d))\n\t\t\t{\n\t\t\t\treturn s%d;\n\t\t\t}\n\t\t}\n", i, argc, first, first);
+			}
+			printf("\t\treturn f%d(", i);
+			emitArgs(first, argc);
+			printf(");\n");
+			continue;
+		}
+		printf("\t\tbreak;\n");
+	}
+	printf("\tdefault:\n\t\ts%d = pt_no_function(\"%s\");\n\t\tbreak;\n\t}\n", first, m->names[name_id]);
+};
+
+/**
+ * @brief 関数本体またはトップレベルのコードを出力する
+ * @param m プログラム
+ * @param f 関数（トップレベルならm->main）
+ * @param index 関数番号（トップレベルなら-1）
+ * @param memo 関数ごとのメモ化の有無
+ * @details 演算スタックの深さは命令ごとに静的に決まるので、スタックの各位置をC言語の局所変数にする
+ */
+static void emitBody(BcModule *m, BcFunction *f, int index, BOOL *memo)
+{
+	BOOL inFunc = index >= 0;
+	BOOL *labels = (BOOL *)calloc(f->count + 1, sizeof(BOOL));
+	BOOL selfTail = FALSE;
+	int max_depth = 1;
+
+	// 飛び先と演算スタックの最大の深さを調べる
+	for (int pos = 0, depth = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		int op = f->code[pos];
+		if (isBcJump(op))
+		{
+			labels[getBcTarget(f, pos)] = TRUE;
+		}
+		if (BC_CONST == op || BC_LOAD == op || BC_EXIT == op)
+		{
+			depth++;
+		}
+		else if ((op >= BC_ADD && op <= BC_NE) || BC_POP == op || BC_RETURN == op || BC_SWITCH == op || BC_INDEX == op || (isBcJump(op) && BC_JUMP != op))
+		{
+			depth--;
+		}
+		else if (BC_STORE_INDEX == op || BC_ASSIGN_INDEX == op)
+		{
+			depth -= 2;
+		}
+		else if (BC_BUILTIN == op)
+		{
+			depth += 1 - getBuiltin(f->code[pos + 1])->argc;
+		}
+		else if (BC_CALL == op || BC_TAIL_CALL == op)
+		{
+			depth += 1 - f->code[pos + 2];
+			if (BC_TAIL_CALL == op && inFunc && FALSE == memo[index] && f->code[pos + 1] == f->name_id && f->code[pos + 2] == f->argc)
+			{
+				selfTail = TRUE;
+			}
+		}
+		if (depth > max_depth)
+		{
+			max_depth = depth;
+		}
+	}
+
+	for (int i = 0; i < f->nslots; i++)
+	{
+		if (i < f->argc)
+		{
+			printf("\tint v%d = a%d;\n", i, i);
+		}
+		else
+		{
+			printf("\tint v%d = 0;\n\tunsigned char d%d = 0;\n", i, i);
+		}
+	}
+	printf("\tint s0");
+	for (int i = 1; i < max_depth; i++)
+	{
+		printf(", s%d", i);
+	}
+	printf(";\n\n");
+	if (selfTail)
+	{
+		printf("entry:\n");
+	}
+
+	for (int pos = 0, depth = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		int op = f->code[pos];
+		int operand = f->code[pos + 1];
+		int top = depth - 1;
+
+		if (labels[pos])
+		{
+			printf("L%d:\n", pos);
+		}
+
+		switch (op)
+		{
+		case BC_CONST:
+			printf("\ts%d = %d;\n", depth++, operand);
+			break;
+		case BC_LOAD:
+			if (operand < f->argc)
+			{
+				printf("\ts%d = v%d;\n", depth++, operand);
+			}
+			else
+			{
+				printf("\ts%d = d%d ? v%d : pt_undefined(\"%s\");\n", depth++, operand, operand, f->slot_names[operand]);
+			}
+			break;
+		case BC_STORE:
+			printf("\tv%d = s%d;\n", operand, top);
+			if (operand >= f->argc)
+			{
+				printf("\td%d = 1;\n", operand);
+			}
+			break;
+		case BC_ASSIGN_ADD:
+		case BC_ASSIGN_SUB:
+		case BC_ASSIGN_MUL:
+		case BC_ASSIGN_DIV:
+		case BC_ASSIGN_MOD:
+		case BC_ASSIGN_BIT_AND:
+		case BC_ASSIGN_BIT_OR:
+		case BC_ASSIGN_BIT_XOR:
+		case BC_ASSIGN_SHL:
+		case BC_ASSIGN_SHR:
+		{
+			char var[AOT_NAME_SIZE], value[AOT_NAME_SIZE];
+			snprintf(var, sizeof(var), "v%d", operand);
+			snprintf(value, sizeof(value), "s%d", top);
+			if (operand < f->argc)
+			{
+				printf("\ts%d = v%d = ", top, operand);
+				printOperation(BC_ADD + (op - BC_ASSIGN_ADD), var, value);
+				printf(";\n");
+			}
+			else
+			{
+				printf("\ts%d = d%d ? (v%d = ", top, operand, operand);
+				printOperation(BC_ADD + (op - BC_ASSIGN_ADD), var, value);
+				printf(") : pt_undefined(\"%s\");\n", f->slot_names[operand]);
+			}
+			break;
+		}
+		case BC_ADD:
+		case BC_SUB:
+		case BC_MUL:
+		case BC_DIV:
+		case BC_MOD:
+		case BC_BIT_AND:
+		case BC_BIT_OR:
+		case BC_BIT_XOR:
+		case BC_SHL:
+		case BC_SHR:
+		case BC_LT:
+		case BC_GT:
+		case BC_LE:
+		case BC_GE:
+		case BC_EQ:
+		case BC_NE:
+		{
+			char left[AOT_NAME_SIZE], right[AOT_NAME_SIZE];
+			snprintf(left, sizeof(left), "s%d", top - 1);
+			snprintf(right, sizeof(right), "s%d", top);
+			printf("\ts%d = ", top - 1);
+			printOperation(op, left, right);
+			printf(";\n");
+			depth--;
+			break;
+		}
+		case BC_NEG:
+			printf("\ts%d = (int)(0u - (unsigned int)s%d);\n", top, top);
+			break;
+		case BC_NOT:
+			printf("\ts%d = !s%d;\n", top, top);
+			break;
+		case BC_BIT_NOT:
+			printf("\ts%d = ~s%d;\n", top, top);
+			break;
+		case BC_POP:
+			depth--;
+			break;
+		case BC_PRINT:
+			printf("\tprintf(\"%%d\\n\", s%d);\n\ts%d = 0;\n", top, top);
+			break;
+		case BC_EXIT:
+			printf("\texit(0);\n");
+			depth++;
+			break;
+		case BC_CALL:
+		case BC_TAIL_CALL:
+		{
+			int argc = f->code[pos + 2];
+			emitCall(m, f, memo, operand, argc, depth - argc, inFunc && BC_TAIL_CALL == op);
+			depth += 1 - argc;
+			break;
+		}
+		case BC_RETURN:
+			if (inFunc)
+			{
+				printf("\treturn s%d;\n", top);
+			}
+			else
+			{
+				printf("\tpt_error();\n\tprintf(\"\\\"return\\\" is outside of function\\n\");\n");
+			}
+			depth--;
+			break;
+		case BC_JUMP:
+			printf("\tgoto L%d;\n", pos + 2 + operand);
+			break;
+		case BC_JUMP_IF_FALSE:
+			printf("\tif (!s%d)\n\t{\n\t\tgoto L%d;\n\t}\n", top, pos + 2 + operand);
+			depth--;
+			break;
+		case BC_JUMP_IF_TRUE:
+			printf("\tif (s%d)\n\t{\n\t\tgoto L%d;\n\t}\n", top, pos + 2 + operand);
+			depth--;
+			break;
+		case BC_AND:
+			// 飛び先でも同じ局所変数を値として使う
+			printf("\tif (!s%d)\n\t{\n\t\tgoto L%d;\n\t}\n", top, pos + 2 + operand);
+			depth--;
+			break;
+		case BC_OR:
+			printf("\tif (s%d)\n\t{\n\t\ts%d = 1;\n\t\tgoto L%d;\n\t}\n", top, top, pos + 2 + operand);
+			depth--;
+			break;
+		case BC_SWITCH:
+			// 一致しなければ直後のジャンプ（default）に進む
+			printf("\tswitch ((unsigned int)s%d - (unsigned int)%d)\n\t{\n", top, operand);
+			for (int k = 0; k < f->code[pos + 2]; k++)
+			{
+				int entry = pos + 3 + 2 * (k + 1);
+				printf("\tcase %du:\n\t\tgoto L%d;\n", k, getBcTarget(f, entry));
+			}
+			printf("\t}\n");
+			depth--;
+			break;
+		case BC_DEFINE:
+			printf("\tpt_bind[%d] = %d;\n\tpt_version++;\n", m->funcs[operand]->name_id, operand + 1);
+			break;
+		case BC_INDEX:
+			printf("\ts%d = pt_index(s%d, s%d);\n", top - 1, top - 1, top);
+			depth--;
+			break;
+		case BC_STORE_INDEX:
+			printf("\ts%d = pt_store(s%d, s%d, s%d);\n", top - 2, top - 2, top - 1, top);
+			depth -= 2;
+			break;
+		case BC_ASSIGN_INDEX:
+		{
+			char element[AOT_NAME_SIZE * 3], value[AOT_NAME_SIZE];
+			snprintf(element, sizeof(element), "pt_index(s%d, s%d)", top - 2, top - 1);
+			snprintf(value, sizeof(value), "s%d", top);
+			printf("\ts%d = pt_store(s%d, s%d, ", top - 2, top - 2, top - 1);
+			printOperation(operand, element, value);
+			printf(");\n");
+			depth -= 2;
+			break;
+		}
+		case BC_BUILTIN:
+		{
+			// 引数は先頭から順に積まれている
+			Builtin *builtin = getBuiltin(operand);
+			int first = depth - builtin->argc;
+			printf("\ts%d = %s(", first, builtin->aot_name);
+			for (int i = 0; i < builtin->argc; i++)
+			{
+				printf("%ss%d", i ? ", " : "", first + i);
+			}
+			printf(");\n");
+			depth += 1 - builtin->argc;
+			break;
+		}
+		case BC_HALT:
+		default:
+			printf("\treturn;\n");
+			break;
+		}
+	}
+	if (labels[f->count])
+	{
+		printf("L%d:;\n", f->count);
+	}
+
+	free(labels);
+};
+
+/**
+ * @brief 配列の要素か組み込み関数を扱う命令があるかどうかを判定する
+ * @param m プログラム
+ * @return 判定結果
+ */
+static BOOL usesBuiltins(BcModule *m)
+{
+	for (int i = 0; i <= m->nfuncs; i++)
+	{
+		BcFunction *f = i < m->nfuncs ? m->funcs[i] : m->main;
+		for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+		{
+			int op = f->code[pos];
+			if (BC_INDEX == op || BC_STORE_INDEX == op || BC_ASSIGN_INDEX == op || BC_BUILTIN == op)
+			{
+				return TRUE;
+			}
+		}
+	}
+	return FALSE;
+};
+
+/**
+ * @brief C言語に変換できない組み込み関数を呼び出していないかどうかを判定する
+ * @param m プログラム
+ * @return 判定結果（変換できなければエラーを表示する）
+ */
+static BOOL isEmittableBuiltins(BcModule *m)
+{
+	for (int i = 0; i <= m->nfuncs; i++)
+	{
+		BcFunction *f = i < m->nfuncs ? m->funcs[i] : m->main;
+		for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+		{
+			if (BC_BUILTIN == f->code[pos] && NULL == getBuiltin(f->code[pos + 1])->aot_name)
+			{
+				printError("error : ");
+				printf("built-in function \"%s\" can't be compiled to C\n", getBuiltin(f->code[pos + 1])->name);
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+};
+
+/**
+ * @brief 関数を呼び出す処理を出力する（呼び出しの深さの確認とメモ化）
+ * @param f 関数
+ * @param index 関数番号
+ * @param memo メモ化するかどうか
+ */
+static void emitCallWrapper(BcFunction *f, int index, BOOL memo)
+{
+	printf("static inline int c%d(", index);
+	emitParams(f, "a");
+	printf(")\n{\n\tint value;\n");
+	if (memo)
+	{
+		printf("\tint args[] = {");
+		for (int i = 0; i < f->argc; i++)
+		{
+			printf("%sa%d", i ? ", " : "", i);
+		}
+		printf("%s};\n\n\tif (pt_memo_lookup(%d, %d, args, &value))\n\t{\n\t\treturn value;\n\t}\n", f->argc ? "" : "0", index, f->argc);
+	}
+	printf("\tpt_enter();\n\tvalue = f%d(", index);
+	for (int i = 0; i < f->argc; i++)
+	{
+		printf("%sa%d", i ? ", " : "", i);
+	}
+	printf(");\n\tpt_depth--;\n");
+	if (memo)
+	{
+		printf("\tpt_memo_store(%d, %d, args, value);\n", index, f->argc);
+	}
+	printf("\treturn value;\n}\n\n");
+};
+
+/**
+ * @brief C言語への変換を始める
+ * @details 生成するコードにエラーが混ざらないよう、コードを出力するまで標準出力を標準エラー出力に付け替える
+ */
+void beginEmitC(void)
+{
+	fflush(stdout);
+	output_fd = dup(STDOUT_FILENO);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+};
+
+/**
+ * @brief 付け替えた標準出力を元に戻す
+ */
+static void restoreOutput(void)
+{
+	if (output_fd < 0)
+	{
+		return;
+	}
+	fflush(stdout);
+	dup2(output_fd, STDOUT_FILENO);
+	close(output_fd);
+	output_fd = -1;
+};
+
+/**
+ * @brief 保存済みのプログラム全体をC言語のソースコードに変換して標準出力に出力する
+ * @param maxCallDepth 関数呼び出しの深さの上限
+ * @param autoMemo 純粋関数を自動でメモ化するかどうか
+ * @return 結果
+ * @details 関数はC言語の関数に、制御構造はgotoに、printは実行時ライブラリの呼び出しになる。
+ * エラーのある行が１行でもあれば何も出力せずにエラーとする
+ */
+ENGINE_RESULT emitC(int maxCallDepth, BOOL autoMemo)
+{
+	BcModule *m = compileModule();
+	if (NULL == m)
+	{
+		return RESULT_ERROR;
+	}
+	if (hasCompileError() || FALSE == isEmittableBuiltins(m))
+	{
+		releaseModule(m);
+		return RESULT_ERROR;
+	}
+	restoreOutput();
+
+	BOOL *pure = (BOOL *)calloc(m->nfuncs + 1, sizeof(BOOL));
+	BOOL *memo = (BOOL *)calloc(m->nfuncs + 1, sizeof(BOOL));
+	analyzePurity(m, pure);
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		memo[i] = m->funcs[i]->argc <= MEMO_MAX_ARGS && (m->funcs[i]->memo || (autoMemo && pure[i]));
+	}
+
+	printf("/* Generated by particle --emit-c */\n");
+	printf("#define PT_MAX_DEPTH (%d)\n", maxCallDepth);
+	printf("#define PT_NNAMES (%d)\n", m->nnames);
+	printf("#define PT_MEMO_MAX_ARGS (%d)\n", MEMO_MAX_ARGS);
+	printf("#define PT_MEMO_SIZE (%d)\n", MEMO_TABLE_SIZE);
+	printf("#define PT_MEMO_PROBE (4)\n");
+	printf("#define PT_STACK_SIZE (%luUL)\n", AOT_STACK_SIZE);
+	printf("#define PT_MAP_HANDLE_BASE (%d)\n", MAP_HANDLE_BASE);
+	printf("%s", AOT_RUNTIME);
+	if (usesBuiltins(m))
+	{
+		printf("%s%s%s", AOT_ARRAY_RUNTIME, AOT_MAP_RUNTIME, AOT_MATH_RUNTIME);
+	}
+
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		printf("static int f%d(", i);
+		emitParams(m->funcs[i], "a");
+		printf(");\n");
+	}
+	printf("\n");
+
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		emitCallWrapper(m->funcs[i], i, memo[i]);
+	}
+
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		BcFunction *f = m->funcs[i];
+		printf("/* %sfunc %s */\nstatic int f%d(", f->memo ? "memo " : "", f->name, i);
+		emitParams(f, "a");
+		printf(")\n{\n");
+		emitBody(m, f, i, memo);
+		printf("}\n\n");
+	}
+
+	printf("static void pt_main(void)\n{\n");
+	emitBody(m, m->main, -1, memo);
+	printf("}\n\n%s", AOT_STARTUP);
+
+	free(pure);
+	free(memo);
+	releaseModule(m);
+	return RESULT_OK;
+};
@@ -0,0 +1,16 @@
+#ifndef _AOT_H_
+#define _AOT_H_
+
+#include "engine.h"
+#include "particle.h"
+
+/// 生成したプログラムを実行するスレッドのスタックサイズ（深い再帰に備える）
+#define AOT_STACK_SIZE (1UL << 30)
+
+/// 式に埋め込む一時値や変数の名前の長さの上限
+#define AOT_NAME_SIZE (16)
+
+void beginEmitC(void);
+ENGINE_RESULT emitC(int, BOOL);
+
+#endif
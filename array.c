@@ -0,0 +1,796 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "array.h"
+#include "util.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define ARRAY_SIMD
+#endif
+
+/// 配列の表
+typedef struct array_table
+{
+	/// 配列（添字がハンドル-1）
+	Array *items;
+	/// 配列の数
+	int count;
+	/// 確保済みの配列の数
+	int capacity;
+} ArrayTable;
+
+/// 要素の一括処理（実行するCPUの命令セットに合わせて選ぶ）
+typedef struct array_kernels
+{
+	/// 全要素に値を入れる
+	void (*fill)(int *, int, int);
+	/// 総和
+	int (*sum)(const int *, int);
+	/// 最小値
+	int (*min)(const int *, int);
+	/// 最大値
+	int (*max)(const int *, int);
+	/// 内積
+	int (*dot)(const int *, const int *, int);
+	/// 別の要素の定数倍を足し込む
+	void (*axpy)(int *, const int *, int, int);
+	/// 定数倍する
+	void (*scale)(int *, int, int);
+} ArrayKernels;
+
+static ArrayTable table;
+static ArrayKernels kernels;
+
+/*
+ * 命令セットを使わない一括処理
+ * 総和と内積は符号なしで計算してオーバーフローを2の補数の折り返しにそろえる
+ */
+
+/**
+ * @brief 全要素に値を入れる（命令セットを使わない）
+ * @param data 要素
+ * @param length 要素数
+ * @param value 値
+ */
+static void fillScalar(int *data, int length, int value)
+{
+	for (int i = 0; i < length; i++)
+	{
+		data[i] = value;
+	}
+};
+
+/**
+ * @brief 要素の総和を求める（命令セットを使わない）
+ * @param data 要素
+ * @param length 要素数
+ * @return 総和
+ */
+static int sumScalar(const int *data, int length)
+{
+	unsigned int sum = 0;
+	for (int i = 0; i < length; i++)
+	{
+		sum += (unsigned int)data[i];
+	}
+	return (int)sum;
+};
+
+/**
+ * @brief 要素の最小値を求める（命令セットを使わない）
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最小値
+ */
+static int minScalar(const int *data, int length)
+{
+	int value = data[0];
+	for (int i = 1; i < length; i++)
+	{
+		value = data[i] < value ? data[i] : value;
+	}
+	return value;
+};
+
+/**
+ * @brief 要素の最大値を求める（命令セットを使わない）
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最大値
+ */
+static int maxScalar(const int *data, int length)
+{
+	int value = data[0];
+	for (int i = 1; i < length; i++)
+	{
+		value = data[i] > value ? data[i] : value;
+	}
+	return value;
+};
+
+/**
+ * @brief 要素ごとの積の総和を求める（命令セットを使わない）
+ * @param a 要素
+ * @param b 要素
+ * @param length 要素数
+ * @return 内積
+ */
+static int dotScalar(const int *a, const int *b, int length)
+{
+	unsigned int sum = 0;
+	for (int i = 0; i < length; i++)
+	{
+		sum += (unsigned int)a[i] * (unsigned int)b[i];
+	}
+	return (int)sum;
+};
+
+/**
+ * @brief 別の要素の定数倍を足し込む（命令セットを使わない）
+ * @param dst 足し込む先の要素
+ * @param src 足す要素
+ * @param factor 倍数
+ * @param length 要素数
+ */
+static void axpyScalar(int *dst, const int *src, int factor, int length)
+{
+	for (int i = 0; i < length; i++)
+	{
+		dst[i] = (int)((unsigned int)dst[i] + (unsigned int)factor * (unsigned int)src[i]);
+	}
+};
+
+/**
+ * @brief 要素を定数倍する（命令セットを使わない）
+ * @param data 要素
+ * @param length 要素数
+ * @param factor 倍数
+ */
+static void scaleScalar(int *data, int length, int factor)
+{
+	for (int i = 0; i < length; i++)
+	{
+		data[i] = (int)((unsigned int)data[i] * (unsigned int)factor);
+	}
+};
+
+#if defined(ARRAY_SIMD)
+
+/*
+ * SSE2による一括処理（x86-64では常に使える）
+ * 4要素ずつ処理し、端数は１要素ずつ処理する
+ */
+
+/**
+ * @brief 全要素に値を入れる（SSE2）
+ * @param data 要素
+ * @param length 要素数
+ * @param value 値
+ */
+static void fillSse2(int *data, int length, int value)
+{
+	__m128i v = _mm_set1_epi32(value);
+	int i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		_mm_storeu_si128((__m128i *)(data + i), v);
+	}
+	fillScalar(data + i, length - i, value);
+};
+
+/**
+ * @brief 要素の総和を求める（SSE2）
+ * @param data 要素
+ * @param length 要素数
+ * @return 総和
+ */
+static int sumSse2(const int *data, int length)
+{
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		acc0 = _mm_add_epi32(acc0, _mm_loadu_si128((const __m128i *)(data + i)));
+		acc1 = _mm_add_epi32(acc1, _mm_loadu_si128((const __m128i *)(data + i + 4)));
+	}
+	acc0 = _mm_add_epi32(acc0, acc1);
+	acc0 = _mm_add_epi32(acc0, _mm_shuffle_epi32(acc0, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc0 = _mm_add_epi32(acc0, _mm_shuffle_epi32(acc0, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (int)((unsigned int)_mm_cvtsi128_si32(acc0) + (unsigned int)sumScalar(data + i, length - i));
+};
+
+/**
+ * @brief SSE2で要素ごとに小さい方または大きい方を選ぶ（SSE4.1のpminsd、pmaxsdの代わり）
+ * @param a 値
+ * @param b 値
+ * @param greater 大きい方を選ぶかどうか
+ * @return 選んだ値
+ */
+static __m128i selectSse2(__m128i a, __m128i b, BOOL greater)
+{
+	__m128i mask = greater ? _mm_cmpgt_epi32(a, b) : _mm_cmpgt_epi32(b, a);
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+};
+
+/**
+ * @brief 要素の最小値または最大値を求める（SSE2）
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @param greater 最大値を求めるかどうか
+ * @return 最小値または最大値
+ */
+static int reduceSse2(const int *data, int length, BOOL greater)
+{
+	__m128i acc = _mm_set1_epi32(data[0]);
+	int i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		acc = selectSse2(acc, _mm_loadu_si128((const __m128i *)(data + i)), greater);
+	}
+	acc = selectSse2(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)), greater);
+	acc = selectSse2(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)), greater);
+
+	int value = _mm_cvtsi128_si32(acc);
+	for (; i < length; i++)
+	{
+		value = (greater ? data[i] > value : data[i] < value) ? data[i] : value;
+	}
+	return value;
+};
+
+/**
+ * @brief 要素の最小値を求める（SSE2）
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最小値
+ */
+static int minSse2(const int *data, int length)
+{
+	return reduceSse2(data, length, FALSE);
+};
+
+/**
+ * @brief 要素の最大値を求める（SSE2）
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最大値
+ */
+static int maxSse2(const int *data, int length)
+{
+	return reduceSse2(data, length, TRUE);
+};
+
+/**
+ * @brief 要素ごとの積の総和を求める（SSE2）
+ * @param a 要素
+ * @param b 要素
+ * @param length 要素数
+ * @return 内積
+ */
+static int dotSse2(const int *a, const int *b, int length)
+{
+	// pmuludqは偶数番目の要素の積を64ビットで求める。下位32ビットは符号付きの積と同じなので、
+	// 偶数番目と奇数番目の積を足し込んだ各64ビットの下位32ビット（0番目と2番目の要素）だけを使う
+	__m128i acc = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		acc = _mm_add_epi32(acc, _mm_mul_epu32(x, y));
+		acc = _mm_add_epi32(acc, _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(y, 32)));
+	}
+	unsigned int sum = (unsigned int)_mm_cvtsi128_si32(acc) + (unsigned int)_mm_cvtsi128_si32(_mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 2, 2, 2)));
+	return (int)(sum + (unsigned int)dotScalar(a + i, b + i, length - i));
+};
+
+/**
+ * @brief 4要素ごとの積の下位32ビットを求める（SSE2）
+ * @param x 要素
+ * @param y 要素
+ * @return 積
+ * @details 偶数番目と奇数番目の積をpmuludqで別々に求め、下位32ビットを元の並びに戻す
+ */
+static __m128i mulloSse2(__m128i x, __m128i y)
+{
+	__m128i even = _mm_mul_epu32(x, y);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(y, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+};
+
+/**
+ * @brief 別の要素の定数倍を足し込む（SSE2）
+ * @param dst 足し込む先の要素
+ * @param src 足す要素
+ * @param factor 倍数
+ * @param length 要素数
+ */
+static void axpySse2(int *dst, const int *src, int factor, int length)
+{
+	__m128i f = _mm_set1_epi32(factor);
+	int i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(dst + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(y, mulloSse2(x, f)));
+	}
+	axpyScalar(dst + i, src + i, factor, length - i);
+};
+
+/**
+ * @brief 要素を定数倍する（SSE2）
+ * @param data 要素
+ * @param length 要素数
+ * @param factor 倍数
+ */
+static void scaleSse2(int *data, int length, int factor)
+{
+	__m128i f = _mm_set1_epi32(factor);
+	int i = 0;
+	for (; i + 4 <= length; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+		_mm_storeu_si128((__m128i *)(data + i), mulloSse2(x, f));
+	}
+	scaleScalar(data + i, length - i, factor);
+};
+
+/*
+ * AVX2による一括処理（実行するCPUが対応していれば使う）
+ * 8要素ずつ処理し、端数はSSE2の処理に任せる
+ */
+
+/**
+ * @brief 全要素に値を入れる（AVX2）
+ * @param data 要素
+ * @param length 要素数
+ * @param value 値
+ */
+__attribute__((target("avx2"))) static void fillAvx2(int *data, int length, int value)
+{
+	__m256i v = _mm256_set1_epi32(value);
+	int i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		_mm256_storeu_si256((__m256i *)(data + i), v);
+	}
+	fillSse2(data + i, length - i, value);
+};
+
+/**
+ * @brief 要素の総和を求める（AVX2）
+ * @param data 要素
+ * @param length 要素数
+ * @return 総和
+ */
+__attribute__((target("avx2"))) static int sumAvx2(const int *data, int length)
+{
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		acc0 = _mm256_add_epi32(acc0, _mm256_loadu_si256((const __m256i *)(data + i)));
+		acc1 = _mm256_add_epi32(acc1, _mm256_loadu_si256((const __m256i *)(data + i + 8)));
+	}
+	acc0 = _mm256_add_epi32(acc0, acc1);
+
+	__m128i acc = _mm_add_epi32(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (int)((unsigned int)_mm_cvtsi128_si32(acc) + (unsigned int)sumSse2(data + i, length - i));
+};
+
+/**
+ * @brief 要素の最小値を求める（AVX2）
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最小値
+ */
+__attribute__((target("avx2"))) static int minAvx2(const int *data, int length)
+{
+	__m256i acc = _mm256_set1_epi32(data[0]);
+	int i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		acc = _mm256_min_epi32(acc, _mm256_loadu_si256((const __m256i *)(data + i)));
+	}
+
+	int lanes[8];
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	int value = minScalar(lanes, 8);
+	if (i < length)
+	{
+		int rest = minSse2(data + i, length - i);
+		value = rest < value ? rest : value;
+	}
+	return value;
+};
+
+/**
+ * @brief 要素の最大値を求める（AVX2）
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最大値
+ */
+__attribute__((target("avx2"))) static int maxAvx2(const int *data, int length)
+{
+	__m256i acc = _mm256_set1_epi32(data[0]);
+	int i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		acc = _mm256_max_epi32(acc, _mm256_loadu_si256((const __m256i *)(data + i)));
+	}
+
+	int lanes[8];
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	int value = maxScalar(lanes, 8);
+	if (i < length)
+	{
+		int rest = maxSse2(data + i, length - i);
+		value = rest > value ? rest : value;
+	}
+	return value;
+};
+
+/**
+ * @brief 要素ごとの積の総和を求める（AVX2）
+ * @param a 要素
+ * @param b 要素
+ * @param length 要素数
+ * @return 内積
+ */
+__attribute__((target("avx2"))) static int dotAvx2(const int *a, const int *b, int length)
+{
+	__m256i acc = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(x, y));
+	}
+
+	int lanes[8];
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	return (int)((unsigned int)sumScalar(lanes, 8) + (unsigned int)dotSse2(a + i, b + i, length - i));
+};
+
+/**
+ * @brief 別の要素の定数倍を足し込む（AVX2）
+ * @param dst 足し込む先の要素
+ * @param src 足す要素
+ * @param factor 倍数
+ * @param length 要素数
+ */
+__attribute__((target("avx2"))) static void axpyAvx2(int *dst, const int *src, int factor, int length)
+{
+	__m256i f = _mm256_set1_epi32(factor);
+	int i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		__m256i x0 = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i x1 = _mm256_loadu_si256((const __m256i *)(src + i + 8));
+		__m256i y0 = _mm256_loadu_si256((const __m256i *)(dst + i));
+		__m256i y1 = _mm256_loadu_si256((const __m256i *)(dst + i + 8));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi32(y0, _mm256_mullo_epi32(x0, f)));
+		_mm256_storeu_si256((__m256i *)(dst + i + 8), _mm256_add_epi32(y1, _mm256_mullo_epi32(x1, f)));
+	}
+	axpySse2(dst + i, src + i, factor, length - i);
+};
+
+/**
+ * @brief 要素を定数倍する（AVX2）
+ * @param data 要素
+ * @param length 要素数
+ * @param factor 倍数
+ */
+__attribute__((target("avx2"))) static void scaleAvx2(int *data, int length, int factor)
+{
+	__m256i f = _mm256_set1_epi32(factor);
+	int i = 0;
+	for (; i + 8 <= length; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(data + i));
+		_mm256_storeu_si256((__m256i *)(data + i), _mm256_mullo_epi32(x, f));
+	}
+	scaleSse2(data + i, length - i, factor);
+};
+
+#endif
+
+/**
+ * @brief 配列の表を初期化し、実行するCPUに合わせて一括処理を選ぶ
+ */
+void initArrays(void)
+{
+	table.items = NULL;
+	table.count = 0;
+	table.capacity = 0;
+
+	kernels = (ArrayKernels){fillScalar, sumScalar, minScalar, maxScalar, dotScalar, axpyScalar, scaleScalar};
+#if defined(ARRAY_SIMD)
+	kernels = (ArrayKernels){fillSse2, sumSse2, minSse2, maxSse2, dotSse2, axpySse2, scaleSse2};
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		kernels = (ArrayKernels){fillAvx2, sumAvx2, minAvx2, maxAvx2, dotAvx2, axpyAvx2, scaleAvx2};
+	}
+#endif
+};
+
+/**
+ * @brief すべての配列を破棄する
+ */
+void releaseArrays(void)
+{
+	for (int i = 0; i < table.count; i++)
+	{
+		free(table.items[i].data);
+	}
+	free(table.items);
+	table.items = NULL;
+	table.count = 0;
+	table.capacity = 0;
+};
+
+/**
+ * @brief 要素がすべて0の配列を生成する
+ * @param length 要素数
+ * @retval 0 エラー
+ * @retval Other 配列のハンドル
+ * @details 配列はプログラムの終了まで破棄しない
+ */
+int createArray(int length)
+{
+	if (length < 0)
+	{
+		printError("error : ");
+		printf("length of array must not be negative (%d)\n", length);
+		return 0;
+	}
+
+	int *data = (int *)calloc(length + 1, sizeof(int));
+	if (NULL == data)
+	{
+		printError("error : ");
+		printf("can't allocate array of length %d\n", length);
+		return 0;
+	}
+
+	if (table.count == table.capacity)
+	{
+		table.capacity = table.capacity ? table.capacity * 2 : ARRAY_TABLE_INIT_SIZE;
+		table.items = (Array *)realloc(table.items, table.capacity * sizeof(Array));
+	}
+	table.items[table.count].data = data;
+	table.items[table.count].length = length;
+	table.items[table.count].columns = 0;
+	return ++table.count;
+};
+
+/**
+ * @brief ハンドルの指す配列を取得する
+ * @param handle 配列のハンドル
+ * @retval NULL 配列ではない（エラーを表示する）
+ * @retval Other 配列
+ */
+Array *getArray(int handle)
+{
+	if (handle <= 0 || handle > table.count)
+	{
+		printError("error : ");
+		printf("%d is not an array\n", handle);
+		return NULL;
+	}
+	return &table.items[handle - 1];
+};
+
+/**
+ * @brief 配列の添字が範囲内かどうかを判定する
+ * @param array 配列
+ * @param index 添字
+ * @return 判定結果（範囲外ならエラーを表示する）
+ */
+static BOOL isInRange(Array *array, int index)
+{
+	if ((unsigned int)index >= (unsigned int)array->length)
+	{
+		printError("error : ");
+		printf("index %d is out of range of array (length %d)\n", index, array->length);
+		return FALSE;
+	}
+	return TRUE;
+};
+
+/**
+ * @brief 配列の要素を読み出す
+ * @param handle 配列のハンドル
+ * @param index 添字
+ * @param value 値の格納先
+ * @return 成否
+ */
+BOOL loadElement(int handle, int index, int *value)
+{
+	Array *array = getArray(handle);
+	if (NULL == array || FALSE == isInRange(array, index))
+	{
+		return FALSE;
+	}
+	*value = array->data[index];
+	return TRUE;
+};
+
+/**
+ * @brief 配列の要素に書き込む
+ * @param handle 配列のハンドル
+ * @param index 添字
+ * @param value 値
+ * @return 成否
+ */
+BOOL storeElement(int handle, int index, int value)
+{
+	Array *array = getArray(handle);
+	if (NULL == array || FALSE == isInRange(array, index))
+	{
+		return FALSE;
+	}
+	array->data[index] = value;
+	return TRUE;
+};
+
+/**
+ * @brief 全要素に値を入れる
+ * @param data 要素
+ * @param length 要素数
+ * @param value 値
+ */
+void fillInts(int *data, int length, int value)
+{
+	kernels.fill(data, length, value);
+};
+
+/**
+ * @brief 要素の総和を求める
+ * @param data 要素
+ * @param length 要素数
+ * @return 総和（オーバーフローしたら折り返す）
+ */
+int sumInts(const int *data, int length)
+{
+	return kernels.sum(data, length);
+};
+
+/**
+ * @brief 要素の最小値を求める
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最小値
+ */
+int minInts(const int *data, int length)
+{
+	return kernels.min(data, length);
+};
+
+/**
+ * @brief 要素の最大値を求める
+ * @param data 要素
+ * @param length 要素数（1以上）
+ * @return 最大値
+ */
+int maxInts(const int *data, int length)
+{
+	return kernels.max(data, length);
+};
+
+/**
+ * @brief 要素ごとの積の総和を求める
+ * @param a 要素
+ * @param b 要素
+ * @param length 要素数
+ * @return 内積（オーバーフローしたら折り返す）
+ */
+int dotInts(const int *a, const int *b, int length)
+{
+	return kernels.dot(a, b, length);
+};
+
+/**
+ * @brief 別の要素の定数倍を足し込む
+ * @param dst 足し込む先の要素
+ * @param src 足す要素
+ * @param factor 倍数
+ * @param length 要素数
+ */
+void axpyInts(int *dst, const int *src, int factor, int length)
+{
+	kernels.axpy(dst, src, factor, length);
+};
+
+/**
+ * @brief 要素を定数倍する
+ * @param data 要素
+ * @param length 要素数
+ * @param factor 倍数
+ */
+void scaleInts(int *data, int length, int factor)
+{
+	kernels.scale(data, length, factor);
+};
+
+/**
+ * @brief 要素を昇順に並べる
+ * @param data 要素
+ * @param length 要素数
+ * @details 少なければ挿入ソートし、多ければ８ビットずつ４回に分けて基数ソートする。
+ *          符号ビットを反転して符号なしの順序にそろえ、全要素で同じ桁の回は飛ばす
+ */
+void sortInts(int *data, int length)
+{
+	if (length <= ARRAY_SORT_SMALL)
+	{
+		for (int i = 1; i < length; i++)
+		{
+			int value = data[i];
+			int j = i;
+			for (; j > 0 && data[j - 1] > value; j--)
+			{
+				data[j] = data[j - 1];
+			}
+			data[j] = value;
+		}
+		return;
+	}
+
+	unsigned int *keys = (unsigned int *)data;
+	unsigned int *buf = (unsigned int *)malloc(length * sizeof(unsigned int));
+	unsigned int *src = keys;
+	unsigned int *dst = buf;
+
+	for (int i = 0; i < length; i++)
+	{
+		keys[i] ^= 0x80000000u;
+	}
+
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int counts[256];
+		memset(counts, 0, sizeof(counts));
+		for (int i = 0; i < length; i++)
+		{
+			counts[(src[i] >> shift) & 0xff]++;
+		}
+		if (counts[(src[0] >> shift) & 0xff] == length)
+		{
+			continue;
+		}
+
+		for (int digit = 0, pos = 0; digit < 256; digit++)
+		{
+			int n = counts[digit];
+			counts[digit] = pos;
+			pos += n;
+		}
+		for (int i = 0; i < length; i++)
+		{
+			dst[counts[(src[i] >> shift) & 0xff]++] = src[i];
+		}
+
+		unsigned int *tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	if (src != keys)
+	{
+		memcpy(keys, src, length * sizeof(unsigned int));
+	}
+	for (int i = 0; i < length; i++)
+	{
+		keys[i] ^= 0x80000000u;
+	}
+	free(buf);
+};
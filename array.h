@@ -0,0 +1,43 @@
+#ifndef _ARRAY_H_
+#define _ARRAY_H_
+
+#include "particle.h"
+
+/// 配列の表の初期容量
+#define ARRAY_TABLE_INIT_SIZE (16)
+
+/// 挿入ソートで並べる要素数の上限（これより多ければ基数ソートする）
+#define ARRAY_SORT_SMALL (64)
+
+/**
+ * 整数の配列
+ * @details 値としては表の位置に1を足したハンドルを持ち回る（0は配列ではない）
+ */
+typedef struct array
+{
+	/// 要素（連続した領域）
+	int *data;
+	/// 要素数
+	int length;
+	/// 行列の列数（0なら行列ではない、要素は行ごとに並ぶ）
+	int columns;
+} Array;
+
+void initArrays(void);
+void releaseArrays(void);
+
+int createArray(int);
+Array *getArray(int);
+BOOL loadElement(int, int, int *);
+BOOL storeElement(int, int, int);
+
+void fillInts(int *, int, int);
+int sumInts(const int *, int);
+int minInts(const int *, int);
+int maxInts(const int *, int);
+int dotInts(const int *, const int *, int);
+void axpyInts(int *, const int *, int, int);
+void scaleInts(int *, int, int);
+void sortInts(int *, int);
+
+#endif
@@ -16,30 +16,66 @@ static Token *findRightBracket(Token *);
 static int priorLevel(char *op)
 {
 	int level = 0;
-	if (isStrMatch(op, ","))
+	if (isStrMatch(op, "in", "step"))
 	{
 		level = 0;
 	}
-	else if (isStrMatch(op, "=", "+=", "-=", "*=", "/=", "%="))
+	else if (isStrMatch(op, ","))
 	{
 		level = 1;
 	}
-	else if (isStrMatch(op, "==", "!="))
+	else if (isStrMatch(op, "=", "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "<<=", ">>="))
 	{
 		level = 2;
 	}
-	else if (isStrMatch(op, "<", ">", "<=", ">="))
+	else if (isStrMatch(op, ".."))
 	{
 		level = 3;
 	}
-	else if (isStrMatch(op, "+", "-"))
+	else if (isStrMatch(op, "||"))
 	{
 		level = 4;
 	}
-	else if (isStrMatch(op, "*", "/", "%"))
+	else if (isStrMatch(op, "&&"))
 	{
 		level = 5;
 	}
+	else if (isStrMatch(op, "|"))
+	{
+		level = 6;
+	}
+	else if (isStrMatch(op, "^"))
+	{
+		level = 7;
+	}
+	else if (isStrMatch(op, "&"))
+	{
+		level = 8;
+	}
+	else if (isStrMatch(op, "==", "!="))
+	{
+		level = 9;
+	}
+	else if (isStrMatch(op, "<", ">", "<=", ">="))
+	{
+		level = 10;
+	}
+	else if (isStrMatch(op, "<<", ">>"))
+	{
+		level = 11;
+	}
+	else if (isStrMatch(op, "+", "-"))
+	{
+		level = 12;
+	}
+	else if (isStrMatch(op, "*", "/", "%"))
+	{
+		level = 13;
+	}
+	else if (isStrMatch(op, "[]"))
+	{
+		level = 14;
+	}
 	return level;
 };
 
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Usage: ./bench-run.sh [--emit-c] [--startup] [particle options...]
+#   --emit-c : also compile each program to C with gcc -O2 and report the speedup
+#   --startup : also run each program with --vm through the compiled-program cache (cold, then warm)
+
+PARTICLE=../particle
+TIMEFORMAT=%R
+
+aot=0
+startup=0
+args=()
+for arg in "$@"; do
+	if [ "$arg" = "--emit-c" ]; then
+		aot=1
+	elif [ "$arg" = "--startup" ]; then
+		startup=1
+	else
+		args+=("$arg")
+	fi
+done
+
+for src in *.par; do
+	sec=$( { time $PARTICLE "${args[@]}" $src > /dev/null; } 2>&1 )
+	if [ $aot = 1 ]; then
+		$PARTICLE "${args[@]}" --emit-c $src > aot.c && gcc -O2 aot.c -o aot -pthread
+		aot_sec=$( { time ./aot > /dev/null; } 2>&1 )
+		rm -f aot aot.c
+		speedup=$(awk "BEGIN { if ($aot_sec > 0) printf \"x%.1f\", $sec / $aot_sec; else print \"-\" }")
+		echo "$src : ${sec}s, aot ${aot_sec}s ($speedup)"
+	else
+		echo "$src : ${sec}s"
+	fi
+	if [ $startup = 1 ]; then
+		cache=$(mktemp -d)
+		cold_sec=$( { time $PARTICLE --vm --cache-dir=$cache "${args[@]}" $src > /dev/null; } 2>&1 )
+		warm_sec=$( { time $PARTICLE --vm --cache-dir=$cache "${args[@]}" $src > /dev/null; } 2>&1 )
+		rm -rf $cache
+		echo "$src : --vm cache cold ${cold_sec}s, warm ${warm_sec}s"
+	fi
+done
@@ -0,0 +1,786 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
+#include "builtin.h"
+#include "array.h"
+#include "map.h"
+#include "matrix.h"
+#include "util.h"
+
+static BOOL builtinArray(int *, int *);
+static BOOL builtinLen(int *, int *);
+static BOOL builtinFill(int *, int *);
+static BOOL builtinCopy(int *, int *);
+static BOOL builtinSum(int *, int *);
+static BOOL builtinMin(int *, int *);
+static BOOL builtinMax(int *, int *);
+static BOOL builtinDot(int *, int *);
+static BOOL builtinSort(int *, int *);
+static BOOL builtinMap(int *, int *);
+static BOOL builtinPut(int *, int *);
+static BOOL builtinGet(int *, int *);
+static BOOL builtinHas(int *, int *);
+static BOOL builtinDel(int *, int *);
+static BOOL builtinSize(int *, int *);
+static BOOL builtinMat(int *, int *);
+static BOOL builtinRows(int *, int *);
+static BOOL builtinCols(int *, int *);
+static BOOL builtinMatmul(int *, int *);
+static BOOL builtinTranspose(int *, int *);
+static BOOL builtinMatadd(int *, int *);
+static BOOL builtinMatscale(int *, int *);
+static BOOL builtinAbs(int *, int *);
+static BOOL builtinMin2(int *, int *);
+static BOOL builtinMax2(int *, int *);
+static BOOL builtinPow(int *, int *);
+static BOOL builtinSqrt(int *, int *);
+static BOOL builtinClock(int *, int *);
+static BOOL builtinOffset(int *, int *);
+
+/// 標準の組み込み関数（添字が組み込み関数番号、並びを変えたらキャッシュは読み込まない）
+static const Builtin BUILTIN_TBL[] = {
+	{"array", 1, FALSE, builtinArray, "pt_array"},
+	{"len", 1, FALSE, builtinLen, "pt_len"},
+	{"fill", 2, FALSE, builtinFill, "pt_fill"},
+	{"copy", 2, FALSE, builtinCopy, "pt_copy"},
+	{"sum", 1, FALSE, builtinSum, "pt_sum"},
+	{"min", 1, FALSE, builtinMin, "pt_min"},
+	{"max", 1, FALSE, builtinMax, "pt_max"},
+	{"dot", 2, FALSE, builtinDot, "pt_dot"},
+	{"sort", 1, FALSE, builtinSort, "pt_sort"},
+	{"map", 0, FALSE, builtinMap, "pt_map"},
+	{"put", 3, FALSE, builtinPut, "pt_put"},
+	{"get", 3, FALSE, builtinGet, "pt_get"},
+	{"has", 2, FALSE, builtinHas, "pt_has"},
+	{"del", 2, FALSE, builtinDel, "pt_del"},
+	{"size", 1, FALSE, builtinSize, "pt_size"},
+	{"mat", 2, FALSE, builtinMat, "pt_mat"},
+	{"rows", 1, FALSE, builtinRows, "pt_rows"},
+	{"cols", 1, FALSE, builtinCols, "pt_cols"},
+	{"matmul", 2, FALSE, builtinMatmul, "pt_matmul"},
+	{"transpose", 1, FALSE, builtinTranspose, "pt_transpose"},
+	{"matadd", 2, FALSE, builtinMatadd, "pt_matadd"},
+	{"matscale", 2, FALSE, builtinMatscale, "pt_matscale"},
+	{"abs", 1, TRUE, builtinAbs, "pt_abs"},
+	{"min", 2, TRUE, builtinMin2, "pt_min2"},
+	{"max", 2, TRUE, builtinMax2, "pt_max2"},
+	{"pow", 2, TRUE, builtinPow, "pt_pow"},
+	{"sqrt", 1, TRUE, builtinSqrt, "pt_sqrt"},
+	{"clock", 0, FALSE, builtinClock, "pt_clock"},
+	{MATRIX_OFFSET_NAME, 3, FALSE, builtinOffset, "pt_offset"},
+};
+
+/// 組み込み関数の表（標準の組み込み関数の後に登録した関数が続く）
+typedef struct builtin_table
+{
+	/// 組み込み関数（添字が組み込み関数番号）
+	Builtin *items;
+	/// 組み込み関数の数
+	int count;
+	/// 確保済みの組み込み関数の数
+	int capacity;
+} BuiltinTable;
+
+static BuiltinTable table;
+
+/// 組み込み関数を隠すユーザ関数の宣言
+typedef struct builtin_shadow
+{
+	/// 関数名
+	char *name;
+	/// 宣言した行の位置
+	int pc;
+} BuiltinShadow;
+
+/// 組み込み関数を隠すユーザ関数の宣言の表
+typedef struct shadow_table
+{
+	/// 宣言（宣言した順）
+	BuiltinShadow *items;
+	/// 宣言の数
+	int count;
+	/// 確保済みの宣言の数
+	int capacity;
+} ShadowTable;
+
+static ShadowTable shadows;
+
+/**
+ * @brief 要素数nの配列を生成する（array(n)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinArray(int *args, int *result)
+{
+	*result = createArray(args[0]);
+	return 0 != *result;
+};
+
+/**
+ * @brief 配列の要素数を取得する（len(a)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinLen(int *args, int *result)
+{
+	Array *a = getArray(args[0]);
+	if (NULL == a)
+	{
+		return FALSE;
+	}
+	*result = a->length;
+	return TRUE;
+};
+
+/**
+ * @brief 配列の全要素に値を入れ、配列を返す（fill(a, v)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinFill(int *args, int *result)
+{
+	Array *a = getArray(args[0]);
+	if (NULL == a)
+	{
+		return FALSE;
+	}
+	fillInts(a->data, a->length, args[1]);
+	*result = args[0];
+	return TRUE;
+};
+
+/**
+ * @brief 配列の全要素を別の配列の先頭に写し、写し先を返す（copy(dst, src)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinCopy(int *args, int *result)
+{
+	Array *dst = getArray(args[0]);
+	Array *src = dst ? getArray(args[1]) : NULL;
+	if (NULL == src)
+	{
+		return FALSE;
+	}
+	if (dst->length < src->length)
+	{
+		printError("error : ");
+		printf("can't copy array of length %d into array of length %d\n", src->length, dst->length);
+		return FALSE;
+	}
+	memmove(dst->data, src->data, src->length * sizeof(int));
+	*result = args[0];
+	return TRUE;
+};
+
+/**
+ * @brief 配列の要素の総和を求める（sum(a)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinSum(int *args, int *result)
+{
+	Array *a = getArray(args[0]);
+	if (NULL == a)
+	{
+		return FALSE;
+	}
+	*result = sumInts(a->data, a->length);
+	return TRUE;
+};
+
+/**
+ * @brief 空でない配列を取得する
+ * @param handle 配列のハンドル
+ * @param name 組み込み関数名
+ * @retval NULL 配列ではないか空（エラーを表示する）
+ * @retval Other 配列
+ */
+static Array *getNonEmptyArray(int handle, char *name)
+{
+	Array *a = getArray(handle);
+	if (a && 0 == a->length)
+	{
+		printError("error : ");
+		printf("\"%s\" of empty array\n", name);
+		return NULL;
+	}
+	return a;
+};
+
+/**
+ * @brief 配列の要素の最小値を求める（min(a)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMin(int *args, int *result)
+{
+	Array *a = getNonEmptyArray(args[0], "min");
+	if (NULL == a)
+	{
+		return FALSE;
+	}
+	*result = minInts(a->data, a->length);
+	return TRUE;
+};
+
+/**
+ * @brief 配列の要素の最大値を求める（max(a)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMax(int *args, int *result)
+{
+	Array *a = getNonEmptyArray(args[0], "max");
+	if (NULL == a)
+	{
+		return FALSE;
+	}
+	*result = maxInts(a->data, a->length);
+	return TRUE;
+};
+
+/**
+ * @brief 同じ要素数の配列の内積を求める（dot(a, b)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinDot(int *args, int *result)
+{
+	Array *a = getArray(args[0]);
+	Array *b = a ? getArray(args[1]) : NULL;
+	if (NULL == b)
+	{
+		return FALSE;
+	}
+	if (a->length != b->length)
+	{
+		printError("error : ");
+		printf("lengths of arrays differ (%d and %d)\n", a->length, b->length);
+		return FALSE;
+	}
+	*result = dotInts(a->data, b->data, a->length);
+	return TRUE;
+};
+
+/**
+ * @brief 配列の要素を昇順に並べ替え、配列を返す（sort(a)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinSort(int *args, int *result)
+{
+	Array *a = getArray(args[0]);
+	if (NULL == a)
+	{
+		return FALSE;
+	}
+	sortInts(a->data, a->length);
+	*result = args[0];
+	return TRUE;
+};
+
+/**
+ * @brief 空の連想配列を生成する（map()）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMap(int *args, int *result)
+{
+	(void)args;
+	*result = createMap();
+	return 0 != *result;
+};
+
+/**
+ * @brief キーに値を対応付け、値を返す（put(m, k, v)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinPut(int *args, int *result)
+{
+	Map *map = getMap(args[0]);
+	if (NULL == map || FALSE == putKey(map, args[1], args[2]))
+	{
+		return FALSE;
+	}
+	*result = args[2];
+	return TRUE;
+};
+
+/**
+ * @brief キーの値を取得する、キーがなければ既定値を返す（get(m, k, default)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinGet(int *args, int *result)
+{
+	Map *map = getMap(args[0]);
+	if (NULL == map)
+	{
+		return FALSE;
+	}
+	int *value = findKey(map, args[1]);
+	*result = value ? *value : args[2];
+	return TRUE;
+};
+
+/**
+ * @brief キーがあれば1、なければ0を返す（has(m, k)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinHas(int *args, int *result)
+{
+	Map *map = getMap(args[0]);
+	if (NULL == map)
+	{
+		return FALSE;
+	}
+	*result = NULL != findKey(map, args[1]);
+	return TRUE;
+};
+
+/**
+ * @brief キーを取り除き、キーがあったら1、なければ0を返す（del(m, k)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinDel(int *args, int *result)
+{
+	Map *map = getMap(args[0]);
+	if (NULL == map)
+	{
+		return FALSE;
+	}
+	*result = removeKey(map, args[1]);
+	return TRUE;
+};
+
+/**
+ * @brief キーの数を取得する（size(m)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinSize(int *args, int *result)
+{
+	Map *map = getMap(args[0]);
+	if (NULL == map)
+	{
+		return FALSE;
+	}
+	*result = map->count;
+	return TRUE;
+};
+
+/**
+ * @brief 要素がすべて0の行列を生成する（mat(r, c)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMat(int *args, int *result)
+{
+	*result = createMatrix(args[0], args[1]);
+	return 0 != *result;
+};
+
+/**
+ * @brief 行列の行数を取得する（rows(m)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinRows(int *args, int *result)
+{
+	Array *m = getMatrix(args[0]);
+	if (NULL == m)
+	{
+		return FALSE;
+	}
+	*result = m->length / m->columns;
+	return TRUE;
+};
+
+/**
+ * @brief 行列の列数を取得する（cols(m)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinCols(int *args, int *result)
+{
+	Array *m = getMatrix(args[0]);
+	if (NULL == m)
+	{
+		return FALSE;
+	}
+	*result = m->columns;
+	return TRUE;
+};
+
+/**
+ * @brief 行列の積を新しい行列として求める（matmul(a, b)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMatmul(int *args, int *result)
+{
+	*result = multiplyMatrices(args[0], args[1]);
+	return 0 != *result;
+};
+
+/**
+ * @brief 転置した行列を新しい行列として求める（transpose(a)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinTranspose(int *args, int *result)
+{
+	*result = transposeMatrix(args[0]);
+	return 0 != *result;
+};
+
+/**
+ * @brief 行列に同じ大きさの行列を足し込み、足し込んだ先を返す（matadd(a, b)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMatadd(int *args, int *result)
+{
+	if (FALSE == addMatrix(args[0], args[1]))
+	{
+		return FALSE;
+	}
+	*result = args[0];
+	return TRUE;
+};
+
+/**
+ * @brief 行列の全要素を定数倍し、行列を返す（matscale(a, k)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMatscale(int *args, int *result)
+{
+	Array *m = getMatrix(args[0]);
+	if (NULL == m)
+	{
+		return FALSE;
+	}
+	scaleInts(m->data, m->length, args[1]);
+	*result = args[0];
+	return TRUE;
+};
+
+/**
+ * @brief 絶対値を求める（abs(x)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ * @details 最小値の絶対値は表せないので最小値のままとする
+ */
+static BOOL builtinAbs(int *args, int *result)
+{
+	*result = (int)(args[0] < 0 ? 0U - (unsigned int)args[0] : (unsigned int)args[0]);
+	return TRUE;
+};
+
+/**
+ * @brief ２つの値の小さい方を求める（min(x, y)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMin2(int *args, int *result)
+{
+	*result = args[0] < args[1] ? args[0] : args[1];
+	return TRUE;
+};
+
+/**
+ * @brief ２つの値の大きい方を求める（max(x, y)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinMax2(int *args, int *result)
+{
+	*result = args[0] > args[1] ? args[0] : args[1];
+	return TRUE;
+};
+
+/**
+ * @brief べき乗を求める（pow(x, n)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ * @details 二乗を繰り返して掛ける。溢れたビットは捨て、負の指数は1 / x^-nを0の方向に丸める
+ */
+static BOOL builtinPow(int *args, int *result)
+{
+	int n = args[1];
+	if (n < 0)
+	{
+		*result = 1 == args[0] ? 1 : -1 == args[0] ? 1 - ((n & 1) << 1) : 0;
+		return TRUE;
+	}
+
+	unsigned int base = (unsigned int)args[0];
+	unsigned int value = 1;
+	for (; n > 0; n >>= 1)
+	{
+		if (n & 1)
+		{
+			value *= base;
+		}
+		base *= base;
+	}
+	*result = (int)value;
+	return TRUE;
+};
+
+/**
+ * @brief 平方根の整数部を求める（sqrt(x)）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ * @details 2ビットずつ決める筆算の方法で、浮動小数点数を使わない。負の値は0とする
+ */
+static BOOL builtinSqrt(int *args, int *result)
+{
+	unsigned int x = args[0] < 0 ? 0 : (unsigned int)args[0];
+	unsigned int root = 0;
+	for (unsigned int bit = 1U << 30; bit > 0; bit >>= 2)
+	{
+		if (x >= root + bit)
+		{
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+	}
+	*result = (int)root;
+	return TRUE;
+};
+
+/**
+ * @brief プログラムが使ったCPU時間をミリ秒で求める（clock()）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinClock(int *args, int *result)
+{
+	(void)args;
+	*result = (int)((long long)clock() * 1000 / CLOCKS_PER_SEC);
+	return TRUE;
+};
+
+/**
+ * @brief 行列の要素の位置を求める（m[i, j]を変換した呼び出し）
+ * @param args 引数
+ * @param result 戻り値の格納先
+ * @return 成否
+ */
+static BOOL builtinOffset(int *args, int *result)
+{
+	return getMatrixOffset(args[0], args[1], args[2], result);
+};
+
+/**
+ * @brief 組み込み関数の表を標準の組み込み関数で初期化する
+ */
+void initBuiltins(void)
+{
+	table.count = sizeof(BUILTIN_TBL) / sizeof(BUILTIN_TBL[0]);
+	table.capacity = BUILTIN_TABLE_INIT_SIZE;
+	table.items = (Builtin *)malloc(table.capacity * sizeof(Builtin));
+	memcpy(table.items, BUILTIN_TBL, sizeof(BUILTIN_TBL));
+
+	shadows.items = NULL;
+	shadows.count = 0;
+	shadows.capacity = 0;
+};
+
+/**
+ * @brief 組み込み関数の表を破棄する
+ */
+void releaseBuiltins(void)
+{
+	free(table.items);
+	table.items = NULL;
+	table.count = 0;
+	table.capacity = 0;
+
+	for (int i = 0; i < shadows.count; i++)
+	{
+		free(shadows.items[i].name);
+	}
+	free(shadows.items);
+	shadows.items = NULL;
+	shadows.count = 0;
+	shadows.capacity = 0;
+};
+
+/**
+ * @brief 組み込み関数を登録する
+ * @param name 関数名（登録後も書き換えない文字列）
+ * @param argc 引数の数
+ * @param pure 純粋かどうか（TRUEなら引数がすべて定数の呼び出しを変換時に計算する）
+ * @param func 実処理
+ * @param aot_name C言語に変換したコードで呼び出す関数名（NULLなら--emit-cで使えない）
+ * @retval -1 同じ名前と引数の数の組み込み関数がある（エラーを表示する）
+ * @retval Other 組み込み関数番号
+ * @details プログラムを読み込む前に登録する。名前が同じでも引数の数が違えば別の関数になる
+ */
+int registerBuiltin(char *name, int argc, BOOL pure, BUILTIN_FUNC func, char *aot_name)
+{
+	if (findBuiltin(name, argc) >= 0)
+	{
+		printError("error : ");
+		printf("built-in function \"%s\" with %d argument(s) is already registered\n", name, argc);
+		return -1;
+	}
+
+	if (table.count == table.capacity)
+	{
+		table.capacity *= 2;
+		table.items = (Builtin *)realloc(table.items, table.capacity * sizeof(Builtin));
+	}
+
+	Builtin *builtin = &table.items[table.count];
+	builtin->name = name;
+	builtin->argc = argc;
+	builtin->pure = pure;
+	builtin->func = func;
+	builtin->aot_name = aot_name;
+	return table.count++;
+};
+
+/**
+ * @brief 組み込み関数を検索する
+ * @param name 関数名
+ * @param argc 引数の数
+ * @retval -1 該当なし
+ * @retval Other 組み込み関数番号
+ */
+int findBuiltin(char *name, int argc)
+{
+	for (int i = 0; i < table.count; i++)
+	{
+		if (EQ(table.items[i].name, name) && table.items[i].argc == argc)
+		{
+			return i;
+		}
+	}
+	return -1;
+};
+
+/**
+ * @brief 組み込み関数の名前かどうかを判定する（引数の数は問わない）
+ * @param name 関数名
+ * @param pc 参照する行の位置
+ * @return 判定結果
+ * @details 同名のユーザ関数を宣言した行より後では組み込み関数の名前とみなさない
+ */
+BOOL isBuiltinName(char *name, int pc)
+{
+	for (int i = 0; i < shadows.count; i++)
+	{
+		if (shadows.items[i].pc < pc && EQ(shadows.items[i].name, name))
+		{
+			return FALSE;
+		}
+	}
+
+	for (int i = 0; i < table.count; i++)
+	{
+		if (EQ(table.items[i].name, name))
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+};
+
+/**
+ * @brief 組み込み関数と同名のユーザ関数の宣言を記録する
+ * @param name 関数名
+ * @param pc 宣言した行の位置
+ * @details 記録した行より後の呼び出しはユーザ関数の呼び出しになる（組み込み関数の名前でなければ何もしない）
+ */
+void shadowBuiltin(const char *name, int pc)
+{
+	// 再定義は最初の宣言から隠れているので記録しない
+	for (int i = 0; i < shadows.count; i++)
+	{
+		if (EQ(shadows.items[i].name, name))
+		{
+			return;
+		}
+	}
+
+	int index = 0;
+	while (index < table.count && !EQ(table.items[index].name, name))
+	{
+		index++;
+	}
+	if (index == table.count)
+	{
+		return;
+	}
+
+	if (shadows.count == shadows.capacity)
+	{
+		shadows.capacity = shadows.capacity ? shadows.capacity * 2 : SHADOW_TABLE_INIT_SIZE;
+		shadows.items = (BuiltinShadow *)realloc(shadows.items, shadows.capacity * sizeof(BuiltinShadow));
+	}
+
+	BuiltinShadow *shadow = &shadows.items[shadows.count++];
+	shadow->name = (char *)malloc(strlen(name) + 1);
+	strcpy(shadow->name, name);
+	shadow->pc = pc;
+};
+
+/**
+ * @brief 組み込み関数を取得する
+ * @param index 組み込み関数番号
+ * @return 組み込み関数
+ */
+Builtin *getBuiltin(int index)
+{
+	return &table.items[index];
+};
+
+/**
+ * @brief 組み込み関数の数を取得する
+ * @return 組み込み関数の数
+ */
+int getBuiltinCount(void)
+{
+	return table.count;
+};
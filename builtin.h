@@ -0,0 +1,43 @@
+#ifndef _BUILTIN_H_
+#define _BUILTIN_H_
+
+#include "particle.h"
+
+/// 行列の要素の位置を求める組み込み関数の名前（m[i, j]から呼び出し、変数名としては書けない）
+#define MATRIX_OFFSET_NAME "[,]"
+
+/// 組み込み関数の表の初期容量
+#define BUILTIN_TABLE_INIT_SIZE (64)
+
+/// 組み込み関数を隠すユーザ関数の宣言の表の初期容量
+#define SHADOW_TABLE_INIT_SIZE (8)
+
+/// 組み込み関数の実処理（引数は先頭から順に並ぶ、戻り値は成否）
+typedef BOOL (*BUILTIN_FUNC)(int *, int *);
+
+/// 組み込み関数
+typedef struct builtin
+{
+	/// 関数名
+	char *name;
+	/// 引数の数
+	int argc;
+	/// 純粋かどうか（値が引数だけで決まり、副作用もエラーもない）
+	BOOL pure;
+	/// 実処理
+	BUILTIN_FUNC func;
+	/// C言語に変換したコードで呼び出す実行時ライブラリの関数名（NULLならC言語に変換できない）
+	char *aot_name;
+} Builtin;
+
+void initBuiltins(void);
+void releaseBuiltins(void);
+int registerBuiltin(char *, int, BOOL, BUILTIN_FUNC, char *);
+
+int findBuiltin(char *, int);
+BOOL isBuiltinName(char *, int);
+void shadowBuiltin(const char *, int);
+Builtin *getBuiltin(int);
+int getBuiltinCount(void);
+
+#endif
@@ -0,0 +1,1281 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "bytecode.h"
+#include "builtin.h"
+#include "cache.h"
+#include "code.h"
+#include "program.h"
+#include "util.h"
+#include "particle.h"
+
+/// 命令列の初期容量
+#define BC_CODE_INIT_SIZE (64)
+
+/// 変数名・関数名・関数の表の初期容量
+#define BC_TABLE_INIT_SIZE (16)
+
+/// 関数名のハッシュテーブルの初期容量（2のべき乗）
+#define BC_NAME_INDEX_INIT_SIZE (64)
+
+/// 制御構造の入れ子の上限
+#define BC_MAX_BLOCK_NEST (256)
+
+/// switch文の二分探索を打ち切って順に比べるcaseの数
+#define BC_SWITCH_LINEAR_CASES (3)
+
+/// 変換中の制御構造
+typedef struct bc_block
+{
+	/// 種類（LINE_IF、LINE_WHILE、LINE_FOR、LINE_SWITCH）
+	LINE_TYPE type;
+	/// 条件式の先頭の位置（forではループ本体の先頭の位置）
+	int start;
+	/// 飛び先が未設定のジャンプのオペランドの位置（-1ならなし）
+	int jump;
+	/// else節に入ったかどうか
+	BOOL has_else;
+	/// 飛び先が未設定のbreakのジャンプのオペランドの位置（オペランドに次の位置をつなぐ、-1ならなし）
+	int breaks;
+	/// 飛び先が未設定のcontinueのジャンプのオペランドの位置（forのみ、つなぎ方はbreaksと同じ）
+	int continues;
+	/// ループ変数のスロット番号（for）、分岐する値のスロット番号（switch）
+	int var_slot;
+	/// 終端値を置くスロット番号（forのみ）
+	int limit_slot;
+	/// 増分を置くスロット番号（forのみ、増分が定数なら-1）
+	int step_slot;
+	/// 定数の増分（forのみ、0でない）
+	int step;
+	/// 節ごとの飛び先が未設定のジャンプ（switchのみ、節の出現順、つなぎ方はbreaksと同じ）
+	int *arms;
+	/// 次に現れる節の番号（switchのみ）
+	int arm;
+} BcBlock;
+
+/// 演算子とバイトコードの対応表
+typedef struct
+{
+	/// 演算子
+	char *operator;
+	/// 二項演算の命令
+	BC_OPCODE op;
+	/// 複合代入演算の命令（なければ-1）
+	int assign;
+} BcOperatorTable;
+
+static BcOperatorTable BC_OPERATOR_TBL[] = {
+	{"+", BC_ADD, BC_ASSIGN_ADD},
+	{"-", BC_SUB, BC_ASSIGN_SUB},
+	{"*", BC_MUL, BC_ASSIGN_MUL},
+	{"/", BC_DIV, BC_ASSIGN_DIV},
+	{"%", BC_MOD, BC_ASSIGN_MOD},
+	{"&", BC_BIT_AND, BC_ASSIGN_BIT_AND},
+	{"|", BC_BIT_OR, BC_ASSIGN_BIT_OR},
+	{"^", BC_BIT_XOR, BC_ASSIGN_BIT_XOR},
+	{"<<", BC_SHL, BC_ASSIGN_SHL},
+	{">>", BC_SHR, BC_ASSIGN_SHR},
+	{"<", BC_LT, -1},
+	{">", BC_GT, -1},
+	{"<=", BC_LE, -1},
+	{">=", BC_GE, -1},
+	{"==", BC_EQ, -1},
+	{"!=", BC_NE, -1},
+};
+
+static BOOL compileBlock(BcModule *, BcFunction *, int *, BOOL);
+static void threadJumps(BcFunction *);
+
+/**
+ * @brief 表の容量を確保する
+ * @param table 表
+ * @param count 使用中の要素数
+ * @param capacity 確保済みの要素数
+ * @param size 要素のサイズ
+ */
+static void reserve(void **table, int count, int *capacity, size_t size)
+{
+	if (count == *capacity)
+	{
+		*capacity = *capacity ? *capacity * 2 : BC_TABLE_INIT_SIZE;
+		*table = realloc(*table, *capacity * size);
+	}
+};
+
+/**
+ * @brief 関数を生成する
+ * @param name 関数名
+ * @return 関数
+ */
+static BcFunction *createBcFunction(char *name)
+{
+	BcFunction *f = (BcFunction *)calloc(1, sizeof(BcFunction));
+	f->name = name;
+	f->name_id = -1;
+	f->start_pc = -1;
+	f->end_pc = -1;
+	return f;
+};
+
+/**
+ * @brief 関数を破棄する
+ * @param f 関数
+ */
+static void releaseBcFunction(BcFunction *f)
+{
+	free(f->slot_names);
+	free(f->code);
+	free(f);
+};
+
+/**
+ * @brief 命令列の末尾に１語追加する
+ * @param f 関数
+ * @param word 命令またはオペランド
+ * @return 追加した位置
+ */
+static int emitWord(BcFunction *f, int word)
+{
+	if (f->count == f->capacity)
+	{
+		f->capacity = f->capacity ? f->capacity * 2 : BC_CODE_INIT_SIZE;
+		f->code = (int *)realloc(f->code, f->capacity * sizeof(int));
+	}
+	f->code[f->count] = word;
+	return f->count++;
+};
+
+/**
+ * @brief オペランドを１つ持つ命令を追加する
+ * @param f 関数
+ * @param op 命令
+ * @param operand オペランド
+ * @return オペランドの位置
+ */
+static int emitOp(BcFunction *f, BC_OPCODE op, int operand)
+{
+	emitWord(f, op);
+	return emitWord(f, operand);
+};
+
+/**
+ * @brief ジャンプの飛び先を設定する
+ * @param f 関数
+ * @param at ジャンプのオペランドの位置
+ * @param target 飛び先の位置
+ */
+static void patchJump(BcFunction *f, int at, int target)
+{
+	f->code[at] = target - (at + 1);
+};
+
+/**
+ * @brief 指定した位置に戻るジャンプを追加する
+ * @param f 関数
+ * @param target 飛び先の位置
+ */
+static void emitJumpBack(BcFunction *f, int target)
+{
+	patchJump(f, emitOp(f, BC_JUMP, 0), target);
+};
+
+/**
+ * @brief 変数のスロット番号を取得する（なければ割り当てる）
+ * @param f 関数
+ * @param name 変数名
+ * @return スロット番号
+ */
+static int getSlot(BcFunction *f, char *name)
+{
+	for (int i = 0; i < f->nslots; i++)
+	{
+		if (EQ(f->slot_names[i], name))
+		{
+			return i;
+		}
+	}
+
+	reserve((void **)&f->slot_names, f->nslots, &f->slot_capacity, sizeof(char *));
+	f->slot_names[f->nslots] = name;
+	return f->nslots++;
+};
+
+/**
+ * @brief 関数名のハッシュテーブルから関数名の位置を探す
+ * @param m プログラム
+ * @param name 関数名
+ * @return 関数名の位置（未登録なら空きの位置）
+ */
+static int findNameSlot(BcModule *m, char *name)
+{
+	int mask = m->name_index_capacity - 1;
+	int pos = hashString(name) & mask;
+
+	while (m->name_index[pos] && !EQ(m->names[m->name_index[pos] - 1], name))
+	{
+		pos = (pos + 1) & mask;
+	}
+
+	return pos;
+};
+
+/**
+ * @brief 関数名のハッシュテーブルの容量を倍にする
+ * @param m プログラム
+ */
+static void growNameIndex(BcModule *m)
+{
+	free(m->name_index);
+	m->name_index_capacity = m->name_index_capacity ? m->name_index_capacity * 2 : BC_NAME_INDEX_INIT_SIZE;
+	m->name_index = (int *)calloc(m->name_index_capacity, sizeof(int));
+
+	for (int i = 0; i < m->nnames; i++)
+	{
+		m->name_index[findNameSlot(m, m->names[i])] = i + 1;
+	}
+};
+
+/**
+ * @brief 関数名番号を取得する（なければ割り当てる）
+ * @param m プログラム
+ * @param name 関数名
+ * @return 関数名番号
+ */
+static int getNameId(BcModule *m, char *name)
+{
+	if ((m->nnames + 1) * 2 > m->name_index_capacity)
+	{
+		growNameIndex(m);
+	}
+
+	int pos = findNameSlot(m, name);
+	if (m->name_index[pos])
+	{
+		return m->name_index[pos] - 1;
+	}
+
+	reserve((void **)&m->names, m->nnames, &m->name_capacity, sizeof(char *));
+	m->names[m->nnames] = name;
+	m->name_index[pos] = m->nnames + 1;
+	return m->nnames++;
+};
+
+/**
+ * @brief 二項演算の命令を取得する
+ * @param insn 中間コードの命令
+ * @retval -1 該当なし
+ * @retval Other 命令
+ */
+static int findOperator(Insn *insn)
+{
+	int num = sizeof(BC_OPERATOR_TBL) / sizeof(BC_OPERATOR_TBL[0]);
+
+	for (int i = 0; i < num; i++)
+	{
+		if (OP_BINARY == insn->op && EQ(insn->name, BC_OPERATOR_TBL[i].operator))
+		{
+			return BC_OPERATOR_TBL[i].op;
+		}
+		if (OP_ASSIGN_OP == insn->op && insn->calc == getEngineFunc(BC_OPERATOR_TBL[i].operator))
+		{
+			return BC_OPERATOR_TBL[i].assign;
+		}
+		if (OP_STORE_INDEX == insn->op && insn->calc == getEngineFunc(BC_OPERATOR_TBL[i].operator))
+		{
+			return BC_OPERATOR_TBL[i].op;
+		}
+	}
+
+	return -1;
+};
+
+/**
+ * @brief コンパイルエラーを表示する
+ * @param pc 行の位置
+ * @param message メッセージ
+ */
+static void compileError(int pc, const char *message)
+{
+	printError("error : ");
+	printf("%s (line : %s)\n", message, getProgramLine(pc));
+};
+
+/**
+ * @brief func文から関数をバイトコードに変換する
+ * @param m プログラム
+ * @param code func文の中間コード
+ * @param pc func文の位置（対応するendの位置まで進める）
+ * @return 関数番号（-1ならエラー）
+ */
+static int compileFunction(BcModule *m, LineCode *code, int *pc)
+{
+	Ast *node = code->ast;
+	BOOL memo = EQ(node->root->value.string, "memo");
+
+	// memo指定があれば"func"以降を対象とする
+	if (memo)
+	{
+		node = node->left;
+	}
+
+	BcFunction *f = createBcFunction(node->left->root->value.string);
+	f->memo = memo;
+	f->start_pc = *pc;
+	f->name_id = getNameId(m, f->name);
+
+	// 引数は実行時の関数定義と同じ順にスロットを割り当てる
+	Ast *arg = node->left->left;
+	while (arg)
+	{
+		if (TK_OPERATION == arg->root->type && EQ(arg->root->value.string, ","))
+		{
+			getSlot(f, arg->right->root->value.string);
+			arg = arg->left;
+		}
+		else
+		{
+			getSlot(f, arg->root->value.string);
+			arg = NULL;
+		}
+	}
+	f->argc = f->nslots;
+
+	(*pc)++;
+	if (FALSE == compileBlock(m, f, pc, TRUE))
+	{
+		releaseBcFunction(f);
+		return -1;
+	}
+	f->end_pc = *pc;
+	threadJumps(f);
+
+	reserve((void **)&m->funcs, m->nfuncs, &m->func_capacity, sizeof(BcFunction *));
+	m->funcs[m->nfuncs] = f;
+	return m->nfuncs++;
+};
+
+/**
+ * @brief 行の中の指定した命令に飛ぶ論理演算のジャンプに、現在の位置を飛び先として設定する
+ * @param f 関数
+ * @param code 中間コード
+ * @param jumps 論理演算の命令ごとのジャンプのオペランドの位置
+ * @param index 飛び先の命令の位置
+ */
+static void patchLogicalJumps(BcFunction *f, LineCode *code, int *jumps, int index)
+{
+	for (int i = 0; i < index; i++)
+	{
+		Insn *insn = &code->insns[i];
+		if ((OP_AND == insn->op || OP_OR == insn->op) && i + 1 + insn->number == index)
+		{
+			patchJump(f, jumps[i], f->count);
+		}
+	}
+};
+
+/**
+ * @brief 論理演算のジャンプを、飛び先で結果が決まる位置への分岐に付け替える
+ * @param f 関数
+ * @details 条件式の&&と||は、飛び先の判定を経由せずにifやwhileの分岐先へ直接飛ぶ。
+ *          飛んだ先で値が捨てられるジャンプは、値を残さない条件分岐にする
+ */
+static void threadJumps(BcFunction *f)
+{
+	BOOL changed = TRUE;
+
+	while (changed)
+	{
+		changed = FALSE;
+		for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+		{
+			int op = f->code[pos];
+			if (BC_AND != op && BC_OR != op)
+			{
+				continue;
+			}
+
+			// 飛んだ先ではスタックトップが0（&&）か1（||）と決まっている
+			BOOL truth = BC_OR == op;
+			int target = getBcTarget(f, pos);
+			int next = f->code[target];
+			int dest;
+
+			if (next == op)
+			{
+				dest = getBcTarget(f, target);
+			}
+			else if (BC_AND == next || BC_OR == next)
+			{
+				// 逆の演算子は値を捨てて右辺に進む
+				f->code[pos] = truth ? BC_JUMP_IF_TRUE : BC_JUMP_IF_FALSE;
+				dest = target + 2;
+			}
+			else if (BC_JUMP_IF_FALSE == next || BC_JUMP_IF_TRUE == next)
+			{
+				f->code[pos] = truth ? BC_JUMP_IF_TRUE : BC_JUMP_IF_FALSE;
+				dest = truth == (BC_JUMP_IF_TRUE == next) ? getBcTarget(f, target) : target + 2;
+			}
+			else
+			{
+				continue;
+			}
+
+			patchJump(f, pos + 1, dest);
+			changed = TRUE;
+		}
+	}
+};
+
+/**
+ * @brief break文とcontinue文の対象になるループを探す
+ * @param blocks 変換中の制御構造
+ * @param nest 制御構造の入れ子の深さ
+ * @retval NULL ループの外
+ * @retval Other 最も内側のループ（else節に入ったwhileはループを終えているので除く）
+ */
+static BcBlock *findLoopBlock(BcBlock *blocks, int nest)
+{
+	for (int i = nest - 1; i >= 0; i--)
+	{
+		if ((LINE_WHILE == blocks[i].type && FALSE == blocks[i].has_else) || LINE_FOR == blocks[i].type)
+		{
+			return &blocks[i];
+		}
+	}
+	return NULL;
+};
+
+/**
+ * @brief forループの変数と終端値を比べて分岐する命令を追加する
+ * @param f 関数
+ * @param block forループ
+ * @param compare 比較命令（BC_LTまたはBC_GT）
+ * @param entry ループに入る前の判定かどうか（偽ならループの終わりから本体の先頭に戻る）
+ */
+static void emitForBranch(BcFunction *f, BcBlock *block, BC_OPCODE compare, BOOL entry)
+{
+	emitOp(f, BC_LOAD, block->var_slot);
+	emitOp(f, BC_LOAD, block->limit_slot);
+	emitWord(f, compare);
+	if (entry)
+	{
+		block->breaks = emitOp(f, BC_JUMP_IF_FALSE, block->breaks);
+	}
+	else
+	{
+		patchJump(f, emitOp(f, BC_JUMP_IF_TRUE, 0), block->start);
+	}
+};
+
+/**
+ * @brief forループを続けるかどうかの判定を追加する
+ * @param f 関数
+ * @param block forループ
+ * @param entry ループに入る前の判定かどうか（真なら続けるときに次の命令へ進み、偽なら本体の先頭に戻る）
+ * @details 終えるときはbreakと同じくendの後ろに飛ぶ。増分が変数なら符号で比較の向きを選び、0なら回さない
+ */
+static void emitForTest(BcFunction *f, BcBlock *block, BOOL entry)
+{
+	// 判定は値を2つまで積む
+	if (f->max_stack < 2)
+	{
+		f->max_stack = 2;
+	}
+
+	if (block->step_slot < 0)
+	{
+		emitForBranch(f, block, block->step > 0 ? BC_LT : BC_GT, entry);
+		return;
+	}
+
+	emitOp(f, BC_LOAD, block->step_slot);
+	emitOp(f, BC_CONST, 0);
+	emitWord(f, BC_GT);
+	int negative = emitOp(f, BC_JUMP_IF_FALSE, 0);
+	emitOp(f, BC_LOAD, block->var_slot);
+	emitOp(f, BC_LOAD, block->limit_slot);
+	emitWord(f, BC_LT);
+	int body = emitOp(f, BC_JUMP_IF_TRUE, 0);
+	if (FALSE == entry)
+	{
+		patchJump(f, body, block->start);
+	}
+	block->breaks = emitOp(f, BC_JUMP, block->breaks);
+
+	patchJump(f, negative, f->count);
+	emitOp(f, BC_LOAD, block->step_slot);
+	emitOp(f, BC_CONST, 0);
+	emitWord(f, BC_LT);
+	block->breaks = emitOp(f, BC_JUMP_IF_FALSE, block->breaks);
+	emitForBranch(f, block, BC_GT, entry);
+	if (entry)
+	{
+		patchJump(f, body, f->count);
+	}
+};
+
+/**
+ * @brief switch文の直下にあるcaseとdefaultを集める
+ * @param pc switchの行の位置
+ * @param count 節の数を返す
+ * @retval NULL caseの値の重複などのエラー
+ * @retval Other 分岐先（飛び先は節の出現順の番号）
+ */
+static SwitchTable *collectSwitchArms(int pc, int *count)
+{
+	int size = getProgramSize();
+	int *keys = NULL;
+	int *arms = NULL;
+	int ncases = 0;
+	int capacity = 0;
+	int default_arm = -1;
+	int nest = 0;
+	*count = 0;
+
+	for (int line_pc = pc + 1; line_pc < size && nest >= 0; line_pc++)
+	{
+		LineCode *line = getLineCode(line_pc, getProgramLine(line_pc));
+		if (NULL == line)
+		{
+			continue;
+		}
+
+		char *error = NULL;
+		switch (line->type)
+		{
+		case LINE_IF:
+		case LINE_WHILE:
+		case LINE_FOR:
+		case LINE_SWITCH:
+		case LINE_FUNC:
+			nest++;
+			break;
+		case LINE_END:
+			nest--;
+			break;
+		case LINE_CASE:
+			if (0 == nest)
+			{
+				if (ncases == capacity)
+				{
+					capacity = capacity ? capacity * 2 : BC_TABLE_INIT_SIZE;
+					keys = (int *)realloc(keys, capacity * sizeof(int));
+					arms = (int *)realloc(arms, capacity * sizeof(int));
+				}
+				keys[ncases] = line->insns[0].number;
+				arms[ncases++] = (*count)++;
+			}
+			break;
+		case LINE_DEFAULT:
+			if (0 == nest && default_arm >= 0)
+			{
+				error = "\"default\" appears twice in \"switch\"";
+			}
+			else if (0 == nest)
+			{
+				default_arm = (*count)++;
+			}
+			break;
+		default:
+			break;
+		}
+
+		// 最初のcaseかdefaultより前の行は実行されない
+		if (0 == *count && nest >= 0 && LINE_CASE != line->type && LINE_DEFAULT != line->type)
+		{
+			error = "\"switch\" needs \"case\" or \"default\" before statements";
+		}
+		if (error)
+		{
+			compileError(line_pc, error);
+			free(keys);
+			free(arms);
+			return NULL;
+		}
+	}
+
+	SwitchTable *st = createSwitchTable(keys, arms, ncases, default_arm);
+	free(keys);
+	free(arms);
+	if (NULL == st)
+	{
+		compileError(pc, "duplicate \"case\" in \"switch\"");
+	}
+	return st;
+};
+
+/**
+ * @brief switch文の節に飛ぶジャンプを追加する
+ * @param f 関数
+ * @param block switch文
+ * @param op ジャンプ命令
+ * @param arm 節の番号（-1ならbreakと同じくendの後ろに飛ぶ）
+ */
+static void emitSwitchArm(BcFunction *f, BcBlock *block, BC_OPCODE op, int arm)
+{
+	int *chain = arm >= 0 ? &block->arms[arm] : &block->breaks;
+	*chain = emitOp(f, op, *chain);
+};
+
+/**
+ * @brief switch文の値と一致するcaseを二分探索する命令を追加する
+ * @param f 関数
+ * @param block switch文
+ * @param st 分岐先
+ * @param low 探索するcaseの先頭の添字
+ * @param high 探索するcaseの末尾の次の添字
+ */
+static void emitSwitchSearch(BcFunction *f, BcBlock *block, SwitchTable *st, int low, int high)
+{
+	if (high - low <= BC_SWITCH_LINEAR_CASES)
+	{
+		for (int i = low; i < high; i++)
+		{
+			emitOp(f, BC_LOAD, block->var_slot);
+			emitOp(f, BC_CONST, st->keys[i]);
+			emitWord(f, BC_EQ);
+			emitSwitchArm(f, block, BC_JUMP_IF_TRUE, st->pcs[i]);
+		}
+		emitSwitchArm(f, block, BC_JUMP, st->default_pc);
+		return;
+	}
+
+	int mid = (low + high) / 2;
+	emitOp(f, BC_LOAD, block->var_slot);
+	emitOp(f, BC_CONST, st->keys[mid]);
+	emitWord(f, BC_LT);
+	int less = emitOp(f, BC_JUMP_IF_TRUE, 0);
+	emitSwitchSearch(f, block, st, mid, high);
+	patchJump(f, less, f->count);
+	emitSwitchSearch(f, block, st, low, mid);
+};
+
+/**
+ * @brief スタックの先頭にあるswitch文の値から節に飛ぶ命令を追加する
+ * @param f 関数
+ * @param block switch文
+ * @param st 分岐先
+ * @param pc switchの行の位置
+ * @details caseが多く値の範囲が狭ければBC_SWITCHとジャンプの表にし、そうでなければ比較の二分木にする
+ */
+static void emitSwitchDispatch(BcFunction *f, BcBlock *block, SwitchTable *st, int pc)
+{
+	if (st->table)
+	{
+		emitOp(f, BC_SWITCH, st->keys[0]);
+		emitWord(f, st->span);
+		emitSwitchArm(f, block, BC_JUMP, st->default_pc);
+		for (int i = 0; i < st->span; i++)
+		{
+			emitSwitchArm(f, block, BC_JUMP, st->table[i] >= 0 ? st->table[i] : st->default_pc);
+		}
+		return;
+	}
+
+	// 値を隠れた変数に置いて比べる
+	block->var_slot = getSlot(f, getSwitchSlotName(pc));
+	emitOp(f, BC_STORE, block->var_slot);
+	emitWord(f, BC_POP);
+	if (f->max_stack < 2)
+	{
+		f->max_stack = 2;
+	}
+	emitSwitchSearch(f, block, st, 0, st->count);
+};
+
+/**
+ * @brief １行分の中間コードをバイトコードに変換する
+ * @param m プログラム
+ * @param f 変換先の関数
+ * @param code 中間コード
+ * @param pc 行の位置
+ * @param blocks 変換中の制御構造
+ * @param nest 制御構造の入れ子の深さ
+ * @return 成否
+ */
+static BOOL compileLineCode(BcModule *m, BcFunction *f, LineCode *code, int pc, BcBlock *blocks, int *nest)
+{
+	int start = f->count;
+	int height = 0;
+	int jumps[code->count + 1];
+
+	for (int i = 0; i < code->count; i++)
+	{
+		Insn *insn = &code->insns[i];
+
+		patchLogicalJumps(f, code, jumps, i);
+		switch (insn->op)
+		{
+		case OP_NUMBER:
+			emitOp(f, BC_CONST, insn->number);
+			height++;
+			break;
+		case OP_LOAD:
+			emitOp(f, BC_LOAD, getSlot(f, insn->name));
+			height++;
+			break;
+		case OP_STORE:
+			emitOp(f, BC_STORE, getSlot(f, insn->name));
+			break;
+		case OP_ASSIGN_OP:
+			emitOp(f, findOperator(insn), getSlot(f, insn->name));
+			break;
+		case OP_BINARY:
+			emitWord(f, findOperator(insn));
+			height--;
+			break;
+		case OP_UNARY:
+			if (EQ(insn->name, "-"))
+			{
+				emitWord(f, BC_NEG);
+			}
+			else if (EQ(insn->name, "!"))
+			{
+				emitWord(f, BC_NOT);
+			}
+			else if (EQ(insn->name, "~"))
+			{
+				emitWord(f, BC_BIT_NOT);
+			}
+			break;
+		case OP_AND:
+		case OP_OR:
+			jumps[i] = emitOp(f, OP_AND == insn->op ? BC_AND : BC_OR, 0);
+			height--;
+			break;
+		case OP_POP:
+			emitWord(f, BC_POP);
+			height--;
+			break;
+		case OP_PRINT:
+			emitWord(f, BC_PRINT);
+			break;
+		case OP_EXIT:
+			emitWord(f, BC_EXIT);
+			break;
+		case OP_INDEX:
+			emitWord(f, BC_INDEX);
+			height--;
+			break;
+		case OP_STORE_INDEX:
+			if (insn->calc)
+			{
+				emitOp(f, BC_ASSIGN_INDEX, findOperator(insn));
+			}
+			else
+			{
+				emitWord(f, BC_STORE_INDEX);
+			}
+			height -= 2;
+			break;
+		case OP_BUILTIN:
+			emitOp(f, BC_BUILTIN, insn->number);
+			height = height - getBuiltin(insn->number)->argc + 1;
+			break;
+		case OP_CALL:
+		case OP_TAIL_CALL:
+			emitOp(f, OP_CALL == insn->op ? BC_CALL : BC_TAIL_CALL, getNameId(m, insn->name));
+			emitWord(f, insn->number);
+			height = height - insn->number + 1;
+			break;
+		case OP_IF:
+		case OP_WHILE:
+			if (*nest == BC_MAX_BLOCK_NEST)
+			{
+				compileError(pc, "too deeply nested block");
+				return FALSE;
+			}
+			blocks[*nest].type = OP_IF == insn->op ? LINE_IF : LINE_WHILE;
+			blocks[*nest].start = start;
+			blocks[*nest].jump = emitOp(f, BC_JUMP_IF_FALSE, 0);
+			blocks[*nest].has_else = FALSE;
+			blocks[*nest].breaks = -1;
+			(*nest)++;
+			height--;
+			break;
+		case OP_FOR:
+		{
+			if (*nest == BC_MAX_BLOCK_NEST)
+			{
+				compileError(pc, "too deeply nested block");
+				return FALSE;
+			}
+
+			// 増分と終端値は隠れた変数に置き、ループ本体の後ろで増やして比べる
+			BcBlock *block = &blocks[(*nest)++];
+			block->type = LINE_FOR;
+			block->jump = -1;
+			block->has_else = FALSE;
+			block->breaks = -1;
+			block->continues = -1;
+			block->var_slot = getSlot(f, insn->name);
+			block->limit_slot = getSlot(f, getForSlotName(pc, FALSE));
+			block->step_slot = -1;
+			block->step = insn->number;
+			if (0 == insn->number)
+			{
+				block->step_slot = getSlot(f, getForSlotName(pc, TRUE));
+				emitOp(f, BC_STORE, block->step_slot);
+				emitWord(f, BC_POP);
+			}
+			emitOp(f, BC_STORE, block->limit_slot);
+			emitWord(f, BC_POP);
+			emitOp(f, BC_STORE, block->var_slot);
+			emitWord(f, BC_POP);
+			height = 0;
+			emitForTest(f, block, TRUE);
+			block->start = f->count;
+			break;
+		}
+		case OP_SWITCH:
+		{
+			if (*nest == BC_MAX_BLOCK_NEST)
+			{
+				compileError(pc, "too deeply nested block");
+				return FALSE;
+			}
+
+			// 先にendまでのcaseとdefaultを集めて、値から節に飛ぶ命令を置く
+			int count;
+			SwitchTable *st = collectSwitchArms(pc, &count);
+			if (NULL == st)
+			{
+				return FALSE;
+			}
+			BcBlock *block = &blocks[(*nest)++];
+			block->type = LINE_SWITCH;
+			block->jump = -1;
+			block->has_else = FALSE;
+			block->breaks = -1;
+			block->arms = (int *)malloc((count + 1) * sizeof(int));
+			block->arm = 0;
+			for (int arm = 0; arm < count; arm++)
+			{
+				block->arms[arm] = -1;
+			}
+			emitSwitchDispatch(f, block, st, pc);
+			releaseSwitchTable(st);
+			height = 0;
+			break;
+		}
+		case OP_CASE:
+		case OP_DEFAULT:
+		{
+			BcBlock *block = *nest > 0 ? &blocks[*nest - 1] : NULL;
+			if (NULL == block || LINE_SWITCH != block->type)
+			{
+				compileError(pc, OP_CASE == insn->op ? "\"case\" without \"switch\"" : "\"default\" without \"switch\"");
+				return FALSE;
+			}
+
+			// 直前の節の終わりからendに飛ぶ
+			if (block->arm > 0)
+			{
+				block->breaks = emitOp(f, BC_JUMP, block->breaks);
+			}
+			for (int at = block->arms[block->arm++], next; at >= 0; at = next)
+			{
+				next = f->code[at];
+				patchJump(f, at, f->count);
+			}
+			break;
+		}
+		case OP_ELSE:
+		{
+			if (0 == *nest)
+			{
+				compileError(pc, "\"else\" without \"if\"");
+				return FALSE;
+			}
+
+			BcBlock *block = &blocks[*nest - 1];
+			if (LINE_FOR == block->type)
+			{
+				compileError(pc, "\"else\" is not supported in \"for\"");
+				return FALSE;
+			}
+			if (LINE_SWITCH == block->type)
+			{
+				compileError(pc, "\"else\" without \"if\"");
+				return FALSE;
+			}
+			if (LINE_IF == block->type)
+			{
+				// 直前の節の終わりからendに飛び、直前の分岐はelse節の先頭に飛ばす
+				int jump = emitOp(f, BC_JUMP, 0);
+				patchJump(f, block->jump, f->count);
+				block->jump = jump;
+			}
+			else if (FALSE == block->has_else)
+			{
+				// whileの本体の終わりでは条件に戻り、条件が偽ならelse節を１度だけ実行する
+				emitJumpBack(f, block->start);
+				patchJump(f, block->jump, f->count);
+				block->jump = -1;
+			}
+			else
+			{
+				compileError(pc, "\"else\" appears twice in \"while\"");
+				return FALSE;
+			}
+			block->has_else = TRUE;
+			break;
+		}
+		case OP_END:
+		{
+			BcBlock *block = &blocks[--(*nest)];
+			if (LINE_WHILE == block->type && FALSE == block->has_else)
+			{
+				emitJumpBack(f, block->start);
+			}
+			if (LINE_FOR == block->type)
+			{
+				// continueは増分を足すところに飛ぶ
+				for (int at = block->continues, next; at >= 0; at = next)
+				{
+					next = f->code[at];
+					patchJump(f, at, f->count);
+				}
+				if (block->step_slot < 0)
+				{
+					emitOp(f, BC_CONST, block->step);
+				}
+				else
+				{
+					emitOp(f, BC_LOAD, block->step_slot);
+				}
+				emitOp(f, BC_ASSIGN_ADD, block->var_slot);
+				emitWord(f, BC_POP);
+				emitForTest(f, block, FALSE);
+			}
+			if (LINE_SWITCH == block->type)
+			{
+				free(block->arms);
+			}
+			if (block->jump >= 0)
+			{
+				patchJump(f, block->jump, f->count);
+			}
+			for (int at = block->breaks, next; at >= 0; at = next)
+			{
+				next = f->code[at];
+				patchJump(f, at, f->count);
+			}
+			break;
+		}
+		case OP_BREAK:
+		case OP_CONTINUE:
+		{
+			BcBlock *loop = findLoopBlock(blocks, *nest);
+			if (NULL == loop)
+			{
+				compileError(pc, OP_BREAK == insn->op ? "\"break\" without \"while\"" : "\"continue\" without \"while\"");
+				return FALSE;
+			}
+
+			if (OP_BREAK == insn->op)
+			{
+				loop->breaks = emitOp(f, BC_JUMP, loop->breaks);
+			}
+			else if (LINE_FOR == loop->type)
+			{
+				loop->continues = emitOp(f, BC_JUMP, loop->continues);
+			}
+			else
+			{
+				emitJumpBack(f, loop->start);
+			}
+			break;
+		}
+		case OP_RETURN:
+			emitWord(f, BC_RETURN);
+			height--;
+			break;
+		default:
+			break;
+		}
+
+		if (height > f->max_stack)
+		{
+			f->max_stack = height;
+		}
+	}
+	patchLogicalJumps(f, code, jumps, code->count);
+
+	return TRUE;
+};
+
+/**
+ * @brief 関数本体またはトップレベルのコードをバイトコードに変換する
+ * @param m プログラム
+ * @param f 変換先の関数
+ * @param pc 開始位置（関数本体なら対応するendの位置まで進める）
+ * @param inFunc 関数本体かどうか
+ * @return 成否
+ */
+static BOOL compileBlock(BcModule *m, BcFunction *f, int *pc, BOOL inFunc)
+{
+	BcBlock blocks[BC_MAX_BLOCK_NEST];
+	int nest = 0;
+	int size = getProgramSize();
+
+	for (; *pc < size; (*pc)++)
+	{
+		// エラーのある行は逐次実行と同様に読み飛ばす
+		LineCode *code = getLineCode(*pc, getProgramLine(*pc));
+		if (NULL == code)
+		{
+			continue;
+		}
+
+		if (LINE_FUNC == code->type)
+		{
+			if (inFunc)
+			{
+				compileError(*pc, "nested function definition is not supported");
+				return FALSE;
+			}
+
+			int index = compileFunction(m, code, pc);
+			if (index < 0)
+			{
+				return FALSE;
+			}
+			emitOp(f, BC_DEFINE, index);
+			continue;
+		}
+
+		if (LINE_END == code->type && 0 == nest)
+		{
+			if (FALSE == inFunc)
+			{
+				compileError(*pc, "\"end\" without block");
+				return FALSE;
+			}
+
+			// 末尾に達したら0を返す
+			emitOp(f, BC_CONST, 0);
+			emitWord(f, BC_RETURN);
+			if (f->max_stack < 1)
+			{
+				f->max_stack = 1;
+			}
+			return TRUE;
+		}
+
+		if (FALSE == compileLineCode(m, f, code, *pc, blocks, &nest))
+		{
+			return FALSE;
+		}
+	}
+
+	if (inFunc || nest > 0)
+	{
+		compileError(size - 1, "\"end\" is missing");
+		return FALSE;
+	}
+
+	emitWord(f, BC_HALT);
+	return TRUE;
+};
+
+/**
+ * @brief 保存済みのプログラム全体をバイトコードに変換する（キャッシュファイルがあればそれを使う）
+ * @retval NULL エラー
+ * @retval Other 変換したプログラム
+ */
+BcModule *compileModule(void)
+{
+	BcModule *m = loadCachedModule();
+	int pc = 1;
+
+	if (m)
+	{
+		return m;
+	}
+
+	m = (BcModule *)calloc(1, sizeof(BcModule));
+	m->main = createBcFunction("");
+	if (FALSE == compileBlock(m, m->main, &pc, FALSE))
+	{
+		releaseModule(m);
+		return NULL;
+	}
+	threadJumps(m->main);
+
+	saveCachedModule(m);
+	return m;
+};
+
+/**
+ * @brief 変換したプログラムを破棄する
+ * @param m プログラム
+ */
+void releaseModule(BcModule *m)
+{
+	if (m->mapping)
+	{
+		releaseCachedModule(m);
+		return;
+	}
+
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		releaseBcFunction(m->funcs[i]);
+	}
+	releaseBcFunction(m->main);
+	free(m->funcs);
+	free(m->names);
+	free(m->name_index);
+	free(m);
+};
+
+/**
+ * @brief 命令のオペランドを含めた語数を取得する
+ * @param op 命令
+ * @return 語数
+ */
+int getBcLength(int op)
+{
+	switch (op)
+	{
+	case BC_CALL:
+	case BC_TAIL_CALL:
+	case BC_SWITCH:
+		return 3;
+	case BC_CONST:
+	case BC_LOAD:
+	case BC_STORE:
+	case BC_ASSIGN_ADD:
+	case BC_ASSIGN_SUB:
+	case BC_ASSIGN_MUL:
+	case BC_ASSIGN_DIV:
+	case BC_ASSIGN_MOD:
+	case BC_ASSIGN_BIT_AND:
+	case BC_ASSIGN_BIT_OR:
+	case BC_ASSIGN_BIT_XOR:
+	case BC_ASSIGN_SHL:
+	case BC_ASSIGN_SHR:
+	case BC_JUMP:
+	case BC_JUMP_IF_FALSE:
+	case BC_JUMP_IF_TRUE:
+	case BC_AND:
+	case BC_OR:
+	case BC_ASSIGN_INDEX:
+	case BC_BUILTIN:
+	case BC_DEFINE:
+		return 2;
+	default:
+		return 1;
+	}
+};
+
+/**
+ * @brief 命令がジャンプ（飛び先をオペランドに持つ命令）かどうかを判定する
+ * @param op 命令
+ * @return 判定結果
+ */
+BOOL isBcJump(int op)
+{
+	return BC_JUMP == op || BC_JUMP_IF_FALSE == op || BC_JUMP_IF_TRUE == op || BC_AND == op || BC_OR == op;
+};
+
+/**
+ * @brief ジャンプ命令の飛び先の位置を取得する
+ * @param f 関数
+ * @param pos ジャンプ命令の位置
+ * @return 飛び先の位置
+ */
+int getBcTarget(BcFunction *f, int pos)
+{
+	return pos + 2 + f->code[pos + 1];
+};
+
+/**
+ * @brief 各命令の直前で必ず代入済みになっている変数を求める
+ * @param f 関数
+ * @return 命令の位置×変数スロットの表（1なら代入済み、freeで破棄する）
+ * @details 命令列の順に合流点で積を取ることを変化がなくなるまで繰り返す
+ */
+unsigned char *analyzeDefinedSlots(BcFunction *f)
+{
+	int n = f->nslots;
+	unsigned char *in = (unsigned char *)malloc((size_t)(f->count + 1) * n + 1);
+	unsigned char out[n + 1];
+	BOOL changed = TRUE;
+
+	memset(in, 1, (size_t)(f->count + 1) * n + 1);
+	memset(in + f->argc, 0, n - f->argc);
+
+	while (changed)
+	{
+		changed = FALSE;
+		for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+		{
+			int op = f->code[pos];
+			int succ[BC_SWITCH == op ? f->code[pos + 2] + 2 : 2];
+			int nsucc = 0;
+
+			memcpy(out, in + (size_t)pos * n, n);
+			if (BC_STORE == op)
+			{
+				out[f->code[pos + 1]] = 1;
+			}
+
+			if (isBcJump(op))
+			{
+				succ[nsucc++] = getBcTarget(f, pos);
+			}
+			if (BC_JUMP != op && BC_RETURN != op && BC_HALT != op && BC_EXIT != op)
+			{
+				succ[nsucc++] = pos + getBcLength(op);
+			}
+			if (BC_SWITCH == op)
+			{
+				// 表のジャンプにはswitchからしか進まない
+				for (int k = 1; k <= f->code[pos + 2]; k++)
+				{
+					succ[nsucc++] = pos + 3 + 2 * k;
+				}
+			}
+
+			for (int i = 0; i < nsucc; i++)
+			{
+				unsigned char *next = in + (size_t)succ[i] * n;
+				for (int slot = 0; slot < n; slot++)
+				{
+					if (next[slot] && 0 == out[slot])
+					{
+						next[slot] = 0;
+						changed = TRUE;
+					}
+				}
+			}
+		}
+	}
+
+	return in;
+};
+
+/**
+ * @brief 代入される前に参照するおそれのある変数があるかどうかを判定する
+ * @param f 関数
+ * @return 判定結果（複合代入も参照に数える）
+ */
+BOOL mayReadUndefined(BcFunction *f)
+{
+	unsigned char *defined = analyzeDefinedSlots(f);
+	BOOL found = FALSE;
+
+	for (int pos = 0; FALSE == found && pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		int op = f->code[pos];
+		if (BC_LOAD == op || (op >= BC_ASSIGN_ADD && op <= BC_ASSIGN_SHR))
+		{
+			found = 0 == defined[(size_t)pos * f->nslots + f->code[pos + 1]];
+		}
+	}
+
+	free(defined);
+	return found;
+};
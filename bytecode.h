@@ -0,0 +1,152 @@
+#ifndef _BYTECODE_H_
+#define _BYTECODE_H_
+
+#include <stddef.h>
+#include "particle.h"
+
+/// バイトコードの命令（オペランドは命令の後に続く）
+typedef enum
+{
+	/// 定数をpushする（定数）
+	BC_CONST,
+	/// 変数の値をpushする（スロット番号）
+	BC_LOAD,
+	/// スタックトップの値を変数に代入する、値は残す（スロット番号）
+	BC_STORE,
+	/// 複合代入演算（スロット番号）
+	BC_ASSIGN_ADD,
+	BC_ASSIGN_SUB,
+	BC_ASSIGN_MUL,
+	BC_ASSIGN_DIV,
+	BC_ASSIGN_MOD,
+	BC_ASSIGN_BIT_AND,
+	BC_ASSIGN_BIT_OR,
+	BC_ASSIGN_BIT_XOR,
+	BC_ASSIGN_SHL,
+	BC_ASSIGN_SHR,
+	/// 二項演算
+	BC_ADD,
+	BC_SUB,
+	BC_MUL,
+	BC_DIV,
+	BC_MOD,
+	BC_BIT_AND,
+	BC_BIT_OR,
+	BC_BIT_XOR,
+	BC_SHL,
+	BC_SHR,
+	BC_LT,
+	BC_GT,
+	BC_LE,
+	BC_GE,
+	BC_EQ,
+	BC_NE,
+	/// 単項演算
+	BC_NEG,
+	BC_NOT,
+	BC_BIT_NOT,
+	/// スタックトップの値を捨てる
+	BC_POP,
+	/// 組み込み関数print
+	BC_PRINT,
+	/// 組み込み関数exit
+	BC_EXIT,
+	/// 配列の要素をpushする（配列、添字の順に積む）
+	BC_INDEX,
+	/// 配列の要素に代入する、値は残す（配列、添字、値の順に積む）
+	BC_STORE_INDEX,
+	/// 配列の要素への複合代入、値は残す（二項演算の命令、積み方はBC_STORE_INDEXと同じ）
+	BC_ASSIGN_INDEX,
+	/// 組み込み関数の呼び出し、引数は先頭から順に積む（組み込み関数番号）
+	BC_BUILTIN,
+	/// ユーザ関数の呼び出し（関数名番号、引数の数）
+	BC_CALL,
+	/// 末尾位置でのユーザ関数の呼び出し（関数名番号、引数の数）
+	BC_TAIL_CALL,
+	/// 関数から戻る
+	BC_RETURN,
+	/// 無条件ジャンプ（次の命令からの相対位置）
+	BC_JUMP,
+	/// スタックトップの値が0ならジャンプ（次の命令からの相対位置）
+	BC_JUMP_IF_FALSE,
+	/// スタックトップの値が0でなければジャンプ（次の命令からの相対位置）
+	BC_JUMP_IF_TRUE,
+	/// スタックトップの値が0なら残してジャンプし、0でなければ捨てる（次の命令からの相対位置）
+	BC_AND,
+	/// スタックトップの値が0でなければ1に置き換えてジャンプし、0なら捨てる（次の命令からの相対位置）
+	BC_OR,
+	/// スタックトップの値から最小値を引いた値kが表の大きさ未満なら、直後に並ぶジャンプのk+1番目に進み、そうでなければ先頭（default）に進む（最小値、表の大きさ）
+	BC_SWITCH,
+	/// 関数を定義する（関数番号）
+	BC_DEFINE,
+	/// プログラムの終了
+	BC_HALT,
+} BC_OPCODE;
+
+/// バイトコードに変換した関数（トップレベルのコードを含む）
+typedef struct bc_function
+{
+	/// 関数名
+	char *name;
+	/// 関数名番号（呼び出し命令のオペランド）
+	int name_id;
+	/// 引数の数
+	int argc;
+	/// memo指定の有無
+	BOOL memo;
+	/// 変数名（添字がスロット番号、先頭に引数が並ぶ）
+	char **slot_names;
+	/// 変数の数
+	int nslots;
+	/// 確保済みの変数の数
+	int slot_capacity;
+	/// 命令列
+	int *code;
+	/// 命令列の長さ
+	int count;
+	/// 確保済みの命令列の長さ
+	int capacity;
+	/// 演算スタックの最大の深さ
+	int max_stack;
+	/// func文の位置
+	int start_pc;
+	/// 対応するendの位置
+	int end_pc;
+} BcFunction;
+
+/// バイトコードに変換したプログラム
+typedef struct bc_module
+{
+	/// トップレベルのコード（変数はグローバル変数）
+	BcFunction *main;
+	/// func文ごとの関数（添字が関数番号）
+	BcFunction **funcs;
+	/// 関数の数
+	int nfuncs;
+	/// 確保済みの関数の数
+	int func_capacity;
+	/// 呼び出される関数名（添字が関数名番号）
+	char **names;
+	/// 関数名の数
+	int nnames;
+	/// 確保済みの関数名の数
+	int name_capacity;
+	/// 関数名から関数名番号を引くハッシュテーブル（関数名番号+1、0なら空き、キャッシュから読み込んだプログラムではNULL）
+	int *name_index;
+	/// ハッシュテーブルの容量（2のべき乗）
+	int name_index_capacity;
+	/// 割り当てたキャッシュファイル（NULLでなければ命令列と名前はこの中を指す）
+	void *mapping;
+	/// キャッシュファイルの大きさ
+	size_t mapping_size;
+} BcModule;
+
+BcModule *compileModule(void);
+void releaseModule(BcModule *);
+int getBcLength(int);
+BOOL isBcJump(int);
+int getBcTarget(BcFunction *, int);
+unsigned char *analyzeDefinedSlots(BcFunction *);
+BOOL mayReadUndefined(BcFunction *);
+
+#endif
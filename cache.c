@@ -0,0 +1,714 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "builtin.h"
+
+/// 書き出し中のキャッシュファイルの初期容量
+#define CACHE_BUFFER_INIT_SIZE (4096)
+
+/// キャッシュファイルの先頭（オフセットはファイルの先頭からのバイト数）
+typedef struct cache_header
+{
+	/// 識別子（CACHE_MAGIC）
+	char magic[8];
+	/// 形式の版数
+	int32_t version;
+	/// バイトコードの命令数（命令を追加したら読み込まない）
+	int32_t opcodes;
+	/// 組み込み関数の数（組み込み関数番号がずれたら読み込まない）
+	int32_t builtins;
+	/// ソースファイルの内容のハッシュ値
+	uint64_t hash;
+	/// ソースファイルの大きさ
+	uint64_t source_size;
+	/// 先頭より後ろの内容のハッシュ値（壊れたファイルを読み込まない）
+	uint64_t checksum;
+	/// ファイル全体の大きさ
+	int32_t size;
+	/// 関数の数（トップレベルのコードを含まない）
+	int32_t nfuncs;
+	/// 関数の表（トップレベルのコードを先頭に関数番号順に並ぶ）
+	int32_t funcs;
+	/// 関数名の数
+	int32_t nnames;
+	/// 関数名の表（関数名番号順の文字列のオフセット）
+	int32_t names;
+} CacheHeader;
+
+/// キャッシュファイル中の関数
+typedef struct cache_function
+{
+	/// 関数名の文字列
+	int32_t name;
+	/// 関数名番号
+	int32_t name_id;
+	/// 引数の数
+	int32_t argc;
+	/// memo指定の有無
+	int32_t memo;
+	/// 変数の数
+	int32_t nslots;
+	/// 変数名の表（スロット番号順の文字列のオフセット）
+	int32_t slot_names;
+	/// 命令列
+	int32_t code;
+	/// 命令列の長さ
+	int32_t count;
+	/// 演算スタックの最大の深さ
+	int32_t max_stack;
+	/// func文の位置
+	int32_t start_pc;
+	/// 対応するendの位置
+	int32_t end_pc;
+} CacheFunction;
+
+/// 書き出し中のキャッシュファイル
+typedef struct cache_buffer
+{
+	/// 内容
+	unsigned char *bytes;
+	/// 長さ
+	size_t count;
+	/// 確保済みの長さ
+	size_t capacity;
+} CacheBuffer;
+
+/// 実行中のプログラムのキャッシュ
+typedef struct program_cache
+{
+	/// キャッシュファイルのパス（NULLならキャッシュを使わない）
+	char *path;
+	/// ソースファイルの内容のハッシュ値
+	uint64_t hash;
+	/// ソースファイルの大きさ
+	uint64_t source_size;
+	/// 割り当てたキャッシュファイル（NULLなら読み込んでいない）
+	void *mapping;
+	/// キャッシュファイルの大きさ
+	size_t size;
+	/// キャッシュファイルから取り出したプログラム（NULLなら取り出していないか受け渡し済み）
+	BcModule *module;
+} ProgramCache;
+
+static ProgramCache cache;
+
+static BcModule *readModule(void);
+
+/**
+ * @brief ソースファイルの内容のハッシュ値を求める（FNV-1a）
+ * @param bytes 内容
+ * @param size 大きさ
+ * @return ハッシュ値
+ */
+static uint64_t hashSource(const unsigned char *bytes, size_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+};
+
+/**
+ * @brief ファイル中の範囲が正しいかどうかを判定する
+ * @param offset 先頭のオフセット
+ * @param length 長さ
+ * @return ファイルに収まるかどうか
+ */
+static BOOL checkRange(int32_t offset, size_t length)
+{
+	return offset >= 0 && (size_t)offset <= cache.size && length <= cache.size - (size_t)offset && 0 == offset % sizeof(int32_t);
+};
+
+/**
+ * @brief ファイル中の文字列を取得する
+ * @param offset 文字列のオフセット
+ * @retval NULL ファイルに収まらない
+ * @retval Other 文字列
+ */
+static char *getString(int32_t offset)
+{
+	char *base = (char *)cache.mapping;
+
+	if (!checkRange(offset, 1) || NULL == memchr(base + offset, '\0', cache.size - (size_t)offset))
+	{
+		return NULL;
+	}
+	return base + offset;
+};
+
+/**
+ * @brief キャッシュファイルを割り当て、ソースファイルに対応するか確かめる
+ * @return 使えるキャッシュファイルかどうか
+ */
+static BOOL mapCache(void)
+{
+	struct stat st;
+	int fd = open(cache.path, O_RDONLY);
+
+	if (fd < 0)
+	{
+		return FALSE;
+	}
+	if (0 != fstat(fd, &st) || (size_t)st.st_size < sizeof(CacheHeader))
+	{
+		close(fd);
+		return FALSE;
+	}
+
+	void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == mapping)
+	{
+		return FALSE;
+	}
+
+	CacheHeader *h = (CacheHeader *)mapping;
+	if (0 != memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) || CACHE_VERSION != h->version || BC_HALT + 1 != h->opcodes || getBuiltinCount() != h->builtins ||
+		cache.hash != h->hash || cache.source_size != h->source_size || st.st_size != h->size ||
+		hashSource((unsigned char *)mapping + sizeof(CacheHeader), st.st_size - sizeof(CacheHeader)) != h->checksum)
+	{
+		munmap(mapping, st.st_size);
+		return FALSE;
+	}
+
+	cache.mapping = mapping;
+	cache.size = st.st_size;
+	return TRUE;
+};
+
+/**
+ * @brief ソースファイルに対応するキャッシュファイルを開く
+ * @param source ソースファイルのパス
+ * @param dir キャッシュディレクトリ（NULLならソースファイルの隣に置く）
+ * @return 使えるキャッシュファイルがあったかどうか（なければ変換後に書き出す）
+ * @details 壊れたキャッシュファイルでソースファイルを読み飛ばさないよう、開くときに中身まで確かめる
+ */
+BOOL openProgramCache(char *source, char *dir)
+{
+	FILE *fp = fopen(source, "rb");
+	if (!fp)
+	{
+		return FALSE;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	unsigned char *bytes = (unsigned char *)malloc(size + 1);
+	size_t read = fread(bytes, 1, size, fp);
+	fclose(fp);
+
+	cache.hash = hashSource(bytes, read);
+	cache.source_size = read;
+	free(bytes);
+
+	// キャッシュディレクトリでは内容のハッシュ値をファイル名にする
+	if (dir)
+	{
+		size_t length = strlen(dir) + 16 + strlen(CACHE_EXTENSION) + 2;
+		cache.path = (char *)malloc(length);
+		snprintf(cache.path, length, "%s/%016llx%s", dir, (unsigned long long)cache.hash, CACHE_EXTENSION);
+		mkdir(dir, 0755);
+	}
+	else
+	{
+		size_t length = strlen(source) + strlen(CACHE_SUFFIX) + 1;
+		cache.path = (char *)malloc(length);
+		snprintf(cache.path, length, "%s%s", source, CACHE_SUFFIX);
+	}
+
+	if (FALSE == mapCache())
+	{
+		return FALSE;
+	}
+	cache.module = readModule();
+	return NULL != cache.module;
+};
+
+/**
+ * @brief キャッシュを閉じる
+ */
+void closeProgramCache(void)
+{
+	if (cache.module)
+	{
+		releaseModule(cache.module);
+	}
+	if (cache.mapping)
+	{
+		munmap(cache.mapping, cache.size);
+	}
+	free(cache.path);
+	memset(&cache, 0, sizeof(cache));
+};
+
+/**
+ * @brief 命令のオペランドが範囲内かどうかを判定する
+ * @param code 命令列
+ * @param count 命令列の長さ
+ * @param pos 命令の位置（命令全体が命令列に収まること）
+ * @param nslots 変数の数
+ * @param max_stack 演算スタックの最大の深さ
+ * @param h キャッシュファイルの先頭
+ * @return 判定結果
+ */
+static BOOL checkOperand(int32_t *code, int count, int pos, int nslots, int max_stack, CacheHeader *h)
+{
+	int op = code[pos];
+	int operand = getBcLength(op) > 1 ? code[pos + 1] : 0;
+
+	if (BC_LOAD == op || BC_STORE == op || (op >= BC_ASSIGN_ADD && op <= BC_ASSIGN_SHR))
+	{
+		return operand >= 0 && operand < nslots;
+	}
+	if (isBcJump(op))
+	{
+		return operand >= -(pos + 2) && operand < count - (pos + 2);
+	}
+	if (BC_ASSIGN_INDEX == op)
+	{
+		return operand >= BC_ADD && operand <= BC_SHR;
+	}
+	if (BC_BUILTIN == op)
+	{
+		return operand >= 0 && operand < getBuiltinCount();
+	}
+	if (BC_CALL == op || BC_TAIL_CALL == op)
+	{
+		return operand >= 0 && operand < h->nnames && code[pos + 2] >= 0 && code[pos + 2] <= max_stack;
+	}
+	if (BC_DEFINE == op)
+	{
+		return operand >= 0 && operand < h->nfuncs;
+	}
+	if (BC_SWITCH == op)
+	{
+		// 直後に既定の飛び先と表の大きさの数のジャンプが並ぶ
+		int size = code[pos + 2];
+		if (size < 0 || size >= (count - pos) / 2)
+		{
+			return FALSE;
+		}
+		for (int i = 0; i <= size; i++)
+		{
+			if (BC_JUMP != code[pos + 3 + 2 * i])
+			{
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+};
+
+/**
+ * @brief 命令が演算スタックから取り出す値の数を取得する
+ * @param code 命令列
+ * @param pos 命令の位置
+ * @return 取り出す値の数（残す値は取り出して積み直すものとして数える）
+ */
+static int getPopCount(int32_t *code, int pos)
+{
+	int op = code[pos];
+
+	if (op >= BC_ADD && op <= BC_NE)
+	{
+		return 2;
+	}
+	switch (op)
+	{
+	case BC_CONST:
+	case BC_LOAD:
+	case BC_EXIT:
+	case BC_JUMP:
+	case BC_DEFINE:
+	case BC_HALT:
+		return 0;
+	case BC_INDEX:
+		return 2;
+	case BC_STORE_INDEX:
+	case BC_ASSIGN_INDEX:
+		return 3;
+	case BC_BUILTIN:
+		return getBuiltin(code[pos + 1])->argc;
+	case BC_CALL:
+	case BC_TAIL_CALL:
+		return code[pos + 2];
+	default:
+		return 1;
+	}
+};
+
+/**
+ * @brief 命令が演算スタックに積む値の数を取得する
+ * @param op 命令
+ * @return 積む値の数（分岐する命令は次の命令に進むときの数）
+ */
+static int getPushCount(int op)
+{
+	switch (op)
+	{
+	case BC_POP:
+	case BC_EXIT:
+	case BC_RETURN:
+	case BC_JUMP:
+	case BC_JUMP_IF_FALSE:
+	case BC_JUMP_IF_TRUE:
+	case BC_AND:
+	case BC_OR:
+	case BC_SWITCH:
+	case BC_DEFINE:
+	case BC_HALT:
+		return 0;
+	default:
+		return 1;
+	}
+};
+
+/**
+ * @brief 飛び先の演算スタックの深さを記録する
+ * @param heights 位置ごとの深さ（-1なら未到達）
+ * @param pending 未処理の位置
+ * @param npending 未処理の位置の数
+ * @param target 飛び先（命令の先頭であること）
+ * @param height 深さ
+ * @return 到達済みの深さと一致するかどうか
+ */
+static BOOL reachCode(int *heights, int *pending, int *npending, int target, int height)
+{
+	if (heights[target] < 0)
+	{
+		heights[target] = height;
+		pending[(*npending)++] = target;
+		return TRUE;
+	}
+	return heights[target] == height;
+};
+
+/**
+ * @brief 命令列が正しいかどうかを判定する
+ * @param code 命令列
+ * @param count 命令列の長さ
+ * @param nslots 変数の数
+ * @param max_stack 演算スタックの最大の深さ
+ * @param h キャッシュファイルの先頭
+ * @return 判定結果
+ * @details 読み込むときに一度だけ、オペランドの範囲と、どの経路でも演算スタックの深さが
+ *          0〜max_stackに収まって合流点で一致することを確かめ、実行時には確かめない
+ */
+static BOOL checkCode(int32_t *code, int count, int nslots, int max_stack, CacheHeader *h)
+{
+	int *heights = (int *)malloc(count * sizeof(int));
+	int *pending = (int *)malloc(count * sizeof(int));
+	int npending = 0;
+	BOOL valid = TRUE;
+
+	// 命令の先頭以外は到達できない位置として-2にする
+	for (int pos = 0; pos < count; pos++)
+	{
+		heights[pos] = -2;
+	}
+	for (int pos = 0; valid && pos < count; pos += getBcLength(code[pos]))
+	{
+		int op = code[pos];
+		valid = op >= 0 && op <= BC_HALT && pos + getBcLength(op) <= count && checkOperand(code, count, pos, nslots, max_stack, h);
+		heights[pos] = -1;
+	}
+
+	valid = valid && reachCode(heights, pending, &npending, 0, 0);
+	while (valid && npending > 0)
+	{
+		int pos = pending[--npending];
+		int op = code[pos];
+		int next = pos + getBcLength(op);
+		int height = heights[pos] - getPopCount(code, pos);
+		if (height < 0 || height + getPushCount(op) > max_stack)
+		{
+			valid = FALSE;
+			break;
+		}
+
+		if (isBcJump(op))
+		{
+			// 論理演算は飛ぶときに値を残す
+			int target = next + code[pos + 1];
+			valid = heights[target] >= -1 && reachCode(heights, pending, &npending, target, height + (BC_AND == op || BC_OR == op));
+		}
+		else if (BC_SWITCH == op)
+		{
+			for (int i = 0; valid && i <= code[pos + 2]; i++)
+			{
+				valid = reachCode(heights, pending, &npending, next + 2 * i, height);
+			}
+			continue;
+		}
+
+		// 関数の外のreturnはエラーを表示して次に進む
+		BOOL falls = BC_JUMP != op && BC_EXIT != op && BC_HALT != op && (BC_RETURN != op || next < count);
+		if (valid && falls)
+		{
+			valid = next < count && reachCode(heights, pending, &npending, next, height + getPushCount(op));
+		}
+	}
+
+	free(heights);
+	free(pending);
+	return valid;
+};
+
+/**
+ * @brief キャッシュファイル中の関数を取り出す
+ * @param cf キャッシュファイル中の関数
+ * @param h キャッシュファイルの先頭
+ * @retval NULL 壊れている
+ * @retval Other 関数（命令列と名前はキャッシュファイルを直接指す）
+ */
+static BcFunction *loadFunction(CacheFunction *cf, CacheHeader *h)
+{
+	char *base = (char *)cache.mapping;
+
+	if (cf->count <= 0 || cf->nslots < cf->argc || cf->argc < 0 || !checkRange(cf->code, cf->count * sizeof(int32_t)) ||
+		!checkRange(cf->slot_names, cf->nslots * sizeof(int32_t)) || NULL == getString(cf->name) || cf->max_stack < 0 || cf->max_stack > cf->count ||
+		cf->name_id < -1 || cf->name_id >= h->nnames || !checkCode((int32_t *)(base + cf->code), cf->count, cf->nslots, cf->max_stack, h))
+	{
+		return NULL;
+	}
+
+	BcFunction *f = (BcFunction *)calloc(1, sizeof(BcFunction));
+	f->name = getString(cf->name);
+	f->name_id = cf->name_id;
+	f->argc = cf->argc;
+	f->memo = (BOOL)cf->memo;
+	f->nslots = cf->nslots;
+	f->slot_capacity = cf->nslots;
+	f->slot_names = (char **)malloc((cf->nslots + 1) * sizeof(char *));
+	f->code = (int *)(base + cf->code);
+	f->count = cf->count;
+	f->capacity = cf->count;
+	f->max_stack = cf->max_stack;
+	f->start_pc = cf->start_pc;
+	f->end_pc = cf->end_pc;
+
+	int32_t *slot_names = (int32_t *)(base + cf->slot_names);
+	for (int i = 0; i < cf->nslots; i++)
+	{
+		if (NULL == (f->slot_names[i] = getString(slot_names[i])))
+		{
+			free(f->slot_names);
+			free(f);
+			return NULL;
+		}
+	}
+	return f;
+};
+
+/**
+ * @brief 割り当てたキャッシュファイルからプログラムを取り出す
+ * @retval NULL 壊れている（割り当ては解除する）
+ * @retval Other プログラム（releaseModuleで破棄するとキャッシュファイルの割り当ても解除する）
+ */
+static BcModule *readModule(void)
+{
+	char *base = (char *)cache.mapping;
+	CacheHeader *h = (CacheHeader *)cache.mapping;
+	if (h->nfuncs < 0 || h->nnames < 0 || !checkRange(h->funcs, (h->nfuncs + 1) * sizeof(CacheFunction)) ||
+		!checkRange(h->names, h->nnames * sizeof(int32_t)))
+	{
+		munmap(cache.mapping, cache.size);
+		cache.mapping = NULL;
+		return NULL;
+	}
+
+	BcModule *m = (BcModule *)calloc(1, sizeof(BcModule));
+	CacheFunction *funcs = (CacheFunction *)(base + h->funcs);
+	int32_t *names = (int32_t *)(base + h->names);
+
+	m->mapping = cache.mapping;
+	m->mapping_size = cache.size;
+	m->funcs = (BcFunction **)calloc(h->nfuncs + 1, sizeof(BcFunction *));
+	m->func_capacity = h->nfuncs + 1;
+	m->names = (char **)calloc(h->nnames + 1, sizeof(char *));
+	m->name_capacity = h->nnames + 1;
+
+	BOOL valid = NULL != (m->main = loadFunction(&funcs[0], h));
+	for (int i = 0; valid && i < h->nfuncs; i++)
+	{
+		valid = NULL != (m->funcs[m->nfuncs] = loadFunction(&funcs[i + 1], h));
+		m->nfuncs += valid;
+	}
+	for (int i = 0; valid && i < h->nnames; i++)
+	{
+		valid = NULL != (m->names[m->nnames] = getString(names[i]));
+		m->nnames += valid;
+	}
+
+	// 割り当ての解除はプログラムの破棄に任せる
+	cache.mapping = NULL;
+	if (!valid)
+	{
+		releaseModule(m);
+		return NULL;
+	}
+	return m;
+};
+
+/**
+ * @brief 開いたキャッシュファイルから取り出したプログラムを受け取る
+ * @retval NULL キャッシュファイルがない
+ * @retval Other プログラム（releaseModuleで破棄するとキャッシュファイルの割り当ても解除する）
+ */
+BcModule *loadCachedModule(void)
+{
+	BcModule *m = cache.module;
+	cache.module = NULL;
+	return m;
+};
+
+/**
+ * @brief キャッシュファイルの内容を追加する
+ * @param b 書き出し中のキャッシュファイル
+ * @param data 内容
+ * @param n 大きさ
+ * @return 追加した位置のオフセット（4バイト境界に揃える）
+ */
+static int32_t putBytes(CacheBuffer *b, const void *data, size_t n)
+{
+	size_t offset = (b->count + sizeof(int32_t) - 1) / sizeof(int32_t) * sizeof(int32_t);
+
+	while (offset + n > b->capacity)
+	{
+		b->capacity *= 2;
+		b->bytes = (unsigned char *)realloc(b->bytes, b->capacity);
+	}
+	memset(b->bytes + b->count, 0, offset - b->count);
+	if (n > 0)
+	{
+		memcpy(b->bytes + offset, data, n);
+	}
+	b->count = offset + n;
+	return (int32_t)offset;
+};
+
+/**
+ * @brief 文字列の表を追加する
+ * @param b 書き出し中のキャッシュファイル
+ * @param strings 文字列
+ * @param n 文字列の数
+ * @return 表のオフセット
+ */
+static int32_t putStrings(CacheBuffer *b, char **strings, int n)
+{
+	int32_t *offsets = (int32_t *)malloc((n + 1) * sizeof(int32_t));
+
+	for (int i = 0; i < n; i++)
+	{
+		offsets[i] = putBytes(b, strings[i], strlen(strings[i]) + 1);
+	}
+	int32_t table = putBytes(b, offsets, n * sizeof(int32_t));
+	free(offsets);
+	return table;
+};
+
+/**
+ * @brief 変換したプログラムをキャッシュファイルに書き出す
+ * @param m プログラム
+ * @details 書き出しに失敗してもキャッシュを使わないだけでエラーにはしない
+ */
+void saveCachedModule(BcModule *m)
+{
+	if (NULL == cache.path || m->mapping)
+	{
+		return;
+	}
+
+	CacheBuffer b;
+	CacheHeader h;
+	CacheFunction *funcs = (CacheFunction *)calloc(m->nfuncs + 1, sizeof(CacheFunction));
+
+	b.capacity = CACHE_BUFFER_INIT_SIZE;
+	b.count = 0;
+	b.bytes = (unsigned char *)malloc(b.capacity);
+	memset(&h, 0, sizeof(h));
+	putBytes(&b, &h, sizeof(h));
+
+	for (int i = 0; i <= m->nfuncs; i++)
+	{
+		BcFunction *f = 0 == i ? m->main : m->funcs[i - 1];
+		CacheFunction *cf = &funcs[i];
+		cf->name = putBytes(&b, f->name, strlen(f->name) + 1);
+		cf->name_id = f->name_id;
+		cf->argc = f->argc;
+		cf->memo = f->memo;
+		cf->nslots = f->nslots;
+		cf->slot_names = putStrings(&b, f->slot_names, f->nslots);
+		cf->code = putBytes(&b, f->code, f->count * sizeof(int32_t));
+		cf->count = f->count;
+		cf->max_stack = f->max_stack;
+		cf->start_pc = f->start_pc;
+		cf->end_pc = f->end_pc;
+	}
+
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.version = CACHE_VERSION;
+	h.opcodes = BC_HALT + 1;
+	h.builtins = getBuiltinCount();
+	h.hash = cache.hash;
+	h.source_size = cache.source_size;
+	h.nfuncs = m->nfuncs;
+	h.funcs = putBytes(&b, funcs, (m->nfuncs + 1) * sizeof(CacheFunction));
+	h.nnames = m->nnames;
+	h.names = putStrings(&b, m->names, m->nnames);
+	h.size = (int32_t)b.count;
+	h.checksum = hashSource(b.bytes + sizeof(h), b.count - sizeof(h));
+	memcpy(b.bytes, &h, sizeof(h));
+	free(funcs);
+
+	// 書き終えてから置き換え、読み込み中の実行に途中までのファイルを見せない
+	size_t length = strlen(cache.path) + 32;
+	char *temp = (char *)malloc(length);
+	snprintf(temp, length, "%s.%d.tmp", cache.path, (int)getpid());
+	FILE *fp = fopen(temp, "wb");
+	if (fp)
+	{
+		BOOL written = b.count == fwrite(b.bytes, 1, b.count, fp);
+		if (0 == fclose(fp) && written)
+		{
+			rename(temp, cache.path);
+		}
+		remove(temp);
+	}
+	free(temp);
+	free(b.bytes);
+};
+
+/**
+ * @brief キャッシュファイルから取り出したプログラムを破棄する
+ * @param m プログラム
+ */
+void releaseCachedModule(BcModule *m)
+{
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		free(m->funcs[i]->slot_names);
+		free(m->funcs[i]);
+	}
+	if (m->main)
+	{
+		free(m->main->slot_names);
+		free(m->main);
+	}
+	free(m->funcs);
+	free(m->names);
+	munmap(m->mapping, m->mapping_size);
+	free(m);
+};
@@ -0,0 +1,25 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "bytecode.h"
+#include "particle.h"
+
+/// キャッシュファイルの識別子
+#define CACHE_MAGIC "PARTCACH"
+
+/// キャッシュファイルの形式の版数（形式を変えたら上げる、命令の追加は命令数で判別する）
+#define CACHE_VERSION (3)
+
+/// ソースファイルの隣に置くキャッシュファイルの接尾辞（sample.par → sample.parc）
+#define CACHE_SUFFIX "c"
+
+/// キャッシュディレクトリに置くキャッシュファイルの拡張子
+#define CACHE_EXTENSION ".parc"
+
+BOOL openProgramCache(char *, char *);
+void closeProgramCache(void);
+BcModule *loadCachedModule(void);
+void saveCachedModule(BcModule *);
+void releaseCachedModule(BcModule *);
+
+#endif
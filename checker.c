@@ -152,6 +152,14 @@ static BOOL caseNumber(Token *tokens)
  */
 static BOOL caseOperation(Token *tokens)
 {
+	// 添字は配列の変数の直後にだけ書ける
+	if (EQ(tokens->value.string, "[]") && (NULL == tokens->prev || TK_VARIABLE != tokens->prev->type))
+	{
+		printError("error : ");
+		printf("\"[\" must follow array variable\n");
+		return FALSE;
+	}
+
 	return hasNextToken(tokens) && checkNextTokenType(tokens, TK_VARIABLE, TK_NUMBER, TK_UNARY_OP, TK_LEFT_BK, TK_FUNCTION);
 };
 
@@ -280,6 +288,27 @@ static BOOL caseKeyword(Token *tokens)
 	{
 		return hasNextToken(tokens) && checkNextTokenType(tokens, TK_FUNCTION);
 	}
+	else if (EQ(keyword, "memo"))
+	{
+		if (FALSE == hasNextToken(tokens))
+		{
+			return FALSE;
+		}
+
+		Token *next = tokens->next;
+		if (TK_KEYWORD != next->type || !EQ(next->value.string, "func"))
+		{
+			printError("error : ");
+			printTokenValue(next);
+			printf(" is unexpected token\n");
+			return FALSE;
+		}
+		return TRUE;
+	}
+	else if (EQ(keyword, "const"))
+	{
+		return hasNextToken(tokens) && checkNextTokenType(tokens, TK_VARIABLE);
+	}
 	else if (EQ(keyword, "end"))
 	{
 		return isLastToken(tokens);
@@ -288,7 +317,7 @@ static BOOL caseKeyword(Token *tokens)
 	{
 		return checkNextTokenType(tokens, TK_VARIABLE, TK_NUMBER, TK_UNARY_OP, TK_LEFT_BK, TK_FUNCTION);
 	}
-	else if (EQ(keyword, "if") || EQ(keyword, "while"))
+	else if (isStrMatch(keyword, "if", "while", "switch"))
 	{
 		Token *last = getLastToken(tokens);
 		if (TK_RIGHT_BK != last->type)
@@ -300,7 +329,15 @@ static BOOL caseKeyword(Token *tokens)
 
 		return hasNextToken(tokens) && checkNextTokenType(tokens, TK_LEFT_BK);
 	}
-	else if (EQ(keyword, "else"))
+	else if (EQ(keyword, "for"))
+	{
+		return hasNextToken(tokens) && checkNextTokenType(tokens, TK_VARIABLE);
+	}
+	else if (EQ(keyword, "case"))
+	{
+		return hasNextToken(tokens) && checkNextTokenType(tokens, TK_NUMBER, TK_UNARY_OP);
+	}
+	else if (isStrMatch(keyword, "else", "default", "break", "continue"))
 	{
 		return isLastToken(tokens);
 	}
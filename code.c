@@ -0,0 +1,1079 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "code.h"
+#include "builtin.h"
+#include "const.h"
+#include "threaded.h"
+#include "lexer.h"
+#include "mem.h"
+#include "util.h"
+#include "particle.h"
+
+/// 命令列の初期容量
+#define INSN_INIT_SIZE (8)
+
+/// 中間コードのキャッシュの初期容量
+#define CODE_CACHE_INIT_SIZE (256)
+
+/// 中間コードのキャッシュ
+typedef struct code_cache
+{
+	/// 各行の中間コード（添字がプログラムカウンタ）
+	LineCode **lines;
+	/// 確保済みの行数
+	int capacity;
+	/// 変換に失敗した行があったかどうか
+	BOOL failed;
+} CodeCache;
+
+static CodeCache cache;
+
+static BOOL compileExpr(LineCode *, Ast *);
+static BOOL compileCondition(LineCode *, Ast *);
+static BOOL isOperation(Ast *, char *);
+
+/**
+ * @brief 命令列の末尾に命令を追加する
+ * @param code 中間コード
+ * @param op 命令の種類
+ * @return 追加した命令
+ */
+Insn *emit(LineCode *code, OPCODE op)
+{
+	if (code->count == code->capacity)
+	{
+		code->capacity = code->capacity ? code->capacity * 2 : INSN_INIT_SIZE;
+		code->insns = (Insn *)realloc(code->insns, code->capacity * sizeof(Insn));
+	}
+
+	Insn *insn = &code->insns[code->count++];
+	memset(insn, 0, sizeof(Insn));
+	insn->op = op;
+	return insn;
+};
+
+/**
+ * @brief 関数呼び出しの引数を評価する命令を追加する
+ * @param code 中間コード
+ * @param node 引数となる抽象構文木
+ * @param argc 引数の数の格納先
+ * @return 成否
+ * @details 引数は右から順に評価し、スタックには仮引数リストの順に積まれる
+ */
+static BOOL compileArgs(LineCode *code, Ast *node, int *argc)
+{
+	*argc = 0;
+
+	while (node)
+	{
+		Ast *arg = node;
+
+		if (node->root->type == TK_OPERATION && EQ(node->root->value.string, ","))
+		{
+			arg = node->right;
+			node = node->left;
+		}
+		else
+		{
+			node = NULL;
+		}
+
+		if (FALSE == compileExpr(code, arg))
+		{
+			return FALSE;
+		}
+		(*argc)++;
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief ユーザ関数の呼び出しかどうかを判定する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @return 判定結果
+ */
+static BOOL isUserCall(LineCode *code, Ast *node)
+{
+	return node && TK_FUNCTION == node->root->type && !isStrMatch(node->root->value.string, "print", "exit") && !isBuiltinName(node->root->value.string, code->pc);
+};
+
+/**
+ * @brief ユーザ関数の呼び出しを中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @param op 呼び出し命令の種類
+ * @return 成否
+ */
+static BOOL compileCall(LineCode *code, Ast *node, OPCODE op)
+{
+	int argc;
+	if (FALSE == compileArgs(code, node->left, &argc))
+	{
+		return FALSE;
+	}
+
+	// 呼び出す関数は初回実行時に解決する
+	Insn *insn = emit(code, op);
+	insn->name = node->root->value.string;
+	insn->number = argc;
+	insn->func = NULL;
+
+	return TRUE;
+};
+
+/**
+ * @brief 組み込み関数の引数を評価する命令を追加する
+ * @param code 中間コード
+ * @param node 引数となる抽象構文木
+ * @param argc 引数の数の格納先（0にしておく）
+ * @return 成否
+ * @details 引数は左から順に評価し、スタックには先頭の引数から順に積まれる
+ */
+static BOOL compileBuiltinArgs(LineCode *code, Ast *node, int *argc)
+{
+	if (NULL == node)
+	{
+		return TRUE;
+	}
+
+	if (isOperation(node, ","))
+	{
+		if (FALSE == compileBuiltinArgs(code, node->left, argc))
+		{
+			return FALSE;
+		}
+		node = node->right;
+	}
+
+	(*argc)++;
+	return compileExpr(code, node);
+};
+
+/**
+ * @brief 組み込み関数の呼び出しを中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @return 成否
+ */
+static BOOL compileBuiltin(LineCode *code, Ast *node)
+{
+	char *name = node->root->value.string;
+	int argc = 0;
+	int start = code->count;
+
+	if (FALSE == compileBuiltinArgs(code, node->left, &argc))
+	{
+		return FALSE;
+	}
+
+	int index = findBuiltin(name, argc);
+	if (index < 0)
+	{
+		printError("error : ");
+		printf("built-in function \"%s\" doesn't take %d argument(s)\n", name, argc);
+		return FALSE;
+	}
+
+	// 純粋な組み込み関数の引数がすべて定数なら変換時に呼び出す
+	Builtin *builtin = getBuiltin(index);
+	if (builtin->pure && argc > 0 && code->count == start + argc)
+	{
+		int args[argc];
+		int i = 0;
+		while (i < argc && OP_NUMBER == code->insns[start + i].op)
+		{
+			args[i] = code->insns[start + i].number;
+			i++;
+		}
+		int value;
+		if (i == argc && builtin->func(args, &value))
+		{
+			code->insns[start].number = value;
+			code->count = start + 1;
+			return TRUE;
+		}
+	}
+
+	emit(code, OP_BUILTIN)->number = index;
+	return TRUE;
+};
+
+/**
+ * @brief 関数トークンを節とする式を中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @return 成否
+ */
+static BOOL compileFunction(LineCode *code, Ast *node)
+{
+	char *name = node->root->value.string;
+
+	if (EQ(name, "print"))
+	{
+		if (FALSE == compileExpr(code, node->left))
+		{
+			return FALSE;
+		}
+		emit(code, OP_PRINT);
+		return TRUE;
+	}
+	else if (EQ(name, "exit"))
+	{
+		emit(code, OP_EXIT);
+		return TRUE;
+	}
+	else if (isBuiltinName(name, code->pc))
+	{
+		return compileBuiltin(code, node);
+	}
+
+	return compileCall(code, node, OP_CALL);
+};
+
+/**
+ * @brief 論理演算子（&&、||）を節とする式かどうかを判定する
+ * @param node 抽象構文木
+ * @return 判定結果
+ */
+static BOOL isLogical(Ast *node)
+{
+	return node && TK_OPERATION == node->root->type && isStrMatch(node->root->value.string, "&&", "||");
+};
+
+/**
+ * @brief 値が0か1になる式かどうかを判定する
+ * @param node 抽象構文木
+ * @return 判定結果
+ */
+static BOOL isBooleanExpr(Ast *node)
+{
+	if (NULL == node)
+	{
+		return FALSE;
+	}
+	if (TK_UNARY_OP == node->root->type)
+	{
+		return EQ(node->root->value.string, "!");
+	}
+	return TK_OPERATION == node->root->type && isStrMatch(node->root->value.string, "<", ">", "<=", ">=", "==", "!=", "&&", "||");
+};
+
+/**
+ * @brief 論理演算子を節とする式を、右辺を評価するかどうかの分岐を含む中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @param value 式の値を使うかどうか（偽なら真偽だけを使う条件式とし、値を0か1にそろえない）
+ * @return 成否
+ * @details 左辺で結果が決まれば右辺を評価せずに式の終わりへ飛ぶ。
+ *          同じ演算子が続くときは、左辺の中の分岐も式の終わりへ直接飛ばす
+ */
+static BOOL compileLogical(LineCode *code, Ast *node, BOOL value)
+{
+	OPCODE op = EQ(node->root->value.string, "&&") ? OP_AND : OP_OR;
+	int left = code->count;
+
+	if (FALSE == compileCondition(code, node->left))
+	{
+		return FALSE;
+	}
+
+	int at = code->count;
+	emit(code, op);
+
+	if (FALSE == (value ? compileExpr(code, node->right) : compileCondition(code, node->right)))
+	{
+		return FALSE;
+	}
+	if (value && FALSE == isBooleanExpr(node->right))
+	{
+		emit(code, OP_NUMBER)->number = 0;
+		Insn *insn = emit(code, OP_BINARY);
+		insn->name = "!=";
+		insn->calc = getEngineFunc(insn->name);
+	}
+
+	for (int i = left; i <= at; i++)
+	{
+		Insn *insn = &code->insns[i];
+		if (op == insn->op && (i == at || i + 1 + insn->number == at))
+		{
+			insn->number = code->count - (i + 1);
+		}
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief 真偽だけを使う式（if文やwhile文の条件、論理演算子の左辺）を中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @return 成否
+ */
+static BOOL compileCondition(LineCode *code, Ast *node)
+{
+	if (isLogical(node))
+	{
+		return compileLogical(code, node, FALSE);
+	}
+	return compileExpr(code, node);
+};
+
+/**
+ * @brief 添字の式（a[i]）の配列と添字を積む命令を追加する
+ * @param code 中間コード
+ * @param node 演算子"[]"を節とする抽象構文木
+ * @return 成否
+ * @details 行列の添字（m[i, j]）は、行列と、行と列から求めた要素の位置を積む
+ */
+static BOOL compileIndex(LineCode *code, Ast *node)
+{
+	if (NULL == node->right)
+	{
+		printError("error : ");
+		printf("index of \"%s\" is missing\n", node->left->root->value.string);
+		return FALSE;
+	}
+
+	if (FALSE == isOperation(node->right, ","))
+	{
+		return compileExpr(code, node->left) && compileExpr(code, node->right);
+	}
+	if (isOperation(node->right->left, ","))
+	{
+		printError("error : ");
+		printf("too many indices of \"%s\"\n", node->left->root->value.string);
+		return FALSE;
+	}
+
+	// 配列の前にある変数は副作用なく何度でも読める
+	if (FALSE == compileExpr(code, node->left) || FALSE == compileExpr(code, node->left) ||
+		FALSE == compileExpr(code, node->right->left) || FALSE == compileExpr(code, node->right->right))
+	{
+		return FALSE;
+	}
+	emit(code, OP_BUILTIN)->number = findBuiltin(MATRIX_OFFSET_NAME, 3);
+	return TRUE;
+};
+
+/**
+ * @brief 演算子トークンを節とする式を中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @return 成否
+ */
+static BOOL compileOperation(LineCode *code, Ast *node)
+{
+	char *op = node->root->value.string;
+
+	if (EQ(op, ","))
+	{
+		// 左右を順に評価し、式の値は0とする
+		BOOL ret = compileExpr(code, node->left);
+		emit(code, OP_POP);
+		ret = ret && compileExpr(code, node->right);
+		emit(code, OP_POP);
+		emit(code, OP_NUMBER)->number = 0;
+		return ret;
+	}
+
+	if (EQ(op, "[]"))
+	{
+		if (FALSE == compileIndex(code, node))
+		{
+			return FALSE;
+		}
+		emit(code, OP_INDEX);
+		return TRUE;
+	}
+
+	OPERATOR_FUNC assign = getEngineAssignFunc(op);
+	if (EQ(op, "=") || assign)
+	{
+		// 配列の要素への代入は配列、添字、右辺の順に評価する
+		if (isOperation(node->left, "[]"))
+		{
+			if (FALSE == compileIndex(code, node->left) || FALSE == compileExpr(code, node->right))
+			{
+				return FALSE;
+			}
+			emit(code, OP_STORE_INDEX)->calc = assign;
+			return TRUE;
+		}
+
+		if (TK_VARIABLE != node->left->root->type)
+		{
+			printError("error : ");
+			printf("left side of \"%s\" must be variable\n", op);
+			return FALSE;
+		}
+
+		if (FALSE == compileExpr(code, node->right))
+		{
+			return FALSE;
+		}
+
+		Insn *insn = emit(code, assign ? OP_ASSIGN_OP : OP_STORE);
+		insn->name = node->left->root->value.string;
+		insn->calc = assign;
+		return TRUE;
+	}
+
+	if (isLogical(node))
+	{
+		return compileLogical(code, node, TRUE);
+	}
+
+	OPERATOR_FUNC calc = getEngineFunc(op);
+	if (NULL == calc)
+	{
+		printError("error : ");
+		printf("\"%s\" is not a binary operator\n", op);
+		return FALSE;
+	}
+
+	int start = code->count;
+	if (FALSE == compileExpr(code, node->left) || FALSE == compileExpr(code, node->right))
+	{
+		return FALSE;
+	}
+
+	// 定数どうしの演算は変換時に計算する（0と-1による除算は実行時の挙動に任せる）
+	if (code->count == start + 2 && OP_NUMBER == code->insns[start].op && OP_NUMBER == code->insns[start + 1].op)
+	{
+		int right = code->insns[start + 1].number;
+		if (FALSE == isStrMatch(op, "/", "%") || (0 != right && -1 != right))
+		{
+			code->insns[start].number = calc(code->insns[start].number, right);
+			code->count--;
+			return TRUE;
+		}
+	}
+
+	Insn *insn = emit(code, OP_BINARY);
+	insn->name = op;
+	insn->calc = calc;
+
+	return TRUE;
+};
+
+/**
+ * @brief 式を中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @return 成否
+ */
+static BOOL compileExpr(LineCode *code, Ast *node)
+{
+	// 空の式の値は0
+	if (NULL == node)
+	{
+		emit(code, OP_NUMBER)->number = 0;
+		return TRUE;
+	}
+
+	switch (node->root->type)
+	{
+	case TK_VARIABLE:
+		emit(code, OP_LOAD)->name = node->root->value.string;
+		return TRUE;
+	case TK_NUMBER:
+		emit(code, OP_NUMBER)->number = node->root->value.number;
+		return TRUE;
+	case TK_OPERATION:
+		return compileOperation(code, node);
+	case TK_UNARY_OP:
+	{
+		UNARY_OPERATOR_FUNC unary = getEngineUnaryFunc(node->root->value.string);
+		if (NULL == unary)
+		{
+			printError("error : ");
+			printf("\"%s\" is not a unary operator\n", node->root->value.string);
+			return FALSE;
+		}
+		int start = code->count;
+		if (FALSE == compileExpr(code, node->left))
+		{
+			return FALSE;
+		}
+		if (code->count == start + 1 && OP_NUMBER == code->insns[start].op)
+		{
+			code->insns[start].number = unary(code->insns[start].number);
+			return TRUE;
+		}
+		Insn *insn = emit(code, OP_UNARY);
+		insn->name = node->root->value.string;
+		insn->unary = unary;
+		return TRUE;
+	}
+	case TK_FUNCTION:
+		return compileFunction(code, node);
+	default:
+		printError("error : ");
+		printf("unexpected expression\n");
+		return FALSE;
+	}
+};
+
+/**
+ * @brief 指定した演算子を節とする式かどうかを判定する
+ * @param node 抽象構文木
+ * @param op 演算子
+ * @return 判定結果
+ */
+static BOOL isOperation(Ast *node, char *op)
+{
+	return node && TK_OPERATION == node->root->type && EQ(node->root->value.string, op);
+};
+
+/**
+ * @brief for文（for 変数 in 開始値..終端値 step 増分）を中間コードに変換する
+ * @param code 中間コード
+ * @param node "for"の後に続く抽象構文木
+ * @return 成否
+ * @details 増分が定数なら命令に持たせ、省略したら1とする
+ */
+static BOOL compileFor(LineCode *code, Ast *node)
+{
+	Ast *step = NULL;
+	if (isOperation(node, "step"))
+	{
+		step = node->right;
+		node = node->left;
+	}
+
+	if (!isOperation(node, "in") || TK_VARIABLE != node->left->root->type || !isOperation(node->right, ".."))
+	{
+		printError("error : ");
+		printf("\"for\" needs \"VARIABLE in START..END\"\n");
+		return FALSE;
+	}
+
+	emit(code, OP_FOR_ENTER);
+	if (FALSE == compileExpr(code, node->right->left) || FALSE == compileExpr(code, node->right->right))
+	{
+		return FALSE;
+	}
+
+	int number = 1;
+	if (step && TK_NUMBER == step->root->type)
+	{
+		number = step->root->value.number;
+	}
+	else if (step && TK_UNARY_OP == step->root->type && EQ(step->root->value.string, "-") && TK_NUMBER == step->left->root->type)
+	{
+		number = -step->left->root->value.number;
+	}
+	else if (step)
+	{
+		number = 0;
+	}
+
+	// 定数の0は積んで実行時の増分と同じに扱う
+	if (0 == number && FALSE == compileExpr(code, step))
+	{
+		return FALSE;
+	}
+
+	Insn *insn = emit(code, OP_FOR);
+	insn->name = node->left->root->value.string;
+	insn->number = number;
+	return TRUE;
+};
+
+/**
+ * @brief case文を中間コードに変換する
+ * @param code 中間コード
+ * @param node "case"の後に続く抽象構文木
+ * @return 成否
+ */
+static BOOL compileCase(LineCode *code, Ast *node)
+{
+	Insn *insn = emit(code, OP_CASE);
+	if (TK_NUMBER == node->root->type && NULL == node->left)
+	{
+		insn->number = node->root->value.number;
+	}
+	else if (TK_UNARY_OP == node->root->type && EQ(node->root->value.string, "-") && TK_NUMBER == node->left->root->type && NULL == node->left->left)
+	{
+		insn->number = -node->left->root->value.number;
+	}
+	else
+	{
+		printError("error : ");
+		printf("\"case\" needs a number\n");
+		return FALSE;
+	}
+	return TRUE;
+};
+
+/**
+ * @brief 定数の宣言（const 名前 = 式）を変換し、値を定数の表に加える
+ * @param code 中間コード
+ * @param node "const"の後に続く抽象構文木
+ * @param pc 行の位置
+ * @return 成否
+ * @details 式は定数の畳み込みで１つの値になるものに限る。宣言の行は実行時には何もしない
+ */
+static BOOL compileConstant(LineCode *code, Ast *node, int pc)
+{
+	if (FALSE == isOperation(node, "=") || TK_VARIABLE != node->left->root->type)
+	{
+		printError("error : ");
+		printf("\"const\" needs \"NAME = EXPRESSION\"\n");
+		return FALSE;
+	}
+
+	char *name = node->left->root->value.string;
+	if (FALSE == compileExpr(code, node->right))
+	{
+		return FALSE;
+	}
+	if (1 != code->count || OP_NUMBER != code->insns[0].op)
+	{
+		printError("error : ");
+		printf("value of constant \"%s\" must be a constant expression\n", name);
+		return FALSE;
+	}
+
+	int value = code->insns[0].number;
+	code->count = 0;
+	return defineConstant(name, value, pc);
+};
+
+/**
+ * @brief 予約語で始まる行を中間コードに変換する
+ * @param code 中間コード
+ * @param node 抽象構文木
+ * @return 成否
+ */
+static BOOL compileKeyword(LineCode *code, Ast *node)
+{
+	char *keyword = node->root->value.string;
+
+	if (EQ(keyword, "func") || EQ(keyword, "memo"))
+	{
+		code->type = LINE_FUNC;
+		emit(code, OP_FUNC)->number = EQ(keyword, "memo");
+	}
+	else if (EQ(keyword, "return"))
+	{
+		code->type = LINE_RETURN;
+
+		// 末尾呼び出しは戻り先を引き継いで呼び出し先にジャンプする
+		if (isUserCall(code, node->left))
+		{
+			if (FALSE == compileCall(code, node->left, OP_TAIL_CALL))
+			{
+				return FALSE;
+			}
+		}
+		else if (FALSE == compileExpr(code, node->left))
+		{
+			return FALSE;
+		}
+		emit(code, OP_RETURN);
+	}
+	else if (EQ(keyword, "if"))
+	{
+		code->type = LINE_IF;
+		emit(code, OP_IF_ENTER);
+		if (FALSE == compileCondition(code, node->left))
+		{
+			return FALSE;
+		}
+		emit(code, OP_IF);
+	}
+	else if (EQ(keyword, "while"))
+	{
+		code->type = LINE_WHILE;
+		emit(code, OP_WHILE_ENTER);
+		if (FALSE == compileCondition(code, node->left))
+		{
+			return FALSE;
+		}
+		emit(code, OP_WHILE);
+	}
+	else if (EQ(keyword, "for"))
+	{
+		code->type = LINE_FOR;
+		if (FALSE == compileFor(code, node->left))
+		{
+			return FALSE;
+		}
+	}
+	else if (EQ(keyword, "switch"))
+	{
+		code->type = LINE_SWITCH;
+		emit(code, OP_SWITCH_ENTER);
+		if (FALSE == compileExpr(code, node->left))
+		{
+			return FALSE;
+		}
+		emit(code, OP_SWITCH);
+	}
+	else if (EQ(keyword, "case"))
+	{
+		code->type = LINE_CASE;
+		return compileCase(code, node->left);
+	}
+	else if (EQ(keyword, "default"))
+	{
+		code->type = LINE_DEFAULT;
+		emit(code, OP_DEFAULT);
+	}
+	else if (EQ(keyword, "else"))
+	{
+		code->type = LINE_ELSE;
+		emit(code, OP_ELSE);
+	}
+	else if (EQ(keyword, "end"))
+	{
+		code->type = LINE_END;
+		emit(code, OP_END);
+	}
+	else if (EQ(keyword, "break"))
+	{
+		code->type = LINE_BREAK;
+		emit(code, OP_BREAK);
+	}
+	else if (EQ(keyword, "continue"))
+	{
+		code->type = LINE_CONTINUE;
+		emit(code, OP_CONTINUE);
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief for文の終端値または増分を置く隠れた変数の名前を取得する
+ * @param pc for文の行の位置
+ * @param step 増分かどうか
+ * @return 変数名（利用者の変数と重ならない、internName()で登録した文字列）
+ */
+char *getForSlotName(int pc, BOOL step)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%s@%d", step ? "step" : "end", pc);
+	return (char *)internName(name);
+};
+
+/**
+ * @brief switch文の値を置く隠れた変数の名前を取得する
+ * @param pc switch文の行の位置
+ * @return 変数名（利用者の変数と重ならない、internName()で登録した文字列）
+ */
+char *getSwitchSlotName(int pc)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "switch@%d", pc);
+	return (char *)internName(name);
+};
+
+/**
+ * @brief switch文の分岐先を作る
+ * @param keys caseの値（出現順）
+ * @param pcs 分岐先の位置（keysと同じ添字）
+ * @param count caseの数
+ * @param default_pc defaultの位置（-1ならなし）
+ * @retval NULL caseの値が重複している
+ * @retval Other 分岐先（releaseSwitchTable()で破棄する）
+ * @details caseが多く値の範囲が狭ければ値から直接引ける分岐表を作り、そうでなければ二分探索する
+ */
+SwitchTable *createSwitchTable(int *keys, int *pcs, int count, int default_pc)
+{
+	SwitchTable *st = (SwitchTable *)calloc(1, sizeof(SwitchTable));
+	st->count = count;
+	st->keys = (int *)malloc((count + 1) * sizeof(int));
+	st->pcs = (int *)malloc((count + 1) * sizeof(int));
+	st->default_pc = default_pc;
+
+	// caseの数は少ないので挿入ソートで並べる
+	for (int i = 0; i < count; i++)
+	{
+		int j = i;
+		for (; j > 0 && st->keys[j - 1] > keys[i]; j--)
+		{
+			st->keys[j] = st->keys[j - 1];
+			st->pcs[j] = st->pcs[j - 1];
+		}
+		st->keys[j] = keys[i];
+		st->pcs[j] = pcs[i];
+	}
+	for (int i = 1; i < count; i++)
+	{
+		if (st->keys[i - 1] == st->keys[i])
+		{
+			releaseSwitchTable(st);
+			return NULL;
+		}
+	}
+
+	long long span = count > 0 ? (long long)st->keys[count - 1] - st->keys[0] + 1 : 0;
+	if (count >= SWITCH_TABLE_MIN_CASES && span <= (long long)count * SWITCH_TABLE_DENSITY)
+	{
+		st->span = (int)span;
+		st->table = (int *)malloc(span * sizeof(int));
+		for (int i = 0; i < span; i++)
+		{
+			st->table[i] = -1;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			st->table[st->keys[i] - st->keys[0]] = st->pcs[i];
+		}
+	}
+	return st;
+};
+
+/**
+ * @brief switch文の分岐先を破棄する
+ * @param st 分岐先
+ */
+void releaseSwitchTable(SwitchTable *st)
+{
+	free(st->keys);
+	free(st->pcs);
+	free(st->table);
+	free(st);
+};
+
+/**
+ * @brief 空行またはコメント行かどうかを判定する
+ * @param stream 実行コード
+ * @return 判定結果
+ */
+static BOOL isBlankLine(char *stream)
+{
+	while (isCharMatch(*stream, ' ', '\t'))
+	{
+		stream++;
+	}
+	return isCharMatch(*stream, '\0', '#');
+};
+
+/**
+ * @brief 定数の宣言の行かどうかを判定する
+ * @param stream 実行コード
+ * @return 判定結果
+ */
+BOOL isConstantLine(char *stream)
+{
+	while (isCharMatch(*stream, ' ', '\t'))
+	{
+		stream++;
+	}
+	return 0 == strncmp(stream, "const", 5) && isCharMatch(stream[5], ' ', '\t');
+};
+
+/**
+ * @brief 関数の宣言の行なら、以降の行で同名の組み込み関数をユーザ関数で隠す
+ * @param pc 行の位置
+ * @param stream 実行コード
+ */
+void declareFunctionLine(int pc, char *stream)
+{
+	while (isCharMatch(*stream, ' ', '\t'))
+	{
+		stream++;
+	}
+	if (0 == strncmp(stream, "memo", 4) && isCharMatch(stream[4], ' ', '\t'))
+	{
+		stream += 4;
+		while (isCharMatch(*stream, ' ', '\t'))
+		{
+			stream++;
+		}
+	}
+	if (0 != strncmp(stream, "func", 4) || FALSE == isCharMatch(stream[4], ' ', '\t'))
+	{
+		return;
+	}
+	stream += 4;
+	while (isCharMatch(*stream, ' ', '\t'))
+	{
+		stream++;
+	}
+
+	char name[64];
+	int len = 0;
+	while (len < (int)sizeof(name) - 1 && (('a' <= stream[len] && stream[len] <= 'z') || ('A' <= stream[len] && stream[len] <= 'Z') || ('0' <= stream[len] && stream[len] <= '9') || '_' == stream[len]))
+	{
+		name[len] = stream[len];
+		len++;
+	}
+	name[len] = '\0';
+
+	shadowBuiltin(name, pc);
+};
+
+/**
+ * @brief １行分の実行コードを中間コードに変換する
+ * @param pc 行の位置
+ * @param stream 実行コード
+ * @retval NULL エラー
+ * @retval Other 中間コード
+ */
+LineCode *compileLine(int pc, char *stream)
+{
+	LineCode *code = (LineCode *)calloc(1, sizeof(LineCode));
+	if (!code)
+	{
+		return NULL;
+	}
+	code->type = LINE_EXPR;
+	code->pc = pc;
+
+	// 空行は命令なしの式とする
+	if (isBlankLine(stream))
+	{
+		return code;
+	}
+
+	Token *tokens = tokenize(stream, pc);
+	if (NULL == tokens)
+	{
+		releaseLineCode(code);
+		return NULL;
+	}
+
+	code->ast = createAst(tokens);
+	if (NULL == code->ast)
+	{
+		return code;
+	}
+
+	BOOL ret;
+	if (TK_KEYWORD == code->ast->root->type && EQ(code->ast->root->value.string, "const"))
+	{
+		ret = compileConstant(code, code->ast->left, pc);
+	}
+	else if (TK_KEYWORD == code->ast->root->type)
+	{
+		ret = compileKeyword(code, code->ast);
+	}
+	else
+	{
+		ret = compileExpr(code, code->ast);
+		emit(code, OP_POP);
+	}
+
+	if (FALSE == ret)
+	{
+		releaseLineCode(code);
+		return NULL;
+	}
+
+	return code;
+};
+
+/**
+ * @brief 中間コードを破棄する
+ * @param code 中間コード
+ */
+void releaseLineCode(LineCode *code)
+{
+	if (code->ast)
+	{
+		releaseAst(code->ast);
+	}
+	for (int i = 0; i < code->count; i++)
+	{
+		if (code->insns[i].inlined)
+		{
+			releaseLineCode(code->insns[i].inlined);
+		}
+	}
+	if (code->threaded)
+	{
+		releaseThreadedCode(code->threaded);
+	}
+	if (code->cases)
+	{
+		releaseSwitchTable(code->cases);
+	}
+	free(code->insns);
+	free(code);
+};
+
+/**
+ * @brief 中間コードのキャッシュを初期化する
+ */
+void initCodeCache(void)
+{
+	cache.lines = (LineCode **)calloc(CODE_CACHE_INIT_SIZE, sizeof(LineCode *));
+	cache.capacity = CODE_CACHE_INIT_SIZE;
+	cache.failed = FALSE;
+};
+
+/**
+ * @brief 中間コードのキャッシュを破棄する
+ */
+void releaseCodeCache(void)
+{
+	for (int i = 0; i < cache.capacity; i++)
+	{
+		if (cache.lines[i])
+		{
+			releaseLineCode(cache.lines[i]);
+		}
+	}
+	free(cache.lines);
+	cache.lines = NULL;
+	cache.capacity = 0;
+};
+
+/**
+ * @brief 指定した行の中間コードを取得する（未生成なら生成する）
+ * @param pc プログラムカウンタ
+ * @param stream 実行コード
+ * @retval NULL エラー
+ * @retval Other 中間コード
+ */
+LineCode *getLineCode(int pc, char *stream)
+{
+	if (pc >= cache.capacity)
+	{
+		int capacity = cache.capacity;
+		while (pc >= cache.capacity)
+		{
+			cache.capacity *= 2;
+		}
+		cache.lines = (LineCode **)realloc(cache.lines, cache.capacity * sizeof(LineCode *));
+		memset(cache.lines + capacity, 0, (cache.capacity - capacity) * sizeof(LineCode *));
+	}
+
+	if (NULL == cache.lines[pc])
+	{
+		cache.lines[pc] = compileLine(pc, stream);
+		cache.failed = cache.failed || NULL == cache.lines[pc];
+	}
+
+	return cache.lines[pc];
+};
+
+/**
+ * @brief 変換に失敗した行があったかどうかを判定する
+ * @return 判定結果
+ * @details 逐次実行と仮想マシンはエラーのある行を読み飛ばして続けるが、C言語への変換ではエラーとする
+ */
+BOOL hasCompileError(void)
+{
+	return cache.failed;
+};
+
+/**
+ * @brief 生成済みの中間コードを取得する
+ * @param pc プログラムカウンタ
+ * @retval NULL 未生成またはエラーのある行
+ * @retval Other 中間コード
+ */
+LineCode *getCachedCode(int pc)
+{
+	return pc < cache.capacity ? cache.lines[pc] : NULL;
+};
+
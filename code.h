@@ -0,0 +1,199 @@
+#ifndef _CODE_H_
+#define _CODE_H_
+
+#include "ast.h"
+#include "engine.h"
+#include "function.h"
+
+/// 分岐表を使うcaseの数の下限（これより少なければ二分探索する）
+#define SWITCH_TABLE_MIN_CASES (4)
+
+/// 分岐表を使うときのcaseの値の範囲の上限（caseの数に対する倍率）
+#define SWITCH_TABLE_DENSITY (2)
+
+/// 命令の種類
+typedef enum
+{
+	/// 定数をpushする
+	OP_NUMBER,
+	/// 変数の値をpushする
+	OP_LOAD,
+	/// スタックトップの値を変数に代入する（値は残す）
+	OP_STORE,
+	/// 複合代入演算（値は残す）
+	OP_ASSIGN_OP,
+	/// 二項演算
+	OP_BINARY,
+	/// 単項演算
+	OP_UNARY,
+	/// スタックトップの値が0ならそのまま残してnumber個先の命令にジャンプし、0でなければ捨てる（&&の左辺）
+	OP_AND,
+	/// スタックトップの値が0でなければ1に置き換えてnumber個先の命令にジャンプし、0なら捨てる（||の左辺）
+	OP_OR,
+	/// スタックトップの値を捨てる
+	OP_POP,
+	/// 組み込み関数print
+	OP_PRINT,
+	/// 組み込み関数exit
+	OP_EXIT,
+	/// 配列の要素をpushする（配列、添字の順に積む）
+	OP_INDEX,
+	/// 配列の要素に代入する（配列、添字、値の順に積む、calcがあれば複合代入、値は残す）
+	OP_STORE_INDEX,
+	/// 組み込み関数の呼び出し（引数は仮引数リストの順に積む）
+	OP_BUILTIN,
+	/// ユーザ関数の呼び出し
+	OP_CALL,
+	/// 末尾位置でのユーザ関数の呼び出し（現在のフレームを再利用する）
+	OP_TAIL_CALL,
+	/// if文の開始（ブロック定義の確認）
+	OP_IF_ENTER,
+	/// if文の条件判定
+	OP_IF,
+	/// while文の開始（ブロック定義の確認）
+	OP_WHILE_ENTER,
+	/// while文の条件判定
+	OP_WHILE,
+	/// for文の開始（ブロック定義の確認）
+	OP_FOR_ENTER,
+	/// for文の初期化と判定（開始値、終端値、増分の順に積む、増分が定数ならnumberに持って積まない）
+	OP_FOR,
+	/// switch文の開始（ブロック定義の確認）
+	OP_SWITCH_ENTER,
+	/// switch文の分岐（スタックトップの値と一致するcaseの行に飛ぶ）
+	OP_SWITCH,
+	/// case文（numberが値、直前の節の終わりならendに飛ぶ）
+	OP_CASE,
+	/// default文（直前の節の終わりならendに飛ぶ）
+	OP_DEFAULT,
+	/// else文
+	OP_ELSE,
+	/// end文
+	OP_END,
+	/// break文（対応するendの次の行に飛ぶ）
+	OP_BREAK,
+	/// continue文（whileの行に戻る）
+	OP_CONTINUE,
+	/// 関数定義
+	OP_FUNC,
+	/// return文
+	OP_RETURN,
+	/// スタックトップからnumber個下の値をpushする（インライン展開した関数の引数の参照）
+	OP_PICK,
+	/// スタックトップの値を残してその下のnumber個の値を捨てる（インライン展開した関数の引数の破棄）
+	OP_SLIDE,
+	/// number個先の命令にジャンプする（関数単位に変換したコード）
+	OP_JUMP,
+	/// スタックトップの値が0ならnumber個先の命令にジャンプする（関数単位に変換したコード）
+	OP_JUMP_IF_FALSE,
+} OPCODE;
+
+/// 命令
+typedef struct instruction
+{
+	/// 命令の種類
+	OPCODE op;
+	/// 定数（OP_NUMBER、OP_CASE）、引数の数（OP_CALL、OP_TAIL_CALL、OP_SLIDE）、組み込み関数番号（OP_BUILTIN）、memo指定の有無（OP_FUNC）、参照位置（OP_PICK）、ジャンプ先までの距離（OP_AND、OP_OR）、定数の増分（OP_FOR、0なら増分を積む）
+	int number;
+	/// 変数名（OP_LOAD、OP_STORE、OP_ASSIGN_OP、OP_FOR）、関数名（OP_CALL、OP_TAIL_CALL）、演算子（OP_BINARY、OP_UNARY）
+	char *name;
+	/// 呼び出し先として解決済みの関数（OP_CALL、OP_TAIL_CALL、再定義されたら解決し直す）
+	Function *func;
+	/// 二項演算の実処理（OP_BINARY、OP_ASSIGN_OP、OP_STORE_INDEX）
+	OPERATOR_FUNC calc;
+	/// 単項演算の実処理（OP_UNARY）
+	UNARY_OPERATOR_FUNC unary;
+	/// インライン展開した呼び出し先の本体（OP_CALL、OP_TAIL_CALL、NULLなら通常の呼び出し）
+	struct line_code *inlined;
+	/// インライン展開を判定したときの関数リストの版数（OP_CALL、OP_TAIL_CALL）
+	unsigned int inline_version;
+} Insn;
+
+/// 行の種類
+typedef enum
+{
+	/// 式
+	LINE_EXPR,
+	/// 関数定義
+	LINE_FUNC,
+	/// return文
+	LINE_RETURN,
+	/// if文
+	LINE_IF,
+	/// else文
+	LINE_ELSE,
+	/// while文
+	LINE_WHILE,
+	/// for文
+	LINE_FOR,
+	/// switch文
+	LINE_SWITCH,
+	/// case文
+	LINE_CASE,
+	/// default文
+	LINE_DEFAULT,
+	/// end文
+	LINE_END,
+	/// break文
+	LINE_BREAK,
+	/// continue文
+	LINE_CONTINUE,
+} LINE_TYPE;
+
+/// switch文の分岐先
+typedef struct switch_table
+{
+	/// caseの数
+	int count;
+	/// caseの値（昇順）
+	int *keys;
+	/// 分岐先の位置（keysと同じ添字、中間コードではcaseの行、バイトコードでは節の出現順の番号）
+	int *pcs;
+	/// caseの値の最小値を引いた値を添字とする分岐先の位置（-1ならdefault、NULLなら二分探索する）
+	int *table;
+	/// 分岐表の大きさ
+	int span;
+	/// defaultの位置（-1ならなし）
+	int default_pc;
+} SwitchTable;
+
+/// １行分の中間コード
+typedef struct line_code
+{
+	/// 行の種類
+	LINE_TYPE type;
+	/// 行の位置
+	int pc;
+	/// 抽象構文木
+	Ast *ast;
+	/// 命令列（後置記法）
+	Insn *insns;
+	/// 命令数
+	int count;
+	/// 確保済みの命令数
+	int capacity;
+	/// スレッド化した命令列（初回の実行時に生成する）
+	struct threaded_code *threaded;
+	/// 対応するendの行の位置（LINE_WHILE、LINE_FOR、LINE_SWITCH、最初に必要になったときに求める、0なら未解決）
+	int end_pc;
+	/// switch文の分岐先（LINE_SWITCH、最初に分岐するときに作る）
+	SwitchTable *cases;
+} LineCode;
+
+Insn *emit(LineCode *, OPCODE);
+BOOL isConstantLine(char *);
+void declareFunctionLine(int, char *);
+LineCode *compileLine(int, char *);
+void releaseLineCode(LineCode *);
+char *getForSlotName(int, BOOL);
+char *getSwitchSlotName(int);
+SwitchTable *createSwitchTable(int *, int *, int, int);
+void releaseSwitchTable(SwitchTable *);
+
+void initCodeCache(void);
+void releaseCodeCache(void);
+LineCode *getLineCode(int, char *);
+LineCode *getCachedCode(int);
+BOOL hasCompileError(void);
+
+#endif
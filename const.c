@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "const.h"
+#include "util.h"
+
+/// 定数
+typedef struct constant
+{
+	/// 名前
+	char *name;
+	/// 値
+	int value;
+	/// 宣言した行の位置
+	int pc;
+} Constant;
+
+/// 定数の表
+typedef struct const_table
+{
+	/// 定数（宣言した順）
+	Constant *items;
+	/// 定数の数
+	int count;
+	/// 確保済みの定数の数
+	int capacity;
+} ConstTable;
+
+static ConstTable table;
+
+/**
+ * @brief 定数の表を初期化する
+ */
+void initConstants(void)
+{
+	table.items = NULL;
+	table.count = 0;
+	table.capacity = 0;
+};
+
+/**
+ * @brief すべての定数を破棄する
+ */
+void releaseConstants(void)
+{
+	for (int i = 0; i < table.count; i++)
+	{
+		free(table.items[i].name);
+	}
+	free(table.items);
+	table.items = NULL;
+	table.count = 0;
+	table.capacity = 0;
+};
+
+/**
+ * @brief 定数を追加する
+ * @param name 名前
+ * @param value 値
+ * @param pc 宣言した行の位置
+ * @return 成否（同じ名前の定数があればエラーを表示する）
+ */
+BOOL defineConstant(const char *name, int value, int pc)
+{
+	for (int i = 0; i < table.count; i++)
+	{
+		if (EQ(table.items[i].name, name))
+		{
+			printError("error : ");
+			printf("constant \"%s\" is already defined\n", name);
+			return FALSE;
+		}
+	}
+
+	if (table.count == table.capacity)
+	{
+		table.capacity = table.capacity ? table.capacity * 2 : CONST_TABLE_INIT_SIZE;
+		table.items = (Constant *)realloc(table.items, table.capacity * sizeof(Constant));
+	}
+
+	Constant *c = &table.items[table.count++];
+	c->name = (char *)malloc(strlen(name) + 1);
+	strcpy(c->name, name);
+	c->value = value;
+	c->pc = pc;
+	return TRUE;
+};
+
+/**
+ * @brief 指定した行から見える定数を探す
+ * @param name 名前
+ * @param pc 参照する行の位置
+ * @param value 値の格納先
+ * @return 見つかったかどうか
+ * @details 定数は宣言より後の行（関数の中を含む）からだけ見える
+ */
+BOOL findConstant(const char *name, int pc, int *value)
+{
+	for (int i = 0; i < table.count; i++)
+	{
+		if (table.items[i].pc < pc && EQ(table.items[i].name, name))
+		{
+			*value = table.items[i].value;
+			return TRUE;
+		}
+	}
+	return FALSE;
+};
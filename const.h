@@ -0,0 +1,15 @@
+#ifndef _CONST_H_
+#define _CONST_H_
+
+#include "particle.h"
+
+/// 定数の表の初期容量
+#define CONST_TABLE_INIT_SIZE (16)
+
+void initConstants(void);
+void releaseConstants(void);
+
+BOOL defineConstant(const char *, int, int);
+BOOL findConstant(const char *, int, int *);
+
+#endif
@@ -1,29 +1,36 @@
 #include <stdio.h>
 #include <malloc.h>
 #include "context.h"
-#include "stack.h"
+#include "debug.h"
 
-/// コンテキスト
+/// コントロールスタックの初期容量
+#define FRAME_STACK_INIT_SIZE (1024)
+
+/// コントロールスタック
 typedef struct context
 {
-	/// プログラムカウンタ
-	Stack *pc;
-	/// 実行状態
-	Stack *state;
-	/// コードブロック
-	Stack *block;
-	/// 下位のコンテキスト
-	struct context *next;
+	/// フレーム領域
+	Frame *frames;
+	/// 確保済みのフレーム数
+	int capacity;
+	/// 使用中のフレーム数
+	int sp;
+	/// 現在の関数フレームの位置（-1ならトップレベル）
+	int fp;
 } Context;
 
-static Context *context = NULL;
+static Context context = {NULL, 0, 0, -1};
 
 /**
  * @brief コンテキストの初期化
  */
 void initContext(void)
 {
-	pushContext();
+	DPRINTF("%s\n", "initContext");
+	context.frames = (Frame *)calloc(FRAME_STACK_INIT_SIZE, sizeof(Frame));
+	context.capacity = FRAME_STACK_INIT_SIZE;
+	context.sp = 0;
+	context.fp = -1;
 };
 
 /**
@@ -31,132 +38,114 @@ void initContext(void)
  */
 void releaseContext(void)
 {
-	while (context)
-	{
-		popContext();
-	}
+	DPRINTF("%s\n", "releaseContext");
+	free(context.frames);
+	context.frames = NULL;
+	context.capacity = 0;
+	context.sp = 0;
+	context.fp = -1;
 };
 
 /**
- * @brief 現在のコンテキストの保存
+ * @brief フレームを１つ確保する
+ * @return 確保したフレーム
  */
-void pushContext(void)
+static Frame *allocFrame(void)
 {
-	Context *new_context;
-	new_context = (Context *)calloc(1, sizeof(Context));
-	new_context->pc = (Stack *)calloc(1, sizeof(Stack));
-	new_context->state = (Stack *)calloc(1, sizeof(Stack));
-	new_context->block = (Stack *)calloc(1, sizeof(Stack));
-	new_context->next = NULL;
-
-	if (NULL == context)
+	if (context.sp == context.capacity)
 	{
-		context = new_context;
-	}
-	else
-	{
-		new_context->next = context;
-		context = new_context;
+		context.capacity *= 2;
+		context.frames = (Frame *)realloc(context.frames, context.capacity * sizeof(Frame));
 	}
+	return &context.frames[context.sp++];
 };
 
 /**
- * @brief 現在のコンテキストの破棄
+ * @brief コードブロックのフレームをpushする
+ * @param block コードブロックの種類
+ * @param state 保存する実行状態
+ * @return pushしたフレーム
  */
-void popContext(void)
+Frame *pushFrame(int block, int state)
 {
-	Context *peek = context;
-	context = context->next;
-
-	Elem *elem = peek->pc->head;
-	while (elem)
-	{
-		Elem *temp = elem;
-		elem = elem->next;
-		free(temp);
-	}
-	free(peek->pc);
-
-	elem = peek->state->head;
-	while (elem)
-	{
-		Elem *temp = elem;
-		elem = elem->next;
-		free(temp);
-	}
-	free(peek->state);
-
-	elem = peek->block->head;
-	while (elem)
-	{
-		Elem *temp = elem;
-		elem = elem->next;
-		free(temp);
-	}
-	free(peek->block);
-
-	free(peek);
+	Frame *frame = allocFrame();
+	frame->block = block;
+	frame->state = state;
+	frame->loop_pc = -1;
+	return frame;
 };
 
 /**
- * @brief プログラムカウンタのpush
- * @param pc プログラムカウンタの値
+ * @brief スタックトップのフレームをpopする
+ * @return popしたフレーム（次のpushまで有効）
  */
-void pushPC(int pc)
+Frame *popFrame(void)
 {
-	push(context->pc, pc);
+	return &context.frames[--context.sp];
 };
 
 /**
- * @brief プログラムカウンタのpop
- * @return プログラムカウンタの値
+ * @brief スタックトップのフレームを取得する（popはしない）
+ * @retval NULL フレームなし
+ * @retval Other スタックトップのフレーム
  */
-int popPC(void)
+Frame *peekFrame(void)
 {
-	return pop(context->pc);
+	if (0 == context.sp)
+	{
+		return NULL;
+	}
+	return &context.frames[context.sp - 1];
 };
 
 /**
- * @brief 実行状態のpush
- * @param state 実行状態
+ * @brief 積まれているフレームの数を取得する
+ * @return フレームの数
  */
-void pushState(int state)
+int getFrameDepth(void)
 {
-	push(context->state, state);
+	return context.sp;
 };
 
 /**
- * @brief 実行状態のpop
- * @return 実行状態
+ * @brief 関数呼び出しのフレームをpushする
+ * @param block コードブロックの種類
+ * @param state 保存する実行状態
+ * @param return_pc 戻り先のプログラムカウンタ
+ * @return pushしたフレーム
  */
-int popState(void)
+Frame *pushCallFrame(int block, int state, int return_pc)
 {
-	return pop(context->state);
+	Frame *frame = pushFrame(block, state);
+	frame->return_pc = return_pc;
+	frame->link = context.fp;
+	context.fp = context.sp - 1;
+	return frame;
 };
 
 /**
- * @brief スタックトップの実行状態の取得
- * @return 実行状態
+ * @brief 現在の関数フレームを取得する
+ * @retval NULL トップレベル
+ * @retval Other 関数フレーム
  */
-int peekState(void)
+Frame *getCallFrame(void)
 {
-	return peek(context->state);
+	return context.fp < 0 ? NULL : &context.frames[context.fp];
 };
 
 /**
- * @brief コードブロックのpush
- * @param block コードブロック
+ * @brief 現在の関数フレームの上に積まれたブロックのフレームを破棄する
  */
-void pushBlock(int block)
+void resetCallFrame(void)
 {
-	push(context->block, block);
+	context.sp = context.fp + 1;
 };
 
 /**
- * @brief コードブロックのpop
- * @return コードブロック
+ * @brief 現在の関数フレームと、その上に積まれたブロックのフレームを破棄する
  */
-int popBlock(void)
+void popCallFrame(void)
 {
-	return pop(context->block);
+	context.sp = context.fp;
+	context.fp = context.frames[context.fp].link;
 };
@@ -1,20 +1,47 @@
 #ifndef _CONTEXT_H_
 #define _CONTEXT_H_
 
-void initContext(void);
-void releaseContext(void);
+struct line_code;
+struct function;
 
-void pushContext(void);
-void popContext(void);
+/// コントロールフレーム（関数呼び出しおよびコードブロック１つ分の制御情報）
+typedef struct frame
+{
+	/// コードブロックの種類
+	int block;
+	/// 保存した実行状態
+	int state;
+	/// 戻り先のプログラムカウンタ（関数ブロック）
+	int return_pc;
+	/// ブロック先頭のプログラムカウンタ（ループ・再実行位置、-1なら無効）
+	int loop_pc;
+	/// 呼び出し元の関数フレームの位置
+	int link;
+	/// 呼び出し元で再開する命令の位置（関数ブロック）
+	int ip;
+	/// 呼び出し元の中間コード（関数ブロック）
+	struct line_code *code;
+	/// 戻り値をメモ化する関数（関数ブロック、NULLならメモ化しない）
+	struct function *memo;
+	/// ループ変数の変数領域での位置（forブロック）
+	int slot;
+	/// 終端値（forブロック）
+	int limit;
+	/// 増分（forブロック）
+	int step;
+} Frame;
 
-void pushPC(int);
-int popPC(void);
+void initContext(void);
+void releaseContext(void);
 
-void pushState(int);
-int popState(void);
-int peekState(void);
+Frame *pushFrame(int, int);
+Frame *popFrame(void);
+Frame *peekFrame(void);
+int getFrameDepth(void);
 
-void pushBlock(int);
-int popBlock(void);
+Frame *pushCallFrame(int, int, int);
+Frame *getCallFrame(void);
+void resetCallFrame(void);
+void popCallFrame(void);
 
 #endif
@@ -1,17 +1,33 @@
 #include <stdio.h>
+#include <malloc.h>
 #include <memory.h>
 #include <string.h>
 #include "engine.h"
-#include "lexer.h"
-#include "ast.h"
+#include "code.h"
+#include "const.h"
 #include "function.h"
 #include "util.h"
-#include "stack.h"
 #include "program.h"
 #include "mem.h"
 #include "context.h"
+#include "memo.h"
+#include "inline.h"
+#include "parallel.h"
+#include "purity.h"
+#include "vm.h"
+#include "regvm.h"
+#include "threaded.h"
+#include "trace.h"
+#include "aot.h"
+#include "array.h"
+#include "map.h"
+#include "matrix.h"
+#include "builtin.h"
 #include "particle.h"
 
+/// 演算スタックの初期容量
+#define VALUE_STACK_INIT_SIZE (1024)
+
 /**
  * 実行エンジンの状態
  */
@@ -37,19 +53,48 @@ typedef enum
 	BLOCK_IF,
 	/// whileブロック
 	BLOCK_WHILE,
+	/// forブロック
+	BLOCK_FOR,
+	/// switchブロック
+	BLOCK_SWITCH,
 } BLOCK_TYPE;
 
-static Stack return_stack = {NULL};
-static int return_value = 0;
-static BOOL fReturn = FALSE;
+/// 演算スタック
+typedef struct value_stack
+{
+	/// 値の配列
+	int *values;
+	/// 使用中の要素数
+	int sp;
+	/// 確保済みの要素数
+	int capacity;
+} ValueStack;
+
 static BOOL fBlockDefined = FALSE;
+static BOOL fError = FALSE;
+static BOOL fAutoMemo = TRUE;
+static BOOL fMemoStats = FALSE;
+static BOOL fInsnStats = FALSE;
+static BOOL fInline = TRUE;
+static BOOL fThreaded = TRUE;
+static BOOL fTrace = TRUE;
+static BOOL fParallel = FALSE;
+static ENGINE_MODE mode = ENGINE_MODE_TREE;
 static int blockDepth = 0;
+static int callDepth = 0;
+static int maxCallDepth = DEFAULT_MAX_CALL_DEPTH;
 static ENGINE_STATE state = ESTATE_RUN;
+static ValueStack vstack;
+
+/// 実行した命令数
+static unsigned long insnCount = 0;
 
-static int eval(Ast *);
-static int runFunction(Function *);
+/// 定義中の関数
+static Function *defining = NULL;
 
-typedef int (*OPERATOR_FUNC)(Ast *);
+/// 呼び出し元に戻ったときに実行を再開する中間コードと命令の位置
+static LineCode *resume_code = NULL;
+static int resume_ip = 0;
 
 /// 演算子と実処理のテーブル
 typedef struct
@@ -60,28 +105,24 @@ typedef struct
 	OPERATOR_FUNC func;
 } OperatorFuncTable;
 
-static int plus(Ast *);
-static int minus(Ast *);
-static int times(Ast *);
-static int div(Ast *);
-static int surplus(Ast *);
-static int substitute(Ast *);
-static int less(Ast *);
-static int more(Ast *);
-static int plusEq(Ast *);
-static int minusEq(Ast *);
-static int timesEq(Ast *);
-static int divEq(Ast *);
-static int surplusEQ(Ast *);
-static int lessEq(Ast *);
-static int moreEq(Ast *);
-static int equal(Ast *);
-static int notEq(Ast *);
-static int comma(Ast *);
+static int plus(int, int);
+static int minus(int, int);
+static int times(int, int);
+static int div(int, int);
+static int surplus(int, int);
+static int less(int, int);
+static int more(int, int);
+static int lessEq(int, int);
+static int moreEq(int, int);
+static int equal(int, int);
+static int notEq(int, int);
+static int bitAnd(int, int);
+static int bitOr(int, int);
+static int bitXor(int, int);
+static int shiftLeft(int, int);
+static int shiftRight(int, int);
 
 static OperatorFuncTable OPERATOR_FUNC_TBL[] = {
-	{"=", substitute},
-
 	{"+", plus},
 	{"-", minus},
 	{"*", times},
@@ -95,200 +136,193 @@ static OperatorFuncTable OPERATOR_FUNC_TBL[] = {
 	{"==", equal},
 	{"!=", notEq},
 
-	{"+=", plusEq},
-	{"-=", minusEq},
-	{"*=", timesEq},
-	{"/=", divEq},
-	{"%=", surplusEQ},
-
-	{",", comma},
-};
-
-static int plus(Ast *node)
-{
-	return eval(node->left) + eval(node->right);
+	{"&", bitAnd},
+	{"|", bitOr},
+	{"^", bitXor},
+	{"<<", shiftLeft},
+	{">>", shiftRight},
 };
 
-static int minus(Ast *node)
-{
-	return eval(node->left) - eval(node->right);
+/// 複合代入演算子と実処理のテーブル
+static OperatorFuncTable ASSIGN_OPERATOR_FUNC_TBL[] = {
+	{"+=", plus},
+	{"-=", minus},
+	{"*=", times},
+	{"/=", div},
+	{"%=", surplus},
+	{"&=", bitAnd},
+	{"|=", bitOr},
+	{"^=", bitXor},
+	{"<<=", shiftLeft},
+	{">>=", shiftRight},
 };
 
-static int times(Ast *node)
+static int plus(int left, int right)
 {
-	return eval(node->left) * eval(node->right);
+	return left + right;
 };
 
-static int div(Ast *node)
+static int minus(int left, int right)
 {
-	return eval(node->left) / eval(node->right);
+	return left - right;
 };
 
-static int surplus(Ast *node)
+static int times(int left, int right)
 {
-	return eval(node->left) % eval(node->right);
+	return left * right;
 };
 
-static int substitute(Ast *node)
+static int div(int left, int right)
 {
-	int value = eval(node->right);
-	setVariable(node->left->root->value.string, value, VAR_LOCAL);
-	return value;
+	return left / right;
 };
 
-static int less(Ast *node)
+static int surplus(int left, int right)
 {
-	return eval(node->left) < eval(node->right);
+	return left % right;
 };
 
-static int more(Ast *node)
+static int less(int left, int right)
 {
-	return eval(node->left) > eval(node->right);
+	return left < right;
 };
 
-static int plusEq(Ast *node)
+static int more(int left, int right)
 {
-	int value = eval(node->right);
-	Variable *var = getVariable(node->left->root->value.string);
-	if (NULL == var)
-	{
-		printError("error : ");
-		printf("\"%s\" is not defined\n", node->left->root->value.string);
-		return 0;
-	}
-	var->value += value;
-	return var->value;
+	return left > right;
 };
 
-static int minusEq(Ast *node)
+static int lessEq(int left, int right)
 {
-	int value = eval(node->right);
-	Variable *var = getVariable(node->left->root->value.string);
-	if (NULL == var)
-	{
-		printError("error : ");
-		printf("\"%s\" is not defined\n", node->left->root->value.string);
-		return 0;
-	}
-	var->value -= value;
-	return var->value;
+	return left <= right;
 };
 
-static int timesEq(Ast *node)
+static int moreEq(int left, int right)
 {
-	int value = eval(node->right);
-	Variable *var = getVariable(node->left->root->value.string);
-	if (NULL == var)
-	{
-		printError("error : ");
-		printf("\"%s\" is not defined\n", node->left->root->value.string);
-		return 0;
-	}
-	var->value *= value;
-	return var->value;
+	return left >= right;
 };
 
-static int divEq(Ast *node)
+static int equal(int left, int right)
 {
-	int value = eval(node->right);
-	Variable *var = getVariable(node->left->root->value.string);
-	if (NULL == var)
-	{
-		printError("error : ");
-		printf("\"%s\" is not defined\n", node->left->root->value.string);
-		return 0;
-	}
-	var->value /= value;
-	return var->value;
+	return left == right;
 };
 
-static int surplusEQ(Ast *node)
+static int notEq(int left, int right)
 {
-	int value = eval(node->right);
-	Variable *var = getVariable(node->left->root->value.string);
-	if (NULL == var)
-	{
-		printError("error : ");
-		printf("\"%s\" is not defined\n", node->left->root->value.string);
-		return 0;
-	}
-	var->value %= value;
-
-	return var->value;
+	return left != right;
 };
 
-static int lessEq(Ast *node)
+static int bitAnd(int left, int right)
 {
-	return eval(node->left) <= eval(node->right);
+	return left & right;
 };
 
-static int moreEq(Ast *node)
+static int bitOr(int left, int right)
 {
-	return eval(node->left) >= eval(node->right);
+	return left | right;
 };
 
-static int equal(Ast *node)
+static int bitXor(int left, int right)
 {
-	return eval(node->left) == eval(node->right);
+	return left ^ right;
 };
 
-static int notEq(Ast *node)
+static int shiftLeft(int left, int right)
 {
-	return eval(node->left) != eval(node->right);
+	return SHIFT_LEFT(left, right);
 };
 
-static int comma(Ast *node)
+static int shiftRight(int left, int right)
 {
-	eval(node->left);
-	eval(node->right);
-	return 0;
+	return SHIFT_RIGHT(left, right);
 };
 
 /**
- * @brief 指定した演算子に対応する実処理関数を取得する
+ * @brief 演算子テーブルから実処理関数を検索する
+ * @param table 演算子テーブル
+ * @param num テーブルの要素数
  * @param operator 演算子
  * @retval NULL 該当する演算子がない
  * @retval Other 実処理関数
  */
-static OPERATOR_FUNC getEngineFunc(char *operator)
+static OPERATOR_FUNC findEngineFunc(OperatorFuncTable *table, int num, char *operator)
 {
 	OPERATOR_FUNC func = NULL;
-	int num = sizeof(OPERATOR_FUNC_TBL) / sizeof(OPERATOR_FUNC_TBL[0]);
 
 	for (int i = 0; i < num; i++)
 	{
-		if (EQ(operator, OPERATOR_FUNC_TBL[i].operator))
+		if (EQ(operator, table[i].operator))
 		{
-			func = OPERATOR_FUNC_TBL[i].func;
+			func = table[i].func;
 			break;
 		}
 	}
 	return func;
 };
 
-static int unary_plus(Ast *);
-static int unary_minus(Ast *);
-static int unary_not(Ast *);
+/**
+ * @brief 指定した演算子に対応する実処理関数を取得する
+ * @param operator 演算子
+ * @retval NULL 該当する演算子がない
+ * @retval Other 実処理関数
+ */
+OPERATOR_FUNC getEngineFunc(char *operator)
+{
+	int num = sizeof(OPERATOR_FUNC_TBL) / sizeof(OPERATOR_FUNC_TBL[0]);
+	return findEngineFunc(OPERATOR_FUNC_TBL, num, operator);
+};
+
+/**
+ * @brief 指定した複合代入演算子に対応する実処理関数を取得する
+ * @param operator 演算子
+ * @retval NULL 該当する演算子がない
+ * @retval Other 実処理関数
+ */
+OPERATOR_FUNC getEngineAssignFunc(char *operator)
+{
+	int num = sizeof(ASSIGN_OPERATOR_FUNC_TBL) / sizeof(ASSIGN_OPERATOR_FUNC_TBL[0]);
+	return findEngineFunc(ASSIGN_OPERATOR_FUNC_TBL, num, operator);
+};
+
+/// 単項演算子と実処理のテーブル
+typedef struct
+{
+	/// 演算子
+	char *operator;
+	/// 実処理
+	UNARY_OPERATOR_FUNC func;
+} UnaryOperatorFuncTable;
+
+static int unary_plus(int);
+static int unary_minus(int);
+static int unary_not(int);
+static int unary_bit_not(int);
 
-static OperatorFuncTable UNARY_OPERATOR_FUNC_TBL[] = {
+static UnaryOperatorFuncTable UNARY_OPERATOR_FUNC_TBL[] = {
 	{"+", unary_plus},
 	{"-", unary_minus},
 	{"!", unary_not},
+	{"~", unary_bit_not},
+};
+
+static int unary_plus(int value)
+{
+	return value;
 };
 
-static int unary_plus(Ast *node)
+static int unary_minus(int value)
 {
-	return eval(node->left);
+	return -value;
 };
 
-static int unary_minus(Ast *node)
+static int unary_not(int value)
 {
-	return -eval(node->left);
+	return !value;
 };
 
-static int unary_not(Ast *node)
+static int unary_bit_not(int value)
 {
-	return !eval(node->left);
+	return ~value;
 };
 
 /**
@@ -297,9 +331,9 @@ static int unary_not(Ast *node)
  * @retval NULL 該当する演算子がない
  * @retval Other 実処理関数
  */
-static OPERATOR_FUNC getEngineUnaryFunc(char *operator)
+UNARY_OPERATOR_FUNC getEngineUnaryFunc(char *operator)
 {
-	OPERATOR_FUNC func = NULL;
+	UNARY_OPERATOR_FUNC func = NULL;
 	int num = sizeof(UNARY_OPERATOR_FUNC_TBL) / sizeof(UNARY_OPERATOR_FUNC_TBL[0]);
 
 	for (int i = 0; i < num; i++)
@@ -314,412 +348,1452 @@ static OPERATOR_FUNC getEngineUnaryFunc(char *operator)
 };
 
 /**
- * @brief 関数の引数をパースし、変数マップに格納する
- * @param func 関数オブジェクト
- * @param ast 引数となる抽象構文木
+ * @brief 演算スタックに値をpushする
+ * @param value 値
  */
-static void parseArgs(Function *func, Ast *ast)
+static void pushValue(int value)
 {
-	ArgList *arg = func->args;
-	Ast *node = ast;
-
-	while (arg)
+	if (vstack.sp == vstack.capacity)
 	{
-		int value;
+		vstack.capacity *= 2;
+		vstack.values = (int *)realloc(vstack.values, vstack.capacity * sizeof(int));
+	}
+	vstack.values[vstack.sp++] = value;
+};
 
-		if (node->root->type == TK_OPERATION && EQ(node->root->value.string, ","))
-		{
-			value = eval(node->right);
-			node = node->left;
-		}
-		else
-		{
-			value = eval(node);
-		}
+/**
+ * @brief 演算スタックから値をpopする
+ * @return 値
+ */
+static int popValue(void)
+{
+	return vstack.values[--vstack.sp];
+};
 
-		setVariable(arg->name, value, VAR_ARG);
+static void returnFunction(int);
 
-		arg = arg->next;
+/**
+ * @brief 変数の値を取得する
+ * @param name 変数名
+ * @return 値（未定義ならエラーを表示して0）
+ */
+static int loadVariable(char *name)
+{
+	Variable *var = getVariable(name);
+	if (NULL == var)
+	{
+		printError("error : ");
+		printf("\"%s\" is not defined\n", name);
+		return 0;
 	}
+	return var->value;
 };
 
 /**
- * @brief 実行状態のときの評価処理
- * @param node 抽象構文木
- * @return 評価値
+ * @brief 複合代入演算を実行して結果をpushする
+ * @param name 変数名
+ * @param calc 演算の実処理
+ * @param value 右辺の値
  */
-static int evalRun(Ast *node)
+static void assignVariable(char *name, OPERATOR_FUNC calc, int value)
 {
-	int value = 0;
+	Variable *var = getVariable(name);
+	if (NULL == var)
+	{
+		printError("error : ");
+		printf("\"%s\" is not defined\n", name);
+		pushValue(0);
+	}
+	else
+	{
+		var->value = calc(var->value, value);
+		pushValue(var->value);
+	}
+};
 
-	switch (node->root->type)
+/**
+ * @brief 関数を定義する
+ * @param node func文の抽象構文木
+ * @param memo memo指定の有無
+ */
+static void defineFunction(Ast *node, BOOL memo)
+{
+	pushFrame(BLOCK_FUNC, state);
+	state = ESTATE_FUNC_DEF;
+
+	// memo指定があれば"func"以降を対象とする
+	if (memo)
 	{
-	case TK_VARIABLE:
+		node = node->left;
+	}
+
+	// 関数定義の追加
+	Function *func = createFunction(node->left->root->value.string, getpc());
+	func->memo = memo;
+	addFunction(func);
+	defining = func;
+
+	// 引数定義の評価
+	Ast *arg = node->left->left;
+	while (arg)
 	{
-		Variable *var = getVariable(node->root->value.string);
-		if (NULL == var)
+		if (TK_OPERATION == arg->root->type && EQ(arg->root->value.string, ","))
 		{
-			printError("error : ");
-			printf("\"%s\" is not defined\n", node->root->value.string);
+			addArgument(func, arg->right->root->value.string);
+			arg = arg->left;
 		}
 		else
 		{
-			value = var->value;
+			addArgument(func, arg->root->value.string);
+			arg = NULL;
 		}
-		break;
-	}
-	case TK_NUMBER:
-	{
-		value = node->root->value.number;
-		break;
 	}
-	case TK_OPERATION:
+};
+
+/**
+ * @brief 実行中の関数呼び出しをすべて破棄し、トップレベルに戻る
+ */
+static void abortExecution(void)
+{
+	Frame *frame;
+	int pc = getpc();
+
+	while ((frame = getCallFrame()))
 	{
-		OPERATOR_FUNC func = getEngineFunc(node->root->value.string);
-		value = func(node);
-		break;
+		pc = frame->return_pc;
+		popCallFrame();
+		popMemorySpace();
 	}
-	case TK_UNARY_OP:
+
+	callDepth = 0;
+	vstack.sp = 0;
+	resume_code = NULL;
+	state = ESTATE_RUN;
+	fError = TRUE;
+	jump(pc);
+};
+
+/**
+ * @brief 呼び出し先の関数を解決する
+ * @param insn 呼び出し命令
+ * @retval NULL エラー（引数を捨てて戻り値0をpushする）
+ * @retval Other 呼び出す関数
+ */
+static Function *resolveFunction(Insn *insn)
+{
+	// 前回の解決後に再定義されていなければそのまま使う
+	Function *func = insn->func;
+	if (NULL == func || func->redefined)
 	{
-		OPERATOR_FUNC func = getEngineUnaryFunc(node->root->value.string);
-		value = func(node);
-		break;
+		func = getFunction(insn->name);
+		insn->func = func;
 	}
-	case TK_FUNCTION:
+
+	if (NULL == func || func->argc != insn->number)
 	{
-		if (EQ(node->root->value.string, "print"))
-		{
-			printf("%d\n", eval(node->left));
-		}
-		else if (EQ(node->root->value.string, "exit"))
+		printError("error : ");
+		if (NULL == func)
 		{
-			state = ESTATE_END;
+			printf("function \"%s\" is not defined\n", insn->name);
 		}
 		else
 		{
-			Function *func = getFunction(node->root->value.string);
+			printf("function \"%s\" takes %d argument(s), but %d given\n", insn->name, func->argc, insn->number);
+		}
+		vstack.sp -= insn->number;
+		pushValue(0);
+		return NULL;
+	}
 
-			// 引数の評価値の保存
-			parseArgs(func, node->left);
+	return func;
+};
 
-			// メモリ空間とコンテキストの切り替え
-			pushMemorySpace();
-			pushContext();
+/**
+ * @brief 演算スタックに積まれた引数の評価値を変数に格納する
+ * @param func 呼び出す関数
+ * @param keep 引数を演算スタックに残すかどうか（メモ化のキー）
+ */
+static void bindArguments(Function *func, BOOL keep)
+{
+	int index = vstack.sp - func->argc;
 
-			// 関数の実行
-			value = runFunction(func);
+	for (ArgList *arg = func->args; arg != NULL; arg = arg->next)
+	{
+		setVariable(arg->name, vstack.values[index++], VAR_ARG);
+	}
 
-			// メモリ空間とコンテキストの復元
-			popMemorySpace();
-			popContext();
-		}
-		break;
+	if (FALSE == keep)
+	{
+		vstack.sp -= func->argc;
 	}
-	case TK_KEYWORD:
+};
+
+/**
+ * @brief メモ化された戻り値を検索する
+ * @param func 呼び出す関数
+ * @param value 戻り値の格納先
+ * @return 見つかったかどうか（見つかれば引数を演算スタックから捨てる）
+ */
+static BOOL findMemo(Function *func, int *value)
+{
+	if (lookupMemo(func, &vstack.values[vstack.sp - func->argc], value))
 	{
-		if (EQ(node->root->value.string, "func"))
-		{
-			state = ESTATE_FUNC_DEF;
-			pushBlock(BLOCK_FUNC);
+		vstack.sp -= func->argc;
+		return TRUE;
+	}
+	return FALSE;
+};
 
-			// 関数定義の追加
-			Function *func = createFunction(node->left->root->value.string, getpc());
-			addFunction(func);
+/**
+ * @brief インライン展開した関数本体を実行する
+ * @param body 展開した命令列
+ */
+static void execInline(LineCode *body)
+{
+	insnCount += body->count;
+	for (int ip = 0; ip < body->count; ip++)
+	{
+		Insn *insn = &body->insns[ip];
 
-			// 引数定義の評価
-			Ast *arg = node->left->left;
-			while (arg)
-			{
-				if (TK_OPERATION == arg->root->type && EQ(arg->root->value.string, ","))
-				{
-					addArgument(func, arg->right->root->value.string);
-					arg = arg->left;
-				}
-				else
-				{
-					addArgument(func, arg->root->value.string);
-					arg = NULL;
-				}
-			}
-		}
-		else if (EQ(node->root->value.string, "return"))
+		switch (insn->op)
 		{
-			return_value = eval(node->left);
-			fReturn = TRUE;
-			jump(pop(&return_stack));
-		}
-		else if (EQ(node->root->value.string, "if"))
+		case OP_NUMBER:
+			pushValue(insn->number);
+			break;
+		case OP_PICK:
+			pushValue(vstack.values[vstack.sp - insn->number]);
+			break;
+		case OP_BINARY:
 		{
-			pushBlock(BLOCK_IF);
-
-			if (fBlockDefined)
+			int right = popValue();
+			vstack.values[vstack.sp - 1] = insn->calc(vstack.values[vstack.sp - 1], right);
+			break;
+		}
+		case OP_UNARY:
+			vstack.values[vstack.sp - 1] = insn->unary(vstack.values[vstack.sp - 1]);
+			break;
+		case OP_AND:
+			if (0 == vstack.values[vstack.sp - 1])
 			{
-				fBlockDefined = FALSE;
-				pushState(state);
-				if (eval(node->left))
-				{
-					state = ESTATE_RUN;
-				}
-				else
-				{
-					state = ESTATE_SKIP;
-				}
+				ip += insn->number;
 			}
 			else
 			{
-				fBlockDefined = FALSE;
-				blockDepth = 1;
-				pushPC(getpc() - 1);
-				state = ESTATE_COND_DEF;
+				vstack.sp--;
 			}
-		}
-		else if (EQ(node->root->value.string, "else"))
-		{
-			state = ESTATE_SKIP;
-		}
-		else if (EQ(node->root->value.string, "while"))
-		{
-			pushBlock(BLOCK_WHILE);
-
-			if (fBlockDefined)
+			break;
+		case OP_OR:
+			if (0 != vstack.values[vstack.sp - 1])
 			{
-				fBlockDefined = FALSE;
-				pushState(state);
-				if (eval(node->left))
-				{
-					pushPC(getpc() - 1);
-					state = ESTATE_RUN;
-				}
-				else
-				{
-					pushPC(-1);
-					state = ESTATE_SKIP;
-				}
+				vstack.values[vstack.sp - 1] = 1;
+				ip += insn->number;
 			}
 			else
 			{
-				fBlockDefined = FALSE;
-				blockDepth = 1;
-				pushPC(getpc() - 1);
-				state = ESTATE_COND_DEF;
+				vstack.sp--;
 			}
-		}
-		else if (EQ(node->root->value.string, "end"))
+			break;
+		case OP_SLIDE:
 		{
-			state = popState();
-			BLOCK_TYPE block = popBlock();
-
-			if (BLOCK_FUNC == block)
-			{
-				return_value = 0;
-				fReturn = TRUE;
-				jump(pop(&return_stack));
-			}
-			else if (BLOCK_WHILE == block)
-			{
-				int next_pc = popPC();
-				if (next_pc >= 0)
-				{
-					jump(next_pc);
-				}
-			}
+			int value = popValue();
+			vstack.sp -= insn->number;
+			pushValue(value);
+			break;
+		}
+		default:
+			break;
 		}
-		break;
-	}
-	default:
-		break;
 	}
-
-	return value;
 };
 
 /**
- * @brief 関数定義状態のときの評価処理
- * @param node 抽象構文木
- * @return 評価値
+ * @brief 呼び出しをインライン展開して実行する
+ * @param insn 呼び出し命令
+ * @param func 呼び出す関数
+ * @return 展開して実行したかどうか（実行したら戻り値が演算スタックに積まれている）
+ * @details 展開の可否は関数リストが変わるまで呼び出し命令に保存しておく
  */
-static int evalFunc(Ast *node)
+static BOOL inlineFunction(Insn *insn, Function *func)
 {
-	if (TK_KEYWORD != node->root->type)
-	{
-		return 0;
-	}
+	unsigned int version = getFuncListVersion();
 
-	if (isStrMatch(node->root->value.string, "if"))
-	{
-		pushBlock(BLOCK_IF);
-	}
-	else if (isStrMatch(node->root->value.string, "while"))
+	if (insn->inline_version != version)
 	{
-		pushBlock(BLOCK_WHILE);
-	}
-	else if (isStrMatch(node->root->value.string, "end"))
-	{
-		if (BLOCK_FUNC == popBlock())
+		if (insn->inlined)
 		{
-			state = ESTATE_RUN;
+			releaseLineCode(insn->inlined);
 		}
+		insn->inlined = fInline ? createInlineCode(func) : NULL;
+		insn->inline_version = version;
+	}
+
+	if (NULL == insn->inlined)
+	{
+		return FALSE;
 	}
 
-	return 0;
-}
+	execInline(insn->inlined);
+	return TRUE;
+};
 
 /**
- * @brief コードブロック定義状態のときの評価処理
- * @param node 抽象構文木
- * @return 評価値
+ * @brief 関数を呼び出す
+ * @param insn 呼び出し命令
+ * @param code 呼び出し元の中間コード
+ * @param ip 呼び出し元で再開する命令の位置
+ * @return 呼び出し元の実行を中断したかどうか
+ * @details 関数の本体はエンジンの実行ループで実行される。
+ *          中断しない場合（エラー、メモ化済み）は戻り値が演算スタックに積まれている
  */
-static int evalCondDef(Ast *node)
+static BOOL callFunction(Insn *insn, LineCode *code, int ip)
 {
-	if (TK_KEYWORD != node->root->type)
+	if (callDepth >= maxCallDepth)
 	{
-		return 0;
+		printError("error : ");
+		printf("maximum call depth (%d) exceeded\n", maxCallDepth);
+		abortExecution();
+		return TRUE;
 	}
 
-	if (isStrMatch(node->root->value.string, "if"))
+	Function *func = resolveFunction(insn);
+	if (NULL == func || inlineFunction(insn, func))
 	{
-		pushBlock(BLOCK_IF);
-		blockDepth++;
+		return FALSE;
 	}
-	else if (isStrMatch(node->root->value.string, "while"))
+
+	// 並列モードではメモ化しない純粋関数をスレッドプールで評価する
+	BOOL memo = isMemoizable(func, fAutoMemo);
+	int value;
+	if (fParallel && FALSE == memo && isPureFunction(func) &&
+		callParallel(func, &vstack.values[vstack.sp - func->argc], &value))
 	{
-		pushBlock(BLOCK_WHILE);
-		blockDepth++;
+		vstack.sp -= func->argc;
+		pushValue(value);
+		return FALSE;
 	}
-	else if (isStrMatch(node->root->value.string, "end"))
+
+	if (memo && findMemo(func, &value))
 	{
-		popBlock();
-		blockDepth--;
-		if (blockDepth == 0)
-		{
-			fBlockDefined = TRUE;
-			jump(popPC());
-			state = ESTATE_RUN;
-		}
+		pushValue(value);
+		return FALSE;
 	}
 
-	return 0;
+	bindArguments(func, memo);
+
+	// メモリ空間の切り替え
+	pushMemorySpace();
+
+	Frame *frame = pushCallFrame(BLOCK_FUNC, state, getpc());
+	frame->code = code;
+	frame->ip = ip;
+	frame->memo = memo ? func : NULL;
+	callDepth++;
+
+	// 関数にジャンプ
+	jump(func->start_pc);
+
+	return TRUE;
 };
 
 /**
- * @brief 実行スキップ状態のときの評価処理
- * @param node 抽象構文木
- * @return 評価値
+ * @brief 末尾位置で関数を呼び出す
+ * @param insn 呼び出し命令
+ * @param code 呼び出し元の中間コード
+ * @param ip 呼び出し元で再開する命令の位置
+ * @return 呼び出し元の実行を中断したかどうか
+ * @details 現在の関数フレームとメモリ空間を呼び出し先で再利用するため、深さが増えない
  */
-static int evalSkip(Ast *node)
+static BOOL tailCallFunction(Insn *insn, LineCode *code, int ip)
 {
-	if (TK_KEYWORD != node->root->type)
+	// トップレベルでは通常の呼び出しとする
+	if (NULL == getCallFrame())
 	{
-		return 0;
+		return callFunction(insn, code, ip);
 	}
 
-	if (isStrMatch(node->root->value.string, "if"))
-	{
-		pushState(state);
-		pushBlock(BLOCK_IF);
-	}
-	else if (isStrMatch(node->root->value.string, "while"))
+	Function *func = resolveFunction(insn);
+	if (NULL == func || inlineFunction(insn, func))
 	{
-		pushState(state);
-		pushBlock(BLOCK_WHILE);
+		return FALSE;
 	}
-	else if (isStrMatch(node->root->value.string, "else"))
+
+	int value;
+	if (isMemoizable(func, fAutoMemo) && findMemo(func, &value))
 	{
-		if (ESTATE_RUN == peekState())
-		{
-			state = ESTATE_RUN;
-		}
+		returnFunction(value);
+		return TRUE;
 	}
-	else if (isStrMatch(node->root->value.string, "end"))
-	{
-		state = popState();
 
-		// while節に対応するendならプログラムカウンタを飛ばす
-		if (BLOCK_WHILE == popBlock())
-		{
-			int next_pc = popPC();
-			if (next_pc >= 0)
-			{
-				jump(next_pc);
-			}
-		}
-	}
+	// 現在の関数のローカル変数を破棄してから引数を格納する
+	popMemorySpace();
+	bindArguments(func, FALSE);
+	pushMemorySpace();
 
-	return 0;
+	// 戻り先はそのままで、関数内のブロックのフレームだけを破棄する
+	resetCallFrame();
+
+	// 関数にジャンプ
+	jump(func->start_pc);
+
+	return TRUE;
 };
 
 /**
- * @brief 入力された抽象構文木を評価する
- * @param node 抽象構文木
- * @return 評価値
+ * @brief 現在の関数から呼び出し元に戻る
+ * @param value 戻り値
  */
-static int eval(Ast *node)
+static void returnFunction(int value)
 {
-	int value = 0;
-
-	if (node == NULL)
+	Frame *frame = getCallFrame();
+	if (NULL == frame)
 	{
-		return value;
+		printError("error : ");
+		printf("\"return\" is outside of function\n");
+		return;
 	}
 
-	switch (state)
+	jump(frame->return_pc);
+	resume_code = frame->code;
+	resume_ip = frame->ip;
+
+	// 呼び出し時に残しておいた引数をキーとして戻り値を登録する
+	if (frame->memo)
 	{
-	case ESTATE_RUN:
-		value = evalRun(node);
+		vstack.sp -= frame->memo->argc;
+		storeMemo(frame->memo, &vstack.values[vstack.sp], value);
+	}
+
+	// メモリ空間とフレームの復元
+	popCallFrame();
+	popMemorySpace();
+	callDepth--;
+
+	pushValue(value);
+};
+
+/**
+ * @brief while、forまたはswitchの行に対応するendの行の位置を求める
+ * @param pc ブロックの先頭の行の直前の位置（フレームのloop_pc）
+ * @return endの行の位置
+ * @details 求めた位置はブロックの先頭の行の中間コードに覚えておき、２回目からは探さない
+ */
+static int findBlockEnd(int pc)
+{
+	LineCode *header = getCachedCode(pc + 1);
+	if (header->end_pc > 0)
+	{
+		return header->end_pc;
+	}
+
+	int size = getProgramSize();
+	int nest = 1;
+	int end = pc + 1;
+	while (nest > 0 && ++end < size)
+	{
+		LineCode *line = getLineCode(end, getProgramLine(end));
+		if (NULL == line)
+		{
+			continue;
+		}
+
+		switch (line->type)
+		{
+		case LINE_IF:
+		case LINE_WHILE:
+		case LINE_FOR:
+		case LINE_SWITCH:
+		case LINE_FUNC:
+			nest++;
+			break;
+		case LINE_END:
+			nest--;
+			break;
+		default:
+			break;
+		}
+	}
+
+	header->end_pc = end;
+	return end;
+};
+
+/**
+ * @brief switch文の分岐先を取得する
+ * @param pc switchの行の位置
+ * @retval NULL caseの値の重複などのエラー
+ * @retval Other 分岐先
+ * @details 初回はendまでの行からswitchの直下にあるcaseとdefaultを集めて、switchの行の中間コードに覚えておく
+ */
+static SwitchTable *getSwitchTable(int pc)
+{
+	LineCode *header = getCachedCode(pc);
+	if (header->cases)
+	{
+		return header->cases;
+	}
+
+	int end = findBlockEnd(pc - 1);
+	int keys[end - pc + 1];
+	int pcs[end - pc + 1];
+	int count = 0;
+	int default_pc = -1;
+	int nest = 0;
+
+	for (int line_pc = pc + 1; line_pc < end; line_pc++)
+	{
+		LineCode *line = getCachedCode(line_pc);
+		if (NULL == line)
+		{
+			continue;
+		}
+
+		switch (line->type)
+		{
+		case LINE_IF:
+		case LINE_WHILE:
+		case LINE_FOR:
+		case LINE_SWITCH:
+		case LINE_FUNC:
+			nest++;
+			break;
+		case LINE_END:
+			nest--;
+			break;
+		case LINE_CASE:
+			if (0 == nest)
+			{
+				keys[count] = line->insns[0].number;
+				pcs[count++] = line_pc;
+			}
+			break;
+		case LINE_DEFAULT:
+			if (0 == nest && default_pc >= 0)
+			{
+				printError("error : ");
+				printf("\"default\" appears twice in \"switch\"\n");
+				return NULL;
+			}
+			if (0 == nest)
+			{
+				default_pc = line_pc;
+			}
+			break;
+		default:
+			break;
+		}
+
+		// 最初のcaseかdefaultより前の行は実行されない
+		if (0 == count && default_pc < 0 && LINE_CASE != line->type && LINE_DEFAULT != line->type)
+		{
+			printError("error : ");
+			printf("\"switch\" needs \"case\" or \"default\" before statements\n");
+			return NULL;
+		}
+	}
+
+	header->cases = createSwitchTable(keys, pcs, count, default_pc);
+	if (NULL == header->cases)
+	{
+		printError("error : ");
+		printf("duplicate \"case\" in \"switch\"\n");
+	}
+	return header->cases;
+};
+
+/**
+ * @brief switch文の値に対応する分岐先の位置を求める
+ * @param st 分岐先
+ * @param value switch文の値
+ * @retval -1 一致するcaseもdefaultもない
+ * @retval Other caseまたはdefaultの行の位置
+ */
+static int findSwitchTarget(SwitchTable *st, int value)
+{
+	if (st->table)
+	{
+		// 範囲外の値は符号なしの比較で一度に除く
+		unsigned int index = (unsigned int)value - (unsigned int)st->keys[0];
+		int target = index < (unsigned int)st->span ? st->table[index] : -1;
+		return target >= 0 ? target : st->default_pc;
+	}
+
+	int low = 0;
+	int high = st->count - 1;
+	while (low <= high)
+	{
+		int mid = (low + high) / 2;
+		if (st->keys[mid] == value)
+		{
+			return st->pcs[mid];
+		}
+		if (st->keys[mid] < value)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+	return st->default_pc;
+};
+
+/**
+ * @brief forループの条件が真かどうかを判定する
+ * @param frame forブロックのフレーム
+ * @return ループ変数が終端値に達していなければ真（増分が0なら偽）
+ */
+static BOOL isForRunning(Frame *frame)
+{
+	int value = getVariableByIndex(frame->slot)->value;
+	return frame->step > 0 ? value < frame->limit : frame->step < 0 && value > frame->limit;
+};
+
+/**
+ * @brief forループを続けるならループ本体の先頭の行に、終えるならendの次の行に進む
+ * @param frame forブロックのフレーム
+ * @details 条件が真ならトレースがあれば実行する（途中脱出したら条件が真のまま戻る）
+ */
+static void nextFor(Frame *frame)
+{
+	if (fTrace && isForRunning(frame))
+	{
+		enterTrace(frame->loop_pc, getCachedCode(frame->loop_pc + 1), getFrameDepth(), frame->limit, frame->step);
+	}
+
+	if (isForRunning(frame))
+	{
+		jump(frame->loop_pc + 1);
+		return;
+	}
+
+	state = frame->state;
+	popFrame();
+	jump(findBlockEnd(frame->loop_pc));
+};
+
+/**
+ * @brief forループの変数に増分を足して次の反復に進む
+ * @param frame forブロックのフレーム
+ * @details ループ変数は変数領域の位置で直接参照し、名前では探さない
+ */
+static void advanceFor(Frame *frame)
+{
+	getVariableByIndex(frame->slot)->value += frame->step;
+	nextFor(frame);
+};
+
+/**
+ * @brief break文とcontinue文を実行する
+ * @param isBreak break文かどうか
+ * @details 内側のifのフレームを捨て、breakはループのendの次の行に、continueはwhileの行かforの次の反復に直接進む。
+ *          else節を実行中のwhileはループを終えているので、その外側のループを対象にする
+ */
+static void leaveLoop(BOOL isBreak)
+{
+	Frame *frame;
+
+	while ((frame = peekFrame()) && BLOCK_FUNC != frame->block)
+	{
+		if (BLOCK_FOR == frame->block && FALSE == isBreak)
+		{
+			advanceFor(frame);
+			return;
+		}
+
+		popFrame();
+		if (BLOCK_FOR == frame->block || (BLOCK_WHILE == frame->block && frame->loop_pc >= 0))
+		{
+			state = frame->state;
+			// endの行まで進めたことにして、breakはその次の行から実行する
+			jump(isBreak ? findBlockEnd(frame->loop_pc) : frame->loop_pc);
+			return;
+		}
+	}
+
+	printError("error : ");
+	printf("\"%s\" without \"while\"\n", isBreak ? "break" : "continue");
+	abortExecution();
+};
+
+/**
+ * @brief 制御構造などの命令を実行する
+ * @param insn 命令
+ * @param code 命令を含む中間コード
+ * @return 行の実行を中断するかどうか
+ */
+static BOOL execControl(Insn *insn, LineCode *code)
+{
+	switch (insn->op)
+	{
+	case OP_EXIT:
+		state = ESTATE_END;
+		return TRUE;
+	case OP_INDEX:
+	{
+		int index = popValue();
+		int value;
+		if (FALSE == loadElement(popValue(), index, &value))
+		{
+			abortExecution();
+			return TRUE;
+		}
+		pushValue(value);
+		break;
+	}
+	case OP_STORE_INDEX:
+	{
+		int value = popValue();
+		int index = popValue();
+		int handle = popValue();
+		if (insn->calc)
+		{
+			int old;
+			if (FALSE == loadElement(handle, index, &old))
+			{
+				abortExecution();
+				return TRUE;
+			}
+			value = insn->calc(old, value);
+		}
+		if (FALSE == storeElement(handle, index, value))
+		{
+			abortExecution();
+			return TRUE;
+		}
+		pushValue(value);
+		break;
+	}
+	case OP_BUILTIN:
+	{
+		// 引数は先頭から順に積まれているので、その位置から引数の並びとして渡す
+		Builtin *builtin = getBuiltin(insn->number);
+		int value;
+		vstack.sp -= builtin->argc;
+		if (FALSE == builtin->func(&vstack.values[vstack.sp], &value))
+		{
+			abortExecution();
+			return TRUE;
+		}
+		pushValue(value);
+		break;
+	}
+	case OP_IF_ENTER:
+	case OP_WHILE_ENTER:
+	case OP_FOR_ENTER:
+	case OP_SWITCH_ENTER:
+		// 分岐先を求め終えたswitchはendまで読み込み済みなので読み直さない
+		if (FALSE == fBlockDefined && NULL == code->cases)
+		{
+			// ブロックの終端まで読み込んでから条件を評価し直す
+			blockDepth = 1;
+			Frame *frame = pushFrame(OP_IF_ENTER == insn->op ? BLOCK_IF : OP_WHILE_ENTER == insn->op ? BLOCK_WHILE : OP_FOR_ENTER == insn->op ? BLOCK_FOR : BLOCK_SWITCH, state);
+			frame->loop_pc = getpc() - 1;
+			state = ESTATE_COND_DEF;
+			return TRUE;
+		}
+		fBlockDefined = FALSE;
+		break;
+	case OP_IF:
+	{
+		int cond = popValue();
+		pushFrame(BLOCK_IF, state);
+		state = cond ? ESTATE_RUN : ESTATE_SKIP;
+		break;
+	}
+	case OP_WHILE:
+	{
+		int cond = popValue();
+		Frame *frame = pushFrame(BLOCK_WHILE, state);
+		if (cond)
+		{
+			frame->loop_pc = getpc() - 1;
+			state = ESTATE_RUN;
+
+			// トレースから抜けたらループの先頭から評価し直す
+			if (fTrace && enterTrace(frame->loop_pc, code, getFrameDepth(), 0, 0))
+			{
+				state = frame->state;
+				popFrame();
+				jump(frame->loop_pc);
+			}
+		}
+		else
+		{
+			state = ESTATE_SKIP;
+		}
+		break;
+	}
+	case OP_FOR:
+	{
+		int step = insn->number ? insn->number : popValue();
+		int limit = popValue();
+		setVariable(insn->name, popValue(), VAR_LOCAL);
+
+		Frame *frame = pushFrame(BLOCK_FOR, state);
+		frame->loop_pc = getpc() - 1;
+		frame->slot = getVariableIndex(insn->name);
+		frame->limit = limit;
+		frame->step = step;
+		nextFor(frame);
+		break;
+	}
+	case OP_SWITCH:
+	{
+		int value = popValue();
+		SwitchTable *st = getSwitchTable(getpc());
+		if (NULL == st)
+		{
+			abortExecution();
+			return TRUE;
+		}
+
+		// 一致するcaseの次の行に直接飛び、途中のcaseの条件は評価しない
+		int target = findSwitchTarget(st, value);
+		if (target < 0)
+		{
+			jump(findBlockEnd(getpc() - 1));
+			break;
+		}
+		Frame *frame = pushFrame(BLOCK_SWITCH, state);
+		frame->loop_pc = getpc() - 1;
+		jump(target);
+		break;
+	}
+	case OP_CASE:
+	case OP_DEFAULT:
+	{
+		// 節の終わりに達したのでendの次の行に進む
+		Frame *frame = peekFrame();
+		if (NULL == frame || BLOCK_SWITCH != frame->block)
+		{
+			printError("error : ");
+			printf("\"%s\" without \"switch\"\n", OP_CASE == insn->op ? "case" : "default");
+			abortExecution();
+			return TRUE;
+		}
+		state = frame->state;
+		popFrame();
+		jump(findBlockEnd(frame->loop_pc));
+		break;
+	}
+	case OP_ELSE:
+		if (NULL == peekFrame())
+		{
+			printError("error : ");
+			printf("\"else\" without \"if\"\n");
+			break;
+		}
+		if (BLOCK_FOR == peekFrame()->block)
+		{
+			printError("error : ");
+			printf("\"else\" is not supported in \"for\"\n");
+			abortExecution();
+			break;
+		}
+		if (BLOCK_SWITCH == peekFrame()->block)
+		{
+			printError("error : ");
+			printf("\"else\" without \"if\"\n");
+			abortExecution();
+			break;
+		}
+		state = ESTATE_SKIP;
+		break;
+	case OP_END:
+	{
+		Frame *frame = peekFrame();
+		if (NULL == frame)
+		{
+			printError("error : ");
+			printf("\"end\" without block\n");
+			break;
+		}
+		if (BLOCK_FOR == frame->block)
+		{
+			advanceFor(frame);
+			break;
+		}
+		state = frame->state;
+
+		if (BLOCK_FUNC == frame->block)
+		{
+			returnFunction(0);
+		}
+		else
+		{
+			popFrame();
+			if (BLOCK_WHILE == frame->block && frame->loop_pc >= 0)
+			{
+				jump(frame->loop_pc);
+			}
+		}
+		break;
+	}
+	case OP_BREAK:
+	case OP_CONTINUE:
+		leaveLoop(OP_BREAK == insn->op);
+		return TRUE;
+	case OP_FUNC:
+		defineFunction(code->ast, insn->number);
+		break;
+	case OP_RETURN:
+		returnFunction(popValue());
+		return TRUE;
+	default:
+		break;
+	}
+
+	return FALSE;
+};
+
+/**
+ * @brief 実行状態のときの評価処理
+ * @param code 中間コード
+ * @param ip 実行を開始する命令の位置
+ * @details 関数呼び出しに達したら呼び出し元の状態をフレームに保存して中断する
+ */
+static void execLine(LineCode *code, int ip)
+{
+	for (; ip < code->count; ip++)
+	{
+		Insn *insn = &code->insns[ip];
+		insnCount++;
+
+		switch (insn->op)
+		{
+		case OP_NUMBER:
+			pushValue(insn->number);
+			break;
+		case OP_LOAD:
+			pushValue(loadVariable(insn->name));
+			break;
+		case OP_STORE:
+			setVariable(insn->name, vstack.values[vstack.sp - 1], VAR_LOCAL);
+			break;
+		case OP_ASSIGN_OP:
+		{
+			int value = popValue();
+			assignVariable(insn->name, insn->calc, value);
+			break;
+		}
+		case OP_BINARY:
+		{
+			int right = popValue();
+			int left = popValue();
+			pushValue(insn->calc(left, right));
+			break;
+		}
+		case OP_UNARY:
+			vstack.values[vstack.sp - 1] = insn->unary(vstack.values[vstack.sp - 1]);
+			break;
+		case OP_AND:
+			if (0 == vstack.values[vstack.sp - 1])
+			{
+				ip += insn->number;
+			}
+			else
+			{
+				vstack.sp--;
+			}
+			break;
+		case OP_OR:
+			if (0 != vstack.values[vstack.sp - 1])
+			{
+				vstack.values[vstack.sp - 1] = 1;
+				ip += insn->number;
+			}
+			else
+			{
+				vstack.sp--;
+			}
+			break;
+		case OP_POP:
+			vstack.sp--;
+			break;
+		case OP_PRINT:
+			printf("%d\n", popValue());
+			pushValue(0);
+			break;
+		case OP_CALL:
+			// インライン展開済みの呼び出しは関数リストが変わっていなければそのまま実行する
+			if (insn->inlined && insn->inline_version == getFuncListVersion())
+			{
+				execInline(insn->inlined);
+				break;
+			}
+			if (callFunction(insn, code, ip + 1))
+			{
+				return;
+			}
+			break;
+		case OP_TAIL_CALL:
+			if (insn->inlined && insn->inline_version == getFuncListVersion())
+			{
+				execInline(insn->inlined);
+				break;
+			}
+			if (tailCallFunction(insn, code, ip + 1))
+			{
+				return;
+			}
+			break;
+		default:
+			if (execControl(insn, code))
+			{
+				return;
+			}
+			break;
+		}
+	}
+};
+
+/*
+ * スレッド化した命令列の分岐
+ * GCCでは命令ごとに処理の先頭アドレスを持たせて直接ジャンプし、それ以外ではswitch文で分岐する
+ */
+#if defined(__GNUC__)
+#define THREADED_LABEL(op) [op] = &&L_##op,
+#define THREADED_CASE(op) L_##op:
+#define THREADED_NEXT()   \
+	do                    \
+	{                     \
+		t++;              \
+		insnCount++;      \
+		goto *t->handler; \
+	} while (0)
+#else
+#define THREADED_CASE(op) case op:
+#define THREADED_NEXT() \
+	do                  \
+	{                   \
+		t++;            \
+		insnCount++;    \
+		goto dispatch;  \
+	} while (0)
+#endif
+
+/// 二項演算の被演算子の形ごとの処理
+#define THREADED_BINARY_CASES(kind, op)                                    \
+	THREADED_CASE(TOP_##kind)                                              \
+	{                                                                      \
+		int right = popValue();                                            \
+		vstack.values[vstack.sp - 1] = vstack.values[vstack.sp - 1] op right; \
+		THREADED_NEXT();                                                   \
+	}                                                                      \
+	THREADED_CASE(TOP_##kind##_VAR_CONST)                                  \
+	{                                                                      \
+		pushValue(loadVariable(t->name) op t->number);                     \
+		THREADED_NEXT();                                                   \
+	}                                                                      \
+	THREADED_CASE(TOP_##kind##_VAR_VAR)                                    \
+	{                                                                      \
+		int left = loadVariable(t->name);                                  \
+		pushValue(left op loadVariable(t->right));                         \
+		THREADED_NEXT();                                                   \
+	}                                                                      \
+	THREADED_CASE(TOP_##kind##_CONST)                                      \
+	{                                                                      \
+		vstack.values[vstack.sp - 1] = vstack.values[vstack.sp - 1] op t->number; \
+		THREADED_NEXT();                                                   \
+	}                                                                      \
+	THREADED_CASE(TOP_##kind##_VAR)                                        \
+	{                                                                      \
+		int right = loadVariable(t->name);                                 \
+		vstack.values[vstack.sp - 1] = vstack.values[vstack.sp - 1] op right; \
+		THREADED_NEXT();                                                   \
+	}
+
+/**
+ * @brief 実行状態のときの評価処理（スレッド化した命令列で実行する）
+ * @param code 中間コード
+ * @param ip 実行を開始するスレッド化した命令の位置
+ * @details 演算と被演算子の形ごとに特化した命令へ直接分岐する。
+ *          関数呼び出しで中断したときの再開位置もスレッド化した命令の位置になる
+ */
+static void execThreaded(LineCode *code, int ip)
+{
+	if (NULL == code->threaded)
+	{
+		code->threaded = createThreadedCode(code);
+	}
+
+	ThreadedCode *tc = code->threaded;
+	ThreadedInsn *t = &tc->insns[ip];
+
+#if defined(__GNUC__)
+#define THREADED_BINARY_LABELS(kind, op) \
+	THREADED_LABEL(TOP_##kind)           \
+	THREADED_LABEL(TOP_##kind##_VAR_CONST) \
+	THREADED_LABEL(TOP_##kind##_VAR_VAR) \
+	THREADED_LABEL(TOP_##kind##_CONST)   \
+	THREADED_LABEL(TOP_##kind##_VAR)
+
+	static const void *labels[TOP_COUNT] = {
+		THREADED_LABEL(TOP_NUMBER)
+		THREADED_LABEL(TOP_LOAD)
+		THREADED_LABEL(TOP_STORE)
+		THREADED_LABEL(TOP_STORE_POP)
+		THREADED_LABEL(TOP_ASSIGN_OP)
+		THREADED_LABEL(TOP_ASSIGN_OP_CONST)
+		THREADED_LABEL(TOP_BINARY)
+		THREADED_LABEL(TOP_UNARY)
+		THREADED_LABEL(TOP_AND)
+		THREADED_LABEL(TOP_OR)
+		THREADED_LABEL(TOP_POP)
+		THREADED_LABEL(TOP_PRINT)
+		THREADED_LABEL(TOP_CALL)
+		THREADED_LABEL(TOP_TAIL_CALL)
+		THREADED_LABEL(TOP_CONTROL)
+		THREADED_LABEL(TOP_END_LINE)
+		THREADED_BINARY_OPS(THREADED_BINARY_LABELS)
+	};
+#undef THREADED_BINARY_LABELS
+
+	if (FALSE == tc->linked)
+	{
+		for (int i = 0; i < tc->count; i++)
+		{
+			tc->insns[i].handler = labels[tc->insns[i].op];
+		}
+		tc->linked = TRUE;
+	}
+
+	insnCount++;
+	goto *t->handler;
+#else
+	insnCount++;
+dispatch:
+	switch (t->op)
+#endif
+	{
+		THREADED_CASE(TOP_NUMBER)
+		{
+			pushValue(t->number);
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_LOAD)
+		{
+			pushValue(loadVariable(t->name));
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_STORE)
+		{
+			setVariable(t->name, vstack.values[vstack.sp - 1], VAR_LOCAL);
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_STORE_POP)
+		{
+			setVariable(t->name, popValue(), VAR_LOCAL);
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_ASSIGN_OP)
+		{
+			int value = popValue();
+			assignVariable(t->name, t->insn->calc, value);
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_ASSIGN_OP_CONST)
+		{
+			assignVariable(t->name, t->insn->calc, t->number);
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_BINARY)
+		{
+			int right = popValue();
+			vstack.values[vstack.sp - 1] = t->insn->calc(vstack.values[vstack.sp - 1], right);
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_UNARY)
+		{
+			vstack.values[vstack.sp - 1] = t->insn->unary(vstack.values[vstack.sp - 1]);
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_AND)
+		{
+			if (0 == vstack.values[vstack.sp - 1])
+			{
+				t += t->number;
+			}
+			else
+			{
+				vstack.sp--;
+			}
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_OR)
+		{
+			if (0 != vstack.values[vstack.sp - 1])
+			{
+				vstack.values[vstack.sp - 1] = 1;
+				t += t->number;
+			}
+			else
+			{
+				vstack.sp--;
+			}
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_POP)
+		{
+			vstack.sp--;
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_PRINT)
+		{
+			printf("%d\n", vstack.values[vstack.sp - 1]);
+			vstack.values[vstack.sp - 1] = 0;
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_CALL)
+		{
+			Insn *insn = t->insn;
+			if (insn->inlined && insn->inline_version == getFuncListVersion())
+			{
+				execInline(insn->inlined);
+			}
+			else if (callFunction(insn, code, (int)(t - tc->insns) + 1))
+			{
+				return;
+			}
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_TAIL_CALL)
+		{
+			Insn *insn = t->insn;
+			if (insn->inlined && insn->inline_version == getFuncListVersion())
+			{
+				execInline(insn->inlined);
+			}
+			else if (tailCallFunction(insn, code, (int)(t - tc->insns) + 1))
+			{
+				return;
+			}
+			THREADED_NEXT();
+		}
+		THREADED_CASE(TOP_CONTROL)
+		{
+			if (execControl(t->insn, code))
+			{
+				return;
+			}
+			THREADED_NEXT();
+		}
+		THREADED_BINARY_OPS(THREADED_BINARY_CASES)
+		THREADED_CASE(TOP_END_LINE)
+		{
+			return;
+		}
+#if !defined(__GNUC__)
+	default:
+		return;
+#endif
+	}
+};
+
+#undef THREADED_BINARY_CASES
+#undef THREADED_NEXT
+#undef THREADED_CASE
+#undef THREADED_LABEL
+
+/**
+ * @brief 実行状態のときの評価処理
+ * @param code 中間コード
+ * @param ip 実行を開始する命令の位置
+ */
+static void execCode(LineCode *code, int ip)
+{
+	if (fThreaded)
+	{
+		execThreaded(code, ip);
+	}
+	else
+	{
+		execLine(code, ip);
+	}
+};
+
+/**
+ * @brief 関数定義状態のときの評価処理
+ * @param code 中間コード
+ */
+static void evalFunc(LineCode *code)
+{
+	switch (code->type)
+	{
+	case LINE_IF:
+		pushFrame(BLOCK_IF, state);
 		break;
-	case ESTATE_FUNC_DEF:
-		value = evalFunc(node);
+	case LINE_WHILE:
+		pushFrame(BLOCK_WHILE, state);
 		break;
-	case ESTATE_COND_DEF:
-		value = evalCondDef(node);
+	case LINE_FOR:
+		pushFrame(BLOCK_FOR, state);
 		break;
-	case ESTATE_SKIP:
-		value = evalSkip(node);
+	case LINE_SWITCH:
+		pushFrame(BLOCK_SWITCH, state);
+		break;
+	case LINE_END:
+		if (BLOCK_FUNC == popFrame()->block)
+		{
+			state = ESTATE_RUN;
+			defining->end_pc = getpc();
+		}
 		break;
 	default:
 		break;
 	}
-
-	return value;
 };
 
 /**
- * @brief 関数を実行する
- * @param func 関数オブジェクト
- * @return 戻り値
+ * @brief コードブロック定義状態のときの評価処理
+ * @param code 中間コード
  */
-static int runFunction(Function *func)
+static void evalCondDef(LineCode *code)
 {
-	char *code;
-
-	push(&return_stack, getpc());
-	pushState(state);
-	pushBlock(BLOCK_FUNC);
-
-	fReturn = FALSE;
-
-	// 関数にジャンプ
-	jump(func->start_pc);
+	switch (code->type)
+	{
+	case LINE_IF:
+		pushFrame(BLOCK_IF, state);
+		blockDepth++;
+		break;
+	case LINE_WHILE:
+		pushFrame(BLOCK_WHILE, state);
+		blockDepth++;
+		break;
+	case LINE_FOR:
+		pushFrame(BLOCK_FOR, state);
+		blockDepth++;
+		break;
+	case LINE_SWITCH:
+		pushFrame(BLOCK_SWITCH, state);
+		blockDepth++;
+		break;
+	case LINE_FUNC:
+		pushFrame(BLOCK_FUNC, state);
+		blockDepth++;
+		break;
+	case LINE_END:
+	{
+		Frame *frame = popFrame();
+		blockDepth--;
+		if (blockDepth == 0)
+		{
+			fBlockDefined = TRUE;
+			jump(frame->loop_pc);
+			state = ESTATE_RUN;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+};
 
-	while ((code = fetch()))
+/**
+ * @brief 実行スキップ状態のときの評価処理
+ * @param code 中間コード
+ */
+static void evalSkip(LineCode *code)
+{
+	switch (code->type)
 	{
-		Token *tokens = tokenize(code);
-		if (tokens)
+	case LINE_IF:
+		pushFrame(BLOCK_IF, state);
+		break;
+	case LINE_WHILE:
+		pushFrame(BLOCK_WHILE, state);
+		break;
+	case LINE_FOR:
+		pushFrame(BLOCK_FOR, state);
+		break;
+	case LINE_SWITCH:
+		pushFrame(BLOCK_SWITCH, state);
+		break;
+	case LINE_FUNC:
+		pushFrame(BLOCK_FUNC, state);
+		break;
+	case LINE_ELSE:
+		if (ESTATE_RUN == peekFrame()->state)
 		{
-			Ast *ast = createAst(tokens);
-			eval(ast);
-			releaseAst(ast);
+			state = ESTATE_RUN;
 		}
+		break;
+	case LINE_END:
+	{
+		Frame *frame = popFrame();
+		state = frame->state;
 
-		if (fReturn)
+		// while節に対応するendならプログラムカウンタを飛ばす
+		if (BLOCK_WHILE == frame->block && frame->loop_pc >= 0)
 		{
-			break;
+			jump(frame->loop_pc);
 		}
+		break;
+	}
+	default:
+		break;
+	}
+};
+
+/**
+ * @brief 中間コードを評価する
+ * @param code 中間コード
+ */
+static void eval(LineCode *code)
+{
+	switch (state)
+	{
+	case ESTATE_RUN:
+		execCode(code, 0);
+		break;
+	case ESTATE_FUNC_DEF:
+		evalFunc(code);
+		break;
+	case ESTATE_COND_DEF:
+		evalCondDef(code);
+		break;
+	case ESTATE_SKIP:
+		evalSkip(code);
+		break;
+	default:
+		break;
 	}
+};
 
-	fReturn = FALSE;
+/**
+ * @brief 中間コードを評価し、トレースを記録中なら評価した行を記録する
+ * @param code 中間コード
+ */
+static void evalLine(LineCode *code)
+{
+	ENGINE_STATE before = state;
+	int depth = getFrameDepth();
+
+	eval(code);
 
-	return return_value;
+	if (FALSE == isTraceRecording() || ESTATE_RUN != before)
+	{
+		return;
+	}
+
+	TRACE_LINE_RESULT result;
+	switch (fError ? ESTATE_END : state)
+	{
+	case ESTATE_RUN:
+		result = TRACE_LINE_RUN;
+		break;
+	case ESTATE_SKIP:
+		result = TRACE_LINE_SKIP;
+		break;
+	case ESTATE_COND_DEF:
+		result = TRACE_LINE_DEFER;
+		break;
+	default:
+		result = TRACE_LINE_ABORT;
+		break;
+	}
+	recordTraceLine(code, depth, result);
 };
 
 /**
@@ -730,7 +1804,22 @@ void initEngine(void)
 	initProgram();
 	initMemory();
 	initFuncList();
+	initPurity();
 	initContext();
+	initMemo();
+
+	vstack.values = (int *)calloc(VALUE_STACK_INIT_SIZE, sizeof(int));
+	vstack.sp = 0;
+	vstack.capacity = VALUE_STACK_INIT_SIZE;
+
+	initBuiltins();
+	initCodeCache();
+	initConstants();
+	initTrace();
+	initArrays();
+	initMaps();
+	initMatrices();
+
 	state = ESTATE_RUN;
 };
 
@@ -739,10 +1828,30 @@ void initEngine(void)
  */
 void releaseEngine(void)
 {
+	releaseTrace();
+	releaseCodeCache();
+	releaseConstants();
+	free(vstack.values);
+
+	if (fMemoStats)
+	{
+		printMemoStats();
+	}
+	if (fInsnStats)
+	{
+		fprintf(stderr, "insns : executed = %lu\n", insnCount);
+	}
+
 	releaseProgram();
 	releaseMemory();
 	releaseFuncList();
+	releasePurity();
 	releaseContext();
+	releaseMemo();
+	releaseParallel();
+	releaseArrays();
+	releaseMaps();
+	releaseBuiltins();
 };
 
 /**
@@ -764,27 +1873,85 @@ ENGINE_RESULT runEngine(char *stream)
 	// コードをメモリに保存
 	store(stream);
 
-	// コード実行
-	while ((code = fetch()))
+	// 関数の宣言は読み込んだ時点で記録し、以降の行の変換では同名の組み込み関数より優先する
+	declareFunctionLine(getProgramSize() - 1, stream);
+
+	// 定数の宣言は読み込んだ時点で値を決め、以降の行の変換で値に置き換える
+	if (isConstantLine(stream) && NULL == getLineCode(getProgramSize() - 1, stream))
+	{
+		return RESULT_ERROR;
+	}
+
+	// 逐次実行以外はプログラム全体を読み込んでから実行する
+	if (ENGINE_MODE_TREE != mode)
+	{
+		return ret;
+	}
+
+	// コード実行（関数の呼び出しと復帰もこのループで処理する）
+	while (ESTATE_END != state && FALSE == fError)
 	{
-		Token *tokens = tokenize(code);
-		if (tokens)
+		if (resume_code)
 		{
-			Ast *ast = createAst(tokens);
-			eval(ast);
-			releaseAst(ast);
+			LineCode *line = resume_code;
+			resume_code = NULL;
+			execCode(line, resume_ip);
+			continue;
 		}
 
-		if (ESTATE_END == state)
+		if (NULL == (code = fetch()))
 		{
-			ret = RESULT_EXIT;
 			break;
 		}
+
+		LineCode *line = getLineCode(getpc(), code);
+		if (line)
+		{
+			evalLine(line);
+		}
+	}
+
+	if (ESTATE_END == state)
+	{
+		ret = RESULT_EXIT;
+	}
+	else if (fError)
+	{
+		fError = FALSE;
+		ret = RESULT_ERROR;
 	}
 
 	return ret;
 };
 
+/**
+ * @brief 読み込んだプログラム全体を実行する（逐次実行では何もしない）
+ * @return 結果
+ */
+ENGINE_RESULT finishEngine(void)
+{
+	switch (mode)
+	{
+	case ENGINE_MODE_VM:
+		return runVM(maxCallDepth, fAutoMemo, &insnCount);
+	case ENGINE_MODE_REGVM:
+		return runRegVM(maxCallDepth, fAutoMemo, &insnCount);
+	case ENGINE_MODE_EMIT_C:
+		return emitC(maxCallDepth, fAutoMemo);
+	default:
+		return RESULT_OK;
+	}
+};
+
+/**
+ * @brief 実行方式を設定する
+ * @param engineMode 実行方式
+ */
+void setEngineMode(ENGINE_MODE engineMode)
+{
+	mode = engineMode;
+};
+
 /**
  * @brief 予約語（end）の入力を待っているかどうかを取得する
  * @return 予約語（end）の入力を待っているかどうか
@@ -800,3 +1967,78 @@ BOOL isWaitEnd(void)
 		return FALSE;
 	}
 };
+
+/**
+ * @brief 関数呼び出しの深さの上限を設定する
+ * @param depth 上限
+ */
+void setMaxCallDepth(int depth)
+{
+	maxCallDepth = depth;
+};
+
+/**
+ * @brief 純粋関数の自動メモ化の有無を設定する（memo指定した関数は常にメモ化する）
+ * @param enable 有効にするかどうか
+ */
+void setAutoMemo(BOOL enable)
+{
+	fAutoMemo = enable;
+};
+
+/**
+ * @brief 小さな関数のインライン展開の有無を設定する
+ * @param enable 有効にするかどうか
+ */
+void setInline(BOOL enable)
+{
+	fInline = enable;
+};
+
+/**
+ * @brief 純粋関数の呼び出しを並列評価するモードにする
+ * @param threads スレッド数（行列の積にも使う）
+ * @param cutoff 呼び出しをタスクとして分岐させる深さの上限
+ */
+void setParallel(int threads, int cutoff)
+{
+	initParallel(threads, cutoff);
+	setMatrixThreads(threads);
+	fParallel = TRUE;
+};
+
+/**
+ * @brief 終了時にメモ化の統計情報を表示するかどうかを設定する
+ * @param enable 表示するかどうか
+ */
+void setMemoStats(BOOL enable)
+{
+	fMemoStats = enable;
+};
+
+/**
+ * @brief 終了時に実行した命令数を表示するかどうかを設定する
+ * @param enable 表示するかどうか
+ */
+void setInsnStats(BOOL enable)
+{
+	fInsnStats = enable;
+};
+
+/**
+ * @brief 行ごとの命令列をスレッド化して実行するかどうかを設定する
+ * @param enable 有効にするかどうか
+ */
+void setThreaded(BOOL enable)
+{
+	fThreaded = enable;
+};
+
+/**
+ * @brief ホットなwhileループをトレースにコンパイルして実行するかどうかを設定する
+ * @param enable 有効にするかどうか
+ */
+void setTrace(BOOL enable)
+{
+	fTrace = enable;
+};
@@ -3,6 +3,9 @@
 
 #include "particle.h"
 
+/// 関数呼び出しの深さの上限の既定値
+#define DEFAULT_MAX_CALL_DEPTH (1000000)
+
 typedef enum
 {
 	/// 実行成功
@@ -13,9 +16,48 @@ typedef enum
 	RESULT_EXIT,
 } ENGINE_RESULT;
 
+/// 実行方式
+typedef enum
+{
+	/// １行ずつ解釈して実行する
+	ENGINE_MODE_TREE,
+	/// プログラム全体をバイトコードに変換してスタックマシンで実行する
+	ENGINE_MODE_VM,
+	/// プログラム全体をレジスタマシンの命令列に変換して実行する
+	ENGINE_MODE_REGVM,
+	/// プログラム全体をC言語のソースコードに変換して出力する
+	ENGINE_MODE_EMIT_C,
+} ENGINE_MODE;
+
+/// 左シフト（シフト量は下位5ビットだけを使い、溢れたビットは捨てる）
+#define SHIFT_LEFT(x, n) ((int)((unsigned int)(x) << ((n) & 31)))
+
+/// 右シフト（シフト量は下位5ビットだけを使い、負の値は符号を保つ算術シフト）
+#define SHIFT_RIGHT(x, n) ((x) >> ((n) & 31))
+
+/// 二項演算の実処理
+typedef int (*OPERATOR_FUNC)(int, int);
+
+/// 単項演算の実処理
+typedef int (*UNARY_OPERATOR_FUNC)(int);
+
 void initEngine(void);
 void releaseEngine(void);
 ENGINE_RESULT runEngine(char *);
+ENGINE_RESULT finishEngine(void);
+void setEngineMode(ENGINE_MODE);
 BOOL isWaitEnd(void);
+void setMaxCallDepth(int);
+void setAutoMemo(BOOL);
+void setInline(BOOL);
+void setThreaded(BOOL);
+void setTrace(BOOL);
+void setParallel(int, int);
+void setMemoStats(BOOL);
+void setInsnStats(BOOL);
+
+OPERATOR_FUNC getEngineFunc(char *);
+OPERATOR_FUNC getEngineAssignFunc(char *);
+UNARY_OPERATOR_FUNC getEngineUnaryFunc(char *);
 
 #endif
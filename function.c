@@ -2,11 +2,24 @@
 #include <string.h>
 #include "debug.h"
 #include "function.h"
+#include "util.h"
+
+/// 関数テーブルの初期容量（2のべき乗）
+#define FUNC_TABLE_INIT_SIZE (64)
 
 /// 関数リスト
 typedef struct func_list
 {
+	/// 定義済みの全関数（再定義前のものを含む）
 	Function *functions;
+	/// 関数名をキーとするハッシュテーブル（オープンアドレス法）
+	Function **table;
+	/// ハッシュテーブルの登録数
+	int count;
+	/// ハッシュテーブルの容量
+	int capacity;
+	/// 関数の追加ごとに更新される版数
+	unsigned int version;
 } FuncList;
 
 static FuncList *flist;
@@ -19,6 +32,10 @@ void initFuncList(void)
 	DPRINTF("%s\n", "initFuncList");
 	flist = (FuncList *)calloc(1, sizeof(FuncList));
 	flist->functions = NULL;
+	flist->table = (Function **)calloc(FUNC_TABLE_INIT_SIZE, sizeof(Function *));
+	flist->count = 0;
+	flist->capacity = FUNC_TABLE_INIT_SIZE;
+	flist->version = 1;
 };
 
 /**
@@ -47,6 +64,7 @@ void releaseFuncList(void)
 		free(temp);
 	}
 
+	free(flist->table);
 	free(flist);
 };
 
@@ -66,8 +84,16 @@ Function *createFunction(char *name, int pc)
 		return NULL;
 	}
 	func->start_pc = pc;
+	func->end_pc = -1;
 	strcpy(func->name, name);
 	func->args = NULL;
+	func->argc = 0;
+	func->redefined = NULL;
+	func->memo = FALSE;
+	func->pure = FALSE;
+	func->pure_version = 0;
+	func->bytecode = NULL;
+	func->bytecode_names = NULL;
 	func->next = NULL;
 
 	return func;
@@ -88,6 +114,7 @@ void addArgument(Function *func, char *name)
 		return;
 	}
 	strcpy(new_arg->name, name);
+	func->argc++;
 
 	if (NULL == func->args)
 	{
@@ -105,23 +132,74 @@ void addArgument(Function *func, char *name)
 	}
 };
 
+/**
+ * @brief ハッシュテーブル中で関数名に対応する位置を検索する
+ * @param name 関数名
+ * @return 登録済みの位置、または空き位置
+ */
+static int findSlot(char *name)
+{
+	int mask = flist->capacity - 1;
+	int pos = hashString(name) & mask;
+
+	while (flist->table[pos] && strcmp(name, flist->table[pos]->name) != 0)
+	{
+		pos = (pos + 1) & mask;
+	}
+
+	return pos;
+};
+
+/**
+ * @brief ハッシュテーブルの容量を倍にする
+ */
+static void growTable(void)
+{
+	Function **old = flist->table;
+	int old_capacity = flist->capacity;
+
+	flist->capacity *= 2;
+	flist->table = (Function **)calloc(flist->capacity, sizeof(Function *));
+
+	for (int i = 0; i < old_capacity; i++)
+	{
+		if (old[i])
+		{
+			flist->table[findSlot(old[i]->name)] = old[i];
+		}
+	}
+
+	free(old);
+};
+
 /**
  * @brief 関数リストに関数を追加する
  * @param func 追加する関数
+ * @details 同名の関数が定義済みであれば置き換え、古い関数に再定義されたことを記録する
  */
 void addFunction(Function *func)
 {
 	DPRINTF("addFunction : %s\n", func->name);
 
-	if (NULL == flist->functions)
+	func->next = flist->functions;
+	flist->functions = func;
+
+	if ((flist->count + 1) * 2 > flist->capacity)
+	{
+		growTable();
+	}
+
+	int pos = findSlot(func->name);
+	if (flist->table[pos])
 	{
-		flist->functions = func;
+		flist->table[pos]->redefined = func;
 	}
 	else
 	{
-		func->next = flist->functions;
-		flist->functions = func;
+		flist->count++;
 	}
+	flist->table[pos] = func;
+	flist->version++;
 };
 
 /**
@@ -133,13 +211,23 @@ Function *getFunction(char *name)
 {
 	DPRINTF("getFunction : %s\n", name);
 
-	for (Function *func = flist->functions; func != NULL; func = func->next)
-	{
-		if (strcmp(name, func->name) == 0)
-		{
-			return func;
-		}
-	}
+	return flist->table[findSlot(name)];
+};
+
+/**
+ * @brief 定義済みの全関数を取得する
+ * @return 関数リストの先頭（再定義前の関数を含む）
+ */
+Function *getFunctions(void)
+{
+	return flist->functions;
+};
 
-	return NULL;
+/**
+ * @brief 関数リストの版数を取得する
+ * @return 関数の追加ごとに更新される版数
+ */
+unsigned int getFuncListVersion(void)
+{
+	return flist->version;
 };
@@ -1,6 +1,8 @@
 #ifndef _FUNCTION_H_
 #define _FUNCTION_H_
 
+#include "particle.h"
+
 /// 引数リスト
 typedef struct argument_list
 {
@@ -15,10 +17,26 @@ typedef struct function
 {
 	/// プログラム開始位置
 	int start_pc;
+	/// プログラム終了位置（対応するendの位置、未定義なら-1）
+	int end_pc;
 	/// 関数名
 	char name[64];
 	/// 引数リスト
 	ArgList *args;
+	/// 引数の数
+	int argc;
+	/// 同名で再定義された関数（NULLなら最新の定義）
+	struct function *redefined;
+	/// memo指定の有無
+	BOOL memo;
+	/// 純粋関数かどうか（解析結果）
+	BOOL pure;
+	/// 純粋性を解析したときの関数リストの版数
+	unsigned int pure_version;
+	/// バイトコードに変換した本体（NULLなら本体の行を解析する）
+	struct bc_function *bytecode;
+	/// バイトコードの関数名番号に対応する関数名
+	char **bytecode_names;
 	/// 次の関数
 	struct function *next;
 } Function;
@@ -32,5 +50,7 @@ void addArgument(Function *, char *);
 
 void addFunction(Function *);
 Function *getFunction(char *);
+Function *getFunctions(void);
+unsigned int getFuncListVersion(void);
 
 #endif
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <malloc.h>
+#include "inline.h"
+#include "util.h"
+#include "particle.h"
+
+/**
+ * @brief 仮引数リスト中の位置を取得する
+ * @param func 関数
+ * @param name 変数名
+ * @retval -1 引数ではない
+ * @retval Other 仮引数リスト中の位置
+ */
+static int findArgument(Function *func, char *name)
+{
+	int index = 0;
+
+	for (ArgList *arg = func->args; arg != NULL; arg = arg->next, index++)
+	{
+		if (EQ(arg->name, name))
+		{
+			return index;
+		}
+	}
+
+	return -1;
+};
+
+/**
+ * @brief 関数本体の唯一のreturn文を取得する
+ * @param func 関数
+ * @retval NULL 本体がreturn文１行だけではない
+ * @retval Other return文の中間コード
+ */
+static LineCode *getReturnLine(Function *func)
+{
+	LineCode *ret = NULL;
+
+	if (func->redefined || func->end_pc < 0)
+	{
+		return NULL;
+	}
+
+	for (int pc = func->start_pc + 1; pc < func->end_pc; pc++)
+	{
+		LineCode *code = getCachedCode(pc);
+		if (NULL == code)
+		{
+			return NULL;
+		}
+
+		// 空行とコメント行は無視する
+		if (0 == code->count)
+		{
+			continue;
+		}
+
+		if (LINE_RETURN != code->type || ret)
+		{
+			return NULL;
+		}
+		ret = code;
+	}
+
+	return ret;
+};
+
+/**
+ * @brief 関数本体を展開する
+ * @param out 展開先
+ * @param func 関数
+ * @param height 引数を積んだ後の演算スタックの高さ（展開開始時を0とする）
+ * @param chain 展開中の関数の並び（再帰の検出用）
+ * @param nest 入れ子の深さ
+ * @return 成否
+ * @details 引数は変数に格納せず、演算スタック上の位置で参照するため名前が衝突しない。
+ *          展開後は引数が捨てられ、戻り値だけが残る
+ */
+static BOOL expandFunction(LineCode *out, Function *func, int height, Function **chain, int nest)
+{
+	if (nest >= INLINE_MAX_NEST)
+	{
+		return FALSE;
+	}
+
+	for (int i = 0; i < nest; i++)
+	{
+		if (chain[i] == func)
+		{
+			return FALSE;
+		}
+	}
+	chain[nest] = func;
+
+	LineCode *body = getReturnLine(func);
+	if (NULL == body)
+	{
+		return FALSE;
+	}
+
+	int base = height - func->argc;
+	int map[body->count + 1];
+	int jumps[body->count + 1];
+	int njumps = 0;
+
+	for (int i = 0; i < body->count; i++)
+	{
+		Insn *insn = &body->insns[i];
+
+		map[i] = out->count;
+		switch (insn->op)
+		{
+		case OP_NUMBER:
+			emit(out, OP_NUMBER)->number = insn->number;
+			height++;
+			break;
+		case OP_LOAD:
+		{
+			// 関数内から見える変数は引数だけとする
+			int index = findArgument(func, insn->name);
+			if (index < 0)
+			{
+				return FALSE;
+			}
+			emit(out, OP_PICK)->number = height - (base + index);
+			height++;
+			break;
+		}
+		case OP_BINARY:
+			emit(out, OP_BINARY)->calc = insn->calc;
+			height--;
+			break;
+		case OP_UNARY:
+			emit(out, OP_UNARY)->unary = insn->unary;
+			break;
+		case OP_AND:
+		case OP_OR:
+			// 展開した呼び出しで命令の位置がずれるため、飛び先は元の位置で持っておき後で付け替える
+			jumps[njumps++] = out->count;
+			emit(out, insn->op)->number = i + 1 + insn->number;
+			height--;
+			break;
+		case OP_CALL:
+		case OP_TAIL_CALL:
+		{
+			Function *callee = getFunction(insn->name);
+			if (NULL == callee || callee->argc != insn->number)
+			{
+				return FALSE;
+			}
+			if (FALSE == expandFunction(out, callee, height, chain, nest + 1))
+			{
+				return FALSE;
+			}
+			height = height - callee->argc + 1;
+			break;
+		}
+		case OP_RETURN:
+			break;
+		default:
+			return FALSE;
+		}
+
+		if (out->count > INLINE_MAX_INSNS)
+		{
+			return FALSE;
+		}
+	}
+
+	map[body->count] = out->count;
+	for (int i = 0; i < njumps; i++)
+	{
+		Insn *insn = &out->insns[jumps[i]];
+		insn->number = map[insn->number] - (jumps[i] + 1);
+	}
+
+	if (func->argc > 0)
+	{
+		emit(out, OP_SLIDE)->number = func->argc;
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief 関数呼び出しに置き換える命令列を生成する
+ * @param func 呼び出す関数
+ * @retval NULL インライン展開できない
+ * @retval Other 命令列（引数が積まれた演算スタックで実行すると、引数を戻り値に置き換える）
+ * @details 本体がreturn文１行だけで、引数と定数の演算と展開可能な関数の呼び出しだけからなる
+ *          再帰しない関数を、命令数の上限の範囲で展開する
+ */
+LineCode *createInlineCode(Function *func)
+{
+	LineCode *code = (LineCode *)calloc(1, sizeof(LineCode));
+	Function *chain[INLINE_MAX_NEST];
+
+	code->type = LINE_EXPR;
+
+	if (FALSE == expandFunction(code, func, func->argc, chain, 0))
+	{
+		releaseLineCode(code);
+		return NULL;
+	}
+
+	return code;
+};
@@ -0,0 +1,15 @@
+#ifndef _INLINE_H_
+#define _INLINE_H_
+
+#include "code.h"
+#include "function.h"
+
+/// インライン展開した本体の命令数の上限
+#define INLINE_MAX_INSNS (32)
+
+/// インライン展開する呼び出しの入れ子の上限
+#define INLINE_MAX_NEST (4)
+
+LineCode *createInlineCode(Function *);
+
+#endif
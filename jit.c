@@ -0,0 +1,595 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <string.h>
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+
+/// 生成中のコードの初期容量
+#define JIT_BUFFER_INIT_SIZE (4096)
+
+/// x86-64のレジスタ番号（ModR/Mのregフィールド）
+enum
+{
+	X86_EAX = 0,
+	X86_ECX = 1,
+	X86_EDX = 2,
+	X86_EDI = 7,
+};
+
+/// 生成中のコード
+typedef struct jit_buffer
+{
+	/// コード
+	unsigned char *bytes;
+	/// 長さ
+	size_t count;
+	/// 確保済みの長さ
+	size_t capacity;
+} JitBuffer;
+
+/// 飛び先が未確定のジャンプ
+typedef struct jit_patch
+{
+	/// rel32の位置
+	size_t at;
+	/// 飛び先の命令の位置
+	int target;
+} JitPatch;
+
+/// setccとjccの条件コード（RV_LT〜RV_NE、RV_BLT〜RV_BNEの順）
+static const unsigned char JIT_CONDITION[] = {
+	0x0C, // l
+	0x0F, // g
+	0x0E, // le
+	0x0D, // ge
+	0x04, // e
+	0x05, // ne
+};
+
+/// 入口の共通処理：rbxにレジスタ、r13に代入済みフラグを置いて指定位置に飛ぶ
+static const unsigned char JIT_PROLOGUE[] = {
+	0x53,			  // push rbx
+	0x41, 0x55,		  // push r13
+	0x41, 0x56,		  // push r14（呼び出し時のスタックを16バイト境界に揃える）
+	0x48, 0x89, 0xFB, // mov rbx, rdi
+	0x49, 0x89, 0xF5, // mov r13, rsi
+	0xFF, 0xE2,		  // jmp rdx
+};
+
+/// 出口の共通処理：eaxにインタプリタで実行する命令の位置を入れて戻る
+static const unsigned char JIT_EPILOGUE[] = {
+	0x41, 0x5E, // pop r14
+	0x41, 0x5D, // pop r13
+	0x5B,		// pop rbx
+	0xC3,		// ret
+};
+
+/**
+ * @brief 組み込み関数printの実処理（ネイティブコードから呼び出す）
+ * @param value 値
+ */
+static void jitPrint(int value)
+{
+	printf("%d\n", value);
+};
+
+/**
+ * @brief コードを追加する
+ * @param b 生成中のコード
+ * @param bytes コード
+ * @param n 長さ
+ */
+static void emitBytes(JitBuffer *b, const unsigned char *bytes, size_t n)
+{
+	while (b->count + n > b->capacity)
+	{
+		b->capacity *= 2;
+		b->bytes = (unsigned char *)realloc(b->bytes, b->capacity);
+	}
+	memcpy(b->bytes + b->count, bytes, n);
+	b->count += n;
+};
+
+/**
+ * @brief 1バイト追加する
+ * @param b 生成中のコード
+ * @param byte 値
+ */
+static void emitByte(JitBuffer *b, int byte)
+{
+	unsigned char c = (unsigned char)byte;
+	emitBytes(b, &c, 1);
+};
+
+/**
+ * @brief 4バイトの値を追加する
+ * @param b 生成中のコード
+ * @param value 値
+ */
+static void emit32(JitBuffer *b, int32_t value)
+{
+	emitBytes(b, (unsigned char *)&value, 4);
+};
+
+/**
+ * @brief 仮想マシンのレジスタを被演算子とする命令を追加する（[rbx + disp32]）
+ * @param b 生成中のコード
+ * @param opcode 命令コード（2バイトなら上位バイトから）
+ * @param reg x86-64のレジスタ番号
+ * @param vmreg 仮想マシンのレジスタ番号
+ */
+static void emitRegOperand(JitBuffer *b, int opcode, int reg, int vmreg)
+{
+	if (opcode > 0xFF)
+	{
+		emitByte(b, opcode >> 8);
+	}
+	emitByte(b, opcode & 0xFF);
+	emitByte(b, 0x80 | (reg << 3) | 3);
+	emit32(b, vmreg * (int)sizeof(int));
+};
+
+/**
+ * @brief 代入済みフラグを被演算子とする命令を追加する（byte [r13 + disp32]）
+ * @param b 生成中のコード
+ * @param opcode 命令コード
+ * @param reg ModR/Mのregフィールド
+ * @param slot 変数スロット
+ * @param imm 即値
+ */
+static void emitDefinedOperand(JitBuffer *b, int opcode, int reg, int slot, int imm)
+{
+	emitByte(b, 0x41);
+	emitByte(b, opcode);
+	emitByte(b, 0x80 | (reg << 3) | 5);
+	emit32(b, slot);
+	emitByte(b, imm);
+};
+
+/**
+ * @brief インタプリタに戻る処理を追加する
+ * @param b 生成中のコード
+ * @param index インタプリタで実行する命令の位置
+ */
+static void emitExit(JitBuffer *b, int index)
+{
+	emitByte(b, 0xB8); // mov eax, imm32
+	emit32(b, index);
+	emitByte(b, 0xE9); // jmp rel32（出口の共通処理へ）
+	emit32(b, (int32_t)(sizeof(JIT_PROLOGUE) - (b->count + 4)));
+};
+
+/**
+ * @brief 命令列の中へのジャンプを追加する
+ * @param b 生成中のコード
+ * @param patches 飛び先が未確定のジャンプ
+ * @param npatches ジャンプの数
+ * @param cond 条件コード（-1なら無条件）
+ * @param target 飛び先の命令の位置
+ */
+static void emitJump(JitBuffer *b, JitPatch *patches, int *npatches, int cond, int target)
+{
+	if (cond < 0)
+	{
+		emitByte(b, 0xE9);
+	}
+	else
+	{
+		emitByte(b, 0x0F);
+		emitByte(b, 0x80 | cond);
+	}
+	patches[*npatches].at = b->count;
+	patches[*npatches].target = target;
+	(*npatches)++;
+	emit32(b, 0);
+};
+
+/**
+ * @brief 定数による符号付き除算を乗算とシフトに置き換えるための定数を求める
+ * @param d 除数（絶対値が2以上）
+ * @param magic 乗数の格納先
+ * @param shift 右シフト量の格納先
+ * @details Hacker's Delightの方法による
+ */
+static void computeMagic(int d, int32_t *magic, int *shift)
+{
+	const uint32_t two31 = 0x80000000U;
+	uint32_t ad = d < 0 ? 0U - (uint32_t)d : (uint32_t)d;
+	uint32_t t = two31 + ((uint32_t)d >> 31);
+	uint32_t anc = t - 1 - t % ad;
+	uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+	uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+	uint32_t delta;
+	int p = 31;
+
+	do
+	{
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc)
+		{
+			q1++;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad)
+		{
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && 0 == r1));
+
+	*magic = (int32_t)(q2 + 1);
+	if (d < 0)
+	{
+		*magic = (int32_t)(0U - (q2 + 1));
+	}
+	*shift = p - 32;
+};
+
+/**
+ * @brief 定数による除算または剰余を乗算とシフトで追加する
+ * @param b 生成中のコード
+ * @param insn 命令（RV_DIVIかRV_MODI）
+ */
+static void emitDivConst(JitBuffer *b, RegInsn *insn)
+{
+	int32_t magic;
+	int shift;
+
+	computeMagic(insn->c, &magic, &shift);
+	emitRegOperand(b, 0x8B, X86_ECX, insn->b); // mov ecx, 被除数
+	emitByte(b, 0xB8);						   // mov eax, magic
+	emit32(b, magic);
+	emitByte(b, 0xF7); // imul ecx（edxに積の上位）
+	emitByte(b, 0xE9);
+	if (insn->c > 0 && magic < 0)
+	{
+		emitByte(b, 0x01); // add edx, ecx
+		emitByte(b, 0xCA);
+	}
+	else if (insn->c < 0 && magic > 0)
+	{
+		emitByte(b, 0x29); // sub edx, ecx
+		emitByte(b, 0xCA);
+	}
+	if (shift > 0)
+	{
+		emitByte(b, 0xC1); // sar edx, shift
+		emitByte(b, 0xFA);
+		emitByte(b, shift);
+	}
+	emitByte(b, 0x89); // mov eax, edx
+	emitByte(b, 0xD0);
+	emitByte(b, 0xC1); // shr eax, 31
+	emitByte(b, 0xE8);
+	emitByte(b, 31);
+	emitByte(b, 0x01); // add edx, eax（負の商を0方向に丸める）
+	emitByte(b, 0xC2);
+	if (RV_DIVI == insn->op)
+	{
+		emitRegOperand(b, 0x89, X86_EDX, insn->a);
+		return;
+	}
+	emitByte(b, 0x69); // imul edx, edx, 除数
+	emitByte(b, 0xD2);
+	emit32(b, insn->c);
+	emitByte(b, 0x89); // mov eax, ecx
+	emitByte(b, 0xC8);
+	emitByte(b, 0x29); // sub eax, edx
+	emitByte(b, 0xD0);
+	emitRegOperand(b, 0x89, X86_EAX, insn->a);
+};
+
+/**
+ * @brief 命令をネイティブコードに変換する
+ * @param b 生成中のコード
+ * @param insn 命令
+ * @param index 命令の位置
+ * @param patches 飛び先が未確定のジャンプ
+ * @param npatches ジャンプの数
+ * @details ネイティブコードにしない命令はインタプリタに戻って実行する
+ */
+static void compileInsn(JitBuffer *b, RegInsn *insn, int index, JitPatch *patches, int *npatches)
+{
+	static const unsigned char SETCC_MOVZX[] = {0x0F, 0xB6, 0xC0};
+	static const unsigned char TEST_EAX[] = {0x85, 0xC0};
+
+	switch (insn->op)
+	{
+	case RV_MOVE:
+	case RV_SET:
+	case RV_CHECK:
+		if (RV_CHECK == insn->op)
+		{
+			// 未代入ならエラーの表示をインタプリタに任せる
+			emitDefinedOperand(b, 0x80, 7, insn->b, 0); // cmp byte [r13 + b], 0
+			emitByte(b, 0x75);							 // jne +10
+			emitByte(b, 10);
+			emitExit(b, index);
+		}
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		if (RV_SET == insn->op)
+		{
+			emitDefinedOperand(b, 0xC6, 0, insn->a, 1); // mov byte [r13 + a], 1
+		}
+		break;
+	case RV_ADD:
+	case RV_SUB:
+	case RV_MUL:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitRegOperand(b, RV_ADD == insn->op ? 0x03 : RV_SUB == insn->op ? 0x2B : 0x0FAF, X86_EAX, insn->c);
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_BIT_AND:
+	case RV_BIT_OR:
+	case RV_BIT_XOR:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitRegOperand(b, RV_BIT_AND == insn->op ? 0x23 : RV_BIT_OR == insn->op ? 0x0B : 0x33, X86_EAX, insn->c);
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_SHL:
+	case RV_SHR:
+		// シフト量の下位5ビットだけを使うのはx86のシフト命令と同じ
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitRegOperand(b, 0x8B, X86_ECX, insn->c);
+		emitByte(b, 0xD3); // shl eax, cl / sar eax, cl
+		emitByte(b, RV_SHL == insn->op ? 0xE0 : 0xF8);
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_DIV:
+	case RV_MOD:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitRegOperand(b, 0x8B, X86_ECX, insn->c);
+		emitByte(b, 0x99); // cdq
+		emitByte(b, 0xF7); // idiv ecx
+		emitByte(b, 0xF9);
+		if (RV_MOD == insn->op)
+		{
+			emitByte(b, 0x89); // mov eax, edx
+			emitByte(b, 0xD0);
+		}
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_DIVI:
+	case RV_MODI:
+		emitDivConst(b, insn);
+		break;
+	case RV_LT:
+	case RV_GT:
+	case RV_LE:
+	case RV_GE:
+	case RV_EQ:
+	case RV_NE:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitRegOperand(b, 0x3B, X86_EAX, insn->c);
+		emitByte(b, 0x0F); // setcc al
+		emitByte(b, 0x90 | JIT_CONDITION[insn->op - RV_LT]);
+		emitByte(b, 0xC0);
+		emitBytes(b, SETCC_MOVZX, sizeof(SETCC_MOVZX));
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_NEG:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitByte(b, 0xF7); // neg eax
+		emitByte(b, 0xD8);
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_BIT_NOT:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitByte(b, 0xF7); // not eax
+		emitByte(b, 0xD0);
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_NOT:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->b);
+		emitBytes(b, TEST_EAX, sizeof(TEST_EAX));
+		emitByte(b, 0x0F); // sete al
+		emitByte(b, 0x94);
+		emitByte(b, 0xC0);
+		emitBytes(b, SETCC_MOVZX, sizeof(SETCC_MOVZX));
+		emitRegOperand(b, 0x89, X86_EAX, insn->a);
+		break;
+	case RV_PRINT:
+	{
+		uint64_t helper = (uint64_t)(uintptr_t)jitPrint;
+		emitRegOperand(b, 0x8B, X86_EDI, insn->a);
+		emitByte(b, 0x48); // mov rax, imm64
+		emitByte(b, 0xB8);
+		emitBytes(b, (unsigned char *)&helper, 8);
+		emitByte(b, 0xFF); // call rax
+		emitByte(b, 0xD0);
+		break;
+	}
+	case RV_JUMP:
+		emitJump(b, patches, npatches, -1, index + 1 + insn->a);
+		break;
+	case RV_JUMP_IF_ZERO:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->a);
+		emitBytes(b, TEST_EAX, sizeof(TEST_EAX));
+		emitJump(b, patches, npatches, 0x04, index + 1 + insn->b);
+		break;
+	case RV_JUMP_IF_DEFINED:
+		emitDefinedOperand(b, 0x80, 7, insn->a, 0);
+		emitJump(b, patches, npatches, 0x05, index + 1 + insn->b);
+		break;
+	case RV_BLT:
+	case RV_BGT:
+	case RV_BLE:
+	case RV_BGE:
+	case RV_BEQ:
+	case RV_BNE:
+		emitRegOperand(b, 0x8B, X86_EAX, insn->a);
+		emitRegOperand(b, 0x3B, X86_EAX, insn->b);
+		emitJump(b, patches, npatches, JIT_CONDITION[insn->op - RV_BLT], index + 1 + insn->c);
+		break;
+	case RV_SWITCH:
+	{
+		static const unsigned char DISPATCH[] = {
+			0x48, 0x8D, 0x04, 0x80, // lea rax, [rax + rax*4]
+			0x48, 0x01, 0xD0,		// add rax, rdx
+			0xFF, 0xE0,				// jmp rax
+		};
+		emitRegOperand(b, 0x8B, X86_EAX, insn->a);
+		emitByte(b, 0x2D); // sub eax, 最小値
+		emit32(b, insn->b);
+		emitByte(b, 0x3D); // cmp eax, 表の大きさ
+		emit32(b, insn->c);
+		emitByte(b, 0x73); // jae（直後の命令のジャンプに進む）
+		emitByte(b, 7 + sizeof(DISPATCH));
+
+		// 表のジャンプはそれぞれ5バイトのjmp rel32なので、k番目の位置を計算して飛ぶ
+		emitByte(b, 0x48); // lea rdx, [rip + 表の先頭]
+		emitByte(b, 0x8D);
+		emitByte(b, 0x15);
+		patches[*npatches].at = b->count;
+		patches[*npatches].target = index + 2;
+		(*npatches)++;
+		emit32(b, 0);
+		emitBytes(b, DISPATCH, sizeof(DISPATCH));
+		break;
+	}
+	default:
+		// 呼び出し、復帰、終了、関数定義
+		emitExit(b, index);
+		break;
+	}
+};
+
+/**
+ * @brief 関数をネイティブコードに変換する
+ * @param rf 関数
+ * @retval NULL 変換できない
+ * @retval Other ネイティブコード
+ */
+JitCode *compileJit(RegFunction *rf)
+{
+	JitBuffer b;
+	JitPatch *patches = (JitPatch *)malloc((rf->count + 1) * sizeof(JitPatch));
+	int npatches = 0;
+	int *offsets = (int *)malloc((rf->count + 1) * sizeof(int));
+
+	b.capacity = JIT_BUFFER_INIT_SIZE;
+	b.count = 0;
+	b.bytes = (unsigned char *)malloc(b.capacity);
+
+	emitBytes(&b, JIT_PROLOGUE, sizeof(JIT_PROLOGUE));
+	emitBytes(&b, JIT_EPILOGUE, sizeof(JIT_EPILOGUE));
+
+	for (int i = 0; i < rf->count; i++)
+	{
+		offsets[i] = (int)b.count;
+		compileInsn(&b, &rf->code[i], i, patches, &npatches);
+	}
+	offsets[rf->count] = (int)b.count;
+	emitExit(&b, rf->count);
+
+	for (int i = 0; i < npatches; i++)
+	{
+		int32_t rel = (int32_t)(offsets[patches[i].target] - (int)(patches[i].at + 4));
+		memcpy(b.bytes + patches[i].at, &rel, 4);
+	}
+	free(patches);
+
+	// 書き込み可能なメモリにコピーしてから実行可能に切り替える
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t size = (b.count + page - 1) / page * page;
+	void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == memory)
+	{
+		free(b.bytes);
+		free(offsets);
+		return NULL;
+	}
+	memcpy(memory, b.bytes, b.count);
+	free(b.bytes);
+	if (0 != mprotect(memory, size, PROT_READ | PROT_EXEC))
+	{
+		munmap(memory, size);
+		free(offsets);
+		return NULL;
+	}
+
+	JitCode *jc = (JitCode *)malloc(sizeof(JitCode));
+	jc->memory = (unsigned char *)memory;
+	jc->size = size;
+	jc->offsets = offsets;
+	return jc;
+};
+
+/**
+ * @brief ネイティブコードを破棄する
+ * @param jc ネイティブコード
+ */
+void releaseJit(JitCode *jc)
+{
+	munmap(jc->memory, jc->size);
+	free(jc->offsets);
+	free(jc);
+};
+
+/**
+ * @brief ネイティブコードを実行する
+ * @param jc ネイティブコード
+ * @param r レジスタ
+ * @param defs 変数スロットの代入済みフラグ
+ * @param index 実行を開始する命令の位置
+ * @return インタプリタで実行する命令の位置
+ */
+int enterJit(JitCode *jc, int *r, unsigned char *defs, int index)
+{
+	int (*entry)(int *, unsigned char *, void *);
+	void *memory = jc->memory;
+
+	memcpy(&entry, &memory, sizeof(entry));
+	return entry(r, defs, jc->memory + jc->offsets[index]);
+};
+
+#else
+
+/**
+ * @brief 関数をネイティブコードに変換する（x86-64のLinux以外では変換しない）
+ * @param rf 関数
+ * @return NULL
+ */
+JitCode *compileJit(RegFunction *rf)
+{
+	(void)rf;
+	return NULL;
+};
+
+/**
+ * @brief ネイティブコードを破棄する
+ * @param jc ネイティブコード
+ */
+void releaseJit(JitCode *jc)
+{
+	(void)jc;
+};
+
+/**
+ * @brief ネイティブコードを実行する（呼び出されない）
+ * @param jc ネイティブコード
+ * @param r レジスタ
+ * @param defs 変数スロットの代入済みフラグ
+ * @param index 実行を開始する命令の位置
+ * @return 実行を開始する命令の位置
+ */
+int enterJit(JitCode *jc, int *r, unsigned char *defs, int index)
+{
+	(void)jc;
+	(void)r;
+	(void)defs;
+	return index;
+};
+
+#endif
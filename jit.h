@@ -0,0 +1,26 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include <stddef.h>
+#include "regvm.h"
+#include "particle.h"
+
+/// JITコンパイルする呼び出し回数と後方ジャンプ回数の合計の既定値
+#define DEFAULT_JIT_THRESHOLD (100)
+
+/// ネイティブコード
+typedef struct jit_code
+{
+	/// 実行可能メモリ（先頭は入口と出口の共通処理）
+	unsigned char *memory;
+	/// 確保したサイズ
+	size_t size;
+	/// 各命令に対応するネイティブコードの位置
+	int *offsets;
+} JitCode;
+
+JitCode *compileJit(RegFunction *);
+void releaseJit(JitCode *);
+int enterJit(JitCode *, int *, unsigned char *, int);
+
+#endif
@@ -3,7 +3,8 @@
 #include <memory.h>
 
 #include "checker.h"
-#include "function.h"
+#include "const.h"
+#include "engine.h"
 #include "lexer.h"
 #include "particle.h"
 #include "util.h"
@@ -40,9 +41,9 @@ typedef enum
 	INPUT_CHAR = 0,
 	/// 定数（0 ~ 9）
 	INPUT_NUM,
-	/// 演算子（+, -, *, /, %, =）
+	/// 演算子（+, -, *, /, %, =, &, |, .）
 	INPUT_OP,
-	/// 括弧
+	/// 括弧（(, ), [, ]）
 	INPUT_BRACKET,
 	/// スペース
 	INPUT_SPACE,
@@ -153,14 +154,19 @@ static void createSymbol(Lexer *lxr, char c)
 	{
 		createToken(lxr, TK_FUNCTION);
 	}
-	else if (NULL != getFunction(lxr->buf) || isStrMatch(lxr->buf, "print", "exit"))
+	else if (isStrMatch(lxr->buf, "print", "exit"))
 	{
 		createToken(lxr, TK_FUNCTION);
 	}
-	else if (isStrMatch(lxr->buf, "func", "end", "return", "if", "else", "while"))
+	else if (isStrMatch(lxr->buf, "func", "memo", "const", "end", "return", "if", "else", "while", "for", "switch", "case", "default", "break", "continue"))
 	{
 		createToken(lxr, TK_KEYWORD);
 	}
+	else if (isStrMatch(lxr->buf, "in", "step"))
+	{
+		// for文の区切り（for i in 0..n step 2）は演算子として構文木の節にする
+		createToken(lxr, TK_OPERATION);
+	}
 	else
 	{
 		createToken(lxr, TK_VARIABLE);
@@ -192,6 +198,20 @@ static void createOperation(Lexer *lxr, char c)
 		return;
 	}
 
+	// ビット演算の複合代入（&=、|=、^=）
+	if (c == '=' && 1 == lxr->index && isCharMatch(lxr->buf[0], '&', '|', '^'))
+	{
+		lxr->buf[lxr->index++] = c;
+		return;
+	}
+
+	// 論理演算子（&&、||）、範囲（..）とシフト（<<、>>）
+	if (1 == lxr->index && isCharMatch(c, '&', '|', '.', '<', '>') && lxr->buf[0] == c)
+	{
+		lxr->buf[lxr->index++] = c;
+		return;
+	}
+
 	Token *last = getLastToken(lxr->tokens);
 
 	if (last == NULL || (last->type != TK_VARIABLE && last->type != TK_NUMBER && last->type != TK_RIGHT_BK))
@@ -215,12 +235,34 @@ static void createBracket(Lexer *lxr, char c)
 {
 	if (lxr->buf[0] == '(')
 	{
+		// 直後に"("が続く名前は関数呼び出しとする
+		Token *last = getLastToken(lxr->tokens);
+		if (last && TK_VARIABLE == last->type)
+		{
+			last->type = TK_FUNCTION;
+		}
 		createToken(lxr, TK_LEFT_BK);
 	}
 	else if (lxr->buf[0] == ')')
 	{
 		createToken(lxr, TK_RIGHT_BK);
 	}
+	else if (lxr->buf[0] == '[')
+	{
+		// 添字（a[i]）は( a [] ( i ) )として、演算子"[]"の右辺にする
+		Token *last = getLastToken(lxr->tokens);
+		if (last && TK_VARIABLE == last->type)
+		{
+			lxr->tokens = insertToken(lxr->tokens, last, createLeftBracketToken('('));
+		}
+		lxr->tokens = addToken(lxr->tokens, createOperatorToken("[]"));
+		createToken(lxr, TK_LEFT_BK);
+	}
+	else if (lxr->buf[0] == ']')
+	{
+		lxr->tokens = addToken(lxr->tokens, createRightBracketToken(']'));
+		createToken(lxr, TK_RIGHT_BK);
+	}
 
 	lxr->buf[lxr->index++] = c;
 };
@@ -292,11 +334,11 @@ static int input(Lexer *lxr, char c)
 	{
 		type = INPUT_NUM;
 	}
-	else if (isCharMatch(c, '+', '-', '*', '/', '%', '=', '<', '>', '!', ','))
+	else if (isCharMatch(c, '+', '-', '*', '/', '%', '=', '<', '>', '!', '&', '|', '^', '~', ',', '.'))
 	{
 		type = INPUT_OP;
 	}
-	else if (isCharMatch(c, '(', ')'))
+	else if (isCharMatch(c, '(', ')', '[', ']'))
 	{
 		type = INPUT_BRACKET;
 	}
@@ -340,13 +382,55 @@ static int input(Lexer *lxr, char c)
 	return 0;
 };
 
+/**
+ * @brief 定数の名前を値のトークンに置き換える
+ * @param tokens トークン列
+ * @param pc 行の位置
+ * @return 成否（定数への代入などはエラーを表示する）
+ * @details 構文チェックの前に置き換えるので、定数はcaseの値やstepの増分にも書ける
+ */
+static BOOL replaceConstants(Token *tokens, int pc)
+{
+	BOOL defining = tokens && TK_KEYWORD == tokens->type && isStrMatch(tokens->value.string, "func", "memo");
+	int value;
+
+	for (Token *tk = tokens; tk; tk = tk->next)
+	{
+		if (TK_VARIABLE != tk->type || FALSE == findConstant(tk->value.string, pc, &value))
+		{
+			continue;
+		}
+
+		// 再宣言は定数の表で検出する
+		if (tk->prev && TK_KEYWORD == tk->prev->type && EQ(tk->prev->value.string, "const"))
+		{
+			continue;
+		}
+
+		Token *next = tk->next;
+		BOOL assigned = next && TK_OPERATION == next->type && (EQ(next->value.string, "=") || getEngineAssignFunc(next->value.string));
+		BOOL counter = tk->prev && TK_KEYWORD == tk->prev->type && EQ(tk->prev->value.string, "for");
+		if (defining || assigned || counter)
+		{
+			printError("error : ");
+			printf("\"%s\" is a constant\n", tk->value.string);
+			return FALSE;
+		}
+
+		tk->type = TK_NUMBER;
+		tk->value.number = value;
+	}
+	return TRUE;
+};
+
 /**
  * @brief 入力文字列をトークン列に分解する
  * @param stream 入力文字列
+ * @param pc 行の位置（見える定数を決める）
  * @retval NULL エラー
  * @retval tokenのポインタ 分解されたトークン列
  */
-Token *tokenize(char *stream)
+Token *tokenize(char *stream, int pc)
 {
 	Lexer lxr;
 	memset(lxr.buf, 0, sizeof(lxr.buf));
@@ -364,7 +448,7 @@ Token *tokenize(char *stream)
 
 	input(&lxr, '\0');
 
-	if (FALSE == isCorrectTokens(lxr.tokens))
+	if (FALSE == replaceConstants(lxr.tokens, pc) || FALSE == isCorrectTokens(lxr.tokens))
 	{
 		return NULL;
 	}
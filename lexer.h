@@ -3,6 +3,6 @@
 
 #include "token.h"
 
-Token *tokenize(char *);
+Token *tokenize(char *, int);
 
 #endif
@@ -1,6 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "aot.h"
+#include "cache.h"
 #include "engine.h"
+#include "optimize.h"
+#include "parallel.h"
+#include "regvm.h"
 #include "util.h"
 
 typedef enum
@@ -13,6 +19,15 @@ int main(int argc, char *argv[])
 {
 	INPUT_MODE mode;
 	FILE *fp;
+	char *path = NULL;
+	int status = 0;
+	int threads = 0;
+	int cutoff = DEFAULT_PARALLEL_CUTOFF;
+	BOOL compiled = FALSE;
+	BOOL stopped = FALSE;
+	BOOL cached = FALSE;
+	BOOL loaded = FALSE;
+	char *cacheDir = NULL;
 
 	char stream[256];
 	memset(stream, 0, sizeof(stream));
@@ -20,7 +35,107 @@ int main(int argc, char *argv[])
 	// 初期化
 	initEngine();
 
-	if (argc == 1)
+	// オプションの解析
+	for (int i = 1; i < argc; i++)
+	{
+		if (0 == strncmp(argv[i], "--max-depth=", 12))
+		{
+			setMaxCallDepth(atoi(argv[i] + 12));
+		}
+		else if (EQ(argv[i], "--no-memo"))
+		{
+			setAutoMemo(FALSE);
+		}
+		else if (0 == strncmp(argv[i], "--threads=", 10))
+		{
+			threads = atoi(argv[i] + 10);
+		}
+		else if (0 == strncmp(argv[i], "--par-cutoff=", 13))
+		{
+			cutoff = atoi(argv[i] + 13);
+		}
+		else if (EQ(argv[i], "--vm"))
+		{
+			setEngineMode(ENGINE_MODE_VM);
+			compiled = TRUE;
+		}
+		else if (EQ(argv[i], "--regvm"))
+		{
+			setEngineMode(ENGINE_MODE_REGVM);
+			compiled = TRUE;
+		}
+		else if (EQ(argv[i], "--emit-c"))
+		{
+			setEngineMode(ENGINE_MODE_EMIT_C);
+			beginEmitC();
+			compiled = TRUE;
+		}
+		else if (EQ(argv[i], "--no-jit"))
+		{
+			setJitThreshold(-1);
+		}
+		else if (0 == strncmp(argv[i], "--jit-threshold=", 16))
+		{
+			setJitThreshold(atoi(argv[i] + 16));
+		}
+		else if (EQ(argv[i], "--no-inline"))
+		{
+			setInline(FALSE);
+		}
+		else if (EQ(argv[i], "--no-threaded"))
+		{
+			setThreaded(FALSE);
+		}
+		else if (EQ(argv[i], "--no-trace"))
+		{
+			setTrace(FALSE);
+		}
+		else if (EQ(argv[i], "--cache"))
+		{
+			cached = TRUE;
+		}
+		else if (0 == strncmp(argv[i], "--cache-dir=", 12))
+		{
+			cached = TRUE;
+			cacheDir = argv[i] + 12;
+		}
+		else if (EQ(argv[i], "--no-opt"))
+		{
+			setOptimize(FALSE);
+		}
+		else if (EQ(argv[i], "--memo-stats"))
+		{
+			setMemoStats(TRUE);
+		}
+		else if (EQ(argv[i], "--insn-stats"))
+		{
+			setInsnStats(TRUE);
+		}
+		else if ('-' == argv[i][0])
+		{
+			printError("error : ");
+			printf("unknown option \"%s\"\n", argv[i]);
+			return 1;
+		}
+		else
+		{
+			path = argv[i];
+		}
+	}
+
+	if (threads > 0)
+	{
+		setParallel(threads, cutoff);
+	}
+
+	if (NULL == path && compiled)
+	{
+		printError("error : ");
+		printf("source file is required to compile\n");
+		return 1;
+	}
+
+	if (NULL == path)
 	{
 		mode = MODE_CONSOLE;
 		fp = stdin;
@@ -29,16 +144,22 @@ int main(int argc, char *argv[])
 	else
 	{
 		mode = MODE_FILE;
-		fp = fopen(argv[1], "r");
+		fp = fopen(path, "r");
 		if (!fp)
 		{
 			printError("error : ");
-			printf("failed to open \"%s\"\n", argv[1]);
+			printf("failed to open \"%s\"\n", path);
 			return 1;
 		}
 	}
 
-	while (fgets(stream, sizeof(stream), fp))
+	// 変換済みのキャッシュがあればソースの各行を読み込まない
+	if (cached && compiled)
+	{
+		loaded = openProgramCache(path, cacheDir);
+	}
+
+	while (FALSE == loaded && fgets(stream, sizeof(stream), fp))
 	{
 		stream[strlen(stream) - 1] = '\0'; // 末尾の改行コードを削除
 
@@ -46,6 +167,13 @@ int main(int argc, char *argv[])
 		ENGINE_RESULT ret = runEngine(stream);
 		if (ret == RESULT_EXIT)
 		{
+			stopped = TRUE;
+			break;
+		}
+		else if (ret == RESULT_ERROR && mode == MODE_FILE)
+		{
+			status = 1;
+			stopped = TRUE;
 			break;
 		}
 
@@ -62,13 +190,20 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	// 読み込んだプログラム全体の実行（コンパイルして実行する場合）
+	if (FALSE == stopped && RESULT_ERROR == finishEngine())
+	{
+		status = 1;
+	}
+
 	// リソース開放
 	releaseEngine();
+	closeProgramCache();
 
 	if (mode == MODE_FILE)
 	{
 		fclose(fp);
 	}
 
-	return 0;
+	return status;
 };
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <malloc.h>
+#include "map.h"
+#include "util.h"
+
+/// 連想配列の表
+typedef struct map_table
+{
+	/// 連想配列（添字がハンドル-MAP_HANDLE_BASE-1）
+	Map *items;
+	/// 連想配列の数
+	int count;
+	/// 確保済みの連想配列の数
+	int capacity;
+} MapTable;
+
+static MapTable table;
+
+/**
+ * @brief キーのハッシュ値からスロットの位置を求める
+ * @param key キー
+ * @param shift シフト量
+ * @return 位置
+ * @details 黄金比に基づく乗算ハッシュの上位ビットを使うので、連続したキーも散らばる
+ */
+static unsigned int hashKey(int key, int shift)
+{
+	return ((unsigned int)key * 2654435769u) >> shift;
+};
+
+/**
+ * @brief 空きスロットだけのスロット列を確保する
+ * @param capacity スロット数（2のべき乗）
+ * @retval NULL 確保できない（エラーを表示する）
+ * @retval Other スロット列
+ */
+static MapEntry *allocEntries(unsigned int capacity)
+{
+	MapEntry *entries = (MapEntry *)malloc(capacity * sizeof(MapEntry));
+	if (NULL == entries)
+	{
+		printError("error : ");
+		printf("can't allocate map of %u slots\n", capacity);
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < capacity; i++)
+	{
+		entries[i].key = MAP_EMPTY_KEY;
+	}
+	return entries;
+};
+
+/**
+ * @brief スロット列からキーを探す
+ * @param entries スロット列
+ * @param mask スロット数-1
+ * @param shift シフト量
+ * @param key キー（MAP_EMPTY_KEY以外）
+ * @retval NULL 該当なし
+ * @retval Other キーのスロット
+ */
+static MapEntry *probeEntries(MapEntry *entries, unsigned int mask, int shift, int key)
+{
+	for (unsigned int i = hashKey(key, shift);; i = (i + 1) & mask)
+	{
+		if (entries[i].key == key)
+		{
+			return &entries[i];
+		}
+		if (MAP_EMPTY_KEY == entries[i].key)
+		{
+			return NULL;
+		}
+	}
+};
+
+/**
+ * @brief スロット列の空きスロットにキーを入れる
+ * @param entries スロット列
+ * @param mask スロット数-1
+ * @param shift シフト量
+ * @param key キー（スロット列にないもの）
+ * @param value 値
+ */
+static void insertEntry(MapEntry *entries, unsigned int mask, int shift, int key, int value)
+{
+	unsigned int i = hashKey(key, shift);
+	while (MAP_EMPTY_KEY != entries[i].key)
+	{
+		i = (i + 1) & mask;
+	}
+	entries[i].key = key;
+	entries[i].value = value;
+};
+
+/**
+ * @brief 拡張前のスロットを新しいスロット列に移す
+ * @param map 連想配列
+ * @param steps 移すスロット数
+ * @details 拡張前のスロット列は読むだけにしておくので、移し終えるまでは探査の列が崩れない
+ */
+static void migrateEntries(Map *map, unsigned int steps)
+{
+	for (; steps > 0 && map->migrated <= map->old_mask; steps--, map->migrated++)
+	{
+		MapEntry *e = &map->old_entries[map->migrated];
+		if (MAP_EMPTY_KEY != e->key)
+		{
+			insertEntry(map->entries, map->mask, map->shift, e->key, e->value);
+			map->used++;
+		}
+	}
+
+	if (map->migrated > map->old_mask)
+	{
+		free(map->old_entries);
+		map->old_entries = NULL;
+	}
+};
+
+/**
+ * @brief スロット数を倍にする
+ * @param map 連想配列
+ * @return 成否
+ * @details 拡張前のスロットは以降の追加のたびにMAP_MIGRATE_STEPずつ移す
+ */
+static BOOL growMap(Map *map)
+{
+	if (map->old_entries)
+	{
+		migrateEntries(map, map->old_mask + 1);
+	}
+
+	unsigned int capacity = (map->mask + 1) * 2;
+	if (capacity > MAP_MAX_CAPACITY)
+	{
+		printError("error : ");
+		printf("map can't hold more than %d keys\n", map->count);
+		return FALSE;
+	}
+
+	MapEntry *entries = allocEntries(capacity);
+	if (NULL == entries)
+	{
+		return FALSE;
+	}
+
+	map->old_entries = map->entries;
+	map->old_mask = map->mask;
+	map->old_shift = map->shift;
+	map->migrated = 0;
+	map->entries = entries;
+	map->mask = capacity - 1;
+	map->shift--;
+	map->used = 0;
+	return TRUE;
+};
+
+/**
+ * @brief 連想配列の表を初期化する
+ */
+void initMaps(void)
+{
+	table.items = NULL;
+	table.count = 0;
+	table.capacity = 0;
+};
+
+/**
+ * @brief すべての連想配列を破棄する
+ */
+void releaseMaps(void)
+{
+	for (int i = 0; i < table.count; i++)
+	{
+		free(table.items[i].entries);
+		free(table.items[i].old_entries);
+	}
+	free(table.items);
+	table.items = NULL;
+	table.count = 0;
+	table.capacity = 0;
+};
+
+/**
+ * @brief 空の連想配列を生成する
+ * @retval 0 エラー
+ * @retval Other 連想配列のハンドル
+ * @details 連想配列はプログラムの終了まで破棄しない
+ */
+int createMap(void)
+{
+	MapEntry *entries = allocEntries(MAP_INIT_CAPACITY);
+	if (NULL == entries)
+	{
+		return 0;
+	}
+
+	if (table.count == table.capacity)
+	{
+		table.capacity = table.capacity ? table.capacity * 2 : MAP_TABLE_INIT_SIZE;
+		table.items = (Map *)realloc(table.items, table.capacity * sizeof(Map));
+	}
+
+	Map *map = &table.items[table.count];
+	map->entries = entries;
+	map->mask = MAP_INIT_CAPACITY - 1;
+	map->shift = 32 - __builtin_ctz(MAP_INIT_CAPACITY);
+	map->used = 0;
+	map->old_entries = NULL;
+	map->count = 0;
+	map->has_empty_key = FALSE;
+	return MAP_HANDLE_BASE + ++table.count;
+};
+
+/**
+ * @brief ハンドルの指す連想配列を取得する
+ * @param handle 連想配列のハンドル
+ * @retval NULL 連想配列ではない（エラーを表示する）
+ * @retval Other 連想配列
+ */
+Map *getMap(int handle)
+{
+	if (handle <= MAP_HANDLE_BASE || handle > MAP_HANDLE_BASE + table.count)
+	{
+		printError("error : ");
+		printf("%d is not a map\n", handle);
+		return NULL;
+	}
+	return &table.items[handle - MAP_HANDLE_BASE - 1];
+};
+
+/**
+ * @brief キーの値を探す
+ * @param map 連想配列
+ * @param key キー
+ * @retval NULL 該当なし
+ * @retval Other 値の格納先
+ */
+int *findKey(Map *map, int key)
+{
+	if (MAP_EMPTY_KEY == key)
+	{
+		return map->has_empty_key ? &map->empty_key_value : NULL;
+	}
+
+	MapEntry *e = probeEntries(map->entries, map->mask, map->shift, key);
+	if (NULL == e && map->old_entries)
+	{
+		// まだ移していないキーは拡張前のスロットにある
+		e = probeEntries(map->old_entries, map->old_mask, map->old_shift, key);
+	}
+	return e ? &e->value : NULL;
+};
+
+/**
+ * @brief キーに値を対応付ける
+ * @param map 連想配列
+ * @param key キー
+ * @param value 値
+ * @return 成否
+ */
+BOOL putKey(Map *map, int key, int value)
+{
+	if (map->old_entries)
+	{
+		migrateEntries(map, MAP_MIGRATE_STEP);
+	}
+
+	int *found = findKey(map, key);
+	if (found)
+	{
+		*found = value;
+		return TRUE;
+	}
+
+	if (MAP_EMPTY_KEY == key)
+	{
+		map->has_empty_key = TRUE;
+		map->empty_key_value = value;
+		map->count++;
+		return TRUE;
+	}
+
+	// 使用率が3/4を超えないようにする
+	if ((map->used + 1) * 4 > (int)(map->mask + 1) * 3 && FALSE == growMap(map))
+	{
+		return FALSE;
+	}
+	insertEntry(map->entries, map->mask, map->shift, key, value);
+	map->used++;
+	map->count++;
+	return TRUE;
+};
+
+/**
+ * @brief キーを取り除く
+ * @param map 連想配列
+ * @param key キー
+ * @return キーがあったかどうか
+ * @details 墓標は残さず、後ろに続くスロットを空きに詰め直す（backward shift deletion）
+ */
+BOOL removeKey(Map *map, int key)
+{
+	if (MAP_EMPTY_KEY == key)
+	{
+		BOOL found = map->has_empty_key;
+		map->has_empty_key = FALSE;
+		map->count -= found;
+		return found;
+	}
+
+	// 詰め直すと拡張前のスロットの探査の列が崩れるので、先に移し終える
+	if (map->old_entries)
+	{
+		migrateEntries(map, map->old_mask + 1);
+	}
+
+	MapEntry *e = probeEntries(map->entries, map->mask, map->shift, key);
+	if (NULL == e)
+	{
+		return FALSE;
+	}
+
+	unsigned int hole = e - map->entries;
+	for (unsigned int i = (hole + 1) & map->mask; MAP_EMPTY_KEY != map->entries[i].key; i = (i + 1) & map->mask)
+	{
+		// 本来の位置から見て空きが手前にあるキーだけを空きに移す
+		unsigned int home = hashKey(map->entries[i].key, map->shift);
+		if (((i - home) & map->mask) >= ((i - hole) & map->mask))
+		{
+			map->entries[hole] = map->entries[i];
+			hole = i;
+		}
+	}
+	map->entries[hole].key = MAP_EMPTY_KEY;
+	map->used--;
+	map->count--;
+	return TRUE;
+};
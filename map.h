@@ -0,0 +1,73 @@
+#ifndef _MAP_H_
+#define _MAP_H_
+
+#include <limits.h>
+#include "particle.h"
+
+/// 連想配列のハンドルの始まり（配列のハンドルと重ならず、取り違えるとエラーになる）
+#define MAP_HANDLE_BASE (1 << 30)
+
+/// 連想配列の表の初期容量
+#define MAP_TABLE_INIT_SIZE (16)
+
+/// 連想配列の初期のスロット数（2のべき乗）
+#define MAP_INIT_CAPACITY (16)
+
+/// 連想配列の最大のスロット数（2のべき乗）
+#define MAP_MAX_CAPACITY (1 << 30)
+
+/// 拡張中に1回の追加で移すスロット数
+#define MAP_MIGRATE_STEP (8)
+
+/// 空きスロットを表すキー（このキーの値はスロットの外に持つ）
+#define MAP_EMPTY_KEY (INT_MIN)
+
+/// 連想配列のスロット
+typedef struct map_entry
+{
+	/// キー（MAP_EMPTY_KEYなら空き）
+	int key;
+	/// 値
+	int value;
+} MapEntry;
+
+/**
+ * 整数から整数への連想配列（開番地法、線形探査）
+ * @details 拡張するときは新しい表に少しずつ移し、移し終えるまでは古い表も探す
+ */
+typedef struct map
+{
+	/// スロット
+	MapEntry *entries;
+	/// スロット数-1（スロット数は2のべき乗）
+	unsigned int mask;
+	/// ハッシュ値から位置を取り出すシフト量
+	int shift;
+	/// スロットに入っているキーの数
+	int used;
+	/// 拡張前のスロット（移し終えたらNULL）
+	MapEntry *old_entries;
+	/// 拡張前のスロット数-1
+	unsigned int old_mask;
+	/// 拡張前のシフト量
+	int old_shift;
+	/// 拡張前のスロットのうち次に移す位置
+	unsigned int migrated;
+	/// キーの数
+	int count;
+	/// キーMAP_EMPTY_KEYがあるかどうか
+	BOOL has_empty_key;
+	/// キーMAP_EMPTY_KEYの値
+	int empty_key_value;
+} Map;
+
+void initMaps(void);
+void releaseMaps(void);
+
+int createMap(void);
+Map *getMap(int);
+int *findKey(Map *, int);
+BOOL putKey(Map *, int, int);
+BOOL removeKey(Map *, int);
+
+#endif
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <limits.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "parallel.h"
+#include "util.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MATRIX_SIMD
+#endif
+
+/// 積の小ブロック（MATRIX_TILE_ROWS行×MATRIX_TILE_COLUMNS列）に足し込む処理
+typedef void (*TILE_KERNEL)(int *, const int *, const int *, int, int, int);
+
+/// 行列の積の計算範囲（結果の行の範囲ごとにスレッドに割り当てる）
+typedef struct matrix_task
+{
+	/// 左辺
+	const Array *a;
+	/// 右辺
+	const Array *b;
+	/// 結果（0で初期化済み）
+	Array *c;
+	/// 計算する最初の行
+	int first_row;
+	/// 計算する最後の行の次
+	int end_row;
+} MatrixTask;
+
+/// 行列の積に使うスレッド数
+static int threads = 1;
+/// 実行するCPUに合わせて選んだ小ブロックの処理
+static TILE_KERNEL tileKernel;
+
+/**
+ * @brief 積の小ブロックに足し込む（命令セットを使わない）
+ * @param c 結果の小ブロックの左上
+ * @param a 左辺の小ブロックの行の先頭
+ * @param b 右辺の小ブロックの左上
+ * @param inner 左辺の列数
+ * @param columns 右辺と結果の列数
+ * @param depth 足し込む右辺の行数
+ */
+static void tileScalar(int *c, const int *a, const int *b, int inner, int columns, int depth)
+{
+	for (int i = 0; i < MATRIX_TILE_ROWS; i++)
+	{
+		unsigned int acc[MATRIX_TILE_COLUMNS] = {0};
+		for (int k = 0; k < depth; k++)
+		{
+			unsigned int factor = (unsigned int)a[i * inner + k];
+			for (int j = 0; j < MATRIX_TILE_COLUMNS; j++)
+			{
+				acc[j] += factor * (unsigned int)b[k * columns + j];
+			}
+		}
+		for (int j = 0; j < MATRIX_TILE_COLUMNS; j++)
+		{
+			c[i * columns + j] = (int)((unsigned int)c[i * columns + j] + acc[j]);
+		}
+	}
+};
+
+#if defined(MATRIX_SIMD)
+
+/**
+ * @brief 4要素ごとの積の下位32ビットを求める（SSE2）
+ * @param x 要素
+ * @param y 要素
+ * @return 積
+ */
+static __m128i mulloSse2(__m128i x, __m128i y)
+{
+	__m128i even = _mm_mul_epu32(x, y);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(y, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+};
+
+/**
+ * @brief 積の小ブロックに足し込む（SSE2）
+ * @param c 結果の小ブロックの左上
+ * @param a 左辺の小ブロックの行の先頭
+ * @param b 右辺の小ブロックの左上
+ * @param inner 左辺の列数
+ * @param columns 右辺と結果の列数
+ * @param depth 足し込む右辺の行数
+ * @details レジスタに収まるよう、8列ずつ2回に分けて4行分をレジスタに溜める
+ */
+static void tileSse2(int *c, const int *a, const int *b, int inner, int columns, int depth)
+{
+	for (int j = 0; j < MATRIX_TILE_COLUMNS; j += 8)
+	{
+		__m128i acc[MATRIX_TILE_ROWS][2];
+		for (int i = 0; i < MATRIX_TILE_ROWS; i++)
+		{
+			acc[i][0] = _mm_setzero_si128();
+			acc[i][1] = _mm_setzero_si128();
+		}
+		for (int k = 0; k < depth; k++)
+		{
+			__m128i b0 = _mm_loadu_si128((const __m128i *)(b + k * columns + j));
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(b + k * columns + j + 4));
+			for (int i = 0; i < MATRIX_TILE_ROWS; i++)
+			{
+				__m128i f = _mm_set1_epi32(a[i * inner + k]);
+				acc[i][0] = _mm_add_epi32(acc[i][0], mulloSse2(f, b0));
+				acc[i][1] = _mm_add_epi32(acc[i][1], mulloSse2(f, b1));
+			}
+		}
+		for (int i = 0; i < MATRIX_TILE_ROWS; i++)
+		{
+			__m128i *dst = (__m128i *)(c + i * columns + j);
+			_mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), acc[i][0]));
+			_mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), acc[i][1]));
+		}
+	}
+};
+
+/**
+ * @brief 積の小ブロックに足し込む（AVX2）
+ * @param c 結果の小ブロックの左上
+ * @param a 左辺の小ブロックの行の先頭
+ * @param b 右辺の小ブロックの左上
+ * @param inner 左辺の列数
+ * @param columns 右辺と結果の列数
+ * @param depth 足し込む右辺の行数
+ * @details 4行×16列の結果を8本のレジスタに溜め、右辺の1行を読むたびに左辺の4要素を掛けて足す
+ */
+__attribute__((target("avx2"))) static void tileAvx2(int *c, const int *a, const int *b, int inner, int columns, int depth)
+{
+	__m256i acc[MATRIX_TILE_ROWS][2];
+	for (int i = 0; i < MATRIX_TILE_ROWS; i++)
+	{
+		acc[i][0] = _mm256_setzero_si256();
+		acc[i][1] = _mm256_setzero_si256();
+	}
+	for (int k = 0; k < depth; k++)
+	{
+		__m256i b0 = _mm256_loadu_si256((const __m256i *)(b + k * columns));
+		__m256i b1 = _mm256_loadu_si256((const __m256i *)(b + k * columns + 8));
+		for (int i = 0; i < MATRIX_TILE_ROWS; i++)
+		{
+			__m256i f = _mm256_set1_epi32(a[i * inner + k]);
+			acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_mullo_epi32(f, b0));
+			acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_mullo_epi32(f, b1));
+		}
+	}
+	for (int i = 0; i < MATRIX_TILE_ROWS; i++)
+	{
+		__m256i *dst = (__m256i *)(c + i * columns);
+		_mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst), acc[i][0]));
+		_mm256_storeu_si256(dst + 1, _mm256_add_epi32(_mm256_loadu_si256(dst + 1), acc[i][1]));
+	}
+};
+
+#endif
+
+/**
+ * @brief 行列の積の処理を初期化し、実行するCPUに合わせて小ブロックの処理を選ぶ
+ */
+void initMatrices(void)
+{
+	threads = 1;
+	tileKernel = tileScalar;
+#if defined(MATRIX_SIMD)
+	tileKernel = tileSse2;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		tileKernel = tileAvx2;
+	}
+#endif
+};
+
+/**
+ * @brief 要素がすべて0の行列を生成する
+ * @param rows 行数
+ * @param columns 列数
+ * @retval 0 エラー
+ * @retval Other 行列のハンドル（要素を行ごとに並べた配列）
+ */
+int createMatrix(int rows, int columns)
+{
+	if (rows <= 0 || columns <= 0)
+	{
+		printError("error : ");
+		printf("size of matrix must be positive (%d x %d)\n", rows, columns);
+		return 0;
+	}
+	if ((long)rows * columns > INT_MAX)
+	{
+		printError("error : ");
+		printf("can't allocate matrix of %d x %d\n", rows, columns);
+		return 0;
+	}
+
+	int handle = createArray(rows * columns);
+	if (handle)
+	{
+		getArray(handle)->columns = columns;
+	}
+	return handle;
+};
+
+/**
+ * @brief ハンドルの指す行列を取得する
+ * @param handle 行列のハンドル
+ * @retval NULL 行列ではない（エラーを表示する）
+ * @retval Other 行列
+ */
+Array *getMatrix(int handle)
+{
+	Array *m = getArray(handle);
+	if (m && 0 == m->columns)
+	{
+		printError("error : ");
+		printf("%d is not a matrix\n", handle);
+		return NULL;
+	}
+	return m;
+};
+
+/**
+ * @brief 行列の要素の位置を求める（m[i, j]）
+ * @param handle 行列のハンドル
+ * @param row 行
+ * @param column 列
+ * @param offset 要素を並べた配列の添字の格納先
+ * @return 成否
+ */
+BOOL getMatrixOffset(int handle, int row, int column, int *offset)
+{
+	Array *m = getMatrix(handle);
+	if (NULL == m)
+	{
+		return FALSE;
+	}
+
+	int rows = m->length / m->columns;
+	if ((unsigned int)row >= (unsigned int)rows || (unsigned int)column >= (unsigned int)m->columns)
+	{
+		printError("error : ");
+		printf("index (%d, %d) is out of range of matrix (%d x %d)\n", row, column, rows, m->columns);
+		return FALSE;
+	}
+	*offset = row * m->columns + column;
+	return TRUE;
+};
+
+/**
+ * @brief 行列の積の一部の行を計算する
+ * @param arg 計算範囲
+ * @return NULL
+ * @details 右辺をMATRIX_BLOCK_DEPTH行×MATRIX_BLOCK_COLUMNS列のブロックに分けてキャッシュに載せたまま、
+ *          結果を小ブロックごとにレジスタに溜めて足し込む。小ブロックに満たない端は、
+ *          左辺の要素倍した右辺の行を1行ずつ足し込む
+ */
+static void *multiplyRows(void *arg)
+{
+	MatrixTask *task = (MatrixTask *)arg;
+	const int *a = task->a->data;
+	const int *b = task->b->data;
+	int *c = task->c->data;
+	int inner = task->a->columns;
+	int columns = task->b->columns;
+	int tiled_end = task->first_row + (task->end_row - task->first_row) / MATRIX_TILE_ROWS * MATRIX_TILE_ROWS;
+
+	for (int k0 = 0; k0 < inner; k0 += MATRIX_BLOCK_DEPTH)
+	{
+		int depth = k0 + MATRIX_BLOCK_DEPTH < inner ? MATRIX_BLOCK_DEPTH : inner - k0;
+		for (int j0 = 0; j0 < columns; j0 += MATRIX_BLOCK_COLUMNS)
+		{
+			int j1 = j0 + MATRIX_BLOCK_COLUMNS < columns ? j0 + MATRIX_BLOCK_COLUMNS : columns;
+			int tiled_j1 = j0 + (j1 - j0) / MATRIX_TILE_COLUMNS * MATRIX_TILE_COLUMNS;
+			for (int i = task->first_row; i < task->end_row; i++)
+			{
+				if (i < tiled_end && 0 == (i - task->first_row) % MATRIX_TILE_ROWS)
+				{
+					for (int j = j0; j < tiled_j1; j += MATRIX_TILE_COLUMNS)
+					{
+						tileKernel(&c[i * columns + j], &a[i * inner + k0], &b[k0 * columns + j], inner, columns, depth);
+					}
+				}
+
+				int from = i < tiled_end ? tiled_j1 : j0;
+				for (int k = k0; from < j1 && k < k0 + depth; k++)
+				{
+					axpyInts(&c[i * columns + from], &b[k * columns + from], a[i * inner + k], j1 - from);
+				}
+			}
+		}
+	}
+	return NULL;
+};
+
+/**
+ * @brief 行列の積を求める（matmul(a, b)）
+ * @param x 左辺のハンドル
+ * @param y 右辺のハンドル
+ * @retval 0 エラー
+ * @retval Other 積の行列のハンドル
+ * @details 計算量が多ければ結果の行を分けて複数のスレッドで計算する
+ */
+int multiplyMatrices(int x, int y)
+{
+	Array *a = getMatrix(x);
+	Array *b = a ? getMatrix(y) : NULL;
+	if (NULL == b)
+	{
+		return 0;
+	}
+
+	int rows = a->length / a->columns;
+	if (a->columns != b->length / b->columns)
+	{
+		printError("error : ");
+		printf("can't multiply matrix of %d x %d by matrix of %d x %d\n", rows, a->columns, b->length / b->columns, b->columns);
+		return 0;
+	}
+
+	int handle = createMatrix(rows, b->columns);
+	if (0 == handle)
+	{
+		return 0;
+	}
+	// 表が伸びると配列の位置が変わるので、生成してから取り直す
+	a = getArray(x);
+	b = getArray(y);
+	Array *c = getArray(handle);
+
+	int nthreads = threads < rows ? threads : rows;
+	if (nthreads <= 1 || (long)rows * a->columns * b->columns < MATRIX_PARALLEL_MIN)
+	{
+		MatrixTask task = {a, b, c, 0, rows};
+		multiplyRows(&task);
+		return handle;
+	}
+
+	pthread_t workers[PARALLEL_MAX_THREADS];
+	MatrixTask tasks[PARALLEL_MAX_THREADS];
+	for (int i = 0; i < nthreads; i++)
+	{
+		// 小ブロックが途中で切れないよう、境目をMATRIX_TILE_ROWSの倍数にそろえる
+		int first = (long)rows * i / nthreads / MATRIX_TILE_ROWS * MATRIX_TILE_ROWS;
+		int end = i + 1 < nthreads ? (long)rows * (i + 1) / nthreads / MATRIX_TILE_ROWS * MATRIX_TILE_ROWS : rows;
+		tasks[i] = (MatrixTask){a, b, c, first, end};
+	}
+	for (int i = 1; i < nthreads; i++)
+	{
+		pthread_create(&workers[i], NULL, multiplyRows, &tasks[i]);
+	}
+	multiplyRows(&tasks[0]);
+	for (int i = 1; i < nthreads; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+	return handle;
+};
+
+/**
+ * @brief 転置した行列を求める（transpose(a)）
+ * @param x 行列のハンドル
+ * @retval 0 エラー
+ * @retval Other 転置した行列のハンドル
+ * @details 読み書きの両方がキャッシュに収まるよう、正方形のブロックごとに転置する
+ */
+int transposeMatrix(int x)
+{
+	Array *a = getMatrix(x);
+	if (NULL == a)
+	{
+		return 0;
+	}
+
+	int rows = a->length / a->columns;
+	int columns = a->columns;
+	int handle = createMatrix(columns, rows);
+	if (0 == handle)
+	{
+		return 0;
+	}
+	const int *src = getArray(x)->data;
+	int *dst = getArray(handle)->data;
+
+	for (int i0 = 0; i0 < rows; i0 += MATRIX_BLOCK_TRANSPOSE)
+	{
+		int i1 = i0 + MATRIX_BLOCK_TRANSPOSE < rows ? i0 + MATRIX_BLOCK_TRANSPOSE : rows;
+		for (int j0 = 0; j0 < columns; j0 += MATRIX_BLOCK_TRANSPOSE)
+		{
+			int j1 = j0 + MATRIX_BLOCK_TRANSPOSE < columns ? j0 + MATRIX_BLOCK_TRANSPOSE : columns;
+			for (int i = i0; i < i1; i++)
+			{
+				for (int j = j0; j < j1; j++)
+				{
+					dst[j * rows + i] = src[i * columns + j];
+				}
+			}
+		}
+	}
+	return handle;
+};
+
+/**
+ * @brief 同じ大きさの行列を足し込む（matadd(a, b)）
+ * @param x 足し込む先の行列のハンドル
+ * @param y 足す行列のハンドル
+ * @return 成否
+ */
+BOOL addMatrix(int x, int y)
+{
+	Array *a = getMatrix(x);
+	Array *b = a ? getMatrix(y) : NULL;
+	if (NULL == b)
+	{
+		return FALSE;
+	}
+
+	if (a->columns != b->columns || a->length != b->length)
+	{
+		printError("error : ");
+		printf("can't add matrix of %d x %d to matrix of %d x %d\n", b->length / b->columns, b->columns, a->length / a->columns, a->columns);
+		return FALSE;
+	}
+	axpyInts(a->data, b->data, 1, a->length);
+	return TRUE;
+};
+
+/**
+ * @brief 行列の積に使うスレッド数を設定する
+ * @param count スレッド数（PARALLEL_MAX_THREADSまで）
+ */
+void setMatrixThreads(int count)
+{
+	threads = count < 1 ? 1 : count > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : count;
+};
@@ -0,0 +1,36 @@
+#ifndef _MATRIX_H_
+#define _MATRIX_H_
+
+#include "array.h"
+#include "particle.h"
+
+/// 行列の積で一度に扱う右辺の行数（小ブロックが読む右辺の列を1次キャッシュに収める）
+#define MATRIX_BLOCK_DEPTH (256)
+
+/// 行列の積で一度に扱う列数（右辺のブロックを2次キャッシュに収める）
+#define MATRIX_BLOCK_COLUMNS (256)
+
+/// 結果をレジスタに溜める小ブロックの行数
+#define MATRIX_TILE_ROWS (4)
+
+/// 結果をレジスタに溜める小ブロックの列数
+#define MATRIX_TILE_COLUMNS (16)
+
+/// 転置で一度に扱う正方形のブロックの辺の長さ
+#define MATRIX_BLOCK_TRANSPOSE (32)
+
+/// 行列の積を複数のスレッドで計算する積和の回数の下限
+#define MATRIX_PARALLEL_MIN (1L << 24)
+
+void initMatrices(void);
+
+int createMatrix(int, int);
+Array *getMatrix(int);
+BOOL getMatrixOffset(int, int, int, int *);
+int multiplyMatrices(int, int);
+int transposeMatrix(int);
+BOOL addMatrix(int, int);
+
+void setMatrixThreads(int);
+
+#endif
@@ -5,15 +5,37 @@
 #include "mem.h"
 #include "util.h"
 
-/// 変数マップ
-typedef struct variable_list
+/// 変数領域の初期容量
+#define VARIABLE_INIT_SIZE (1024)
+
+/// 変数名テーブルの初期容量（2のべき乗）
+#define NAME_TABLE_INIT_SIZE (256)
+
+/// 変数領域（メモリ空間の階層順に積まれた変数のスタック）
+typedef struct variable_stack
 {
-	Variable *var;
-	struct variable_list *next;
-} VariableList;
+	/// 変数の配列
+	Variable *vars;
+	/// 使用中の変数の数
+	int count;
+	/// 確保済みの変数の数
+	int capacity;
+} VariableStack;
+
+/// 変数名テーブル
+typedef struct name_table
+{
+	/// 登録済みの変数名（オープンアドレス法）
+	char **names;
+	/// 登録数
+	int count;
+	/// 容量
+	int capacity;
+} NameTable;
 
 static int space;
-static VariableList *vlist;
+static VariableStack vstack;
+static NameTable ntable;
 
 /**
  * @brief 内部メモリを初期化する
@@ -22,7 +44,12 @@ void initMemory(void)
 {
 	DPRINTF("%s\n", "initMemory");
 	space = 0;
-	vlist = NULL;
+	vstack.vars = (Variable *)calloc(VARIABLE_INIT_SIZE, sizeof(Variable));
+	vstack.count = 0;
+	vstack.capacity = VARIABLE_INIT_SIZE;
+	ntable.names = (char **)calloc(NAME_TABLE_INIT_SIZE, sizeof(char *));
+	ntable.count = 0;
+	ntable.capacity = NAME_TABLE_INIT_SIZE;
 };
 
 /**
@@ -31,14 +58,12 @@ void initMemory(void)
 void releaseMemory(void)
 {
 	DPRINTF("%s\n", "releaseMemory");
-	VariableList *var = vlist;
-	while (var)
+	free(vstack.vars);
+	for (int i = 0; i < ntable.capacity; i++)
 	{
-		VariableList *temp = var;
-		var = var->next;
-		free(temp->var);
-		free(temp);
+		free(ntable.names[i]);
 	}
+	free(ntable.names);
 };
 
 /**
@@ -56,16 +81,60 @@ void pushMemorySpace(void)
 void popMemorySpace(void)
 {
 	DPRINTF("%s\n", "popMemorySpace");
-	while (vlist && vlist->var->space == space)
+	while (vstack.count > 0 && vstack.vars[vstack.count - 1].space == space)
 	{
-		VariableList *temp = vlist;
-		vlist = vlist->next;
-		free(temp->var);
-		free(temp);
+		vstack.count--;
 	}
 	space--;
 };
 
+/**
+ * @brief 変数名を登録し、プログラム終了まで有効な同じ内容の文字列を取得する
+ * @param name 変数名
+ * @return 登録済みの変数名
+ */
+const char *internName(const char *name)
+{
+	if ((ntable.count + 1) * 2 > ntable.capacity)
+	{
+		// 容量を倍にして再配置
+		char **old = ntable.names;
+		int old_capacity = ntable.capacity;
+		ntable.capacity *= 2;
+		ntable.names = (char **)calloc(ntable.capacity, sizeof(char *));
+		for (int i = 0; i < old_capacity; i++)
+		{
+			if (old[i])
+			{
+				unsigned int pos = hashString(old[i]) & (ntable.capacity - 1);
+				while (ntable.names[pos])
+				{
+					pos = (pos + 1) & (ntable.capacity - 1);
+				}
+				ntable.names[pos] = old[i];
+			}
+		}
+		free(old);
+	}
+
+	unsigned int pos = hashString(name) & (ntable.capacity - 1);
+	while (ntable.names[pos])
+	{
+		if (EQ(ntable.names[pos], name))
+		{
+			return ntable.names[pos];
+		}
+		pos = (pos + 1) & (ntable.capacity - 1);
+	}
+
+	char *str = (char *)calloc(strlen(name) + 1, sizeof(char));
+	strcpy(str, name);
+	ntable.names[pos] = str;
+	ntable.count++;
+
+	return str;
+};
+
 /**
  * @brief 変数を内部メモリに追加または更新する
  * @param name 変数名
@@ -87,8 +156,14 @@ void setVariable(char *name, int value, VAR_TYPE type)
 	}
 
 	// 変数の新規追加
-	Variable *var = (Variable *)calloc(1, sizeof(Variable));
-	strcpy(var->name, name);
+	if (vstack.count == vstack.capacity)
+	{
+		vstack.capacity *= 2;
+		vstack.vars = (Variable *)realloc(vstack.vars, vstack.capacity * sizeof(Variable));
+	}
+
+	Variable *var = &vstack.vars[vstack.count++];
+	var->name = internName(name);
 	var->value = value;
 
 	switch (type)
@@ -103,30 +178,47 @@ void setVariable(char *name, int value, VAR_TYPE type)
 		var->space = space;
 		break;
 	}
-
-	VariableList *new_vlist = (VariableList *)calloc(1, sizeof(VariableList));
-	new_vlist->var = var;
-	new_vlist->next = vlist;
-
-	vlist = new_vlist;
 };
 
 /**
  * @brief 内部メモリ中の変数を取得する
  * @param name 変数名
- * @return 変数オブジェクト
+ * @return 変数オブジェクト（次の変数追加まで有効）
  */
 Variable *getVariable(char *name)
 {
 	DPRINTF("getVariable : %s\n", name);
-	VariableList *vars;
-	for (vars = vlist; vars; vars = vars->next)
+
+	// 現在のメモリ空間の変数はスタックの上部にまとまっている
+	for (int i = vstack.count - 1; i >= 0 && vstack.vars[i].space >= space; i--)
 	{
-		Variable *var = vars->var;
-		if (EQ(name, var->name) && var->space == space)
+		Variable *var = &vstack.vars[i];
+		if (var->space == space && (name == var->name || EQ(name, var->name)))
 		{
 			return var;
 		}
 	}
 	return NULL;
 };
+
+/**
+ * @brief 内部メモリ中の変数の位置を取得する
+ * @param name 変数名
+ * @retval -1 変数なし
+ * @retval Other 変数領域での位置（変数を追加しても、そのメモリ空間を破棄するまで変わらない）
+ */
+int getVariableIndex(char *name)
+{
+	Variable *var = getVariable(name);
+	return var ? (int)(var - vstack.vars) : -1;
+};
+
+/**
+ * @brief 変数領域での位置から変数を取得する
+ * @param index 変数領域での位置
+ * @return 変数オブジェクト（次の変数追加まで有効）
+ */
+Variable *getVariableByIndex(int index)
+{
+	return &vstack.vars[index];
+};
@@ -4,8 +4,8 @@
 /// 変数
 typedef struct variable
 {
-	/// 変数名
-	char name[64];
+	/// 変数名（internName()で登録した文字列）
+	const char *name;
 	/// 値
 	int value;
 	/// 属するメモリ空間の階層
@@ -27,7 +27,10 @@ void releaseMemory(void);
 void pushMemorySpace(void);
 void popMemorySpace(void);
 
+const char *internName(const char *);
 void setVariable(char *, int, VAR_TYPE);
 Variable *getVariable(char *);
+int getVariableIndex(char *);
+Variable *getVariableByIndex(int);
 
 #endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "memo.h"
+#include "debug.h"
+
+/// 探索する連続スロット数（超えたら先頭のスロットを上書きする）
+#define MEMO_PROBE_COUNT (4)
+
+/// メモ化テーブルの要素
+typedef struct memo_entry
+{
+	/// 関数（NULLなら空き）
+	Function *func;
+	/// 登録時の関数リストの版数
+	unsigned int version;
+	/// 引数
+	int args[MEMO_MAX_ARGS];
+	/// 戻り値
+	int value;
+} MemoEntry;
+
+/// メモ化テーブル
+typedef struct memo_table
+{
+	/// 要素の配列
+	MemoEntry *entries;
+	/// ヒット数
+	unsigned long hits;
+	/// ミス数
+	unsigned long misses;
+	/// 登録数
+	unsigned long stores;
+	/// 上書きで追い出した数
+	unsigned long evictions;
+} MemoTable;
+
+static MemoTable memo;
+
+/**
+ * @brief メモ化テーブルを初期化する
+ */
+void initMemo(void)
+{
+	DPRINTF("%s\n", "initMemo");
+	memo.entries = (MemoEntry *)calloc(MEMO_TABLE_SIZE, sizeof(MemoEntry));
+	memo.hits = 0;
+	memo.misses = 0;
+	memo.stores = 0;
+	memo.evictions = 0;
+};
+
+/**
+ * @brief メモ化テーブルを破棄する
+ */
+void releaseMemo(void)
+{
+	DPRINTF("%s\n", "releaseMemo");
+	free(memo.entries);
+	memo.entries = NULL;
+};
+
+/**
+ * @brief 関数と引数の組からテーブル上の位置を計算する
+ * @param func 関数
+ * @param args 引数
+ * @return テーブル上の位置
+ */
+static unsigned int hashKey(Function *func, int *args)
+{
+	unsigned int hash = (unsigned int)((size_t)func >> 4) * 2654435761u;
+	for (int i = 0; i < func->argc; i++)
+	{
+		hash = (hash ^ (unsigned int)args[i]) * 16777619u;
+	}
+	return hash ^ (hash >> 16);
+};
+
+/**
+ * @brief テーブルの要素が関数と引数の組に一致するかどうかを判定する
+ * @param entry テーブルの要素
+ * @param func 関数
+ * @param args 引数
+ * @return 判定結果
+ */
+static BOOL isMatch(MemoEntry *entry, Function *func, int *args)
+{
+	return entry->func == func &&
+		   entry->version == getFuncListVersion() &&
+		   0 == memcmp(entry->args, args, func->argc * sizeof(int));
+};
+
+/**
+ * @brief 関数の戻り値をメモ化テーブルから検索する
+ * @param func 関数
+ * @param args 引数（func->argc個）
+ * @param value 戻り値の格納先
+ * @return 見つかったかどうか
+ */
+BOOL lookupMemo(Function *func, int *args, int *value)
+{
+	unsigned int pos = hashKey(func, args);
+
+	for (int i = 0; i < MEMO_PROBE_COUNT; i++)
+	{
+		MemoEntry *entry = &memo.entries[(pos + i) & (MEMO_TABLE_SIZE - 1)];
+		if (isMatch(entry, func, args))
+		{
+			memo.hits++;
+			*value = entry->value;
+			return TRUE;
+		}
+	}
+
+	memo.misses++;
+	return FALSE;
+};
+
+/**
+ * @brief 関数の戻り値をメモ化テーブルに登録する
+ * @param func 関数
+ * @param args 引数（func->argc個）
+ * @param value 戻り値
+ */
+void storeMemo(Function *func, int *args, int value)
+{
+	unsigned int pos = hashKey(func, args);
+	MemoEntry *entry = NULL;
+
+	// 空きまたは無効になった要素を探し、なければ先頭を上書きする
+	for (int i = 0; i < MEMO_PROBE_COUNT; i++)
+	{
+		MemoEntry *e = &memo.entries[(pos + i) & (MEMO_TABLE_SIZE - 1)];
+		if (NULL == e->func || e->version != getFuncListVersion() || isMatch(e, func, args))
+		{
+			entry = e;
+			break;
+		}
+	}
+
+	if (NULL == entry)
+	{
+		entry = &memo.entries[pos & (MEMO_TABLE_SIZE - 1)];
+		memo.evictions++;
+	}
+
+	entry->func = func;
+	entry->version = getFuncListVersion();
+	memcpy(entry->args, args, func->argc * sizeof(int));
+	entry->value = value;
+	memo.stores++;
+};
+
+/**
+ * @brief メモ化の統計情報を標準エラー出力に表示する
+ */
+void printMemoStats(void)
+{
+	unsigned long total = memo.hits + memo.misses;
+
+	fprintf(stderr, "memo : hits = %lu, misses = %lu, hit rate = %.1f%%, stores = %lu, evictions = %lu\n",
+			memo.hits, memo.misses, total ? 100.0 * memo.hits / total : 0.0, memo.stores, memo.evictions);
+};
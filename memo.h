@@ -0,0 +1,20 @@
+#ifndef _MEMO_H_
+#define _MEMO_H_
+
+#include "function.h"
+#include "particle.h"
+
+/// メモ化できる引数の数の上限
+#define MEMO_MAX_ARGS (4)
+
+/// メモ化テーブルの要素数（2のべき乗）
+#define MEMO_TABLE_SIZE (1 << 16)
+
+void initMemo(void);
+void releaseMemo(void);
+
+BOOL lookupMemo(Function *, int *, int *);
+void storeMemo(Function *, int *, int);
+void printMemoStats(void);
+
+#endif
@@ -0,0 +1,992 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <limits.h>
+#include "optimize.h"
+
+/// 命令の被演算子のうちレジスタ番号であるもの
+#define OPT_REG_A (1)
+#define OPT_REG_B (2)
+#define OPT_REG_C (4)
+
+/// 命令列の書き換え（命令の位置ごとに持つ）
+typedef struct opt_edit
+{
+	/// 直前に挿入する命令（ループの外からのジャンプはこの先頭に飛ぶ）
+	RegInsn *before;
+	/// 直前に挿入する命令の数
+	int nbefore;
+	/// この位置を先頭とするループの末尾（この範囲からのジャンプは挿入した命令を飛ばす、-1ならループではない）
+	int loop_end;
+	/// 直後に挿入する命令
+	RegInsn *after;
+	/// 直後に挿入する命令の数
+	int nafter;
+	/// 命令を削除するかどうか
+	BOOL deleted;
+} OptEdit;
+
+/// 後方ジャンプで閉じるループ
+typedef struct opt_loop
+{
+	/// 先頭の命令の位置（後方ジャンプの飛び先）
+	int head;
+	/// 末尾の命令の位置（後方ジャンプ）
+	int tail;
+	/// ループ内で書き込むレジスタ
+	unsigned char *written;
+} OptLoop;
+
+/// 帰納変数の乗算を置き換える加算
+typedef struct opt_induction
+{
+	/// ループの番号
+	int loop;
+	/// 帰納変数のレジスタ
+	int var;
+	/// 乗数のレジスタ（ループ不変）
+	int factor;
+	/// 帰納変数の増分のレジスタ（定数）
+	int step;
+} OptInduction;
+
+/// 最適化中の関数
+typedef struct optimizer
+{
+	/// 関数（ジャンプの飛び先は最適化の間だけ絶対位置にする）
+	RegFunction *rf;
+	/// 定数の先頭のレジスタ番号
+	int const_base;
+	/// 終了時に値を読み出すレジスタの数（先頭から）
+	int exit_live;
+	/// ループ
+	OptLoop *loops;
+	/// ループの数
+	int nloops;
+} Optimizer;
+
+/// 最適化するかどうか
+static BOOL fOptimize = TRUE;
+
+/**
+ * @brief 命令の被演算子のうちレジスタ番号であるものを取得する
+ * @param op 命令
+ * @return OPT_REG_A、OPT_REG_B、OPT_REG_Cの組み合わせ
+ */
+static int getRegOperands(int op)
+{
+	if (op >= RV_ADD && op <= RV_NE)
+	{
+		return OPT_REG_A | OPT_REG_B | OPT_REG_C;
+	}
+	if (op >= RV_BLT && op <= RV_BNE)
+	{
+		return OPT_REG_A | OPT_REG_B;
+	}
+
+	switch (op)
+	{
+	case RV_MOVE:
+	case RV_SET:
+	case RV_CHECK:
+	case RV_NEG:
+	case RV_NOT:
+	case RV_BIT_NOT:
+	case RV_DIVI:
+	case RV_MODI:
+		return OPT_REG_A | OPT_REG_B;
+	case RV_INDEX:
+	case RV_STORE_INDEX:
+		return OPT_REG_A | OPT_REG_B | OPT_REG_C;
+	case RV_PRINT:
+	case RV_BUILTIN:
+	case RV_CALL:
+	case RV_TAIL_CALL:
+	case RV_RETURN:
+	case RV_JUMP_IF_ZERO:
+	case RV_JUMP_IF_DEFINED:
+	case RV_SWITCH:
+		return OPT_REG_A;
+	default:
+		return 0;
+	}
+};
+
+/**
+ * @brief 命令がr[a]に書き込むかどうかを判定する
+ * @param op 命令
+ * @return 書き込むかどうか
+ */
+static BOOL isDefining(int op)
+{
+	switch (op)
+	{
+	case RV_PRINT:
+	case RV_STORE_INDEX:
+	case RV_RETURN:
+	case RV_JUMP_IF_ZERO:
+	case RV_JUMP_IF_DEFINED:
+	case RV_SWITCH:
+		return FALSE;
+	default:
+		return 0 != (getRegOperands(op) & OPT_REG_A) && !(op >= RV_BLT && op <= RV_BNE);
+	}
+};
+
+/**
+ * @brief 命令がレジスタに書き込むかどうかを判定する
+ * @param insn 命令
+ * @param reg レジスタ番号
+ * @return 書き込むかどうか（呼び出しはr[a]以降をすべて書き換える）
+ */
+static BOOL writesReg(RegInsn *insn, int reg)
+{
+	if (RV_CALL == insn->op || RV_TAIL_CALL == insn->op)
+	{
+		return reg >= insn->a;
+	}
+	return isDefining(insn->op) && insn->a == reg;
+};
+
+/**
+ * @brief ジャンプ命令の飛び先のオペランドを取得する
+ * @param insn 命令
+ * @retval NULL ジャンプ命令ではない
+ * @retval Other 飛び先のオペランド
+ */
+static int *getTarget(RegInsn *insn)
+{
+	switch (insn->op)
+	{
+	case RV_JUMP:
+		return &insn->a;
+	case RV_JUMP_IF_ZERO:
+	case RV_JUMP_IF_DEFINED:
+		return &insn->b;
+	default:
+		return insn->op >= RV_BLT && insn->op <= RV_BNE ? &insn->c : NULL;
+	}
+};
+
+/**
+ * @brief 命令の後に次の命令を実行することがあるかどうかを判定する
+ * @param op 命令
+ * @return 次の命令を実行することがあるかどうか
+ */
+static BOOL hasFallthrough(int op)
+{
+	return RV_JUMP != op && RV_EXIT != op && RV_HALT != op;
+};
+
+/**
+ * @brief 命令が基本ブロックの末尾になるかどうかを判定する
+ * @param insn 命令
+ * @return 基本ブロックの末尾になるかどうか
+ */
+static BOOL endsBlock(RegInsn *insn)
+{
+	return NULL != getTarget(insn) || !hasFallthrough(insn->op) || RV_RETURN == insn->op || RV_TAIL_CALL == insn->op || RV_SWITCH == insn->op;
+};
+
+/**
+ * @brief レジスタが定数かどうかを判定する
+ * @param o 最適化中の関数
+ * @param reg レジスタ番号
+ * @param value 定数の値の格納先（NULLなら格納しない）
+ * @return 定数かどうか
+ */
+static BOOL getConst(Optimizer *o, int reg, int *value)
+{
+	if (reg < o->const_base || reg >= o->const_base + o->rf->nconsts)
+	{
+		return FALSE;
+	}
+	if (value)
+	{
+		*value = o->rf->consts[reg - o->const_base];
+	}
+	return TRUE;
+};
+
+/**
+ * @brief 結果を使わなければ削除できる命令かどうかを判定する
+ * @param o 最適化中の関数
+ * @param insn 命令
+ * @return 副作用がなく、実行時エラーにもならないかどうか
+ */
+static BOOL isRemovable(Optimizer *o, RegInsn *insn)
+{
+	int value;
+
+	switch (insn->op)
+	{
+	case RV_DIV:
+	case RV_MOD:
+		return getConst(o, insn->c, &value) && 0 != value && -1 != value;
+	case RV_MOVE:
+	case RV_SET:
+	case RV_NEG:
+	case RV_NOT:
+	case RV_BIT_NOT:
+	case RV_DIVI:
+	case RV_MODI:
+		return TRUE;
+	default:
+		return insn->op >= RV_ADD && insn->op <= RV_NE;
+	}
+};
+
+/**
+ * @brief 命令列の書き換えを用意する
+ * @param count 命令列の長さ
+ * @return 書き換え（すべて変更なし）
+ */
+static OptEdit *newEdits(int count)
+{
+	OptEdit *edits = (OptEdit *)calloc(count + 1, sizeof(OptEdit));
+	for (int i = 0; i < count; i++)
+	{
+		edits[i].loop_end = -1;
+	}
+	return edits;
+};
+
+/**
+ * @brief 挿入する命令を追加する
+ * @param list 挿入する命令
+ * @param n 挿入する命令の数
+ * @param op 命令
+ * @param a オペランド
+ * @param b オペランド
+ * @param c オペランド
+ */
+static void appendInsn(RegInsn **list, int *n, int op, int a, int b, int c)
+{
+	*list = (RegInsn *)realloc(*list, (*n + 1) * sizeof(RegInsn));
+	(*list)[*n].op = op;
+	(*list)[*n].a = a;
+	(*list)[*n].b = b;
+	(*list)[*n].c = c;
+	(*n)++;
+};
+
+/**
+ * @brief 命令列を書き換え、ジャンプの飛び先を付け替える
+ * @param o 最適化中の関数
+ * @param edits 書き換え（解放する）
+ */
+static void applyEdits(Optimizer *o, OptEdit *edits)
+{
+	RegFunction *rf = o->rf;
+	int n = rf->count;
+	int *start = (int *)malloc((n + 1) * sizeof(int));
+	int *at = (int *)malloc((n + 1) * sizeof(int));
+	int count = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		start[i] = count;
+		count += edits[i].nbefore;
+		at[i] = count;
+		count += (edits[i].deleted ? 0 : 1) + edits[i].nafter;
+	}
+	start[n] = at[n] = count;
+
+	RegInsn *code = (RegInsn *)malloc((count + 1) * sizeof(RegInsn));
+	int pos = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (edits[i].before)
+		{
+			memcpy(code + pos, edits[i].before, edits[i].nbefore * sizeof(RegInsn));
+			pos += edits[i].nbefore;
+		}
+		if (!edits[i].deleted)
+		{
+			code[pos] = rf->code[i];
+			int *target = getTarget(&code[pos]);
+			if (target)
+			{
+				int t = *target;
+				*target = t < n && i >= t && i <= edits[t].loop_end ? at[t] : start[t];
+			}
+			pos++;
+		}
+		if (edits[i].after)
+		{
+			memcpy(code + pos, edits[i].after, edits[i].nafter * sizeof(RegInsn));
+			pos += edits[i].nafter;
+		}
+		free(edits[i].before);
+		free(edits[i].after);
+	}
+
+	free(rf->code);
+	rf->code = code;
+	rf->count = count;
+	rf->capacity = count + 1;
+	free(start);
+	free(at);
+	free(edits);
+};
+
+/**
+ * @brief 一時値の先頭にレジスタを追加する（呼び出しで書き換えられないように一時値より前に置く）
+ * @param o 最適化中の関数
+ * @param n 追加するレジスタの数
+ * @return 追加したレジスタの先頭の番号
+ */
+static int allocRegisters(Optimizer *o, int n)
+{
+	RegFunction *rf = o->rf;
+	int base = rf->temp_base;
+
+	for (int i = 0; i < rf->count; i++)
+	{
+		RegInsn *insn = &rf->code[i];
+		int mask = getRegOperands(insn->op);
+		if ((mask & OPT_REG_A) && insn->a >= base)
+		{
+			insn->a += n;
+		}
+		if ((mask & OPT_REG_B) && insn->b >= base)
+		{
+			insn->b += n;
+		}
+		if ((mask & OPT_REG_C) && insn->c >= base)
+		{
+			insn->c += n;
+		}
+	}
+	rf->temp_base += n;
+	rf->nregs += n;
+	return base;
+};
+
+/**
+ * @brief ジャンプの飛び先となる命令を調べる
+ * @param o 最適化中の関数
+ * @return 命令の位置ごとの飛び先かどうか
+ */
+static unsigned char *findLabels(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+	unsigned char *labels = (unsigned char *)calloc(rf->count + 1, 1);
+
+	for (int i = 0; i < rf->count; i++)
+	{
+		int *target = getTarget(&rf->code[i]);
+		if (target)
+		{
+			labels[*target] = 1;
+		}
+	}
+	return labels;
+};
+
+/**
+ * @brief 命令で書き込むレジスタを生存集合から除く
+ * @param insn 命令
+ * @param live 生存集合
+ * @param nregs レジスタの数
+ */
+static void killDefs(RegInsn *insn, unsigned char *live, int nregs)
+{
+	if (RV_CALL == insn->op || RV_TAIL_CALL == insn->op)
+	{
+		memset(live + insn->a, 0, nregs - insn->a);
+	}
+	else if (isDefining(insn->op))
+	{
+		live[insn->a] = 0;
+	}
+};
+
+/**
+ * @brief 命令で読み出すレジスタを生存集合に加える
+ * @param insn 命令
+ * @param live 生存集合
+ */
+static void markUses(RegInsn *insn, unsigned char *live)
+{
+	int mask = getRegOperands(insn->op);
+
+	if (RV_CALL == insn->op || RV_TAIL_CALL == insn->op || RV_BUILTIN == insn->op)
+	{
+		memset(live + insn->a, 1, insn->c);
+		return;
+	}
+	if ((mask & OPT_REG_A) && !isDefining(insn->op))
+	{
+		live[insn->a] = 1;
+	}
+	if (mask & OPT_REG_B)
+	{
+		live[insn->b] = 1;
+	}
+	if (mask & OPT_REG_C)
+	{
+		live[insn->c] = 1;
+	}
+};
+
+/**
+ * @brief 各命令の直後で値を使う可能性があるレジスタを求める
+ * @param o 最適化中の関数
+ * @return 命令の位置ごとの生存集合（レジスタの数ずつ並ぶ）
+ */
+static unsigned char *computeLiveOut(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+	int n = rf->count;
+	int nregs = rf->nregs;
+	unsigned char *in = (unsigned char *)calloc((size_t)(n + 1) * nregs, 1);
+	unsigned char *out = (unsigned char *)calloc((size_t)n * nregs + 1, 1);
+	unsigned char *next = (unsigned char *)malloc(nregs + 1);
+	BOOL changed = TRUE;
+
+	while (changed)
+	{
+		changed = FALSE;
+		for (int i = n - 1; i >= 0; i--)
+		{
+			RegInsn *insn = &rf->code[i];
+			unsigned char *live = out + (size_t)i * nregs;
+			int *target = getTarget(insn);
+
+			if (RV_HALT == insn->op)
+			{
+				memset(live, 1, o->exit_live);
+			}
+			for (int reg = 0; reg < nregs; reg++)
+			{
+				live[reg] |= (hasFallthrough(insn->op) ? in[(size_t)(i + 1) * nregs + reg] : 0) | (target ? in[(size_t)*target * nregs + reg] : 0);
+			}
+			for (int k = 2; RV_SWITCH == insn->op && k <= insn->c + 1; k++)
+			{
+				for (int reg = 0; reg < nregs; reg++)
+				{
+					live[reg] |= in[(size_t)(i + k) * nregs + reg];
+				}
+			}
+
+			memcpy(next, live, nregs);
+			killDefs(insn, next, nregs);
+			markUses(insn, next);
+			if (0 != memcmp(next, in + (size_t)i * nregs, nregs))
+			{
+				memcpy(in + (size_t)i * nregs, next, nregs);
+				changed = TRUE;
+			}
+		}
+	}
+
+	free(in);
+	free(next);
+	return out;
+};
+
+/**
+ * @brief 命令が読み出すレジスタを置き換える
+ * @param insn 命令
+ * @param from 置き換え前のレジスタ番号
+ * @param to 置き換え後のレジスタ番号
+ * @details 代入済みフラグを読む被演算子と呼び出しの引数の並びは置き換えない
+ */
+static void replaceUses(RegInsn *insn, int from, int to)
+{
+	int mask = getRegOperands(insn->op);
+
+	if (RV_CHECK == insn->op || RV_CALL == insn->op || RV_TAIL_CALL == insn->op || RV_BUILTIN == insn->op)
+	{
+		return;
+	}
+	if ((mask & OPT_REG_A) && !isDefining(insn->op) && RV_JUMP_IF_DEFINED != insn->op && insn->a == from)
+	{
+		insn->a = to;
+	}
+	if ((mask & OPT_REG_B) && insn->b == from)
+	{
+		insn->b = to;
+	}
+	if ((mask & OPT_REG_C) && insn->c == from)
+	{
+		insn->c = to;
+	}
+};
+
+/**
+ * @brief 一時値へのコピーを基本ブロック内で伝播する
+ * @param o 最適化中の関数
+ */
+static void propagateCopies(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+	unsigned char *labels = findLabels(o);
+
+	for (int i = 0; i < rf->count; i++)
+	{
+		RegInsn *move = &rf->code[i];
+		if (RV_MOVE != move->op || move->a == move->b || move->a < rf->temp_base)
+		{
+			continue;
+		}
+
+		for (int j = i + 1; j < rf->count && !labels[j]; j++)
+		{
+			RegInsn *insn = &rf->code[j];
+			replaceUses(insn, move->a, move->b);
+			if (writesReg(insn, move->a) || writesReg(insn, move->b) || endsBlock(insn))
+			{
+				break;
+			}
+		}
+	}
+
+	free(labels);
+};
+
+/**
+ * @brief 計算結果を直接変数に書き込めるかどうかを判定する
+ * @param op 命令
+ * @return 書き込み先を変えても結果が変わらない命令かどうか
+ */
+static BOOL isRetargetable(int op)
+{
+	return RV_MOVE == op || RV_NEG == op || RV_NOT == op || RV_BIT_NOT == op || RV_DIVI == op || RV_MODI == op || RV_INDEX == op || (op >= RV_ADD && op <= RV_NE);
+};
+
+/**
+ * @brief 使われない値の計算を削除し、一時値を経由する代入を直接の代入にする
+ * @param o 最適化中の関数
+ */
+static void removeDeadCode(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+
+	for (;;)
+	{
+		unsigned char *out = computeLiveOut(o);
+		unsigned char *labels = findLabels(o);
+		OptEdit *edits = newEdits(rf->count);
+		int nregs = rf->nregs;
+		int nremoved = 0;
+
+		for (int i = 0; i < rf->count; i++)
+		{
+			RegInsn *insn = &rf->code[i];
+			RegInsn *next = &rf->code[i + 1];
+
+			if ((RV_MOVE == insn->op && insn->a == insn->b) || (isRemovable(o, insn) && !out[(size_t)i * nregs + insn->a]))
+			{
+				edits[i].deleted = TRUE;
+				nremoved++;
+			}
+			else if (i + 1 < rf->count && !labels[i + 1] && isRetargetable(insn->op) && RV_MOVE == next->op && next->b == insn->a && next->a != insn->a && !out[(size_t)(i + 1) * nregs + insn->a])
+			{
+				// 一時値に計算してから変数に移す代わりに変数に直接計算する
+				insn->a = next->a;
+				edits[i + 1].deleted = TRUE;
+				nremoved++;
+				i++;
+			}
+		}
+
+		free(out);
+		free(labels);
+		if (0 == nremoved)
+		{
+			free(edits);
+			break;
+		}
+		applyEdits(o, edits);
+	}
+};
+
+/**
+ * @brief 定数による除算と剰余を即値の命令にする（ネイティブコードでは乗算とシフトになる）
+ * @param o 最適化中の関数
+ */
+static void reduceDivisions(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+	int value;
+
+	for (int i = 0; i < rf->count; i++)
+	{
+		RegInsn *insn = &rf->code[i];
+		if ((RV_DIV == insn->op || RV_MOD == insn->op) && getConst(o, insn->c, &value) && INT_MIN != value && (value < -1 || value > 1))
+		{
+			insn->op = RV_DIV == insn->op ? RV_DIVI : RV_MODI;
+			insn->c = value;
+		}
+	}
+};
+
+/**
+ * @brief 後方ジャンプで閉じるループを調べる
+ * @param o 最適化中の関数
+ * @details ループの外から途中に飛び込むジャンプがあるループは扱わない
+ */
+static void findLoops(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+	int *tails = (int *)malloc(rf->count * sizeof(int));
+
+	for (int i = 0; i < rf->count; i++)
+	{
+		tails[i] = -1;
+	}
+	for (int i = 0; i < rf->count; i++)
+	{
+		int *target = getTarget(&rf->code[i]);
+		if (target && *target <= i && tails[*target] < i)
+		{
+			tails[*target] = i;
+		}
+	}
+
+	o->loops = (OptLoop *)malloc((rf->count + 1) * sizeof(OptLoop));
+	o->nloops = 0;
+	for (int head = 0; head < rf->count; head++)
+	{
+		int tail = tails[head];
+		BOOL valid = tail >= 0;
+		for (int i = 0; valid && i < rf->count; i++)
+		{
+			int *target = getTarget(&rf->code[i]);
+			if ((i < head || i > tail) && target && *target > head && *target <= tail)
+			{
+				valid = FALSE;
+			}
+		}
+		if (!valid)
+		{
+			continue;
+		}
+
+		OptLoop *loop = &o->loops[o->nloops++];
+		loop->head = head;
+		loop->tail = tail;
+		loop->written = (unsigned char *)calloc(rf->nregs, 1);
+		for (int i = head; i <= tail; i++)
+		{
+			RegInsn *insn = &rf->code[i];
+			if (RV_CALL == insn->op || RV_TAIL_CALL == insn->op)
+			{
+				memset(loop->written + insn->a, 1, rf->nregs - insn->a);
+			}
+			else if (isDefining(insn->op))
+			{
+				loop->written[insn->a] = 1;
+			}
+		}
+	}
+
+	free(tails);
+};
+
+/**
+ * @brief ループの情報を破棄する
+ * @param o 最適化中の関数
+ */
+static void releaseLoops(Optimizer *o)
+{
+	for (int i = 0; i < o->nloops; i++)
+	{
+		free(o->loops[i].written);
+	}
+	free(o->loops);
+	o->loops = NULL;
+	o->nloops = 0;
+};
+
+/**
+ * @brief レジスタの値がループ内で変わらないかどうかを判定する
+ * @param o 最適化中の関数
+ * @param loop ループ
+ * @param reg レジスタ番号
+ * @return ループ内で変わらないかどうか
+ */
+static BOOL isInvariant(Optimizer *o, OptLoop *loop, int reg)
+{
+	return getConst(o, reg, NULL) || !loop->written[reg];
+};
+
+/**
+ * @brief ループ内で値の変わらない計算をループの直前に移す
+ * @param o 最適化中の関数
+ * @return 移した計算があるかどうか
+ * @details 計算はループの先頭に入る前に一度だけ行い、元の位置ではその結果をコピーする
+ */
+static BOOL hoistInvariants(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+	int *chosen = (int *)malloc((rf->count + 1) * sizeof(int));
+	int nhoisted = 0;
+
+	findLoops(o);
+	for (int i = 0; i < rf->count; i++)
+	{
+		RegInsn *insn = &rf->code[i];
+		int mask = getRegOperands(insn->op);
+
+		chosen[i] = -1;
+		if (!isRemovable(o, insn) || RV_MOVE == insn->op || RV_SET == insn->op || insn->a < rf->temp_base)
+		{
+			continue;
+		}
+
+		// 不変である最も外側のループを選ぶ
+		for (int l = 0; l < o->nloops; l++)
+		{
+			OptLoop *loop = &o->loops[l];
+			if (i < loop->head || i > loop->tail || !isInvariant(o, loop, insn->b) || ((mask & OPT_REG_C) && !isInvariant(o, loop, insn->c)))
+			{
+				continue;
+			}
+			if (chosen[i] < 0 || loop->tail - loop->head > o->loops[chosen[i]].tail - o->loops[chosen[i]].head)
+			{
+				chosen[i] = l;
+			}
+		}
+		if (chosen[i] >= 0)
+		{
+			nhoisted++;
+		}
+	}
+
+	if (nhoisted > 0)
+	{
+		int reg = allocRegisters(o, nhoisted);
+		OptEdit *edits = newEdits(rf->count);
+		for (int i = 0; i < rf->count; i++)
+		{
+			if (chosen[i] < 0)
+			{
+				continue;
+			}
+			OptLoop *loop = &o->loops[chosen[i]];
+			RegInsn *insn = &rf->code[i];
+			appendInsn(&edits[loop->head].before, &edits[loop->head].nbefore, insn->op, reg, insn->b, insn->c);
+			edits[loop->head].loop_end = loop->tail;
+			insn->op = RV_MOVE;
+			insn->b = reg++;
+			insn->c = 0;
+		}
+		applyEdits(o, edits);
+	}
+
+	free(chosen);
+	releaseLoops(o);
+	return nhoisted > 0;
+};
+
+/**
+ * @brief 変数がループの基本帰納変数（定数の加減算だけで更新する変数）かどうかを判定する
+ * @param o 最適化中の関数
+ * @param loop ループ
+ * @param var レジスタ番号
+ * @param step 増分のレジスタ番号の格納先
+ * @return 基本帰納変数かどうか
+ */
+static BOOL isInductionVariable(Optimizer *o, OptLoop *loop, int var, int *step)
+{
+	int updates = 0;
+
+	*step = -1;
+	if (var >= o->const_base)
+	{
+		return FALSE;
+	}
+	for (int i = loop->head; i <= loop->tail; i++)
+	{
+		RegInsn *insn = &o->rf->code[i];
+		if (!writesReg(insn, var))
+		{
+			continue;
+		}
+		if ((RV_ADD != insn->op && RV_SUB != insn->op) || insn->a != var || insn->b != var || !getConst(o, insn->c, NULL) || (*step >= 0 && *step != insn->c))
+		{
+			return FALSE;
+		}
+		*step = insn->c;
+		updates++;
+	}
+	return updates > 0;
+};
+
+/**
+ * @brief 帰納変数とループ不変値の乗算を、帰納変数の更新ごとの加算に置き換える
+ * @param o 最適化中の関数
+ * @return 置き換えた乗算があるかどうか
+ */
+static BOOL reduceInductions(Optimizer *o)
+{
+	RegFunction *rf = o->rf;
+	OptInduction *ivs = (OptInduction *)malloc((rf->count + 1) * sizeof(OptInduction));
+	int *which = (int *)malloc((rf->count + 1) * sizeof(int));
+	int nivs = 0;
+
+	findLoops(o);
+	for (int i = 0; i < rf->count; i++)
+	{
+		RegInsn *insn = &rf->code[i];
+		OptInduction found = {-1, -1, -1, -1};
+
+		which[i] = -1;
+		if (RV_MUL != insn->op || insn->a < rf->temp_base)
+		{
+			continue;
+		}
+
+		// 条件を満たす最も内側のループを選ぶ
+		for (int l = 0; l < o->nloops; l++)
+		{
+			OptLoop *loop = &o->loops[l];
+			int var, factor, step;
+			if (i < loop->head || i > loop->tail || (found.loop >= 0 && loop->tail - loop->head >= o->loops[found.loop].tail - o->loops[found.loop].head))
+			{
+				continue;
+			}
+			if (insn->c < rf->temp_base && isInvariant(o, loop, insn->c) && isInductionVariable(o, loop, insn->b, &step))
+			{
+				var = insn->b;
+				factor = insn->c;
+			}
+			else if (insn->b < rf->temp_base && isInvariant(o, loop, insn->b) && isInductionVariable(o, loop, insn->c, &step))
+			{
+				var = insn->c;
+				factor = insn->b;
+			}
+			else
+			{
+				continue;
+			}
+			found.loop = l;
+			found.var = var;
+			found.factor = factor;
+			found.step = step;
+		}
+		if (found.loop < 0)
+		{
+			continue;
+		}
+
+		for (which[i] = 0; which[i] < nivs; which[i]++)
+		{
+			OptInduction *iv = &ivs[which[i]];
+			if (iv->loop == found.loop && iv->var == found.var && iv->factor == found.factor)
+			{
+				break;
+			}
+		}
+		if (which[i] == nivs)
+		{
+			ivs[nivs++] = found;
+		}
+	}
+
+	if (nivs > 0)
+	{
+		// 帰納変数ごとに積と増分の積の2つのレジスタを使う
+		int base = allocRegisters(o, nivs * 2);
+		OptEdit *edits = newEdits(rf->count);
+		for (int k = 0; k < nivs; k++)
+		{
+			OptInduction *iv = &ivs[k];
+			OptLoop *loop = &o->loops[iv->loop];
+			int product = base + k * 2;
+			appendInsn(&edits[loop->head].before, &edits[loop->head].nbefore, RV_MUL, product, iv->var, iv->factor);
+			appendInsn(&edits[loop->head].before, &edits[loop->head].nbefore, RV_MUL, product + 1, iv->step, iv->factor);
+			edits[loop->head].loop_end = loop->tail;
+			for (int i = loop->head; i <= loop->tail; i++)
+			{
+				if (writesReg(&rf->code[i], iv->var))
+				{
+					appendInsn(&edits[i].after, &edits[i].nafter, rf->code[i].op, product, product, product + 1);
+				}
+			}
+		}
+		for (int i = 0; i < rf->count; i++)
+		{
+			if (which[i] >= 0)
+			{
+				rf->code[i].op = RV_MOVE;
+				rf->code[i].b = base + which[i] * 2;
+				rf->code[i].c = 0;
+			}
+		}
+		applyEdits(o, edits);
+	}
+
+	free(ivs);
+	free(which);
+	releaseLoops(o);
+	return nivs > 0;
+};
+
+/**
+ * @brief ジャンプの飛び先を相対位置と絶対位置の間で変換する
+ * @param rf 関数
+ * @param sign 相対位置から絶対位置なら1、逆なら-1
+ */
+static void convertTargets(RegFunction *rf, int sign)
+{
+	for (int i = 0; i < rf->count; i++)
+	{
+		int *target = getTarget(&rf->code[i]);
+		if (target)
+		{
+			*target += sign * (i + 1);
+		}
+	}
+};
+
+/**
+ * @brief レジスタマシンの関数を最適化する
+ * @param rf 関数
+ * @param const_base 定数の先頭のレジスタ番号
+ * @param exit_live 終了時に値を読み出すレジスタの数（先頭から）
+ * @details 定数による除算の即値化、コピー伝播と不要な代入の削除、ループ不変式の移動、帰納変数の乗算の加算化を行う
+ */
+void optimizeRegFunction(RegFunction *rf, int const_base, int exit_live)
+{
+	Optimizer o;
+
+	if (!fOptimize)
+	{
+		return;
+	}
+
+	o.rf = rf;
+	o.const_base = const_base;
+	o.exit_live = exit_live;
+	o.loops = NULL;
+	o.nloops = 0;
+
+	convertTargets(rf, 1);
+	reduceDivisions(&o);
+	propagateCopies(&o);
+	removeDeadCode(&o);
+	for (int round = 0; round < OPT_MAX_ROUNDS && hoistInvariants(&o); round++)
+	{
+		propagateCopies(&o);
+		removeDeadCode(&o);
+	}
+	if (reduceInductions(&o))
+	{
+		propagateCopies(&o);
+		removeDeadCode(&o);
+	}
+	convertTargets(rf, -1);
+};
+
+/**
+ * @brief 最適化するかどうかを設定する
+ * @param enable 最適化するかどうか
+ */
+void setOptimize(BOOL enable)
+{
+	fOptimize = enable;
+};
@@ -0,0 +1,13 @@
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+#include "regvm.h"
+#include "particle.h"
+
+/// ループ不変式の移動を繰り返す回数の上限（移動した式を使う式を次の回で移動する）
+#define OPT_MAX_ROUNDS (8)
+
+void optimizeRegFunction(RegFunction *, int, int);
+void setOptimize(BOOL);
+
+#endif
@@ -0,0 +1,1083 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "parallel.h"
+#include "code.h"
+#include "engine.h"
+#include "util.h"
+#include "debug.h"
+
+/// 関数単位に変換した命令列の初期容量
+#define PAR_CODE_INIT_SIZE (32)
+
+/// 変数スロットの初期容量
+#define PAR_SLOT_INIT_SIZE (8)
+
+/// 制御構造の入れ子の上限
+#define PAR_MAX_BLOCK_NEST (64)
+
+/// タスクキューの初期容量
+#define TASK_QUEUE_INIT_SIZE (64)
+
+/// 待機状態に入るまでにタスクを盗もうとする回数
+#define STEAL_RETRY_COUNT (64)
+
+struct par_func;
+
+/// 並列評価用の命令
+typedef struct par_insn
+{
+	/// 命令の種類
+	OPCODE op;
+	/// 定数（OP_NUMBER）、スロット番号（OP_LOAD、OP_STORE、OP_ASSIGN_OP）、引数の数（OP_CALL）、ジャンプ先までの距離（OP_JUMP、OP_JUMP_IF_FALSE、OP_AND、OP_OR）
+	int number;
+	/// 二項演算の実処理（OP_BINARY、OP_ASSIGN_OP）
+	OPERATOR_FUNC calc;
+	/// 単項演算の実処理（OP_UNARY）
+	UNARY_OPERATOR_FUNC unary;
+	/// 呼び出す関数（OP_CALL）
+	struct par_func *callee;
+} ParInsn;
+
+/// 並列評価用に変換した関数
+typedef struct par_func
+{
+	/// 元の関数
+	Function *func;
+	/// 命令列（制御構造はジャンプに、変数はスロット番号に変換済み）
+	ParInsn *insns;
+	/// 命令数
+	int count;
+	/// 確保済みの命令数
+	int capacity;
+	/// 変数名（添字がスロット番号、先頭に引数が並ぶ）
+	char **names;
+	/// 変数の数
+	int nslots;
+	/// 確保済みの変数の数
+	int slot_capacity;
+	/// 演算スタックの最大の深さ
+	int max_stack;
+	/// 並列評価できるかどうか
+	BOOL ok;
+	/// 呼び出しが深すぎて並列評価を中止したことがあるかどうか（以降は通常の実行で呼び出す）
+	BOOL too_deep;
+	/// 次の関数
+	struct par_func *next;
+} ParFunc;
+
+/// 関数呼び出しのタスク
+typedef struct task
+{
+	/// 呼び出す関数
+	ParFunc *func;
+	/// 呼び出しの深さ
+	int depth;
+	/// 戻り値
+	int result;
+	/// 実行が完了したかどうか
+	int done;
+	/// 引数
+	int args[];
+} Task;
+
+/// 演算スタックの要素（未完了のタスクの戻り値を含む）
+typedef struct par_value
+{
+	/// 値
+	int value;
+	/// 値を計算中のタスク（NULLなら計算済み）
+	Task *task;
+} ParValue;
+
+/// タスクキュー（所有者は底から、他のワーカーは先頭から取り出す）
+typedef struct task_queue
+{
+	/// 排他制御
+	pthread_mutex_t lock;
+	/// タスクの配列
+	Task **tasks;
+	/// 先頭の位置
+	int top;
+	/// 底の位置
+	int bottom;
+	/// 確保済みの要素数
+	int capacity;
+} TaskQueue;
+
+/// ワーカー
+typedef struct worker
+{
+	/// ワーカー番号（0は呼び出し元のスレッド）
+	int id;
+	/// タスクキュー
+	TaskQueue queue;
+	/// スレッド
+	pthread_t thread;
+} Worker;
+
+/// スレッドプール
+typedef struct thread_pool
+{
+	/// ワーカー
+	Worker workers[PARALLEL_MAX_THREADS];
+	/// スレッド数
+	int threads;
+	/// タスクを分岐させる深さの上限
+	int cutoff;
+	/// 待機状態の排他制御
+	pthread_mutex_t lock;
+	/// 待機中のワーカーを起こす条件変数
+	pthread_cond_t wake;
+	/// 並列評価の実行中かどうか
+	int active;
+	/// 待機中のワーカー数
+	int sleeping;
+	/// 終了要求
+	int shutdown;
+	/// 並列評価を中止したかどうか
+	int aborted;
+	/// 呼び出しが深すぎて中止したかどうか
+	int too_deep;
+	/// 初期化済みかどうか
+	BOOL started;
+} ThreadPool;
+
+static ThreadPool pool;
+
+/// 変換済みの関数
+static ParFunc *parFuncs = NULL;
+
+/// 変換したときの関数リストの版数
+static unsigned int parVersion = 0;
+
+/// 呼び出し先の確認が済んでいない関数があるかどうか
+static BOOL parDirty = FALSE;
+
+static int evalPar(Worker *, ParFunc *, int *, int);
+
+/**
+ * @brief タスクキューを初期化する
+ * @param queue タスクキュー
+ */
+static void initQueue(TaskQueue *queue)
+{
+	pthread_mutex_init(&queue->lock, NULL);
+	queue->tasks = (Task **)calloc(TASK_QUEUE_INIT_SIZE, sizeof(Task *));
+	queue->top = 0;
+	queue->bottom = 0;
+	queue->capacity = TASK_QUEUE_INIT_SIZE;
+};
+
+/**
+ * @brief タスクキューを破棄する
+ * @param queue タスクキュー
+ */
+static void releaseQueue(TaskQueue *queue)
+{
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->tasks);
+	queue->tasks = NULL;
+};
+
+/**
+ * @brief タスクキューの底にタスクを積む
+ * @param queue タスクキュー
+ * @param task タスク
+ */
+static void pushTask(TaskQueue *queue, Task *task)
+{
+	pthread_mutex_lock(&queue->lock);
+	if (queue->top == queue->bottom)
+	{
+		queue->top = 0;
+		queue->bottom = 0;
+	}
+	if (queue->bottom == queue->capacity)
+	{
+		queue->capacity *= 2;
+		queue->tasks = (Task **)realloc(queue->tasks, queue->capacity * sizeof(Task *));
+	}
+	queue->tasks[queue->bottom++] = task;
+	pthread_mutex_unlock(&queue->lock);
+
+	// 待機中のワーカーがいれば起こす
+	if (__atomic_load_n(&pool.sleeping, __ATOMIC_RELAXED))
+	{
+		pthread_mutex_lock(&pool.lock);
+		pthread_cond_signal(&pool.wake);
+		pthread_mutex_unlock(&pool.lock);
+	}
+};
+
+/**
+ * @brief タスクキューの底からタスクを取り出す（所有者用）
+ * @param queue タスクキュー
+ * @retval NULL 空
+ * @retval Other タスク
+ */
+static Task *popTask(TaskQueue *queue)
+{
+	Task *task = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->bottom > queue->top)
+	{
+		task = queue->tasks[--queue->bottom];
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return task;
+};
+
+/**
+ * @brief 他のワーカーのタスクキューの先頭からタスクを盗む
+ * @param self 盗む側のワーカー
+ * @retval NULL 盗めるタスクがない
+ * @retval Other タスク
+ */
+static Task *stealTask(Worker *self)
+{
+	for (int i = 1; i < pool.threads; i++)
+	{
+		TaskQueue *queue = &pool.workers[(self->id + i) % pool.threads].queue;
+		Task *task = NULL;
+
+		pthread_mutex_lock(&queue->lock);
+		if (queue->bottom > queue->top)
+		{
+			task = queue->tasks[queue->top++];
+		}
+		pthread_mutex_unlock(&queue->lock);
+
+		if (task)
+		{
+			return task;
+		}
+	}
+
+	return NULL;
+};
+
+/**
+ * @brief タスクを実行する
+ * @param self 実行するワーカー
+ * @param task タスク
+ */
+static void runTask(Worker *self, Task *task)
+{
+	task->result = evalPar(self, task->func, task->args, task->depth);
+	__atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+};
+
+/**
+ * @brief タスクの完了を待ち、戻り値を取得する
+ * @param self 待つ側のワーカー
+ * @param value 演算スタックの要素
+ * @return 値
+ * @details 待つ間は自分のキューに残ったタスクか、他のワーカーのタスクを実行する
+ */
+static int force(Worker *self, ParValue *value)
+{
+	Task *task = value->task;
+	if (NULL == task)
+	{
+		return value->value;
+	}
+
+	while (0 == __atomic_load_n(&task->done, __ATOMIC_ACQUIRE))
+	{
+		Task *next = popTask(&self->queue);
+		if (NULL == next)
+		{
+			next = stealTask(self);
+		}
+
+		if (next)
+		{
+			runTask(self, next);
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+
+	value->value = task->result;
+	value->task = NULL;
+	free(task);
+
+	return value->value;
+};
+
+/**
+ * @brief 並列評価を中止する（呼び出し元で通常の実行に切り替える）
+ */
+static void abortParallel(void)
+{
+	__atomic_store_n(&pool.aborted, 1, __ATOMIC_RELAXED);
+};
+
+/**
+ * @brief 並列評価を中止したかどうかを取得する
+ * @return 中止したかどうか
+ */
+static BOOL isAborted(void)
+{
+	return __atomic_load_n(&pool.aborted, __ATOMIC_RELAXED) ? TRUE : FALSE;
+};
+
+/**
+ * @brief 演算スタックに残った未完了のタスクをすべて待つ
+ * @param self ワーカー
+ * @param stack 演算スタック
+ * @param sp 使用中の要素数
+ */
+static void drain(Worker *self, ParValue *stack, int sp)
+{
+	while (sp > 0)
+	{
+		force(self, &stack[--sp]);
+	}
+};
+
+/**
+ * @brief 変換した関数を評価する
+ * @param self 実行するワーカー
+ * @param f 関数
+ * @param args 引数
+ * @param depth 呼び出しの深さ
+ * @return 戻り値
+ * @details 分岐の深さの上限までは、呼び出しをタスクとしてキューに積んで評価を続け、
+ *          値が必要になった時点で完了を待つ
+ */
+static int evalPar(Worker *self, ParFunc *f, int *args, int depth)
+{
+	if (depth > PARALLEL_MAX_DEPTH)
+	{
+		__atomic_store_n(&pool.too_deep, 1, __ATOMIC_RELAXED);
+		abortParallel();
+		return 0;
+	}
+	if (isAborted())
+	{
+		return 0;
+	}
+
+	int slots[f->nslots + 1];
+	BOOL defined[f->nslots + 1];
+	ParValue stack[f->max_stack + 1];
+	int sp = 0;
+
+	for (int i = 0; i < f->nslots; i++)
+	{
+		slots[i] = i < f->func->argc ? args[i] : 0;
+		defined[i] = i < f->func->argc;
+	}
+
+	for (int ip = 0;; ip++)
+	{
+		ParInsn *insn = &f->insns[ip];
+
+		switch (insn->op)
+		{
+		case OP_NUMBER:
+			stack[sp].value = insn->number;
+			stack[sp++].task = NULL;
+			break;
+		case OP_LOAD:
+			// 未定義の変数の参照は通常の実行でエラーを出力させる
+			if (FALSE == defined[insn->number])
+			{
+				abortParallel();
+				drain(self, stack, sp);
+				return 0;
+			}
+			stack[sp].value = slots[insn->number];
+			stack[sp++].task = NULL;
+			break;
+		case OP_STORE:
+			slots[insn->number] = force(self, &stack[sp - 1]);
+			defined[insn->number] = TRUE;
+			break;
+		case OP_ASSIGN_OP:
+		{
+			int value = force(self, &stack[sp - 1]);
+			if (FALSE == defined[insn->number])
+			{
+				abortParallel();
+				drain(self, stack, sp);
+				return 0;
+			}
+			slots[insn->number] = insn->calc(slots[insn->number], value);
+			stack[sp - 1].value = slots[insn->number];
+			break;
+		}
+		case OP_BINARY:
+		{
+			// 後に積んだ右辺から待つ（自分のキューに残っていれば自分で実行する）
+			int right = force(self, &stack[sp - 1]);
+			int left = force(self, &stack[sp - 2]);
+			sp--;
+			stack[sp - 1].value = insn->calc(left, right);
+			break;
+		}
+		case OP_UNARY:
+			stack[sp - 1].value = insn->unary(force(self, &stack[sp - 1]));
+			break;
+		case OP_AND:
+			if (0 == force(self, &stack[sp - 1]))
+			{
+				ip += insn->number;
+			}
+			else
+			{
+				sp--;
+			}
+			break;
+		case OP_OR:
+			if (0 != force(self, &stack[sp - 1]))
+			{
+				stack[sp - 1].value = 1;
+				ip += insn->number;
+			}
+			else
+			{
+				sp--;
+			}
+			break;
+		case OP_POP:
+			force(self, &stack[--sp]);
+			break;
+		case OP_CALL:
+		{
+			int argc = insn->number;
+			int cargs[argc + 1];
+
+			sp -= argc;
+			for (int i = argc - 1; i >= 0; i--)
+			{
+				cargs[i] = force(self, &stack[sp + i]);
+			}
+
+			if (pool.threads > 1 && depth < pool.cutoff)
+			{
+				Task *task = (Task *)malloc(sizeof(Task) + argc * sizeof(int));
+				task->func = insn->callee;
+				task->depth = depth + 1;
+				task->done = 0;
+				memcpy(task->args, cargs, argc * sizeof(int));
+				pushTask(&self->queue, task);
+				stack[sp].task = task;
+			}
+			else
+			{
+				stack[sp].value = evalPar(self, insn->callee, cargs, depth + 1);
+				stack[sp].task = NULL;
+			}
+			sp++;
+			break;
+		}
+		case OP_JUMP:
+			if (insn->number < 0 && isAborted())
+			{
+				drain(self, stack, sp);
+				return 0;
+			}
+			ip += insn->number;
+			break;
+		case OP_JUMP_IF_FALSE:
+			if (0 == force(self, &stack[--sp]))
+			{
+				ip += insn->number;
+			}
+			break;
+		case OP_RETURN:
+		{
+			int value = force(self, &stack[--sp]);
+			drain(self, stack, sp);
+			return value;
+		}
+		default:
+			break;
+		}
+	}
+};
+
+/**
+ * @brief 変換した命令列の末尾に命令を追加する
+ * @param f 関数
+ * @param op 命令の種類
+ * @return 追加した命令の位置
+ */
+static int emitPar(ParFunc *f, OPCODE op)
+{
+	if (f->count == f->capacity)
+	{
+		f->capacity = f->capacity ? f->capacity * 2 : PAR_CODE_INIT_SIZE;
+		f->insns = (ParInsn *)realloc(f->insns, f->capacity * sizeof(ParInsn));
+	}
+
+	ParInsn *insn = &f->insns[f->count];
+	memset(insn, 0, sizeof(ParInsn));
+	insn->op = op;
+	return f->count++;
+};
+
+/**
+ * @brief ジャンプ命令の飛び先を設定する
+ * @param f 関数
+ * @param at ジャンプ命令の位置
+ * @param target 飛び先の位置
+ */
+static void patchJump(ParFunc *f, int at, int target)
+{
+	f->insns[at].number = target - (at + 1);
+};
+
+/**
+ * @brief 変数のスロット番号を取得する（なければ割り当てる）
+ * @param f 関数
+ * @param name 変数名
+ * @return スロット番号
+ */
+static int getSlot(ParFunc *f, char *name)
+{
+	for (int i = 0; i < f->nslots; i++)
+	{
+		if (EQ(f->names[i], name))
+		{
+			return i;
+		}
+	}
+
+	if (f->nslots == f->slot_capacity)
+	{
+		f->slot_capacity = f->slot_capacity ? f->slot_capacity * 2 : PAR_SLOT_INIT_SIZE;
+		f->names = (char **)realloc(f->names, f->slot_capacity * sizeof(char *));
+	}
+	f->names[f->nslots] = name;
+	return f->nslots++;
+};
+
+static ParFunc *getParFunc(Function *);
+
+/**
+ * @brief 関数本体を並列評価用の命令列に変換する
+ * @param f 変換先
+ * @return 成否
+ */
+static BOOL translate(ParFunc *f)
+{
+	Function *func = f->func;
+
+	/// 変換中の制御構造
+	struct
+	{
+		/// 制御構造の種類（OP_IF、OP_ELSE、OP_WHILE、OP_FOR）
+		OPCODE op;
+		/// 条件式の先頭の位置
+		int start;
+		/// 飛び先が未設定のジャンプ命令の位置
+		int jump;
+		/// 飛び先が未設定のbreakのジャンプ命令の位置（numberに次の位置をつなぐ、-1ならなし）
+		int breaks;
+		/// 飛び先が未設定のcontinueのジャンプ命令の位置（forのみ、つなぎ方はbreaksと同じ）
+		int continues;
+		/// ループ変数のスロット番号（forのみ）
+		int slot;
+		/// 増分（forのみ）
+		int step;
+	} blocks[PAR_MAX_BLOCK_NEST];
+	int nest = 0;
+
+	for (ArgList *arg = func->args; arg != NULL; arg = arg->next)
+	{
+		getSlot(f, arg->name);
+	}
+
+	for (int pc = func->start_pc + 1; pc < func->end_pc; pc++)
+	{
+		LineCode *code = getCachedCode(pc);
+		if (NULL == code)
+		{
+			return FALSE;
+		}
+
+		int start = f->count;
+		int height = 0;
+		int map[code->count + 1];
+		int jumps[code->count + 1];
+		int njumps = 0;
+
+		for (int i = 0; i < code->count; i++)
+		{
+			Insn *insn = &code->insns[i];
+			int at;
+
+			map[i] = f->count;
+			switch (insn->op)
+			{
+			case OP_NUMBER:
+				at = emitPar(f, OP_NUMBER);
+				f->insns[at].number = insn->number;
+				height++;
+				break;
+			case OP_LOAD:
+				at = emitPar(f, OP_LOAD);
+				f->insns[at].number = getSlot(f, insn->name);
+				height++;
+				break;
+			case OP_STORE:
+			case OP_ASSIGN_OP:
+				at = emitPar(f, insn->op);
+				f->insns[at].number = getSlot(f, insn->name);
+				f->insns[at].calc = insn->calc;
+				break;
+			case OP_BINARY:
+				at = emitPar(f, OP_BINARY);
+				f->insns[at].calc = insn->calc;
+				height--;
+				break;
+			case OP_UNARY:
+				at = emitPar(f, OP_UNARY);
+				f->insns[at].unary = insn->unary;
+				break;
+			case OP_AND:
+			case OP_OR:
+				// 飛び先は行の中の命令の位置で持っておき、行の変換後に付け替える
+				at = emitPar(f, insn->op);
+				f->insns[at].number = i + 1 + insn->number;
+				jumps[njumps++] = at;
+				height--;
+				break;
+			case OP_POP:
+				emitPar(f, OP_POP);
+				height--;
+				break;
+			case OP_CALL:
+			case OP_TAIL_CALL:
+			{
+				Function *callee = getFunction(insn->name);
+				if (NULL == callee || FALSE == callee->pure || callee->argc != insn->number)
+				{
+					return FALSE;
+				}
+				ParFunc *target = getParFunc(callee);
+				at = emitPar(f, OP_CALL);
+				f->insns[at].number = insn->number;
+				f->insns[at].callee = target;
+				height = height - insn->number + 1;
+				break;
+			}
+			case OP_IF_ENTER:
+			case OP_WHILE_ENTER:
+			case OP_FOR_ENTER:
+				break;
+			case OP_IF:
+			case OP_WHILE:
+				if (nest == PAR_MAX_BLOCK_NEST)
+				{
+					return FALSE;
+				}
+				blocks[nest].op = insn->op;
+				blocks[nest].start = start;
+				blocks[nest].jump = emitPar(f, OP_JUMP_IF_FALSE);
+				blocks[nest].breaks = -1;
+				nest++;
+				height--;
+				break;
+			case OP_FOR:
+				// 増分が定数のときだけ、終端値を隠れた変数に置いて条件の判定に変換する
+				if (nest == PAR_MAX_BLOCK_NEST || 0 == insn->number)
+				{
+					return FALSE;
+				}
+				blocks[nest].op = OP_FOR;
+				blocks[nest].breaks = -1;
+				blocks[nest].continues = -1;
+				blocks[nest].slot = getSlot(f, insn->name);
+				blocks[nest].step = insn->number;
+				// emitParは命令列を確保し直すので、位置を受け取ってから書き込む
+				at = emitPar(f, OP_STORE);
+				f->insns[at].number = getSlot(f, getForSlotName(pc, FALSE));
+				emitPar(f, OP_POP);
+				at = emitPar(f, OP_STORE);
+				f->insns[at].number = blocks[nest].slot;
+				emitPar(f, OP_POP);
+				blocks[nest].start = f->count;
+				at = emitPar(f, OP_LOAD);
+				f->insns[at].number = blocks[nest].slot;
+				at = emitPar(f, OP_LOAD);
+				f->insns[at].number = getSlot(f, getForSlotName(pc, FALSE));
+				at = emitPar(f, OP_BINARY);
+				f->insns[at].calc = getEngineFunc(insn->number > 0 ? "<" : ">");
+				blocks[nest].jump = emitPar(f, OP_JUMP_IF_FALSE);
+				nest++;
+				height = 0;
+				if (f->max_stack < 2)
+				{
+					f->max_stack = 2;
+				}
+				break;
+			case OP_ELSE:
+				if (0 == nest || OP_IF != blocks[nest - 1].op)
+				{
+					return FALSE;
+				}
+				at = emitPar(f, OP_JUMP);
+				patchJump(f, blocks[nest - 1].jump, f->count);
+				blocks[nest - 1].op = OP_ELSE;
+				blocks[nest - 1].jump = at;
+				break;
+			case OP_END:
+				if (0 == nest)
+				{
+					return FALSE;
+				}
+				nest--;
+				if (OP_FOR == blocks[nest].op)
+				{
+					for (int next; blocks[nest].continues >= 0; blocks[nest].continues = next)
+					{
+						next = f->insns[blocks[nest].continues].number;
+						patchJump(f, blocks[nest].continues, f->count);
+					}
+					at = emitPar(f, OP_NUMBER);
+					f->insns[at].number = blocks[nest].step;
+					at = emitPar(f, OP_ASSIGN_OP);
+					f->insns[at].number = blocks[nest].slot;
+					f->insns[at].calc = getEngineAssignFunc("+=");
+					emitPar(f, OP_POP);
+				}
+				if (OP_WHILE == blocks[nest].op || OP_FOR == blocks[nest].op)
+				{
+					patchJump(f, emitPar(f, OP_JUMP), blocks[nest].start);
+				}
+				patchJump(f, blocks[nest].jump, f->count);
+				for (int next; blocks[nest].breaks >= 0; blocks[nest].breaks = next)
+				{
+					next = f->insns[blocks[nest].breaks].number;
+					patchJump(f, blocks[nest].breaks, f->count);
+				}
+				break;
+			case OP_BREAK:
+			case OP_CONTINUE:
+			{
+				int loop = nest - 1;
+				while (loop >= 0 && OP_WHILE != blocks[loop].op && OP_FOR != blocks[loop].op)
+				{
+					loop--;
+				}
+				if (loop < 0)
+				{
+					return FALSE;
+				}
+
+				at = emitPar(f, OP_JUMP);
+				if (OP_BREAK == insn->op)
+				{
+					f->insns[at].number = blocks[loop].breaks;
+					blocks[loop].breaks = at;
+				}
+				else if (OP_FOR == blocks[loop].op)
+				{
+					f->insns[at].number = blocks[loop].continues;
+					blocks[loop].continues = at;
+				}
+				else
+				{
+					patchJump(f, at, blocks[loop].start);
+				}
+				break;
+			}
+			case OP_RETURN:
+				emitPar(f, OP_RETURN);
+				height--;
+				break;
+			default:
+				return FALSE;
+			}
+
+			if (height > f->max_stack)
+			{
+				f->max_stack = height;
+			}
+		}
+
+		map[code->count] = f->count;
+		for (int i = 0; i < njumps; i++)
+		{
+			patchJump(f, jumps[i], map[f->insns[jumps[i]].number]);
+		}
+	}
+
+	if (0 != nest)
+	{
+		return FALSE;
+	}
+
+	// 末尾に達したら0を返す
+	int at = emitPar(f, OP_NUMBER);
+	f->insns[at].number = 0;
+	emitPar(f, OP_RETURN);
+	if (f->max_stack < 1)
+	{
+		f->max_stack = 1;
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief 変換済みの関数をすべて破棄する
+ */
+static void releaseParFuncs(void)
+{
+	ParFunc *f = parFuncs;
+	while (f)
+	{
+		ParFunc *next = f->next;
+		free(f->insns);
+		free(f->names);
+		free(f);
+		f = next;
+	}
+	parFuncs = NULL;
+};
+
+/**
+ * @brief 並列評価用に変換した関数を取得する（未変換なら変換する）
+ * @param func 関数
+ * @return 変換した関数
+ */
+static ParFunc *getParFunc(Function *func)
+{
+	for (ParFunc *f = parFuncs; f != NULL; f = f->next)
+	{
+		if (f->func == func)
+		{
+			return f;
+		}
+	}
+
+	// 再帰呼び出しで自身を参照できるよう、変換前にリストに加える
+	ParFunc *f = (ParFunc *)calloc(1, sizeof(ParFunc));
+	f->func = func;
+	f->next = parFuncs;
+	parFuncs = f;
+	parDirty = TRUE;
+
+	f->ok = translate(f);
+
+	return f;
+};
+
+/**
+ * @brief 呼び出し先に並列評価できない関数を含む関数を除く
+ */
+static void checkCallees(void)
+{
+	BOOL changed = TRUE;
+
+	while (changed)
+	{
+		changed = FALSE;
+		for (ParFunc *f = parFuncs; f != NULL; f = f->next)
+		{
+			for (int i = 0; f->ok && i < f->count; i++)
+			{
+				if (OP_CALL == f->insns[i].op && FALSE == f->insns[i].callee->ok)
+				{
+					f->ok = FALSE;
+					changed = TRUE;
+				}
+			}
+		}
+	}
+};
+
+/**
+ * @brief ワーカースレッドの処理
+ * @param arg ワーカー
+ * @return NULL
+ */
+static void *workerMain(void *arg)
+{
+	Worker *self = (Worker *)arg;
+	int retry = 0;
+
+	while (1)
+	{
+		// 並列評価中でないか、盗めるタスクがしばらく見つからなければ待機する
+		if (0 == __atomic_load_n(&pool.active, __ATOMIC_RELAXED) || retry >= STEAL_RETRY_COUNT)
+		{
+			pthread_mutex_lock(&pool.lock);
+			if (0 == pool.shutdown)
+			{
+				__atomic_add_fetch(&pool.sleeping, 1, __ATOMIC_RELAXED);
+				pthread_cond_wait(&pool.wake, &pool.lock);
+				__atomic_sub_fetch(&pool.sleeping, 1, __ATOMIC_RELAXED);
+			}
+			int shutdown = pool.shutdown;
+			pthread_mutex_unlock(&pool.lock);
+
+			if (shutdown)
+			{
+				break;
+			}
+			retry = 0;
+		}
+
+		Task *task = stealTask(self);
+		if (task)
+		{
+			runTask(self, task);
+			retry = 0;
+		}
+		else
+		{
+			retry++;
+			sched_yield();
+		}
+	}
+
+	return NULL;
+};
+
+/**
+ * @brief 並列評価のスレッドプールを初期化する
+ * @param threads スレッド数（呼び出し元のスレッドを含む）
+ * @param cutoff タスクを分岐させる深さの上限
+ */
+void initParallel(int threads, int cutoff)
+{
+	DPRINTF("%s\n", "initParallel");
+
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+	else if (threads > PARALLEL_MAX_THREADS)
+	{
+		threads = PARALLEL_MAX_THREADS;
+	}
+
+	pool.threads = threads;
+	pool.cutoff = cutoff;
+	pool.active = 0;
+	pool.sleeping = 0;
+	pool.shutdown = 0;
+	pool.aborted = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.wake, NULL);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, PARALLEL_STACK_SIZE);
+
+	for (int i = 0; i < threads; i++)
+	{
+		pool.workers[i].id = i;
+		initQueue(&pool.workers[i].queue);
+
+		// ワーカー0は呼び出し元のスレッドが兼ねる
+		if (i > 0)
+		{
+			pthread_create(&pool.workers[i].thread, &attr, workerMain, &pool.workers[i]);
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+	pool.started = TRUE;
+};
+
+/**
+ * @brief 並列評価のスレッドプールを破棄する
+ */
+void releaseParallel(void)
+{
+	DPRINTF("%s\n", "releaseParallel");
+
+	if (FALSE == pool.started)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.shutdown = 1;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 1; i < pool.threads; i++)
+	{
+		pthread_join(pool.workers[i].thread, NULL);
+	}
+	for (int i = 0; i < pool.threads; i++)
+	{
+		releaseQueue(&pool.workers[i].queue);
+	}
+
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.wake);
+	releaseParFuncs();
+	pool.started = FALSE;
+};
+
+/**
+ * @brief 純粋関数を並列評価する
+ * @param func 関数（純粋性の解析が最新であること）
+ * @param args 引数（func->argc個）
+ * @param value 戻り値の格納先
+ * @return 評価できたかどうか（できなければ通常の実行で呼び出す）
+ * @details 呼び出しが深すぎて中止した関数は、通常の実行から入れ子で呼ばれるたびに
+ *          深さの上限まで評価し直さないよう、以降は並列評価しない
+ */
+BOOL callParallel(Function *func, int *args, int *value)
+{
+	if (FALSE == pool.started)
+	{
+		return FALSE;
+	}
+
+	if (parVersion != getFuncListVersion())
+	{
+		releaseParFuncs();
+		parVersion = getFuncListVersion();
+	}
+
+	ParFunc *f = getParFunc(func);
+	if (parDirty)
+	{
+		checkCallees();
+		parDirty = FALSE;
+	}
+	if (FALSE == f->ok || f->too_deep)
+	{
+		return FALSE;
+	}
+
+	pool.aborted = 0;
+	pool.too_deep = 0;
+
+	if (pool.threads > 1)
+	{
+		__atomic_store_n(&pool.active, 1, __ATOMIC_RELAXED);
+	}
+
+	*value = evalPar(&pool.workers[0], f, args, 0);
+
+	if (pool.threads > 1)
+	{
+		__atomic_store_n(&pool.active, 0, __ATOMIC_RELAXED);
+	}
+
+	if (pool.too_deep)
+	{
+		f->too_deep = TRUE;
+	}
+	return FALSE == isAborted();
+};
@@ -0,0 +1,24 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include "function.h"
+#include "particle.h"
+
+/// 並列実行のスレッド数の上限
+#define PARALLEL_MAX_THREADS (64)
+
+/// 呼び出しをタスクとして分岐させる深さの既定値（これより深い呼び出しは逐次実行する）
+#define DEFAULT_PARALLEL_CUTOFF (12)
+
+/// 並列評価する呼び出しの深さの上限（超えたら通常の実行に切り替える）
+#define PARALLEL_MAX_DEPTH (4096)
+
+/// ワーカースレッドのスタックサイズ
+#define PARALLEL_STACK_SIZE (64 * 1024 * 1024)
+
+void initParallel(int, int);
+void releaseParallel(void);
+
+BOOL callParallel(Function *, int *, int *);
+
+#endif
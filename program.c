@@ -4,24 +4,18 @@
 #include "program.h"
 #include "debug.h"
 
-/// 実行コードのリスト
-typedef struct codelist
-{
-	/// 実行コード
-	char *code;
-	/// 次の実行コード
-	struct codelist *next;
-} CodeList;
+/// 実行コード領域の初期容量
+#define PROGRAM_INIT_SIZE (256)
 
 /// 実行コードの保存メモリ
 typedef struct programMemory
 {
-	/// 実行コードリストの先頭
-	CodeList *head;
-	/// 実行コードリストの終端
-	CodeList *tail;
-	/// 現在の実行コード
-	CodeList *current;
+	/// 実行コードの配列（添字がプログラムカウンタ）
+	char **codes;
+	/// 保存済みの実行コード数
+	int count;
+	/// 確保済みの実行コード数
+	int capacity;
 	/// 現在の実行コードの位置
 	int pc;
 } ProgramMemory;
@@ -34,9 +28,9 @@ static ProgramMemory *pmem;
 void initProgram(void)
 {
 	pmem = (ProgramMemory *)calloc(1, sizeof(ProgramMemory));
-	pmem->head = NULL;
-	pmem->tail = NULL;
-	pmem->current = NULL;
+	pmem->codes = (char **)calloc(PROGRAM_INIT_SIZE, sizeof(char *));
+	pmem->count = 0;
+	pmem->capacity = PROGRAM_INIT_SIZE;
 	pmem->pc = -1;
 
 	// 空実行文を挿入
@@ -48,11 +42,11 @@ void initProgram(void)
  */
 void releaseProgram(void)
 {
-	for (CodeList *code = pmem->head; code != NULL; code = code->next)
+	for (int i = 0; i < pmem->count; i++)
 	{
-		free(code->code);
-		free(code);
+		free(pmem->codes[i]);
 	}
+	free(pmem->codes);
 	free(pmem);
 };
 
@@ -63,21 +57,16 @@ void store(const char *code)
 {
 	DPRINTF("store : %s\n", code);
 
-	CodeList *item = (CodeList *)calloc(1, sizeof(CodeList));
-
-	item->code = (char *)calloc(strlen(code) + 1, sizeof(char));
-	strcpy(item->code, code);
-
-	if (pmem->head == NULL)
+	if (pmem->count == pmem->capacity)
 	{
-		pmem->head = item;
-		pmem->tail = item;
-	}
-	else
-	{
-		pmem->tail->next = item;
-		pmem->tail = item;
+		pmem->capacity *= 2;
+		pmem->codes = (char **)realloc(pmem->codes, pmem->capacity * sizeof(char *));
 	}
+
+	char *item = (char *)calloc(strlen(code) + 1, sizeof(char));
+	strcpy(item, code);
+
+	pmem->codes[pmem->count++] = item;
 };
 
 /**
@@ -86,25 +75,16 @@ void store(const char *code)
  */
 char *fetch(void)
 {
-	if (pmem->current == pmem->tail)
+	if (pmem->pc + 1 >= pmem->count)
 	{
 		return NULL;
 	}
 
-	if (NULL == pmem->current)
-	{
-		pmem->current = pmem->head;
-		pmem->pc = 0;
-	}
-	else
-	{
-		pmem->current = pmem->current->next;
-		pmem->pc += 1;
-	}
+	pmem->pc += 1;
 
-	DPRINTF("fetch : %s\n", pmem->current->code);
+	DPRINTF("fetch : %s\n", pmem->codes[pmem->pc]);
 
-	return pmem->current->code;
+	return pmem->codes[pmem->pc];
 };
 
 /**
@@ -114,12 +94,6 @@ char *fetch(void)
 void jump(int pc)
 {
 	DPRINTF("jump : %d\n", pc);
-
-	pmem->current = pmem->head;
-	for (int i = 0; i < pc; i++)
-	{
-		pmem->current = pmem->current->next;
-	}
 	pmem->pc = pc;
 };
 
@@ -131,3 +105,27 @@ int getpc(void)
 {
 	return pmem->pc;
 };
+
+/**
+ * @brief 保存済みの実行コードの行数を取得する
+ * @return 行数
+ */
+int getProgramSize(void)
+{
+	return pmem->count;
+};
+
+/**
+ * @brief 指定した位置の実行コードを取得する（プログラムカウンタは変えない）
+ * @param pc プログラムカウンタ
+ * @retval NULL 範囲外
+ * @retval Other 実行コード
+ */
+char *getProgramLine(int pc)
+{
+	if (pc < 0 || pc >= pmem->count)
+	{
+		return NULL;
+	}
+	return pmem->codes[pc];
+};
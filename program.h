@@ -7,5 +7,7 @@ void store(const char *);
 char *fetch(void);
 void jump(int);
 int getpc(void);
+int getProgramSize(void);
+char *getProgramLine(int);
 
 #endif
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "purity.h"
+#include "builtin.h"
+#include "bytecode.h"
+#include "code.h"
+#include "memo.h"
+#include "util.h"
+
+/// 関数名ごとの呼び出し元
+typedef struct
+{
+	char *name;        ///< 呼び出される関数名（NULLなら空き）
+	Function **items;  ///< 呼び出し元の関数
+	int count;         ///< 呼び出し元の数
+	int capacity;      ///< 呼び出し元の容量
+} PurityCallers;
+
+/// 純粋性の解析の状態
+typedef struct
+{
+	PurityCallers *table;   ///< 関数名から呼び出し元を引くハッシュテーブル
+	int count;              ///< 登録済みの関数名の数
+	int capacity;           ///< ハッシュテーブルの容量（2のべき乗）
+	Function **affected;    ///< 解析し直す関数
+	int naffected;          ///< 解析し直す関数の数
+	int affected_capacity;  ///< 解析し直す関数の容量
+	unsigned int version;   ///< 解析済みの関数リストの版数
+	Function *head;         ///< 解析済みの関数リストの先頭
+} PurityState;
+
+static PurityState purity;
+
+/**
+ * @brief 変数名が必ず代入済みの変数名に含まれるかどうかを判定する
+ * @param names 必ず代入済みの変数名
+ * @param count 変数名の数
+ * @param name 変数名
+ * @return 判定結果
+ */
+static BOOL isDefinedName(char **names, int count, char *name)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (EQ(names[i], name))
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+};
+
+/**
+ * @brief 行の本体の変数を代入される前に参照するおそれがあるかどうかを判定する
+ * @param func 関数
+ * @return 判定結果（複合代入も参照に数える）
+ * @details 引数と、ブロックの外で無条件に代入した変数だけを以降の行で必ず代入済みとみなす
+ */
+static BOOL mayReadUndefinedName(Function *func)
+{
+	int capacity = func->argc;
+	for (int pc = func->start_pc + 1; pc < func->end_pc; pc++)
+	{
+		capacity += getCachedCode(pc)->count;
+	}
+
+	char **names = (char **)malloc((capacity + 1) * sizeof(char *));
+	int count = 0;
+	for (ArgList *arg = func->args; arg != NULL; arg = arg->next)
+	{
+		names[count++] = arg->name;
+	}
+
+	BOOL found = FALSE;
+	int nest = 0;
+	for (int pc = func->start_pc + 1; FALSE == found && pc < func->end_pc; pc++)
+	{
+		LineCode *code = getCachedCode(pc);
+		int skipped = 0;
+		for (int i = 0; FALSE == found && i < code->count; i++)
+		{
+			Insn *insn = &code->insns[i];
+			if (OP_LOAD == insn->op || OP_ASSIGN_OP == insn->op)
+			{
+				found = FALSE == isDefinedName(names, count, insn->name);
+			}
+			else if (OP_AND == insn->op || OP_OR == insn->op)
+			{
+				// 論理演算で飛ばされるかもしれない範囲の代入は数えない
+				skipped = i + 1 + insn->number;
+			}
+			else if ((OP_STORE == insn->op || OP_FOR == insn->op) && 0 == nest && i >= skipped && FALSE == isDefinedName(names, count, insn->name))
+			{
+				names[count++] = insn->name;
+			}
+		}
+
+		if (LINE_IF == code->type || LINE_WHILE == code->type || LINE_FOR == code->type || LINE_SWITCH == code->type)
+		{
+			nest++;
+		}
+		else if (LINE_END == code->type)
+		{
+			nest--;
+		}
+	}
+
+	free(names);
+	return found;
+};
+
+/**
+ * @brief バイトコードの関数本体に副作用のある命令がないかどうかを判定する
+ * @param f 関数
+ * @return 判定結果
+ */
+static BOOL isPureBytecode(BcFunction *f)
+{
+	// 未定義の変数を参照するとエラーを出力するため副作用とみなす
+	if (mayReadUndefined(f))
+	{
+		return FALSE;
+	}
+
+	for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		switch (f->code[pos])
+		{
+		case BC_PRINT:
+		case BC_EXIT:
+		case BC_DEFINE:
+		case BC_INDEX:
+		case BC_STORE_INDEX:
+		case BC_ASSIGN_INDEX:
+			// 配列は呼び出しをまたいで書き換わるため副作用とみなす
+			return FALSE;
+		case BC_BUILTIN:
+			// 純粋でない組み込み関数は配列を扱うか外部の状態を読むため副作用とみなす
+			if (FALSE == getBuiltin(f->code[pos + 1])->pure)
+			{
+				return FALSE;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief 関数本体に副作用のある命令がないかどうかを判定する（呼び出し先は含まない）
+ * @param func 関数
+ * @return 判定結果
+ */
+static BOOL isPureBody(Function *func)
+{
+	if (func->redefined || func->end_pc < 0 || func->argc > MEMO_MAX_ARGS)
+	{
+		return FALSE;
+	}
+
+	if (func->bytecode)
+	{
+		return isPureBytecode(func->bytecode);
+	}
+
+	for (int pc = func->start_pc + 1; pc < func->end_pc; pc++)
+	{
+		if (NULL == getCachedCode(pc))
+		{
+			return FALSE;
+		}
+	}
+
+	// 未定義の変数を参照するとエラーを出力するため副作用とみなす
+	if (mayReadUndefinedName(func))
+	{
+		return FALSE;
+	}
+
+	for (int pc = func->start_pc + 1; pc < func->end_pc; pc++)
+	{
+		LineCode *code = getCachedCode(pc);
+		for (int i = 0; i < code->count; i++)
+		{
+			Insn *insn = &code->insns[i];
+			switch (insn->op)
+			{
+			case OP_PRINT:
+			case OP_EXIT:
+			case OP_FUNC:
+			case OP_INDEX:
+			case OP_STORE_INDEX:
+				// 配列は呼び出しをまたいで書き換わるため副作用とみなす
+				return FALSE;
+			case OP_BUILTIN:
+				// 純粋でない組み込み関数は配列を扱うか外部の状態を読むため副作用とみなす
+				if (FALSE == getBuiltin(insn->number)->pure)
+				{
+					return FALSE;
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief 呼び出し元の表から関数名の位置を探す
+ * @param name 関数名
+ * @return 関数名の位置（未登録なら空きの位置）
+ */
+static int findCallersSlot(char *name)
+{
+	int mask = purity.capacity - 1;
+	int pos = hashString(name) & mask;
+
+	while (purity.table[pos].name && strcmp(name, purity.table[pos].name) != 0)
+	{
+		pos = (pos + 1) & mask;
+	}
+
+	return pos;
+};
+
+/**
+ * @brief 呼び出し元の表の容量を倍にする
+ */
+static void growCallersTable(void)
+{
+	PurityCallers *old = purity.table;
+	int old_capacity = purity.capacity;
+
+	purity.capacity *= 2;
+	purity.table = (PurityCallers *)calloc(purity.capacity, sizeof(PurityCallers));
+
+	for (int i = 0; i < old_capacity; i++)
+	{
+		if (old[i].name)
+		{
+			purity.table[findCallersSlot(old[i].name)] = old[i];
+		}
+	}
+
+	free(old);
+};
+
+/**
+ * @brief 関数名の呼び出し元を取得する
+ * @param name 関数名
+ * @param create 未登録なら登録するかどうか
+ * @retval NULL 未登録
+ * @retval Other 呼び出し元
+ */
+static PurityCallers *getCallers(char *name, BOOL create)
+{
+	int pos = findCallersSlot(name);
+	if (purity.table[pos].name || FALSE == create)
+	{
+		return purity.table[pos].name ? &purity.table[pos] : NULL;
+	}
+
+	if ((purity.count + 1) * 2 > purity.capacity)
+	{
+		growCallersTable();
+		pos = findCallersSlot(name);
+	}
+
+	PurityCallers *callers = &purity.table[pos];
+	callers->name = (char *)malloc(strlen(name) + 1);
+	strcpy(callers->name, name);
+	callers->capacity = PURITY_CALLERS_INIT_SIZE;
+	callers->items = (Function **)malloc(callers->capacity * sizeof(Function *));
+	callers->count = 0;
+	purity.count++;
+
+	return callers;
+};
+
+/**
+ * @brief 関数名の呼び出し元に関数を加える
+ * @param name 呼び出す関数名
+ * @param func 呼び出し元の関数
+ */
+static void addCaller(char *name, Function *func)
+{
+	PurityCallers *callers = getCallers(name, TRUE);
+	if (callers->count > 0 && callers->items[callers->count - 1] == func)
+	{
+		return;
+	}
+
+	if (callers->count >= callers->capacity)
+	{
+		callers->capacity *= 2;
+		callers->items = (Function **)realloc(callers->items, callers->capacity * sizeof(Function *));
+	}
+	callers->items[callers->count++] = func;
+};
+
+/**
+ * @brief 関数本体から呼び出す関数名をすべて呼び出し元の表に登録する
+ * @param func 関数
+ */
+static void addCalls(Function *func)
+{
+	if (func->bytecode)
+	{
+		BcFunction *f = func->bytecode;
+		for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+		{
+			if (BC_CALL == f->code[pos] || BC_TAIL_CALL == f->code[pos])
+			{
+				addCaller(func->bytecode_names[f->code[pos + 1]], func);
+			}
+		}
+		return;
+	}
+
+	for (int pc = func->start_pc + 1; pc < func->end_pc; pc++)
+	{
+		LineCode *code = getCachedCode(pc);
+		for (int i = 0; code && i < code->count; i++)
+		{
+			if (OP_CALL == code->insns[i].op || OP_TAIL_CALL == code->insns[i].op)
+			{
+				addCaller(code->insns[i].name, func);
+			}
+		}
+	}
+};
+
+/**
+ * @brief 関数名の呼び出し元を取得する（再定義された関数は取り除く）
+ * @param name 関数名
+ * @retval NULL 呼び出し元がない
+ * @retval Other 呼び出し元
+ */
+static PurityCallers *getLiveCallers(char *name)
+{
+	PurityCallers *callers = getCallers(name, FALSE);
+	if (NULL == callers)
+	{
+		return NULL;
+	}
+
+	int count = 0;
+	for (int i = 0; i < callers->count; i++)
+	{
+		if (NULL == callers->items[i]->redefined)
+		{
+			callers->items[count++] = callers->items[i];
+		}
+	}
+	callers->count = count;
+
+	return callers;
+};
+
+/**
+ * @brief 関数を解析し直す関数に加える
+ * @param func 関数
+ * @param version 関数リストの版数
+ */
+static void addAffected(Function *func, unsigned int version)
+{
+	if (func->redefined || func->pure_version == version)
+	{
+		return;
+	}
+
+	if (purity.naffected >= purity.affected_capacity)
+	{
+		purity.affected_capacity = purity.affected_capacity > 0 ? purity.affected_capacity * 2 : PURITY_CALLERS_INIT_SIZE;
+		purity.affected = (Function **)realloc(purity.affected, purity.affected_capacity * sizeof(Function *));
+	}
+	purity.affected[purity.naffected++] = func;
+	func->pure_version = version;
+};
+
+/**
+ * @brief 関数本体から呼び出す関数がすべて純粋かどうかを判定する
+ * @param func 関数
+ * @return 判定結果
+ */
+static BOOL hasPureCallees(Function *func)
+{
+	if (func->bytecode)
+	{
+		BcFunction *f = func->bytecode;
+		for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+		{
+			if (BC_CALL == f->code[pos] || BC_TAIL_CALL == f->code[pos])
+			{
+				Function *callee = getFunction(func->bytecode_names[f->code[pos + 1]]);
+				if (NULL == callee || FALSE == callee->pure || callee->argc != f->code[pos + 2])
+				{
+					return FALSE;
+				}
+			}
+		}
+		return TRUE;
+	}
+
+	for (int pc = func->start_pc + 1; pc < func->end_pc; pc++)
+	{
+		LineCode *code = getCachedCode(pc);
+		for (int i = 0; code && i < code->count; i++)
+		{
+			Insn *insn = &code->insns[i];
+			if (OP_CALL == insn->op || OP_TAIL_CALL == insn->op)
+			{
+				Function *callee = getFunction(insn->name);
+				if (NULL == callee || FALSE == callee->pure || callee->argc != insn->number)
+				{
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	return TRUE;
+};
+
+/**
+ * @brief 前回の解析以降に定義された関数の分だけ純粋性を解析し直す
+ * @details 新しい関数と、その関数名を呼び出す関数をたどって集め、集めた関数だけを解析し直す。
+ * 純粋でない関数は呼び出し元の表を逆にたどって作業列で伝える
+ */
+static void analyzePurity(void)
+{
+	unsigned int version = getFuncListVersion();
+	purity.naffected = 0;
+
+	Function *head = getFunctions();
+	for (Function *func = head; func != purity.head; func = func->next)
+	{
+		if (NULL == func->redefined)
+		{
+			addCalls(func);
+			addAffected(func, version);
+		}
+	}
+	purity.head = head;
+	purity.version = version;
+
+	// 集めた関数の呼び出し元は純粋性が変わりうる
+	for (int i = 0; i < purity.naffected; i++)
+	{
+		PurityCallers *callers = getLiveCallers(purity.affected[i]->name);
+		for (int j = 0; callers && j < callers->count; j++)
+		{
+			addAffected(callers->items[j], version);
+		}
+	}
+
+	// 集めた関数をいったん純粋とみなし、純粋でない関数を作業列に積む
+	for (int i = 0; i < purity.naffected; i++)
+	{
+		purity.affected[i]->pure = TRUE;
+	}
+	Function **pending = (Function **)malloc((purity.naffected + 1) * sizeof(Function *));
+	int npending = 0;
+	for (int i = 0; i < purity.naffected; i++)
+	{
+		Function *func = purity.affected[i];
+		if (FALSE == isPureBody(func) || FALSE == hasPureCallees(func))
+		{
+			func->pure = FALSE;
+			pending[npending++] = func;
+		}
+	}
+
+	// 純粋でない関数を呼び出す関数も純粋でない
+	while (npending > 0)
+	{
+		PurityCallers *callers = getLiveCallers(pending[--npending]->name);
+		for (int i = 0; callers && i < callers->count; i++)
+		{
+			Function *caller = callers->items[i];
+			if (caller->pure && caller->pure_version == version)
+			{
+				caller->pure = FALSE;
+				pending[npending++] = caller;
+			}
+		}
+	}
+	free(pending);
+};
+
+/**
+ * @brief 純粋性の解析を初期化する
+ */
+void initPurity(void)
+{
+	memset(&purity, 0, sizeof(purity));
+	purity.capacity = PURITY_TABLE_INIT_SIZE;
+	purity.table = (PurityCallers *)calloc(purity.capacity, sizeof(PurityCallers));
+};
+
+/**
+ * @brief 純粋性の解析を終了する
+ */
+void releasePurity(void)
+{
+	for (int i = 0; i < purity.capacity; i++)
+	{
+		free(purity.table[i].name);
+		free(purity.table[i].items);
+	}
+	free(purity.table);
+	free(purity.affected);
+	memset(&purity, 0, sizeof(purity));
+};
+
+/**
+ * @brief 関数が純粋かどうかを判定する（関数リストが変わっていれば新しい関数の分を解析する）
+ * @param func 関数
+ * @return 判定結果
+ */
+BOOL isPureFunction(Function *func)
+{
+	if (func->redefined)
+	{
+		return FALSE;
+	}
+
+	if (purity.version != getFuncListVersion())
+	{
+		analyzePurity();
+	}
+
+	return func->pure;
+};
+
+/**
+ * @brief 関数の戻り値をメモ化するかどうかを判定する
+ * @param func 関数
+ * @param autoMemo 純粋関数を自動でメモ化するかどうか
+ * @return 判定結果
+ */
+BOOL isMemoizable(Function *func, BOOL autoMemo)
+{
+	if (func->argc > MEMO_MAX_ARGS)
+	{
+		return FALSE;
+	}
+
+	if (func->memo)
+	{
+		return TRUE;
+	}
+
+	if (FALSE == autoMemo)
+	{
+		return FALSE;
+	}
+
+	return isPureFunction(func);
+};
@@ -0,0 +1,19 @@
+#ifndef _PURITY_H_
+#define _PURITY_H_
+
+#include "function.h"
+#include "particle.h"
+
+/// 呼び出し元の表の初期容量（2のべき乗）
+#define PURITY_TABLE_INIT_SIZE (64)
+
+/// 関数名ごとの呼び出し元の初期容量
+#define PURITY_CALLERS_INIT_SIZE (4)
+
+void initPurity(void);
+void releasePurity(void);
+
+BOOL isPureFunction(Function *);
+BOOL isMemoizable(Function *, BOOL);
+
+#endif
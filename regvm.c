@@ -0,0 +1,1059 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "regvm.h"
+#include "vm.h"
+#include "bytecode.h"
+#include "array.h"
+#include "builtin.h"
+#include "jit.h"
+#include "optimize.h"
+#include "function.h"
+#include "memo.h"
+#include "purity.h"
+#include "util.h"
+
+/// 命令列の初期容量
+#define RV_CODE_INIT_SIZE (64)
+
+/// 関数名に束縛された関数
+typedef struct rv_binding
+{
+	/// レジスタマシンの命令列
+	RegFunction *code;
+	/// 関数オブジェクト（メモ化と純粋性の解析に使う）
+	Function *func;
+} RVBinding;
+
+/// 呼び出しフレーム
+typedef struct rv_frame
+{
+	/// 実行中の関数
+	RegFunction *code;
+	/// 呼び出し元で再開する命令の位置
+	RegInsn *ret_ip;
+	/// レジスタの先頭の位置（戻り値もここに置く）
+	int base;
+	/// 戻り値をメモ化する関数（NULLならメモ化しない）
+	Function *memo;
+	/// メモ化のキーとなる引数
+	int memo_args[MEMO_MAX_ARGS];
+} RVFrame;
+
+/// レジスタマシン
+typedef struct regvm
+{
+	/// レジスタの値（呼び出しごとにずらして使う）
+	int *values;
+	/// 変数スロットに値が代入済みかどうか
+	unsigned char *defined;
+	/// 確保済みの要素数
+	int capacity;
+	/// 呼び出しフレーム
+	RVFrame *frames;
+	/// 確保済みのフレーム数
+	int frame_capacity;
+	/// 関数名番号ごとの束縛
+	RVBinding *bindings;
+	/// 関数番号ごとの変換した関数
+	RegFunction *funcs;
+	/// トップレベルのコード
+	RegFunction main;
+} RegVM;
+
+/// 変換中の関数の状態
+typedef struct rv_translator
+{
+	/// 変換先
+	RegFunction *rf;
+	/// 変換元
+	BcFunction *f;
+	/// 演算スタックの各位置の値を持つレジスタ
+	int *stack;
+	/// 演算スタックの深さ
+	int depth;
+	/// 飛び先がバイトコードの位置のままのジャンプ命令
+	int *fixups;
+	/// ジャンプ命令の数
+	int nfixups;
+} RVTranslator;
+
+static RegVM rv;
+
+/// JITコンパイルする呼び出し回数と後方ジャンプ回数の合計（負ならJITコンパイルしない）
+static int jitThreshold = DEFAULT_JIT_THRESHOLD;
+
+/**
+ * @brief 命令を追加する
+ * @param rf 関数
+ * @param op 命令
+ * @param a オペランド
+ * @param b オペランド
+ * @param c オペランド
+ * @return 追加した位置
+ */
+static int emitReg(RegFunction *rf, int op, int a, int b, int c)
+{
+	if (rf->count == rf->capacity)
+	{
+		rf->capacity = rf->capacity ? rf->capacity * 2 : RV_CODE_INIT_SIZE;
+		rf->code = (RegInsn *)realloc(rf->code, rf->capacity * sizeof(RegInsn));
+	}
+
+	RegInsn *insn = &rf->code[rf->count];
+	insn->op = op;
+	insn->a = a;
+	insn->b = b;
+	insn->c = c;
+	return rf->count++;
+};
+
+/**
+ * @brief 飛び先がバイトコードの位置のジャンプ命令を追加する
+ * @param t 変換中の関数
+ * @param op 命令
+ * @param a オペランド
+ * @param b オペランド
+ * @param target 飛び先のバイトコードの位置
+ */
+static void emitJump(RVTranslator *t, int op, int a, int b, int target)
+{
+	int at = emitReg(t->rf, op, a, b, 0);
+	RegInsn *insn = &t->rf->code[at];
+
+	if (RV_JUMP == op)
+	{
+		insn->a = target;
+	}
+	else if (RV_JUMP_IF_ZERO == op)
+	{
+		insn->b = target;
+	}
+	else
+	{
+		insn->c = target;
+	}
+	t->fixups[t->nfixups++] = at;
+};
+
+/**
+ * @brief 定数のレジスタ番号を取得する
+ * @param rf 関数
+ * @param value 定数
+ * @return レジスタ番号
+ */
+static int getConstReg(RegFunction *rf, int value)
+{
+	for (int i = 0; i < rf->nconsts; i++)
+	{
+		if (rf->consts[i] == value)
+		{
+			return rf->source->nslots + i;
+		}
+	}
+
+	return -1;
+};
+
+/**
+ * @brief 定数表を作る
+ * @param rf 関数
+ */
+static void buildConsts(RegFunction *rf)
+{
+	BcFunction *f = rf->source;
+
+	// 定数の数は命令数を超えない（printの結果の0を含める）
+	rf->consts = (int *)malloc((f->count + 1) * sizeof(int));
+	rf->consts[rf->nconsts++] = 0;
+
+	for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		if (BC_CONST == f->code[pos] && getConstReg(rf, f->code[pos + 1]) < 0)
+		{
+			rf->consts[rf->nconsts++] = f->code[pos + 1];
+		}
+	}
+
+	rf->temp_base = f->nslots + rf->nconsts;
+	rf->nregs = rf->temp_base + f->max_stack + 1;
+};
+
+/**
+ * @brief 演算スタックの値を本来の一時値レジスタに移す
+ * @param t 変換中の関数
+ * @param i 演算スタックの位置
+ */
+static void materialize(RVTranslator *t, int i)
+{
+	int reg = t->rf->temp_base + i;
+
+	if (t->stack[i] != reg)
+	{
+		emitReg(t->rf, RV_MOVE, reg, t->stack[i], 0);
+		t->stack[i] = reg;
+	}
+};
+
+/**
+ * @brief 変数への代入の前に、その変数を参照中の演算スタックの値を退避する
+ * @param t 変換中の関数
+ * @param slot 変数スロット
+ */
+static void protectSlot(RVTranslator *t, int slot)
+{
+	for (int i = 0; i < t->depth; i++)
+	{
+		if (t->stack[i] == slot)
+		{
+			materialize(t, i);
+		}
+	}
+};
+
+/**
+ * @brief 比較命令を条件が偽のときに分岐する命令に変換する
+ * @param op 比較命令
+ * @return 分岐命令（比較命令でなければ-1）
+ */
+static int negateCompare(int op)
+{
+	switch (op)
+	{
+	case RV_LT:
+		return RV_BGE;
+	case RV_GT:
+		return RV_BLE;
+	case RV_LE:
+		return RV_BGT;
+	case RV_GE:
+		return RV_BLT;
+	case RV_EQ:
+		return RV_BNE;
+	case RV_NE:
+		return RV_BEQ;
+	default:
+		return -1;
+	}
+};
+
+/**
+ * @brief 演算スタックの値をすべて本来の一時値レジスタに移す
+ * @param t 変換中の関数
+ * @details ジャンプの前後で演算スタックの同じ位置の値が同じレジスタにあるようにする
+ */
+static void materializeStack(RVTranslator *t)
+{
+	for (int i = 0; i < t->depth; i++)
+	{
+		materialize(t, i);
+	}
+};
+
+/**
+ * @brief 条件の真偽で分岐する命令を追加する
+ * @param t 変換中の関数
+ * @param cond 条件の値を持つレジスタ
+ * @param truth 分岐する条件の真偽
+ * @param target 飛び先のバイトコードの位置
+ * @param fusible 直前の命令と融合できるかどうか
+ * @details 直前が条件の値を求める比較命令なら比較と分岐を１命令にする
+ */
+static void emitBranch(RVTranslator *t, int cond, BOOL truth, int target, BOOL fusible)
+{
+	RegFunction *rf = t->rf;
+
+	if (fusible && rf->count > 0)
+	{
+		RegInsn *last = &rf->code[rf->count - 1];
+		int branch = truth ? (last->op >= RV_LT && last->op <= RV_NE ? RV_BLT + (last->op - RV_LT) : -1) : negateCompare(last->op);
+		if (branch >= 0 && last->a == cond)
+		{
+			int a = last->b;
+			int b = last->c;
+			rf->count--;
+			emitJump(t, branch, a, b, target);
+			return;
+		}
+	}
+
+	if (truth)
+	{
+		emitJump(t, RV_BNE, cond, getConstReg(rf, 0), target);
+	}
+	else
+	{
+		emitJump(t, RV_JUMP_IF_ZERO, cond, 0, target);
+	}
+};
+
+/**
+ * @brief バイトコードの関数をレジスタマシンの命令列に変換する
+ * @param rf 変換先（sourceを設定しておく）
+ */
+static void translate(RegFunction *rf)
+{
+	BcFunction *f = rf->source;
+	int n = f->nslots;
+	int *map = (int *)malloc((f->count + 1) * sizeof(int));
+	unsigned char *targets = (unsigned char *)calloc(f->count + 1, 1);
+	unsigned char *defined = analyzeDefinedSlots(f);
+	RVTranslator t;
+
+	buildConsts(rf);
+	t.rf = rf;
+	t.f = f;
+	t.stack = (int *)malloc((f->max_stack + 1) * sizeof(int));
+	t.depth = 0;
+	t.fixups = (int *)malloc((f->count + 1) * sizeof(int));
+	t.nfixups = 0;
+
+	for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		if (isBcJump(f->code[pos]))
+		{
+			targets[getBcTarget(f, pos)] = 1;
+		}
+	}
+
+	// 直前の命令がジャンプの飛び先をまたがない場合だけ比較と分岐を融合できる
+	int block_start = 0;
+
+	for (int pos = 0; pos < f->count; pos += getBcLength(f->code[pos]))
+	{
+		int op = f->code[pos];
+		int x = getBcLength(op) > 1 ? f->code[pos + 1] : 0;
+		unsigned char *in = defined + (size_t)pos * n;
+		int top = rf->temp_base + t.depth;
+
+		if (targets[pos])
+		{
+			materializeStack(&t);
+			block_start = rf->count;
+		}
+		map[pos] = rf->count;
+
+		switch (op)
+		{
+		case BC_CONST:
+			t.stack[t.depth++] = getConstReg(rf, x);
+			break;
+		case BC_LOAD:
+			if (in[x])
+			{
+				t.stack[t.depth++] = x;
+			}
+			else
+			{
+				emitReg(rf, RV_CHECK, top, x, 0);
+				t.stack[t.depth++] = top;
+			}
+			break;
+		case BC_STORE:
+			protectSlot(&t, x);
+			emitReg(rf, in[x] ? RV_MOVE : RV_SET, x, t.stack[t.depth - 1], 0);
+			break;
+		case BC_ASSIGN_ADD:
+		case BC_ASSIGN_SUB:
+		case BC_ASSIGN_MUL:
+		case BC_ASSIGN_DIV:
+		case BC_ASSIGN_MOD:
+		case BC_ASSIGN_BIT_AND:
+		case BC_ASSIGN_BIT_OR:
+		case BC_ASSIGN_BIT_XOR:
+		case BC_ASSIGN_SHL:
+		case BC_ASSIGN_SHR:
+		{
+			int calc = RV_ADD + (op - BC_ASSIGN_ADD);
+			int value = t.stack[--t.depth];
+			top = rf->temp_base + t.depth;
+			protectSlot(&t, x);
+			if (in[x])
+			{
+				emitReg(rf, calc, x, x, value);
+				t.stack[t.depth++] = x;
+			}
+			else
+			{
+				// 未代入ならエラーとして0を積み、変数は変更しない
+				emitReg(rf, RV_JUMP_IF_DEFINED, x, 2, 0);
+				emitReg(rf, RV_CHECK, top, x, 0);
+				emitReg(rf, RV_JUMP, 2, 0, 0);
+				emitReg(rf, calc, x, x, value);
+				emitReg(rf, RV_MOVE, top, x, 0);
+				t.stack[t.depth++] = top;
+			}
+			break;
+		}
+		case BC_ADD:
+		case BC_SUB:
+		case BC_MUL:
+		case BC_DIV:
+		case BC_MOD:
+		case BC_BIT_AND:
+		case BC_BIT_OR:
+		case BC_BIT_XOR:
+		case BC_SHL:
+		case BC_SHR:
+		case BC_LT:
+		case BC_GT:
+		case BC_LE:
+		case BC_GE:
+		case BC_EQ:
+		case BC_NE:
+		{
+			int right = t.stack[--t.depth];
+			int left = t.stack[t.depth - 1];
+			int dst = rf->temp_base + t.depth - 1;
+			emitReg(rf, RV_ADD + (op - BC_ADD), dst, left, right);
+			t.stack[t.depth - 1] = dst;
+			break;
+		}
+		case BC_NEG:
+		case BC_NOT:
+		case BC_BIT_NOT:
+		{
+			int dst = rf->temp_base + t.depth - 1;
+			emitReg(rf, RV_NEG + (op - BC_NEG), dst, t.stack[t.depth - 1], 0);
+			t.stack[t.depth - 1] = dst;
+			break;
+		}
+		case BC_POP:
+			t.depth--;
+			break;
+		case BC_PRINT:
+			emitReg(rf, RV_PRINT, t.stack[t.depth - 1], 0, 0);
+			t.stack[t.depth - 1] = getConstReg(rf, 0);
+			break;
+		case BC_EXIT:
+			// 後続の命令のために値を積んだものとして扱う（実行はここで終わる）
+			emitReg(rf, RV_EXIT, 0, 0, 0);
+			t.stack[t.depth++] = getConstReg(rf, 0);
+			break;
+		case BC_INDEX:
+		{
+			int index = t.stack[--t.depth];
+			int dst = rf->temp_base + t.depth - 1;
+			emitReg(rf, RV_INDEX, dst, t.stack[t.depth - 1], index);
+			t.stack[t.depth - 1] = dst;
+			break;
+		}
+		case BC_STORE_INDEX:
+		case BC_ASSIGN_INDEX:
+		{
+			int value = t.stack[t.depth - 1];
+			int index = t.stack[t.depth - 2];
+			int array = t.stack[t.depth - 3];
+			if (BC_ASSIGN_INDEX == op)
+			{
+				// 演算スタックより上の一時値レジスタで要素を読み出して計算する
+				emitReg(rf, RV_INDEX, top, array, index);
+				emitReg(rf, RV_ADD + (x - BC_ADD), top, top, value);
+				value = top;
+			}
+			emitReg(rf, RV_STORE_INDEX, array, index, value);
+			t.depth -= 2;
+			t.stack[t.depth - 1] = value;
+			if (value >= rf->temp_base)
+			{
+				materialize(&t, t.depth - 1);
+			}
+			break;
+		}
+		case BC_BUILTIN:
+		{
+			int argc = getBuiltin(x)->argc;
+			int first = t.depth - argc;
+			for (int i = first; i < t.depth; i++)
+			{
+				materialize(&t, i);
+			}
+			emitReg(rf, RV_BUILTIN, rf->temp_base + first, x, argc);
+			t.depth = first;
+			t.stack[t.depth] = rf->temp_base + t.depth;
+			t.depth++;
+			break;
+		}
+		case BC_CALL:
+		case BC_TAIL_CALL:
+		{
+			int argc = f->code[pos + 2];
+			int first = t.depth - argc;
+			for (int i = first; i < t.depth; i++)
+			{
+				materialize(&t, i);
+			}
+			emitReg(rf, BC_CALL == op ? RV_CALL : RV_TAIL_CALL, rf->temp_base + first, x, argc);
+			t.depth = first;
+			t.stack[t.depth] = rf->temp_base + t.depth;
+			t.depth++;
+			break;
+		}
+		case BC_RETURN:
+			emitReg(rf, RV_RETURN, t.stack[--t.depth], 0, 0);
+			break;
+		case BC_JUMP:
+			materializeStack(&t);
+			emitJump(&t, RV_JUMP, 0, 0, getBcTarget(f, pos));
+			break;
+		case BC_JUMP_IF_FALSE:
+		case BC_JUMP_IF_TRUE:
+		{
+			int cond = t.stack[--t.depth];
+			materializeStack(&t);
+			emitBranch(&t, cond, BC_JUMP_IF_TRUE == op, getBcTarget(f, pos), rf->count > block_start);
+			break;
+		}
+		case BC_AND:
+			// 飛び先でも値を使うため、スタックトップも一時値レジスタに置いてから分岐する
+			materializeStack(&t);
+			emitJump(&t, RV_JUMP_IF_ZERO, top - 1, 0, getBcTarget(f, pos));
+			t.depth--;
+			break;
+		case BC_OR:
+			materializeStack(&t);
+			emitReg(rf, RV_NE, top - 1, top - 1, getConstReg(rf, 0));
+			emitJump(&t, RV_BNE, top - 1, getConstReg(rf, 0), getBcTarget(f, pos));
+			t.depth--;
+			break;
+		case BC_SWITCH:
+			// 後に並ぶジャンプはそれぞれRV_JUMPひとつになり、表の並びが保たれる
+			emitReg(rf, RV_SWITCH, t.stack[--t.depth], x, f->code[pos + 2]);
+			break;
+		case BC_DEFINE:
+			emitReg(rf, RV_DEFINE, x, 0, 0);
+			break;
+		case BC_HALT:
+		default:
+			emitReg(rf, RV_HALT, 0, 0, 0);
+			break;
+		}
+	}
+	map[f->count] = rf->count;
+
+	// ジャンプの飛び先を命令列の相対位置に直す
+	for (int i = 0; i < t.nfixups; i++)
+	{
+		int at = t.fixups[i];
+		RegInsn *insn = &rf->code[at];
+		int *target = RV_JUMP == insn->op ? &insn->a : RV_JUMP_IF_ZERO == insn->op ? &insn->b : &insn->c;
+		*target = map[*target] - (at + 1);
+	}
+
+	free(map);
+	free(targets);
+	free(defined);
+	free(t.stack);
+	free(t.fixups);
+
+	optimizeRegFunction(rf, n, 0);
+};
+
+/**
+ * @brief 変換した関数を破棄する
+ * @param rf 関数
+ */
+static void releaseRegFunction(RegFunction *rf)
+{
+	if (rf->jit)
+	{
+		releaseJit(rf->jit);
+	}
+	free(rf->code);
+	free(rf->consts);
+};
+
+/**
+ * @brief レジスタの領域を拡張する
+ * @param needed 必要な要素数
+ */
+static void reserveRegisters(int needed)
+{
+	if (needed <= rv.capacity)
+	{
+		return;
+	}
+
+	int capacity = rv.capacity;
+	while (needed > rv.capacity)
+	{
+		rv.capacity *= 2;
+	}
+	rv.values = (int *)realloc(rv.values, rv.capacity * sizeof(int));
+	rv.defined = (unsigned char *)realloc(rv.defined, rv.capacity);
+	memset(rv.defined + capacity, 0, rv.capacity - capacity);
+};
+
+/**
+ * @brief 関数を定義する
+ * @param m プログラム
+ * @param rf 変換した関数
+ */
+static void defineRegFunction(BcModule *m, RegFunction *rf)
+{
+	BcFunction *code = rf->source;
+	Function *func = createFunction(code->name, code->start_pc);
+	func->memo = code->memo;
+	func->end_pc = code->end_pc;
+	func->bytecode = code;
+	func->bytecode_names = m->names;
+	for (int i = 0; i < code->argc; i++)
+	{
+		addArgument(func, code->slot_names[i]);
+	}
+	addFunction(func);
+
+	rv.bindings[code->name_id].code = rf;
+	rv.bindings[code->name_id].func = func;
+};
+
+/**
+ * @brief レジスタを関数の呼び出し時の状態にする
+ * @param base レジスタの先頭の位置
+ * @param rf 呼び出す関数
+ */
+static void enterRegisters(int base, RegFunction *rf)
+{
+	BcFunction *code = rf->source;
+
+	memset(rv.defined + base, 1, code->argc);
+	memset(rv.defined + base + code->argc, 0, code->nslots - code->argc);
+	memcpy(rv.values + base + code->nslots, rf->consts, rf->nconsts * sizeof(int));
+};
+
+/**
+ * @brief 関数の実行回数を数え、しきい値に達したらJITコンパイルする
+ * @param rf 関数
+ */
+static void heatUp(RegFunction *rf)
+{
+	if (jitThreshold < 0 || rf->jit_tried || ++rf->hotness < jitThreshold)
+	{
+		return;
+	}
+
+	rf->jit = compileJit(rf);
+	rf->jit_tried = TRUE;
+};
+
+/**
+ * @brief 変数が未定義であることを表示する
+ * @param rf 関数
+ * @param slot 変数スロット
+ */
+static void undefinedError(RegFunction *rf, int slot)
+{
+	printError("error : ");
+	printf("\"%s\" is not defined\n", rf->source->slot_names[slot]);
+};
+
+/**
+ * @brief レジスタマシンの命令列を実行する
+ * @param m プログラム
+ * @param maxCallDepth 関数呼び出しの深さの上限
+ * @param autoMemo 純粋関数を自動でメモ化するかどうか
+ * @param steps 実行した命令数の格納先
+ * @return 結果
+ */
+static ENGINE_RESULT execute(BcModule *m, int maxCallDepth, BOOL autoMemo, unsigned long *steps)
+{
+	RegFunction *cur = &rv.main;
+	RegInsn *ip = cur->code;
+	unsigned long count = 0;
+	ENGINE_RESULT ret = RESULT_OK;
+	int fp = 0;
+	int value;
+
+	reserveRegisters(cur->nregs);
+	enterRegisters(0, cur);
+	int *r = rv.values;
+	unsigned char *defs = rv.defined;
+
+	rv.frames[0].code = cur;
+	rv.frames[0].base = 0;
+	rv.frames[0].memo = NULL;
+	heatUp(cur);
+
+	while (1)
+	{
+		// ネイティブコードがあれば実行し、ネイティブコードにしていない命令だけをここで実行する
+		if (cur->jit)
+		{
+			ip = cur->code + enterJit(cur->jit, r, defs, (int)(ip - cur->code));
+		}
+
+		RegInsn *insn = ip++;
+		count++;
+
+		switch (insn->op)
+		{
+		case RV_MOVE:
+			r[insn->a] = r[insn->b];
+			break;
+		case RV_SET:
+			r[insn->a] = r[insn->b];
+			defs[insn->a] = 1;
+			break;
+		case RV_CHECK:
+			if (defs[insn->b])
+			{
+				r[insn->a] = r[insn->b];
+			}
+			else
+			{
+				undefinedError(cur, insn->b);
+				r[insn->a] = 0;
+			}
+			break;
+		case RV_ADD:
+			r[insn->a] = r[insn->b] + r[insn->c];
+			break;
+		case RV_SUB:
+			r[insn->a] = r[insn->b] - r[insn->c];
+			break;
+		case RV_MUL:
+			r[insn->a] = r[insn->b] * r[insn->c];
+			break;
+		case RV_DIV:
+			r[insn->a] = r[insn->b] / r[insn->c];
+			break;
+		case RV_MOD:
+			r[insn->a] = r[insn->b] % r[insn->c];
+			break;
+		case RV_BIT_AND:
+			r[insn->a] = r[insn->b] & r[insn->c];
+			break;
+		case RV_BIT_OR:
+			r[insn->a] = r[insn->b] | r[insn->c];
+			break;
+		case RV_BIT_XOR:
+			r[insn->a] = r[insn->b] ^ r[insn->c];
+			break;
+		case RV_SHL:
+			r[insn->a] = SHIFT_LEFT(r[insn->b], r[insn->c]);
+			break;
+		case RV_SHR:
+			r[insn->a] = SHIFT_RIGHT(r[insn->b], r[insn->c]);
+			break;
+		case RV_LT:
+			r[insn->a] = r[insn->b] < r[insn->c];
+			break;
+		case RV_GT:
+			r[insn->a] = r[insn->b] > r[insn->c];
+			break;
+		case RV_LE:
+			r[insn->a] = r[insn->b] <= r[insn->c];
+			break;
+		case RV_GE:
+			r[insn->a] = r[insn->b] >= r[insn->c];
+			break;
+		case RV_EQ:
+			r[insn->a] = r[insn->b] == r[insn->c];
+			break;
+		case RV_NE:
+			r[insn->a] = r[insn->b] != r[insn->c];
+			break;
+		case RV_NEG:
+			r[insn->a] = -r[insn->b];
+			break;
+		case RV_NOT:
+			r[insn->a] = !r[insn->b];
+			break;
+		case RV_BIT_NOT:
+			r[insn->a] = ~r[insn->b];
+			break;
+		case RV_DIVI:
+			r[insn->a] = r[insn->b] / insn->c;
+			break;
+		case RV_MODI:
+			r[insn->a] = r[insn->b] % insn->c;
+			break;
+		case RV_PRINT:
+			printf("%d\n", r[insn->a]);
+			break;
+		case RV_EXIT:
+			ret = RESULT_EXIT;
+			goto finish;
+		case RV_INDEX:
+			if (FALSE == loadElement(r[insn->b], r[insn->c], &r[insn->a]))
+			{
+				ret = RESULT_ERROR;
+				goto finish;
+			}
+			break;
+		case RV_STORE_INDEX:
+			if (FALSE == storeElement(r[insn->a], r[insn->b], r[insn->c]))
+			{
+				ret = RESULT_ERROR;
+				goto finish;
+			}
+			break;
+		case RV_BUILTIN:
+			if (FALSE == getBuiltin(insn->b)->func(r + insn->a, &value))
+			{
+				ret = RESULT_ERROR;
+				goto finish;
+			}
+			r[insn->a] = value;
+			break;
+		case RV_CALL:
+		case RV_TAIL_CALL:
+		{
+			BOOL tail = RV_TAIL_CALL == insn->op && fp > 0;
+			RVBinding *binding = &rv.bindings[insn->b];
+			RegFunction *callee = binding->code;
+			int argc = insn->c;
+			int *args = r + insn->a;
+
+			if (NULL == callee || callee->source->argc != argc)
+			{
+				printError("error : ");
+				if (NULL == callee)
+				{
+					printf("function \"%s\" is not defined\n", m->names[insn->b]);
+				}
+				else
+				{
+					printf("function \"%s\" takes %d argument(s), but %d given\n", callee->source->name, callee->source->argc, argc);
+				}
+				args[0] = 0;
+				break;
+			}
+
+			BOOL memo = isMemoizable(binding->func, autoMemo);
+			if (memo && lookupMemo(binding->func, args, &value))
+			{
+				args[0] = value;
+				if (tail)
+				{
+					// 末尾呼び出しならそのまま呼び出し元に戻る
+					goto do_return;
+				}
+				break;
+			}
+
+			int base;
+			if (tail)
+			{
+				// 現在のフレームを再利用する（メモ化のキーは元の呼び出しのまま）
+				base = rv.frames[fp].base;
+				memmove(r, args, argc * sizeof(int));
+			}
+			else
+			{
+				if (fp >= maxCallDepth)
+				{
+					printError("error : ");
+					printf("maximum call depth (%d) exceeded\n", maxCallDepth);
+					ret = RESULT_ERROR;
+					goto finish;
+				}
+
+				if (fp + 1 == rv.frame_capacity)
+				{
+					rv.frame_capacity *= 2;
+					rv.frames = (RVFrame *)realloc(rv.frames, rv.frame_capacity * sizeof(RVFrame));
+				}
+
+				base = (int)(args - rv.values);
+				RVFrame *frame = &rv.frames[++fp];
+				frame->ret_ip = ip;
+				frame->base = base;
+				frame->memo = memo ? binding->func : NULL;
+				if (memo)
+				{
+					memcpy(frame->memo_args, args, argc * sizeof(int));
+				}
+			}
+
+			reserveRegisters(base + callee->nregs);
+			rv.frames[fp].code = callee;
+			enterRegisters(base, callee);
+			cur = callee;
+			r = rv.values + base;
+			defs = rv.defined + base;
+			ip = callee->code;
+			heatUp(callee);
+			break;
+		}
+		case RV_RETURN:
+			value = r[insn->a];
+		do_return:
+		{
+			if (0 == fp)
+			{
+				printError("error : ");
+				printf("\"return\" is outside of function\n");
+				break;
+			}
+
+			RVFrame *frame = &rv.frames[fp--];
+			if (frame->memo)
+			{
+				storeMemo(frame->memo, frame->memo_args, value);
+			}
+
+			ip = frame->ret_ip;
+			rv.values[frame->base] = value;
+
+			cur = rv.frames[fp].code;
+			r = rv.values + rv.frames[fp].base;
+			defs = rv.defined + rv.frames[fp].base;
+			break;
+		}
+		case RV_JUMP:
+			ip += insn->a;
+			if (insn->a < 0)
+			{
+				heatUp(cur);
+			}
+			break;
+		case RV_JUMP_IF_ZERO:
+			if (0 == r[insn->a])
+			{
+				ip += insn->b;
+			}
+			break;
+		case RV_JUMP_IF_DEFINED:
+			if (defs[insn->a])
+			{
+				ip += insn->b;
+			}
+			break;
+		case RV_BLT:
+			if (r[insn->a] < r[insn->b])
+			{
+				ip += insn->c;
+				if (insn->c < 0)
+				{
+					heatUp(cur);
+				}
+			}
+			break;
+		case RV_BGT:
+			if (r[insn->a] > r[insn->b])
+			{
+				ip += insn->c;
+				if (insn->c < 0)
+				{
+					heatUp(cur);
+				}
+			}
+			break;
+		case RV_BLE:
+			if (r[insn->a] <= r[insn->b])
+			{
+				ip += insn->c;
+				if (insn->c < 0)
+				{
+					heatUp(cur);
+				}
+			}
+			break;
+		case RV_BGE:
+			if (r[insn->a] >= r[insn->b])
+			{
+				ip += insn->c;
+				if (insn->c < 0)
+				{
+					heatUp(cur);
+				}
+			}
+			break;
+		case RV_BEQ:
+			if (r[insn->a] == r[insn->b])
+			{
+				ip += insn->c;
+				if (insn->c < 0)
+				{
+					heatUp(cur);
+				}
+			}
+			break;
+		case RV_BNE:
+			if (r[insn->a] != r[insn->b])
+			{
+				ip += insn->c;
+				if (insn->c < 0)
+				{
+					heatUp(cur);
+				}
+			}
+			break;
+		case RV_SWITCH:
+		{
+			unsigned int k = (unsigned int)r[insn->a] - (unsigned int)insn->b;
+			ip += k < (unsigned int)insn->c ? k + 1 : 0;
+			break;
+		}
+		case RV_DEFINE:
+			defineRegFunction(m, &rv.funcs[insn->a]);
+			break;
+		case RV_HALT:
+		default:
+			goto finish;
+		}
+	}
+
+finish:
+	*steps += count;
+	return ret;
+};
+
+/**
+ * @brief 保存済みのプログラムをレジスタマシンの命令列に変換して実行する
+ * @param maxCallDepth 関数呼び出しの深さの上限
+ * @param autoMemo 純粋関数を自動でメモ化するかどうか
+ * @param steps 実行した命令数の格納先（加算する）
+ * @return 結果
+ */
+ENGINE_RESULT runRegVM(int maxCallDepth, BOOL autoMemo, unsigned long *steps)
+{
+	BcModule *m = compileModule();
+	if (NULL == m)
+	{
+		return RESULT_ERROR;
+	}
+
+	memset(&rv.main, 0, sizeof(RegFunction));
+	rv.main.source = m->main;
+	translate(&rv.main);
+	rv.funcs = (RegFunction *)calloc(m->nfuncs + 1, sizeof(RegFunction));
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		rv.funcs[i].source = m->funcs[i];
+		translate(&rv.funcs[i]);
+	}
+
+	rv.values = (int *)calloc(VM_STACK_INIT_SIZE, sizeof(int));
+	rv.defined = (unsigned char *)calloc(VM_STACK_INIT_SIZE, 1);
+	rv.capacity = VM_STACK_INIT_SIZE;
+	rv.frames = (RVFrame *)calloc(VM_FRAME_INIT_SIZE, sizeof(RVFrame));
+	rv.frame_capacity = VM_FRAME_INIT_SIZE;
+	rv.bindings = (RVBinding *)calloc(m->nnames + 1, sizeof(RVBinding));
+
+	ENGINE_RESULT ret = execute(m, maxCallDepth, autoMemo, steps);
+
+	free(rv.values);
+	free(rv.defined);
+	free(rv.frames);
+	free(rv.bindings);
+	for (int i = 0; i < m->nfuncs; i++)
+	{
+		releaseRegFunction(&rv.funcs[i]);
+	}
+	free(rv.funcs);
+	releaseRegFunction(&rv.main);
+	releaseModule(m);
+
+	return ret;
+};
+
+/**
+ * @brief JITコンパイルする呼び出し回数と後方ジャンプ回数の合計を設定する
+ * @param threshold しきい値（0なら最初の実行からJITコンパイルする、負ならJITコンパイルしない）
+ */
+void setJitThreshold(int threshold)
+{
+	jitThreshold = threshold;
+};
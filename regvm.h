@@ -0,0 +1,121 @@
+#ifndef _REGVM_H_
+#define _REGVM_H_
+
+#include "engine.h"
+#include "particle.h"
+
+/// レジスタマシンの命令（a、b、cはレジスタ番号またはオペランド）
+typedef enum
+{
+	/// r[a] = r[b]
+	RV_MOVE,
+	/// r[a] = r[b]、変数aを代入済みにする
+	RV_SET,
+	/// 変数bが代入済みならr[a] = r[b]、未代入ならエラーを表示してr[a] = 0
+	RV_CHECK,
+	/// r[a] = r[b] op r[c]
+	RV_ADD,
+	RV_SUB,
+	RV_MUL,
+	RV_DIV,
+	RV_MOD,
+	RV_BIT_AND,
+	RV_BIT_OR,
+	RV_BIT_XOR,
+	RV_SHL,
+	RV_SHR,
+	RV_LT,
+	RV_GT,
+	RV_LE,
+	RV_GE,
+	RV_EQ,
+	RV_NE,
+	/// r[a] = op r[b]
+	RV_NEG,
+	RV_NOT,
+	RV_BIT_NOT,
+	/// r[a] = r[b] op c（cは絶対値が2以上の定数）
+	RV_DIVI,
+	RV_MODI,
+	/// r[a]を表示する
+	RV_PRINT,
+	/// 組み込み関数exit
+	RV_EXIT,
+	/// r[a] = r[b]の配列のr[c]番目の要素
+	RV_INDEX,
+	/// r[a]の配列のr[b]番目の要素にr[c]を代入する
+	RV_STORE_INDEX,
+	/// r[a]から並ぶc個の引数で組み込み関数番号bの組み込み関数を呼び出し、戻り値をr[a]に置く
+	RV_BUILTIN,
+	/// r[a]から並ぶc個の引数で関数名番号bの関数を呼び出し、戻り値をr[a]に置く
+	RV_CALL,
+	/// 末尾位置での呼び出し（オペランドはRV_CALLと同じ）
+	RV_TAIL_CALL,
+	/// r[a]を戻り値として関数から戻る
+	RV_RETURN,
+	/// 無条件ジャンプ（aは次の命令からの相対位置）
+	RV_JUMP,
+	/// r[a]が0ならジャンプ（bは相対位置）
+	RV_JUMP_IF_ZERO,
+	/// 変数aが代入済みならジャンプ（bは相対位置）
+	RV_JUMP_IF_DEFINED,
+	/// r[a] op r[b]が真ならジャンプ（cは相対位置）
+	RV_BLT,
+	RV_BGT,
+	RV_BLE,
+	RV_BGE,
+	RV_BEQ,
+	RV_BNE,
+	/// r[a]からbを引いた値kがc未満なら直後に並ぶジャンプのk+1番目に進み、そうでなければ直後のジャンプに進む
+	RV_SWITCH,
+	/// 関数を定義する（aは関数番号）
+	RV_DEFINE,
+	/// プログラムの終了
+	RV_HALT,
+} RV_OPCODE;
+
+/// レジスタマシンの命令
+typedef struct reg_insn
+{
+	/// 命令
+	int op;
+	/// オペランド
+	int a;
+	int b;
+	int c;
+} RegInsn;
+
+/**
+ * レジスタマシン向けに変換した関数
+ * @details レジスタは先頭から変数スロット、定数、一時値の順に並ぶ
+ */
+typedef struct reg_function
+{
+	/// 変換元のバイトコード
+	struct bc_function *source;
+	/// 命令列
+	RegInsn *code;
+	/// 命令列の長さ
+	int count;
+	/// 確保済みの命令列の長さ
+	int capacity;
+	/// 定数の値
+	int *consts;
+	/// 定数の数
+	int nconsts;
+	/// 一時値の先頭のレジスタ番号
+	int temp_base;
+	/// レジスタの数
+	int nregs;
+	/// 呼び出し回数と後方ジャンプ回数の合計（JITコンパイルの判定に使う）
+	int hotness;
+	/// ネイティブコード（NULLならインタプリタで実行する）
+	struct jit_code *jit;
+	/// JITコンパイルを試みたかどうか
+	BOOL jit_tried;
+} RegFunction;
+
+ENGINE_RESULT runRegVM(int, BOOL, unsigned long *);
+void setJitThreshold(int);
+
+#endif
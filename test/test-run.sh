@@ -1,12 +1,18 @@
 #!/bin/bash
+# Usage: ./test-run.sh [particle options...]
 
 PARTICLE=../particle
 TEST_SRC=test.par
 RESULT=result.txt
 ANSWER=answer.txt
 
-# Run test
-$PARTICLE $TEST_SRC > $RESULT
+# Run test (with --emit-c, build the generated C source and run it)
+if [ "$1" = "--emit-c" ]; then
+	$PARTICLE "$@" $TEST_SRC > aot.c && gcc -O2 aot.c -o aot -pthread && ./aot > $RESULT
+	rm -f aot aot.c
+else
+	$PARTICLE "$@" $TEST_SRC > $RESULT
+fi
 
 # Check result
 answers=(`cat $ANSWER | grep -v -e '^\s*#' -e '^\s*$'`)
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+#include "threaded.h"
+#include "util.h"
+
+/// 演算子と特化した命令の対応表
+typedef struct
+{
+	/// 演算子
+	char *operator;
+	/// 被演算子がスタックの２つの値のときの命令
+	THREADED_OPCODE op;
+} ThreadedOperatorTable;
+
+static ThreadedOperatorTable THREADED_OPERATOR_TBL[] = {
+	{"+", TOP_ADD},
+	{"-", TOP_SUB},
+	{"*", TOP_MUL},
+	{"/", TOP_DIV},
+	{"%", TOP_MOD},
+	{"&", TOP_BIT_AND},
+	{"|", TOP_BIT_OR},
+	{"^", TOP_BIT_XOR},
+	{"<", TOP_LT},
+	{">", TOP_GT},
+	{"<=", TOP_LE},
+	{">=", TOP_GE},
+	{"==", TOP_EQ},
+	{"!=", TOP_NE},
+};
+
+/**
+ * @brief 二項演算を特化した命令を取得する
+ * @param insn 二項演算の命令
+ * @param shape 被演算子の形
+ * @retval -1 特化できない演算子
+ * @retval Other 命令
+ */
+static int findBinaryOp(Insn *insn, OPERAND_SHAPE shape)
+{
+	int num = sizeof(THREADED_OPERATOR_TBL) / sizeof(THREADED_OPERATOR_TBL[0]);
+
+	for (int i = 0; i < num; i++)
+	{
+		if (EQ(insn->name, THREADED_OPERATOR_TBL[i].operator))
+		{
+			return THREADED_OPERATOR_TBL[i].op + shape;
+		}
+	}
+
+	return -1;
+};
+
+/**
+ * @brief 命令の並びが指定した形かどうかを判定する
+ * @param code 中間コード
+ * @param ip 判定を始める位置
+ * @param end まとめてよい範囲の終わり（飛び先の位置か末尾）
+ * @param first 先頭の命令
+ * @param second ２番目の命令（-1なら判定しない）
+ * @param third ３番目の命令（-1なら判定しない）
+ * @return 一致したかどうか
+ */
+static BOOL matchInsns(LineCode *code, int ip, int end, int first, int second, int third)
+{
+	int ops[] = {first, second, third};
+
+	for (int i = 0; i < 3 && ops[i] >= 0; i++)
+	{
+		if (ip + i >= end || (int)code->insns[ip + i].op != ops[i])
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+};
+
+/**
+ * @brief 二項演算の命令を被演算子の形に合わせて特化する
+ * @param code 中間コード
+ * @param ip 変換する位置
+ * @param end まとめてよい範囲の終わり（飛び先の位置か末尾）
+ * @param out 変換先の命令
+ * @return 変換した元の命令数（0なら特化できない）
+ */
+static int specializeBinary(LineCode *code, int ip, int end, ThreadedInsn *out)
+{
+	Insn *insns = &code->insns[ip];
+	int op;
+
+	if (matchInsns(code, ip, end, OP_LOAD, OP_NUMBER, OP_BINARY) && (op = findBinaryOp(&insns[2], SHAPE_VAR_CONST)) >= 0)
+	{
+		out->op = op;
+		out->name = insns[0].name;
+		out->number = insns[1].number;
+		return 3;
+	}
+	if (matchInsns(code, ip, end, OP_LOAD, OP_LOAD, OP_BINARY) && (op = findBinaryOp(&insns[2], SHAPE_VAR_VAR)) >= 0)
+	{
+		out->op = op;
+		out->name = insns[0].name;
+		out->right = insns[1].name;
+		return 3;
+	}
+	if (matchInsns(code, ip, end, OP_NUMBER, OP_BINARY, -1) && (op = findBinaryOp(&insns[1], SHAPE_CONST)) >= 0)
+	{
+		out->op = op;
+		out->number = insns[0].number;
+		return 2;
+	}
+	if (matchInsns(code, ip, end, OP_LOAD, OP_BINARY, -1) && (op = findBinaryOp(&insns[1], SHAPE_VAR)) >= 0)
+	{
+		out->op = op;
+		out->name = insns[0].name;
+		return 2;
+	}
+	if (matchInsns(code, ip, end, OP_BINARY, -1, -1) && (op = findBinaryOp(&insns[0], SHAPE_STACK)) >= 0)
+	{
+		out->op = op;
+		return 1;
+	}
+
+	return 0;
+};
+
+/**
+ * @brief 命令を１つ以上まとめてスレッド化した命令に変換する
+ * @param code 中間コード
+ * @param ip 変換する位置
+ * @param end まとめてよい範囲の終わり（飛び先の位置か末尾）
+ * @param out 変換先の命令
+ * @return 変換した元の命令数
+ */
+static int translateInsn(LineCode *code, int ip, int end, ThreadedInsn *out)
+{
+	Insn *insn = &code->insns[ip];
+	int used = specializeBinary(code, ip, end, out);
+
+	out->insn = insn;
+	if (used > 0)
+	{
+		return used;
+	}
+
+	switch (insn->op)
+	{
+	case OP_NUMBER:
+		if (matchInsns(code, ip, end, OP_NUMBER, OP_ASSIGN_OP, -1))
+		{
+			out->op = TOP_ASSIGN_OP_CONST;
+			out->number = insn->number;
+			out->name = insn[1].name;
+			out->insn = &insn[1];
+			return 2;
+		}
+		out->op = TOP_NUMBER;
+		out->number = insn->number;
+		return 1;
+	case OP_LOAD:
+		out->op = TOP_LOAD;
+		out->name = insn->name;
+		return 1;
+	case OP_STORE:
+		out->name = insn->name;
+		if (matchInsns(code, ip, end, OP_STORE, OP_POP, -1))
+		{
+			out->op = TOP_STORE_POP;
+			return 2;
+		}
+		out->op = TOP_STORE;
+		return 1;
+	case OP_ASSIGN_OP:
+		out->op = TOP_ASSIGN_OP;
+		out->name = insn->name;
+		return 1;
+	case OP_BINARY:
+		out->op = TOP_BINARY;
+		return 1;
+	case OP_UNARY:
+		out->op = TOP_UNARY;
+		return 1;
+	case OP_AND:
+	case OP_OR:
+		// 飛び先は元の命令の位置で持ち、変換後に付け替える
+		out->op = OP_AND == insn->op ? TOP_AND : TOP_OR;
+		out->number = ip + 1 + insn->number;
+		return 1;
+	case OP_POP:
+		out->op = TOP_POP;
+		return 1;
+	case OP_PRINT:
+		out->op = TOP_PRINT;
+		return 1;
+	case OP_CALL:
+		out->op = TOP_CALL;
+		return 1;
+	case OP_TAIL_CALL:
+		out->op = TOP_TAIL_CALL;
+		return 1;
+	default:
+		out->op = TOP_CONTROL;
+		return 1;
+	}
+};
+
+/**
+ * @brief 中間コードをスレッド化した命令列に変換する
+ * @param code 中間コード
+ * @return スレッド化した命令列
+ * @details 命令の処理の先頭は実行時に設定する
+ */
+ThreadedCode *createThreadedCode(LineCode *code)
+{
+	ThreadedCode *tc = (ThreadedCode *)calloc(1, sizeof(ThreadedCode));
+	tc->insns = (ThreadedInsn *)calloc(code->count + 1, sizeof(ThreadedInsn));
+	int *map = (int *)malloc((code->count + 1) * sizeof(int));
+	BOOL *targets = (BOOL *)calloc(code->count + 1, sizeof(BOOL));
+
+	// 定数の畳み込みで論理演算の飛び先の直前が定数になることがあるので、飛び先をまたいでまとめない
+	for (int ip = 0; ip < code->count; ip++)
+	{
+		map[ip] = -1;
+		if (OP_AND == code->insns[ip].op || OP_OR == code->insns[ip].op)
+		{
+			targets[ip + 1 + code->insns[ip].number] = TRUE;
+		}
+	}
+
+	int end = 0;
+	for (int ip = 0; ip < code->count;)
+	{
+		if (end <= ip)
+		{
+			end = ip + 1;
+			while (end < code->count && FALSE == targets[end])
+			{
+				end++;
+			}
+		}
+		map[ip] = tc->count;
+		ip += translateInsn(code, ip, end, &tc->insns[tc->count++]);
+	}
+	map[code->count] = tc->count;
+	tc->insns[tc->count++].op = TOP_END_LINE;
+
+	for (int i = 0; i < tc->count; i++)
+	{
+		ThreadedInsn *t = &tc->insns[i];
+		if (TOP_AND == t->op || TOP_OR == t->op)
+		{
+			assert(map[t->number] >= 0);
+			t->number = map[t->number] - (i + 1);
+		}
+	}
+
+	free(targets);
+	free(map);
+	return tc;
+};
+
+/**
+ * @brief スレッド化した命令列を破棄する
+ * @param tc スレッド化した命令列
+ */
+void releaseThreadedCode(ThreadedCode *tc)
+{
+	free(tc->insns);
+	free(tc);
+};
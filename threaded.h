@@ -0,0 +1,122 @@
+#ifndef _THREADED_H_
+#define _THREADED_H_
+
+#include "code.h"
+#include "particle.h"
+
+/**
+ * 命令として特化する二項演算（命令名、C言語の演算子）
+ * @details 演算ごとに被演算子の形に応じた５種類の命令を生成する。シフトはシフト量を丸める必要があるので特化しない
+ */
+#define THREADED_BINARY_OPS(X) \
+	X(ADD, +)                  \
+	X(SUB, -)                  \
+	X(MUL, *)                  \
+	X(DIV, /)                  \
+	X(MOD, %)                  \
+	X(BIT_AND, &)              \
+	X(BIT_OR, |)               \
+	X(BIT_XOR, ^)              \
+	X(LT, <)                   \
+	X(GT, >)                   \
+	X(LE, <=)                  \
+	X(GE, >=)                  \
+	X(EQ, ==)                  \
+	X(NE, !=)
+
+/// 二項演算の被演算子の形（特化した命令の並び順）
+typedef enum
+{
+	/// スタックの２つの値
+	SHAPE_STACK,
+	/// 変数と定数
+	SHAPE_VAR_CONST,
+	/// 変数と変数
+	SHAPE_VAR_VAR,
+	/// スタックトップと定数
+	SHAPE_CONST,
+	/// スタックトップと変数
+	SHAPE_VAR,
+	/// 形の数
+	SHAPE_COUNT,
+} OPERAND_SHAPE;
+
+/// スレッド化した命令の種類
+typedef enum
+{
+	/// 定数をpushする
+	TOP_NUMBER,
+	/// 変数の値をpushする
+	TOP_LOAD,
+	/// スタックトップの値を変数に代入する（値は残す）
+	TOP_STORE,
+	/// スタックトップの値を変数に代入して捨てる
+	TOP_STORE_POP,
+	/// 複合代入演算
+	TOP_ASSIGN_OP,
+	/// 定数による複合代入演算
+	TOP_ASSIGN_OP_CONST,
+	/// 特化していない二項演算
+	TOP_BINARY,
+	/// 単項演算
+	TOP_UNARY,
+	/// &&の左辺の判定（numberはスレッド化した命令での飛び先までの距離）
+	TOP_AND,
+	/// ||の左辺の判定（numberはスレッド化した命令での飛び先までの距離）
+	TOP_OR,
+	/// スタックトップの値を捨てる
+	TOP_POP,
+	/// 組み込み関数print
+	TOP_PRINT,
+	/// ユーザ関数の呼び出し
+	TOP_CALL,
+	/// 末尾位置でのユーザ関数の呼び出し
+	TOP_TAIL_CALL,
+	/// 制御構造など、元の命令をそのまま実行する
+	TOP_CONTROL,
+	/// 行の終わり
+	TOP_END_LINE,
+#define THREADED_BINARY_OPCODE(kind, op) \
+	TOP_##kind,                          \
+		TOP_##kind##_VAR_CONST,          \
+		TOP_##kind##_VAR_VAR,            \
+		TOP_##kind##_CONST,              \
+		TOP_##kind##_VAR,
+	THREADED_BINARY_OPS(THREADED_BINARY_OPCODE)
+#undef THREADED_BINARY_OPCODE
+	/// 命令の種類の数
+	TOP_COUNT,
+} THREADED_OPCODE;
+
+/// スレッド化した命令
+typedef struct threaded_insn
+{
+	/// 命令の処理の先頭（直接スレッド化した場合）
+	const void *handler;
+	/// 命令の種類
+	THREADED_OPCODE op;
+	/// 定数
+	int number;
+	/// 変数名（二項演算では左辺）
+	char *name;
+	/// 右辺の変数名（SHAPE_VAR_VAR）
+	char *right;
+	/// 元の命令
+	Insn *insn;
+} ThreadedInsn;
+
+/// １行分のスレッド化した命令列
+typedef struct threaded_code
+{
+	/// 命令列（末尾はTOP_END_LINE）
+	ThreadedInsn *insns;
+	/// 命令数
+	int count;
+	/// 命令の処理の先頭を設定済みかどうか
+	BOOL linked;
+} ThreadedCode;
+
+ThreadedCode *createThreadedCode(LineCode *);
+void releaseThreadedCode(ThreadedCode *);
+
+#endif
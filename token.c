@@ -173,6 +173,27 @@ Token *addToken(Token *tokens, Token *tk)
 	return tokens;
 };
 
+/**
+ * @brief トークン列の指定したトークンの直前にトークンを挿入する
+ * @param tokens トークンリストの先頭ポインタ
+ * @param pos 挿入位置のトークン
+ * @param tk 挿入するトークン
+ * @return 挿入後のトークン群の先頭ポインタ
+ */
+Token *insertToken(Token *tokens, Token *pos, Token *tk)
+{
+	tk->prev = pos->prev;
+	tk->next = pos;
+	pos->prev = tk;
+
+	if (NULL == tk->prev)
+	{
+		return tk;
+	}
+	tk->prev->next = tk;
+	return tokens;
+};
+
 /**
  * @brief トークン列の末尾を取得する
  * @param tokens トークン列
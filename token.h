@@ -51,6 +51,7 @@ Token *createRightBracketToken(char);
 Token *createFunctionToken(char *);
 Token *createKeywordToken(char *);
 Token *addToken(Token *, Token *);
+Token *insertToken(Token *, Token *, Token *);
 Token *getLastToken(Token *);
 
 // デバッグ用
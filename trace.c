@@ -0,0 +1,1163 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "trace.h"
+#include "regvm.h"
+#include "jit.h"
+#include "optimize.h"
+#include "mem.h"
+#include "util.h"
+
+/// 命令列の初期容量
+#define TRACE_CODE_INIT_SIZE (64)
+
+/// 演算子とレジスタマシンの命令の対応表
+typedef struct
+{
+	/// 演算子
+	char *operator;
+	/// 命令
+	int op;
+} TraceOperatorTable;
+
+static TraceOperatorTable TRACE_OPERATOR_TBL[] = {
+	{"+", RV_ADD},
+	{"-", RV_SUB},
+	{"*", RV_MUL},
+	{"/", RV_DIV},
+	{"%", RV_MOD},
+	{"&", RV_BIT_AND},
+	{"|", RV_BIT_OR},
+	{"^", RV_BIT_XOR},
+	{"<<", RV_SHL},
+	{">>", RV_SHR},
+	{"<", RV_LT},
+	{">", RV_GT},
+	{"<=", RV_LE},
+	{">=", RV_GE},
+	{"==", RV_EQ},
+	{"!=", RV_NE},
+};
+
+/// 記録した行
+typedef struct trace_step
+{
+	/// 中間コード
+	LineCode *line;
+	/// ifの条件が真だったかどうか
+	BOOL taken;
+} TraceStep;
+
+/**
+ * コンパイルしたトレース
+ * @details レジスタは先頭から変数、定数、変数の退避先、反復回数、forループの終端値と増分、一時値の順に並ぶ
+ */
+typedef struct trace
+{
+	/// ループ１回分の命令列（末尾で先頭に戻る）
+	RegFunction code;
+	/// 変数名
+	char **names;
+	/// 変数の数
+	int nvars;
+	/// 実行時に束縛した変数
+	Variable **vars;
+	/// レジスタ
+	int *regs;
+	/// 反復回数のレジスタ番号
+	int counter;
+	/// forループの終端値のレジスタ番号（次が増分、whileなら-1）
+	int bound;
+	/// 記録したforループの増分が正かどうか
+	BOOL ascending;
+	/// 途中脱出する命令の位置
+	int side_exit;
+	/// 実行した反復回数
+	unsigned long iterations;
+	/// 途中脱出した回数
+	unsigned long side_exits;
+} Trace;
+
+/// ループの先頭ごとの状態
+typedef struct trace_loop
+{
+	/// 条件が真になった回数
+	int hotness;
+	/// トレースにしないかどうか
+	BOOL blacklisted;
+	/// 次の１回はインタプリタで実行するかどうか（途中脱出の直後）
+	BOOL skip_once;
+	/// コンパイルしたトレース
+	Trace *trace;
+} TraceLoop;
+
+/// 記録中のトレース
+typedef struct trace_recorder
+{
+	/// 記録中かどうか
+	BOOL active;
+	/// ループの先頭の位置
+	int pc;
+	/// ループの先頭の中間コード
+	LineCode *header;
+	/// ループ本体を実行するときのフレームの深さ
+	int depth;
+	/// forループの増分（whileでは使わない）
+	int step;
+	/// ループの先頭の行の評価を終えたかどうか
+	BOOL started;
+	/// 記録した行
+	TraceStep steps[TRACE_MAX_LINES];
+	/// 記録した行数
+	int count;
+} TraceRecorder;
+
+/// トレースへの変換器
+typedef struct trace_builder
+{
+	/// 変換中のトレース
+	Trace *tr;
+	/// 変数の退避先のレジスタ番号（-1なら退避しない）
+	int *shadows;
+	/// シンボリックな演算スタック（値を持つレジスタ番号）
+	int *stack;
+	/// スタックの深さ
+	int sp;
+	/// 飛び先が出口のジャンプの位置
+	int *fixups;
+	/// 飛び先が途中脱出の出口かどうか
+	BOOL *side;
+	/// ジャンプの数
+	int nfixups;
+	/// 変換中の行の先頭の命令の位置
+	int line_start;
+} TraceBuilder;
+
+/// ループの先頭の位置ごとの状態
+static TraceLoop *loops = NULL;
+static int nloops = 0;
+
+static TraceRecorder recorder;
+
+/**
+ * @brief 二項演算の命令を取得する
+ * @param name 演算子
+ * @retval -1 該当なし
+ * @retval Other 命令
+ */
+static int findBinaryOp(char *name)
+{
+	int num = sizeof(TRACE_OPERATOR_TBL) / sizeof(TRACE_OPERATOR_TBL[0]);
+
+	for (int i = 0; i < num; i++)
+	{
+		if (EQ(name, TRACE_OPERATOR_TBL[i].operator))
+		{
+			return TRACE_OPERATOR_TBL[i].op;
+		}
+	}
+	return -1;
+};
+
+/**
+ * @brief 複合代入演算の命令を取得する
+ * @param calc 演算の実処理
+ * @retval -1 該当なし
+ * @retval Other 命令
+ */
+static int findAssignOp(OPERATOR_FUNC calc)
+{
+	int num = sizeof(TRACE_OPERATOR_TBL) / sizeof(TRACE_OPERATOR_TBL[0]);
+
+	for (int i = 0; i < num; i++)
+	{
+		if (calc == getEngineFunc(TRACE_OPERATOR_TBL[i].operator))
+		{
+			return TRACE_OPERATOR_TBL[i].op;
+		}
+	}
+	return -1;
+};
+
+/**
+ * @brief 行をトレースに含められるかどうかを判定する
+ * @param line 中間コード
+ * @return 含められるかどうか
+ * @details 呼び出しや表示など変数の更新以外の副作用を持つ行は含めない
+ */
+static BOOL isTraceableLine(LineCode *line)
+{
+	for (int i = 0; i < line->count; i++)
+	{
+		Insn *insn = &line->insns[i];
+
+		switch (insn->op)
+		{
+		case OP_NUMBER:
+		case OP_LOAD:
+		case OP_POP:
+		case OP_AND:
+		case OP_OR:
+		case OP_IF_ENTER:
+		case OP_IF:
+		case OP_WHILE_ENTER:
+		case OP_WHILE:
+		case OP_ELSE:
+		case OP_END:
+		case OP_CONTINUE:
+			break;
+		case OP_STORE:
+			// 条件式の中の代入は途中脱出したときに二重に実行されてしまう
+			if (LINE_EXPR != line->type)
+			{
+				return FALSE;
+			}
+			break;
+		case OP_ASSIGN_OP:
+			if (LINE_EXPR != line->type || findAssignOp(insn->calc) < 0)
+			{
+				return FALSE;
+			}
+			break;
+		case OP_BINARY:
+			if (findBinaryOp(insn->name) < 0)
+			{
+				return FALSE;
+			}
+			break;
+		case OP_UNARY:
+			if (FALSE == isStrMatch(insn->name, "-", "!", "~", "+"))
+			{
+				return FALSE;
+			}
+			break;
+		default:
+			return FALSE;
+		}
+	}
+	return TRUE;
+};
+
+/**
+ * @brief ループの先頭の状態を取得する
+ * @param pc ループの先頭の位置
+ * @return 状態
+ */
+static TraceLoop *getLoop(int pc)
+{
+	if (pc >= nloops)
+	{
+		int capacity = nloops ? nloops : 64;
+		while (capacity <= pc)
+		{
+			capacity *= 2;
+		}
+		loops = (TraceLoop *)realloc(loops, capacity * sizeof(TraceLoop));
+		memset(&loops[nloops], 0, (capacity - nloops) * sizeof(TraceLoop));
+		nloops = capacity;
+	}
+	return &loops[pc];
+};
+
+/**
+ * @brief 変数のレジスタ番号を取得する（なければ追加する）
+ * @param tr トレース
+ * @param name 変数名
+ * @return レジスタ番号
+ */
+static int getVarReg(Trace *tr, char *name)
+{
+	for (int i = 0; i < tr->nvars; i++)
+	{
+		if (name == tr->names[i] || EQ(name, tr->names[i]))
+		{
+			return i;
+		}
+	}
+
+	tr->names = (char **)realloc(tr->names, (tr->nvars + 1) * sizeof(char *));
+	tr->names[tr->nvars] = name;
+	return tr->nvars++;
+};
+
+/**
+ * @brief 定数の番号を取得する（なければ追加する）
+ * @param tr トレース
+ * @param value 値
+ * @return 定数の番号
+ */
+static int getConstIndex(Trace *tr, int value)
+{
+	RegFunction *rf = &tr->code;
+
+	for (int i = 0; i < rf->nconsts; i++)
+	{
+		if (rf->consts[i] == value)
+		{
+			return i;
+		}
+	}
+
+	rf->consts = (int *)realloc(rf->consts, (rf->nconsts + 1) * sizeof(int));
+	rf->consts[rf->nconsts] = value;
+	return rf->nconsts++;
+};
+
+/**
+ * @brief 定数のレジスタ番号を取得する（変数の数が確定してから使う）
+ * @param tr トレース
+ * @param value 値
+ * @return レジスタ番号
+ */
+static int getConstReg(Trace *tr, int value)
+{
+	return tr->nvars + getConstIndex(tr, value);
+};
+
+/**
+ * @brief for文の行の初期化と判定の命令を取得する
+ * @param header ループの先頭の中間コード
+ * @retval NULL whileの行
+ * @retval Other OP_FORの命令
+ */
+static Insn *getForInsn(LineCode *header)
+{
+	return LINE_FOR == header->type ? &header->insns[header->count - 1] : NULL;
+};
+
+/**
+ * @brief 行で使う変数と定数を登録する
+ * @param tr トレース
+ * @param line 中間コード
+ */
+static void collectOperands(Trace *tr, LineCode *line)
+{
+	for (int i = 0; i < line->count; i++)
+	{
+		Insn *insn = &line->insns[i];
+
+		switch (insn->op)
+		{
+		case OP_NUMBER:
+			getConstIndex(tr, insn->number);
+			break;
+		case OP_LOAD:
+		case OP_STORE:
+		case OP_ASSIGN_OP:
+			getVarReg(tr, insn->name);
+			break;
+		default:
+			break;
+		}
+	}
+};
+
+/**
+ * @brief 命令を追加する
+ * @param rf 命令列
+ * @param op 命令
+ * @param a オペランド
+ * @param b オペランド
+ * @param c オペランド
+ * @return 追加した命令の位置
+ */
+static int emitTrace(RegFunction *rf, int op, int a, int b, int c)
+{
+	if (rf->count == rf->capacity)
+	{
+		rf->capacity = rf->capacity ? rf->capacity * 2 : TRACE_CODE_INIT_SIZE;
+		rf->code = (RegInsn *)realloc(rf->code, rf->capacity * sizeof(RegInsn));
+	}
+
+	RegInsn *insn = &rf->code[rf->count];
+	insn->op = op;
+	insn->a = a;
+	insn->b = b;
+	insn->c = c;
+	return rf->count++;
+};
+
+/**
+ * @brief 変数に代入する前に、スタックに残っている変数の値を一時値に移す
+ * @param tb 変換器
+ * @param reg 変数のレジスタ番号
+ */
+static void protectVar(TraceBuilder *tb, int reg)
+{
+	for (int i = 0; i < tb->sp; i++)
+	{
+		if (tb->stack[i] == reg)
+		{
+			int temp = tb->tr->code.temp_base + i;
+			emitTrace(&tb->tr->code, RV_MOVE, temp, reg, 0);
+			tb->stack[i] = temp;
+		}
+	}
+};
+
+/**
+ * @brief 比較の否定を取得する
+ * @param op 比較の命令
+ * @return 否定した比較の命令
+ */
+static int negateCompare(int op)
+{
+	switch (op)
+	{
+	case RV_LT:
+		return RV_GE;
+	case RV_GT:
+		return RV_LE;
+	case RV_LE:
+		return RV_GT;
+	case RV_GE:
+		return RV_LT;
+	case RV_EQ:
+		return RV_NE;
+	default:
+		return RV_EQ;
+	}
+};
+
+/**
+ * @brief 分岐命令の飛び先を設定する
+ * @param rf 命令列
+ * @param at 分岐命令の位置
+ * @param target 飛び先の位置
+ */
+static void setBranchTarget(RegFunction *rf, int at, int target)
+{
+	RegInsn *insn = &rf->code[at];
+	int rel = target - (at + 1);
+
+	if (RV_JUMP_IF_ZERO == insn->op)
+	{
+		insn->b = rel;
+	}
+	else
+	{
+		insn->c = rel;
+	}
+};
+
+/**
+ * @brief 条件の真偽で分岐する命令を追加する（飛び先は後で設定する）
+ * @param tb 変換器
+ * @param cond 条件のレジスタ番号
+ * @param truth 分岐する条件の真偽
+ * @return 分岐命令の位置
+ * @details 直前の比較の結果を判定するだけなら比較と分岐を１命令にまとめる
+ */
+static int emitBranch(TraceBuilder *tb, int cond, BOOL truth)
+{
+	RegFunction *rf = &tb->tr->code;
+	RegInsn *last = &rf->code[rf->count - 1];
+
+	if (rf->count > tb->line_start && cond >= rf->temp_base && last->a == cond && last->op >= RV_LT && last->op <= RV_NE)
+	{
+		int op = truth ? last->op : negateCompare(last->op);
+		last->op = RV_BLT + (op - RV_LT);
+		last->a = last->b;
+		last->b = last->c;
+		return rf->count - 1;
+	}
+	if (truth)
+	{
+		return emitTrace(rf, RV_BNE, cond, getConstReg(tb->tr, 0), 0);
+	}
+	return emitTrace(rf, RV_JUMP_IF_ZERO, cond, 0, 0);
+};
+
+/**
+ * @brief 出口に飛ぶ分岐を登録する
+ * @param tb 変換器
+ * @param at 分岐命令の位置
+ * @param side 途中脱出の出口に飛ぶかどうか（偽ならループの出口）
+ */
+static void addExit(TraceBuilder *tb, int at, BOOL side)
+{
+	tb->fixups[tb->nfixups] = at;
+	tb->side[tb->nfixups] = side;
+	tb->nfixups++;
+};
+
+/**
+ * @brief ガード（条件が記録と異なれば出口に飛ぶ分岐）を追加する
+ * @param tb 変換器
+ * @param cond 条件のレジスタ番号
+ * @param expected 記録した条件の真偽
+ * @param side 途中脱出の出口に飛ぶかどうか（偽ならループの出口）
+ */
+static void emitGuard(TraceBuilder *tb, int cond, BOOL expected, BOOL side)
+{
+	addExit(tb, emitBranch(tb, cond, !expected), side);
+};
+
+/**
+ * @brief スタックの値をすべて位置ごとの一時値に移す（行の中の分岐の合流点で値の場所をそろえる）
+ * @param tb 変換器
+ */
+static void materializeStack(TraceBuilder *tb)
+{
+	for (int i = 0; i < tb->sp; i++)
+	{
+		int temp = tb->tr->code.temp_base + i;
+		if (tb->stack[i] != temp)
+		{
+			emitTrace(&tb->tr->code, RV_MOVE, temp, tb->stack[i], 0);
+			tb->stack[i] = temp;
+		}
+	}
+};
+
+/**
+ * @brief 記録した行をレジスタマシンの命令に変換する
+ * @param tb 変換器
+ * @param line 中間コード
+ * @param taken ifの条件が真だったかどうか
+ */
+static void translateLine(TraceBuilder *tb, LineCode *line, BOOL taken)
+{
+	Trace *tr = tb->tr;
+	RegFunction *rf = &tr->code;
+	BOOL expected = LINE_IF == line->type ? taken : TRUE;
+	int jumps[line->count + 1];
+	int targets[line->count + 1];
+	int njumps = 0;
+
+	tb->sp = 0;
+	tb->line_start = rf->count;
+
+	for (int i = 0; i < line->count; i++)
+	{
+		Insn *insn = &line->insns[i];
+
+		// 行の中の分岐の合流点では、比較と後続の分岐をまとめない
+		BOOL merge = FALSE;
+		for (int j = 0; j < njumps; j++)
+		{
+			merge = merge || targets[j] == i;
+		}
+		if (merge)
+		{
+			materializeStack(tb);
+			tb->line_start = rf->count;
+			for (int j = 0; j < njumps; j++)
+			{
+				if (targets[j] == i)
+				{
+					setBranchTarget(rf, jumps[j], rf->count);
+				}
+			}
+		}
+
+		switch (insn->op)
+		{
+		case OP_NUMBER:
+			tb->stack[tb->sp++] = getConstReg(tr, insn->number);
+			break;
+		case OP_LOAD:
+			tb->stack[tb->sp++] = getVarReg(tr, insn->name);
+			break;
+		case OP_STORE:
+		{
+			int reg = getVarReg(tr, insn->name);
+			int value = tb->stack[tb->sp - 1];
+			tb->sp--;
+			protectVar(tb, reg);
+			if (value != reg)
+			{
+				emitTrace(rf, RV_MOVE, reg, value, 0);
+			}
+			tb->stack[tb->sp++] = reg;
+			break;
+		}
+		case OP_ASSIGN_OP:
+		{
+			int reg = getVarReg(tr, insn->name);
+			int value = tb->stack[--tb->sp];
+			protectVar(tb, reg);
+			emitTrace(rf, findAssignOp(insn->calc), reg, reg, value);
+			tb->stack[tb->sp++] = reg;
+			break;
+		}
+		case OP_BINARY:
+		{
+			int right = tb->stack[--tb->sp];
+			int left = tb->stack[--tb->sp];
+			int temp = rf->temp_base + tb->sp;
+			emitTrace(rf, findBinaryOp(insn->name), temp, left, right);
+			tb->stack[tb->sp++] = temp;
+			break;
+		}
+		case OP_UNARY:
+		{
+			int value = tb->stack[tb->sp - 1];
+			int temp = rf->temp_base + tb->sp - 1;
+			if (EQ(insn->name, "+"))
+			{
+				break;
+			}
+			emitTrace(rf, EQ(insn->name, "-") ? RV_NEG : EQ(insn->name, "!") ? RV_NOT : RV_BIT_NOT, temp, value, 0);
+			tb->stack[tb->sp - 1] = temp;
+			break;
+		}
+		case OP_AND:
+		case OP_OR:
+		{
+			BOOL truth = OP_OR == insn->op;
+			int target = i + 1 + insn->number;
+			int cond = tb->stack[--tb->sp];
+
+			if (OP_IF == line->insns[target].op || OP_WHILE == line->insns[target].op)
+			{
+				// 条件式の結果が決まるので、記録と異なれば出口へ、同じならガードの後ろへ飛ぶ
+				int at = emitBranch(tb, cond, truth);
+				if (truth != expected)
+				{
+					addExit(tb, at, OP_IF == line->insns[target].op);
+				}
+				else
+				{
+					jumps[njumps] = at;
+					targets[njumps++] = -1;
+				}
+				break;
+			}
+
+			// 飛び先でも値を使うため、スタックトップも一時値に置いてから分岐する
+			tb->sp++;
+			materializeStack(tb);
+			int temp = rf->temp_base + tb->sp - 1;
+			if (truth)
+			{
+				emitTrace(rf, RV_NE, temp, temp, getConstReg(tr, 0));
+				jumps[njumps] = emitTrace(rf, RV_BNE, temp, getConstReg(tr, 0), 0);
+			}
+			else
+			{
+				jumps[njumps] = emitTrace(rf, RV_JUMP_IF_ZERO, temp, 0, 0);
+			}
+			targets[njumps++] = target;
+			tb->sp--;
+			break;
+		}
+		case OP_POP:
+			tb->sp--;
+			break;
+		case OP_IF:
+		case OP_WHILE:
+			emitGuard(tb, tb->stack[--tb->sp], expected, OP_IF == insn->op);
+			for (int j = 0; j < njumps; j++)
+			{
+				if (targets[j] < 0)
+				{
+					setBranchTarget(rf, jumps[j], rf->count);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+};
+
+/**
+ * @brief トレースを破棄する
+ * @param tr トレース
+ */
+static void releaseTraceCode(Trace *tr)
+{
+	if (tr->code.jit)
+	{
+		releaseJit(tr->code.jit);
+	}
+	free(tr->code.code);
+	free(tr->code.consts);
+	free(tr->names);
+	free(tr->vars);
+	free(tr->regs);
+	free(tr);
+};
+
+/**
+ * @brief 記録したループ１回分の実行経路をトレースにコンパイルする
+ * @param rec 記録したトレース
+ * @return トレース
+ * @details 条件が記録と異なれば、その反復で代入した変数を元に戻して途中脱出する
+ */
+static Trace *compileTrace(TraceRecorder *rec)
+{
+	Trace *tr = (Trace *)calloc(1, sizeof(Trace));
+	RegFunction *rf = &tr->code;
+	TraceBuilder tb;
+	int last_guard = -1;
+	int nshadows = 0;
+	int depth = rec->header->count;
+
+	Insn *loop_for = getForInsn(rec->header);
+
+	getConstIndex(tr, 0);
+	getConstIndex(tr, 1);
+	if (loop_for)
+	{
+		// 開始値と終端値はループに入る前に評価済みなので、ループ変数だけを使う
+		getVarReg(tr, loop_for->name);
+	}
+	else
+	{
+		collectOperands(tr, rec->header);
+	}
+	for (int i = 0; i < rec->count; i++)
+	{
+		collectOperands(tr, rec->steps[i].line);
+		if (LINE_IF == rec->steps[i].line->type)
+		{
+			last_guard = i;
+		}
+		if (rec->steps[i].line->count > depth)
+		{
+			depth = rec->steps[i].line->count;
+		}
+	}
+
+	// 最後のガードより前に代入する変数だけを退避する
+	tb.tr = tr;
+	tb.shadows = (int *)malloc(tr->nvars * sizeof(int));
+	for (int i = 0; i < tr->nvars; i++)
+	{
+		tb.shadows[i] = -1;
+	}
+	for (int i = 0; i < last_guard; i++)
+	{
+		LineCode *line = rec->steps[i].line;
+		for (int j = 0; j < line->count; j++)
+		{
+			if (OP_STORE == line->insns[j].op || OP_ASSIGN_OP == line->insns[j].op)
+			{
+				int reg = getVarReg(tr, line->insns[j].name);
+				if (tb.shadows[reg] < 0)
+				{
+					tb.shadows[reg] = tr->nvars + rf->nconsts + nshadows++;
+				}
+			}
+		}
+	}
+	tr->counter = tr->nvars + rf->nconsts + nshadows;
+	tr->bound = loop_for ? tr->counter + 1 : -1;
+	tr->ascending = rec->step > 0;
+	rf->temp_base = tr->counter + (loop_for ? 3 : 1);
+	rf->nregs = rf->temp_base + depth;
+
+	tb.stack = (int *)malloc(depth * sizeof(int));
+	// ガードは条件式の行ごとに１つと、その中の論理演算ごとに１つ
+	int nbranches = rec->header->count;
+	for (int i = 0; i < rec->count; i++)
+	{
+		nbranches += rec->steps[i].line->count;
+	}
+	tb.fixups = (int *)malloc((nbranches + 1) * sizeof(int));
+	tb.side = (BOOL *)malloc((nbranches + 1) * sizeof(BOOL));
+	tb.nfixups = 0;
+
+	// 反復の先頭：退避と反復回数の更新
+	for (int i = 0; i < tr->nvars; i++)
+	{
+		if (tb.shadows[i] >= 0)
+		{
+			emitTrace(rf, RV_MOVE, tb.shadows[i], i, 0);
+		}
+	}
+	emitTrace(rf, RV_ADD, tr->counter, tr->counter, getConstReg(tr, 1));
+
+	// ループ本体、ループの条件の順に並べて先頭に戻る
+	for (int i = 0; i < rec->count; i++)
+	{
+		translateLine(&tb, rec->steps[i].line, rec->steps[i].taken);
+	}
+	if (loop_for)
+	{
+		// forループは増分を足して終端値と比べるだけにする
+		int reg = getVarReg(tr, loop_for->name);
+		emitTrace(rf, RV_ADD, reg, reg, tr->bound + 1);
+		addExit(&tb, emitTrace(rf, tr->ascending ? RV_BGE : RV_BLE, reg, tr->bound, 0), FALSE);
+	}
+	else
+	{
+		translateLine(&tb, rec->header, TRUE);
+	}
+	emitTrace(rf, RV_JUMP, -(rf->count + 1), 0, 0);
+
+	// 途中脱出の出口：反復の先頭の値に戻す
+	int side_exit = rf->count;
+	for (int i = 0; i < tr->nvars; i++)
+	{
+		if (tb.shadows[i] >= 0)
+		{
+			emitTrace(rf, RV_MOVE, i, tb.shadows[i], 0);
+		}
+	}
+	emitTrace(rf, RV_HALT, 0, 0, 0);
+	int loop_exit = emitTrace(rf, RV_HALT, 0, 0, 0);
+
+	for (int i = 0; i < tb.nfixups; i++)
+	{
+		setBranchTarget(rf, tb.fixups[i], tb.side[i] ? side_exit : loop_exit);
+	}
+
+	free(tb.shadows);
+	free(tb.stack);
+	free(tb.fixups);
+	free(tb.side);
+
+	// 出口では変数、定数、退避した値、反復回数を読み出す（出口の2命令は最適化後も末尾に残る）
+	optimizeRegFunction(rf, tr->nvars, rf->temp_base);
+	tr->side_exit = rf->count - 2;
+
+	tr->vars = (Variable **)malloc(tr->nvars * sizeof(Variable *));
+	tr->regs = (int *)calloc(rf->nregs, sizeof(int));
+	rf->jit = compileJit(rf);
+	return tr;
+};
+
+/**
+ * @brief トレースの命令列を実行する（ネイティブコードにできない環境で使う）
+ * @param rf 命令列
+ * @param r レジスタ
+ * @return 出口の命令の位置
+ */
+static int execTraceCode(RegFunction *rf, int *r)
+{
+	RegInsn *ip = rf->code;
+
+	for (;;)
+	{
+		RegInsn *insn = ip++;
+
+		switch (insn->op)
+		{
+		case RV_MOVE:
+			r[insn->a] = r[insn->b];
+			break;
+		case RV_ADD:
+			r[insn->a] = r[insn->b] + r[insn->c];
+			break;
+		case RV_SUB:
+			r[insn->a] = r[insn->b] - r[insn->c];
+			break;
+		case RV_MUL:
+			r[insn->a] = r[insn->b] * r[insn->c];
+			break;
+		case RV_DIV:
+			r[insn->a] = r[insn->b] / r[insn->c];
+			break;
+		case RV_MOD:
+			r[insn->a] = r[insn->b] % r[insn->c];
+			break;
+		case RV_BIT_AND:
+			r[insn->a] = r[insn->b] & r[insn->c];
+			break;
+		case RV_BIT_OR:
+			r[insn->a] = r[insn->b] | r[insn->c];
+			break;
+		case RV_BIT_XOR:
+			r[insn->a] = r[insn->b] ^ r[insn->c];
+			break;
+		case RV_SHL:
+			r[insn->a] = SHIFT_LEFT(r[insn->b], r[insn->c]);
+			break;
+		case RV_SHR:
+			r[insn->a] = SHIFT_RIGHT(r[insn->b], r[insn->c]);
+			break;
+		case RV_LT:
+			r[insn->a] = r[insn->b] < r[insn->c];
+			break;
+		case RV_GT:
+			r[insn->a] = r[insn->b] > r[insn->c];
+			break;
+		case RV_LE:
+			r[insn->a] = r[insn->b] <= r[insn->c];
+			break;
+		case RV_GE:
+			r[insn->a] = r[insn->b] >= r[insn->c];
+			break;
+		case RV_EQ:
+			r[insn->a] = r[insn->b] == r[insn->c];
+			break;
+		case RV_NE:
+			r[insn->a] = r[insn->b] != r[insn->c];
+			break;
+		case RV_NEG:
+			r[insn->a] = -r[insn->b];
+			break;
+		case RV_NOT:
+			r[insn->a] = !r[insn->b];
+			break;
+		case RV_BIT_NOT:
+			r[insn->a] = ~r[insn->b];
+			break;
+		case RV_DIVI:
+			r[insn->a] = r[insn->b] / insn->c;
+			break;
+		case RV_MODI:
+			r[insn->a] = r[insn->b] % insn->c;
+			break;
+		case RV_JUMP:
+			ip += insn->a;
+			break;
+		case RV_JUMP_IF_ZERO:
+			if (0 == r[insn->a])
+			{
+				ip += insn->b;
+			}
+			break;
+		case RV_BLT:
+			ip += r[insn->a] < r[insn->b] ? insn->c : 0;
+			break;
+		case RV_BGT:
+			ip += r[insn->a] > r[insn->b] ? insn->c : 0;
+			break;
+		case RV_BLE:
+			ip += r[insn->a] <= r[insn->b] ? insn->c : 0;
+			break;
+		case RV_BGE:
+			ip += r[insn->a] >= r[insn->b] ? insn->c : 0;
+			break;
+		case RV_BEQ:
+			ip += r[insn->a] == r[insn->b] ? insn->c : 0;
+			break;
+		case RV_BNE:
+			ip += r[insn->a] != r[insn->b] ? insn->c : 0;
+			break;
+		default:
+			return (int)(insn - rf->code);
+		}
+	}
+};
+
+/**
+ * @brief トレースを実行する
+ * @param loop ループの先頭の状態
+ * @param limit forループの終端値
+ * @param step forループの増分
+ * @return 実行したかどうか（変数が未定義か、forループの増分の向きが記録と異なれば実行しない）
+ */
+static BOOL runTrace(TraceLoop *loop, int limit, int step)
+{
+	Trace *tr = loop->trace;
+	int *r = tr->regs;
+
+	if (tr->bound >= 0 && (step > 0) != tr->ascending)
+	{
+		return FALSE;
+	}
+
+	for (int i = 0; i < tr->nvars; i++)
+	{
+		Variable *var = getVariable(tr->names[i]);
+		if (NULL == var)
+		{
+			return FALSE;
+		}
+		tr->vars[i] = var;
+		r[i] = var->value;
+	}
+	memcpy(&r[tr->nvars], tr->code.consts, tr->code.nconsts * sizeof(int));
+	r[tr->counter] = 0;
+	if (tr->bound >= 0)
+	{
+		r[tr->bound] = limit;
+		r[tr->bound + 1] = step;
+	}
+
+	int index = tr->code.jit ? enterJit(tr->code.jit, r, NULL, 0) : execTraceCode(&tr->code, r);
+
+	for (int i = 0; i < tr->nvars; i++)
+	{
+		tr->vars[i]->value = r[i];
+	}
+	tr->iterations += r[tr->counter];
+
+	if (index == tr->side_exit)
+	{
+		// 途中脱出した反復はインタプリタでやり直す
+		loop->skip_once = TRUE;
+		tr->side_exits++;
+
+		// 途中脱出が多ければトレースをやめる
+		if (tr->side_exits >= TRACE_MIN_SIDE_EXITS && tr->side_exits * 4 > tr->iterations)
+		{
+			releaseTraceCode(tr);
+			loop->trace = NULL;
+			loop->blacklisted = TRUE;
+		}
+	}
+	return TRUE;
+};
+
+/**
+ * @brief トレースの記録を中止する
+ */
+static void abortRecording(void)
+{
+	getLoop(recorder.pc)->blacklisted = TRUE;
+	recorder.active = FALSE;
+};
+
+/**
+ * @brief トレースの記録を始める
+ * @param pc ループの先頭の位置
+ * @param header ループの先頭の中間コード
+ * @param depth ループ本体を実行するときのフレームの深さ
+ * @param step forループの増分
+ */
+static void startRecording(int pc, LineCode *header, int depth, int step)
+{
+	recorder.active = TRUE;
+	recorder.pc = pc;
+	recorder.header = header;
+	recorder.depth = depth;
+	recorder.step = step;
+	recorder.started = FALSE;
+	recorder.count = 0;
+
+	// forの行は開始値と終端値を求めるだけでトレースには含めない
+	if (NULL == getForInsn(header) && FALSE == isTraceableLine(header))
+	{
+		abortRecording();
+	}
+};
+
+/**
+ * @brief トレースの初期化
+ */
+void initTrace(void)
+{
+	loops = NULL;
+	nloops = 0;
+	recorder.active = FALSE;
+};
+
+/**
+ * @brief トレースの破棄
+ */
+void releaseTrace(void)
+{
+	for (int i = 0; i < nloops; i++)
+	{
+		if (loops[i].trace)
+		{
+			releaseTraceCode(loops[i].trace);
+		}
+	}
+	free(loops);
+	loops = NULL;
+	nloops = 0;
+	recorder.active = FALSE;
+};
+
+/**
+ * @brief whileまたはforの条件が真になったときに、トレースがあれば実行する
+ * @param pc ループの先頭の位置
+ * @param header ループの先頭の中間コード
+ * @param depth ループ本体を実行するときのフレームの深さ
+ * @param limit forループの終端値（whileでは使わない）
+ * @param step forループの増分（whileでは使わない）
+ * @return トレースを実行したかどうか（実行したらループの条件から評価し直す）
+ * @details 条件が真になった回数が閾値に達したら、次の１回の実行経路の記録を始める
+ */
+BOOL enterTrace(int pc, LineCode *header, int depth, int limit, int step)
+{
+	if (recorder.active)
+	{
+		return FALSE;
+	}
+
+	TraceLoop *loop = getLoop(pc);
+	if (loop->blacklisted)
+	{
+		return FALSE;
+	}
+	if (loop->skip_once)
+	{
+		loop->skip_once = FALSE;
+		return FALSE;
+	}
+	if (NULL == loop->trace)
+	{
+		if (++loop->hotness >= TRACE_HOT_THRESHOLD)
+		{
+			startRecording(pc, header, depth, step);
+		}
+		return FALSE;
+	}
+
+	return runTrace(loop, limit, step);
+};
+
+/**
+ * @brief トレースを記録中かどうかを取得する
+ * @return 記録中かどうか
+ */
+BOOL isTraceRecording(void)
+{
+	return recorder.active;
+};
+
+/**
+ * @brief 実行状態で評価した行をトレースに記録する
+ * @param line 中間コード
+ * @param depth 評価する前のフレームの深さ
+ * @param result 評価の結果
+ * @details ループ本体のendかcontinueに達したら記録を終えてコンパイルする
+ */
+void recordTraceLine(LineCode *line, int depth, TRACE_LINE_RESULT result)
+{
+	if (FALSE == recorder.active)
+	{
+		return;
+	}
+
+	// 記録はループの先頭の行の評価中に始まる
+	if (FALSE == recorder.started)
+	{
+		recorder.started = TRUE;
+		return;
+	}
+
+	if (LINE_EXPR != line->type && LINE_IF != line->type && LINE_ELSE != line->type && LINE_END != line->type && LINE_CONTINUE != line->type)
+	{
+		abortRecording();
+		return;
+	}
+	if (TRACE_LINE_DEFER == result)
+	{
+		return;
+	}
+	if (TRACE_LINE_ABORT == result || recorder.count == TRACE_MAX_LINES || FALSE == isTraceableLine(line))
+	{
+		abortRecording();
+		return;
+	}
+
+	switch (line->type)
+	{
+	case LINE_EXPR:
+	case LINE_IF:
+		recorder.steps[recorder.count].line = line;
+		recorder.steps[recorder.count].taken = TRACE_LINE_RUN == result;
+		recorder.count++;
+		break;
+	case LINE_END:
+	case LINE_CONTINUE:
+		// continueはループ本体のendと同様に反復を終える
+		if (LINE_CONTINUE == line->type || depth == recorder.depth)
+		{
+			getLoop(recorder.pc)->trace = compileTrace(&recorder);
+			recorder.active = FALSE;
+		}
+		break;
+	default:
+		break;
+	}
+};
@@ -0,0 +1,36 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "code.h"
+#include "particle.h"
+
+/// トレースの記録を始めるループの反復回数
+#define TRACE_HOT_THRESHOLD (16)
+
+/// 記録できる行数の上限
+#define TRACE_MAX_LINES (256)
+
+/// トレースを破棄するかどうかを判定し始める途中脱出の回数
+#define TRACE_MIN_SIDE_EXITS (16)
+
+/// 記録中に評価した行の結果
+typedef enum
+{
+	/// 実行状態のまま終わった（ifの条件が真）
+	TRACE_LINE_RUN,
+	/// 実行スキップ状態になった（ifの条件が偽、else）
+	TRACE_LINE_SKIP,
+	/// ブロックの終端を読み込んでから評価し直す
+	TRACE_LINE_DEFER,
+	/// 終了やエラーなどトレースにできない結果
+	TRACE_LINE_ABORT,
+} TRACE_LINE_RESULT;
+
+void initTrace(void);
+void releaseTrace(void);
+
+BOOL enterTrace(int, LineCode *, int, int, int);
+BOOL isTraceRecording(void);
+void recordTraceLine(LineCode *, int, TRACE_LINE_RESULT);
+
+#endif
@@ -56,6 +56,21 @@ BOOL _isCharMatch(char c, int count, ...)
 	return match;
 };
 
+/**
+ * @brief 文字列のハッシュ値を計算する（FNV-1a）
+ * @param str 文字列
+ * @return ハッシュ値
+ */
+unsigned int hashString(const char *str)
+{
+	unsigned int hash = 2166136261u;
+	for (; *str; str++)
+	{
+		hash = (hash ^ (unsigned char)*str) * 16777619u;
+	}
+	return hash;
+};
+
 /**
  * @brief エラーとして文字列を出力する
  * @param message 文字列
@@ -30,6 +30,7 @@
 
 BOOL _isStrMatch(const char *, int, ...);
 BOOL _isCharMatch(char, int, ...);
+unsigned int hashString(const char *);
 void printError(const char *);
 
 #endif
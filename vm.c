@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include "vm.h"
+#include "bytecode.h"
+#include "array.h"
+#include "builtin.h"
+#include "function.h"
+#include "memo.h"
+#include "purity.h"
+#include "util.h"
+
+/// 関数名に束縛された関数
+typedef struct vm_binding
+{
+	/// バイトコード
+	BcFunction *code;
+	/// 関数オブジェクト（メモ化と純粋性の解析に使う）
+	Function *func;
+} VMBinding;
+
+/// 呼び出しフレーム
+typedef struct vm_frame
+{
+	/// 実行中の関数
+	BcFunction *code;
+	/// 呼び出し元で再開する命令の位置
+	int *ret_ip;
+	/// 変数スロットの先頭の位置
+	int base;
+	/// 戻り値をメモ化する関数（NULLならメモ化しない）
+	Function *memo;
+	/// メモ化のキーとなる引数
+	int memo_args[MEMO_MAX_ARGS];
+} VMFrame;
+
+/// 仮想マシン
+typedef struct vm
+{
+	/// 値のスタック（変数スロットと演算スタック）
+	int *values;
+	/// 変数スロットに値が代入済みかどうか
+	unsigned char *defined;
+	/// 確保済みの要素数
+	int capacity;
+	/// 呼び出しフレーム
+	VMFrame *frames;
+	/// 確保済みのフレーム数
+	int frame_capacity;
+	/// 関数名番号ごとの束縛
+	VMBinding *bindings;
+} VM;
+
+static VM vm;
+
+/**
+ * @brief 値のスタックを拡張する
+ * @param needed 必要な要素数
+ */
+static void reserveValues(int needed)
+{
+	if (needed <= vm.capacity)
+	{
+		return;
+	}
+
+	int capacity = vm.capacity;
+	while (needed > vm.capacity)
+	{
+		vm.capacity *= 2;
+	}
+	vm.values = (int *)realloc(vm.values, vm.capacity * sizeof(int));
+	vm.defined = (unsigned char *)realloc(vm.defined, vm.capacity);
+	memset(vm.defined + capacity, 0, vm.capacity - capacity);
+};
+
+/**
+ * @brief 関数を定義する
+ * @param m プログラム
+ * @param code 関数のバイトコード
+ */
+static void defineBcFunction(BcModule *m, BcFunction *code)
+{
+	Function *func = createFunction(code->name, code->start_pc);
+	func->memo = code->memo;
+	func->end_pc = code->end_pc;
+	func->bytecode = code;
+	func->bytecode_names = m->names;
+	for (int i = 0; i < code->argc; i++)
+	{
+		addArgument(func, code->slot_names[i]);
+	}
+	addFunction(func);
+
+	vm.bindings[code->name_id].code = code;
+	vm.bindings[code->name_id].func = func;
+};
+
+/**
+ * @brief 変数スロットを関数の呼び出し時の状態にする
+ * @param base 変数スロットの先頭の位置
+ * @param code 呼び出す関数
+ */
+static void enterSlots(int base, BcFunction *code)
+{
+	memset(vm.defined + base, 1, code->argc);
+	memset(vm.defined + base + code->argc, 0, code->nslots - code->argc);
+};
+
+/**
+ * @brief バイトコードを実行する
+ * @param m プログラム
+ * @param maxCallDepth 関数呼び出しの深さの上限
+ * @param autoMemo 純粋関数を自動でメモ化するかどうか
+ * @param steps 実行した命令数の格納先
+ * @return 結果
+ */
+static ENGINE_RESULT execute(BcModule *m, int maxCallDepth, BOOL autoMemo, unsigned long *steps)
+{
+	BcFunction *cur = m->main;
+	int fp = 0;
+
+	reserveValues(cur->nslots + cur->max_stack + 1);
+	int *ip = cur->code;
+	int *slots = vm.values;
+	unsigned char *defs = vm.defined;
+	int *sp = slots + cur->nslots;
+	unsigned long count = 0;
+	ENGINE_RESULT ret = RESULT_OK;
+
+	vm.frames[0].code = cur;
+	vm.frames[0].base = 0;
+	vm.frames[0].memo = NULL;
+
+	while (1)
+	{
+		count++;
+		switch (*ip++)
+		{
+		case BC_CONST:
+			*sp++ = *ip++;
+			break;
+		case BC_LOAD:
+		{
+			int slot = *ip++;
+			if (defs[slot])
+			{
+				*sp++ = slots[slot];
+			}
+			else
+			{
+				printError("error : ");
+				printf("\"%s\" is not defined\n", cur->slot_names[slot]);
+				*sp++ = 0;
+			}
+			break;
+		}
+		case BC_STORE:
+		{
+			int slot = *ip++;
+			slots[slot] = sp[-1];
+			defs[slot] = 1;
+			break;
+		}
+		case BC_ASSIGN_ADD:
+		case BC_ASSIGN_SUB:
+		case BC_ASSIGN_MUL:
+		case BC_ASSIGN_DIV:
+		case BC_ASSIGN_MOD:
+		case BC_ASSIGN_BIT_AND:
+		case BC_ASSIGN_BIT_OR:
+		case BC_ASSIGN_BIT_XOR:
+		case BC_ASSIGN_SHL:
+		case BC_ASSIGN_SHR:
+		{
+			int op = ip[-1];
+			int slot = *ip++;
+			int value = sp[-1];
+			if (0 == defs[slot])
+			{
+				printError("error : ");
+				printf("\"%s\" is not defined\n", cur->slot_names[slot]);
+				sp[-1] = 0;
+				break;
+			}
+			switch (op)
+			{
+			case BC_ASSIGN_ADD:
+				slots[slot] += value;
+				break;
+			case BC_ASSIGN_SUB:
+				slots[slot] -= value;
+				break;
+			case BC_ASSIGN_MUL:
+				slots[slot] *= value;
+				break;
+			case BC_ASSIGN_DIV:
+				slots[slot] /= value;
+				break;
+			case BC_ASSIGN_BIT_AND:
+				slots[slot] &= value;
+				break;
+			case BC_ASSIGN_BIT_OR:
+				slots[slot] |= value;
+				break;
+			case BC_ASSIGN_BIT_XOR:
+				slots[slot] ^= value;
+				break;
+			case BC_ASSIGN_SHL:
+				slots[slot] = SHIFT_LEFT(slots[slot], value);
+				break;
+			case BC_ASSIGN_SHR:
+				slots[slot] = SHIFT_RIGHT(slots[slot], value);
+				break;
+			default:
+				slots[slot] %= value;
+				break;
+			}
+			sp[-1] = slots[slot];
+			break;
+		}
+		case BC_ADD:
+			sp--;
+			sp[-1] += sp[0];
+			break;
+		case BC_SUB:
+			sp--;
+			sp[-1] -= sp[0];
+			break;
+		case BC_MUL:
+			sp--;
+			sp[-1] *= sp[0];
+			break;
+		case BC_DIV:
+			sp--;
+			sp[-1] /= sp[0];
+			break;
+		case BC_MOD:
+			sp--;
+			sp[-1] %= sp[0];
+			break;
+		case BC_BIT_AND:
+			sp--;
+			sp[-1] &= sp[0];
+			break;
+		case BC_BIT_OR:
+			sp--;
+			sp[-1] |= sp[0];
+			break;
+		case BC_BIT_XOR:
+			sp--;
+			sp[-1] ^= sp[0];
+			break;
+		case BC_SHL:
+			sp--;
+			sp[-1] = SHIFT_LEFT(sp[-1], sp[0]);
+			break;
+		case BC_SHR:
+			sp--;
+			sp[-1] = SHIFT_RIGHT(sp[-1], sp[0]);
+			break;
+		case BC_LT:
+			sp--;
+			sp[-1] = sp[-1] < sp[0];
+			break;
+		case BC_GT:
+			sp--;
+			sp[-1] = sp[-1] > sp[0];
+			break;
+		case BC_LE:
+			sp--;
+			sp[-1] = sp[-1] <= sp[0];
+			break;
+		case BC_GE:
+			sp--;
+			sp[-1] = sp[-1] >= sp[0];
+			break;
+		case BC_EQ:
+			sp--;
+			sp[-1] = sp[-1] == sp[0];
+			break;
+		case BC_NE:
+			sp--;
+			sp[-1] = sp[-1] != sp[0];
+			break;
+		case BC_NEG:
+			sp[-1] = -sp[-1];
+			break;
+		case BC_NOT:
+			sp[-1] = !sp[-1];
+			break;
+		case BC_BIT_NOT:
+			sp[-1] = ~sp[-1];
+			break;
+		case BC_POP:
+			sp--;
+			break;
+		case BC_PRINT:
+			printf("%d\n", sp[-1]);
+			sp[-1] = 0;
+			break;
+		case BC_EXIT:
+			ret = RESULT_EXIT;
+			goto finish;
+		case BC_INDEX:
+			sp--;
+			if (FALSE == loadElement(sp[-1], sp[0], &sp[-1]))
+			{
+				return RESULT_ERROR;
+			}
+			break;
+		case BC_STORE_INDEX:
+			sp -= 2;
+			if (FALSE == storeElement(sp[-1], sp[0], sp[1]))
+			{
+				return RESULT_ERROR;
+			}
+			sp[-1] = sp[1];
+			break;
+		case BC_ASSIGN_INDEX:
+		{
+			int op = *ip++;
+			int value;
+			sp -= 2;
+			if (FALSE == loadElement(sp[-1], sp[0], &value))
+			{
+				return RESULT_ERROR;
+			}
+			switch (op)
+			{
+			case BC_ADD:
+				value += sp[1];
+				break;
+			case BC_SUB:
+				value -= sp[1];
+				break;
+			case BC_MUL:
+				value *= sp[1];
+				break;
+			case BC_DIV:
+				value /= sp[1];
+				break;
+			case BC_BIT_AND:
+				value &= sp[1];
+				break;
+			case BC_BIT_OR:
+				value |= sp[1];
+				break;
+			case BC_BIT_XOR:
+				value ^= sp[1];
+				break;
+			case BC_SHL:
+				value = SHIFT_LEFT(value, sp[1]);
+				break;
+			case BC_SHR:
+				value = SHIFT_RIGHT(value, sp[1]);
+				break;
+			default:
+				value %= sp[1];
+				break;
+			}
+			storeElement(sp[-1], sp[0], value);
+			sp[-1] = value;
+			break;
+		}
+		case BC_BUILTIN:
+		{
+			Builtin *builtin = getBuiltin(*ip++);
+			int value;
+			sp -= builtin->argc;
+			if (FALSE == builtin->func(sp, &value))
+			{
+				return RESULT_ERROR;
+			}
+			*sp++ = value;
+			break;
+		}
+		case BC_CALL:
+		case BC_TAIL_CALL:
+		{
+			BOOL tail = BC_TAIL_CALL == ip[-1] && fp > 0;
+			VMBinding *binding = &vm.bindings[*ip++];
+			int argc = *ip++;
+			BcFunction *callee = binding->code;
+
+			if (NULL == callee || callee->argc != argc)
+			{
+				printError("error : ");
+				if (NULL == callee)
+				{
+					printf("function \"%s\" is not defined\n", m->names[ip[-2]]);
+				}
+				else
+				{
+					printf("function \"%s\" takes %d argument(s), but %d given\n", callee->name, callee->argc, argc);
+				}
+				sp -= argc;
+				*sp++ = 0;
+				break;
+			}
+
+			BOOL memo = isMemoizable(binding->func, autoMemo);
+			int value;
+			if (memo && lookupMemo(binding->func, sp - argc, &value))
+			{
+				sp -= argc;
+				*sp++ = value;
+				if (tail)
+				{
+					// 末尾呼び出しならそのまま呼び出し元に戻る
+					goto do_return;
+				}
+				break;
+			}
+
+			int base;
+			if (tail)
+			{
+				// 現在のフレームを再利用する（メモ化のキーは元の呼び出しのまま）
+				base = vm.frames[fp].base;
+				memmove(vm.values + base, sp - argc, argc * sizeof(int));
+			}
+			else
+			{
+				if (fp >= maxCallDepth)
+				{
+					printError("error : ");
+					printf("maximum call depth (%d) exceeded\n", maxCallDepth);
+					return RESULT_ERROR;
+				}
+
+				if (fp + 1 == vm.frame_capacity)
+				{
+					vm.frame_capacity *= 2;
+					vm.frames = (VMFrame *)realloc(vm.frames, vm.frame_capacity * sizeof(VMFrame));
+				}
+
+				base = (int)(sp - vm.values) - argc;
+				VMFrame *frame = &vm.frames[++fp];
+				frame->ret_ip = ip;
+				frame->base = base;
+				frame->memo = memo ? binding->func : NULL;
+				if (memo)
+				{
+					memcpy(frame->memo_args, sp - argc, argc * sizeof(int));
+				}
+			}
+
+			reserveValues(base + callee->nslots + callee->max_stack + 1);
+			vm.frames[fp].code = callee;
+			enterSlots(base, callee);
+			cur = callee;
+			slots = vm.values + base;
+			defs = vm.defined + base;
+			sp = slots + callee->nslots;
+			ip = callee->code;
+			break;
+		}
+		case BC_RETURN:
+		do_return:
+		{
+			int value = sp[-1];
+			if (0 == fp)
+			{
+				printError("error : ");
+				printf("\"return\" is outside of function\n");
+				sp--;
+				break;
+			}
+
+			VMFrame *frame = &vm.frames[fp--];
+			if (frame->memo)
+			{
+				storeMemo(frame->memo, frame->memo_args, value);
+			}
+
+			ip = frame->ret_ip;
+			sp = vm.values + frame->base;
+			*sp++ = value;
+
+			cur = vm.frames[fp].code;
+			slots = vm.values + vm.frames[fp].base;
+			defs = vm.defined + vm.frames[fp].base;
+			break;
+		}
+		case BC_JUMP:
+			ip += *ip + 1;
+			break;
+		case BC_JUMP_IF_FALSE:
+			if (*--sp)
+			{
+				ip++;
+			}
+			else
+			{
+				ip += *ip + 1;
+			}
+			break;
+		case BC_JUMP_IF_TRUE:
+			if (*--sp)
+			{
+				ip += *ip + 1;
+			}
+			else
+			{
+				ip++;
+			}
+			break;
+		case BC_AND:
+			if (sp[-1])
+			{
+				sp--;
+				ip++;
+			}
+			else
+			{
+				ip += *ip + 1;
+			}
+			break;
+		case BC_OR:
+			if (sp[-1])
+			{
+				sp[-1] = 1;
+				ip += *ip + 1;
+			}
+			else
+			{
+				sp--;
+				ip++;
+			}
+			break;
+		case BC_SWITCH:
+		{
+			unsigned int k = (unsigned int)*--sp - (unsigned int)ip[0];
+			ip += 2 + (k < (unsigned int)ip[1] ? 2 * (k + 1) : 0);
+			break;
+		}
+		case BC_DEFINE:
+			defineBcFunction(m, m->funcs[*ip++]);
+			break;
+		case BC_HALT:
+		default:
+			goto finish;
+		}
+	}
+
+finish:
+	*steps += count;
+	return ret;
+};
+
+/**
+ * @brief 保存済みのプログラムをバイトコードに変換して仮想マシンで実行する
+ * @param maxCallDepth 関数呼び出しの深さの上限
+ * @param autoMemo 純粋関数を自動でメモ化するかどうか
+ * @param steps 実行した命令数の格納先（加算する）
+ * @return 結果
+ */
+ENGINE_RESULT runVM(int maxCallDepth, BOOL autoMemo, unsigned long *steps)
+{
+	BcModule *m = compileModule();
+	if (NULL == m)
+	{
+		return RESULT_ERROR;
+	}
+
+	vm.values = (int *)calloc(VM_STACK_INIT_SIZE, sizeof(int));
+	vm.defined = (unsigned char *)calloc(VM_STACK_INIT_SIZE, 1);
+	vm.capacity = VM_STACK_INIT_SIZE;
+	vm.frames = (VMFrame *)calloc(VM_FRAME_INIT_SIZE, sizeof(VMFrame));
+	vm.frame_capacity = VM_FRAME_INIT_SIZE;
+	vm.bindings = (VMBinding *)calloc(m->nnames + 1, sizeof(VMBinding));
+
+	ENGINE_RESULT ret = execute(m, maxCallDepth, autoMemo, steps);
+
+	free(vm.values);
+	free(vm.defined);
+	free(vm.frames);
+	free(vm.bindings);
+	releaseModule(m);
+
+	return ret;
+};
@@ -0,0 +1,15 @@
+#ifndef _VM_H_
+#define _VM_H_
+
+#include "engine.h"
+#include "particle.h"
+
+/// 仮想マシンのスタックの初期容量
+#define VM_STACK_INIT_SIZE (1024)
+
+/// 仮想マシンの呼び出しフレームの初期容量
+#define VM_FRAME_INIT_SIZE (256)
+
+ENGINE_RESULT runVM(int, BOOL, unsigned long *);
+
+#endif